@@ -7,6 +7,8 @@
 
 //  constant number of bytes which the length of byte-strings gets encoded
 const uint64_t LEN_SIZE = 8;
+//  size of the buffer that file contents are streamed through
+const uint64_t BUF_SIZE = 4 * 1024 * 1024;
 
 //  struct for storing byte-strings and their length
 struct byte_string {
@@ -14,13 +16,51 @@ struct byte_string {
     char *data;
 };
 
+//  struct for an input file that is being encoded
+//  only the header (length of filename, filename, length of file-content) is kept in memory,
+//  the file-content is streamed from the still open input file
+struct encoded_file {
+    uint64_t len;
+    uint64_t header_len;
+    char *header;
+    FILE *file;
+    char *filepath;
+};
+
+//  upper bound for the length of encoded filenames, protects against corrupted input files
+const uint64_t MAX_NAME_LEN = 64 * 1024;
+
+//  steps of the extraction, every encoded file consists of these fields in this order
+enum extract_step {
+    STEP_NAME_LEN,
+    STEP_NAME,
+    STEP_CONTENT_LEN,
+    STEP_CONTENT
+};
+
+//  struct for the progress of the extraction, which can be interrupted after any byte
+struct extract_state {
+    enum extract_step step;
+    uint64_t pos;
+    char len_buf[8];
+    uint64_t name_len;
+    char *f_name;
+    uint64_t f_len;
+    FILE *out;
+    FILE *log;
+};
+
 //  function declarations
 struct byte_string *read_bytes(char *);
 uint64_t f_size(char *);
 uint64_t from_bytes(uint64_t, uint64_t, const char *);
 char *to_bytes(uint64_t, uint64_t);
 int process_input_file(char *);
-struct byte_string *encode_file(char *);
+int extract_files(struct extract_state *, const char *, uint64_t);
+void free_extract_state(struct extract_state *);
+struct encoded_file *encode_file(char *);
+void free_encoded_file(struct encoded_file *);
+uint64_t write_encoded(struct encoded_file *, uint64_t, uint64_t, FILE *, char *);
 uint64_t fwrite64(const void *, uint64_t, FILE *);
 void bytes_cpy(const char *, char *, uint64_t);
 
@@ -119,35 +159,46 @@ int main(int argc, char **argv) {
         uint64_t bytes_carry = 0;
         uint64_t bytes_offset = 0;
         uint32_t f_idx = 0;
-        struct byte_string *bytes = NULL;
+        struct encoded_file *bytes = NULL;
         FILE *f_output = NULL;
 
+        //  the file-contents are streamed through this buffer, so memory usage does not depend on the input size
+        char *buf = malloc(BUF_SIZE);
+        if (!buf) {
+            fprintf(stderr, "Could not allocate memory'.\n");
+            fflush(stderr);
+            free(f_name);
+            return 1;
+        }
+
         //  iterate through all input files
         //  one file can be written in multiple iterations depending on the maximum output file size
         //  iteration counter is adjusted accordingly
         for (uint32_t i = 4; i < argc; i++) {
-            //  when there is no carry, the current byte-string needs to be cleared and a new file needs to be read
+            //  when there is no carry, the current input file needs to be closed and a new file needs to be opened
             if (!bytes_carry) {
-                if (bytes) {
-                    free(bytes->data);
-                    free(bytes);
-                }
-                //  read and encode the new file
+                free_encoded_file(bytes);
+                //  encode the header of the new file
                 bytes = encode_file(argv[i]);
                 if (!bytes) {
                     fprintf(stderr, "Could not encode file '%s'.\n", argv[i]);
                     fflush(stderr);
                     free(f_name);
+                    free(buf);
+                    if (f_output) {
+                        fclose(f_output);
+                    }
                     return 1;
                 }
                 bytes_offset = 0;
             }
 
-            //  the current byte-string must not be NULL at this point
+            //  the current input file must not be NULL at this point
             if (!bytes) {
                 fprintf(stderr, "Error, memory is not allocated.");
                 fflush(stderr);
                 free(f_name);
+                free(buf);
                 return 1;
             }
 
@@ -159,7 +210,7 @@ int main(int argc, char **argv) {
                 bytes_carry = 0;
             }
 
-            //  when the current byte-string is shorter than the remaining filesize, only write as much as needed
+            //  when the current input file is shorter than the remaining filesize, only write as much as needed
             uint64_t write_n = bytes_left;
             if (bytes->len - bytes_offset < bytes_left) {
                 write_n = bytes->len - bytes_offset;
@@ -183,8 +234,8 @@ int main(int argc, char **argv) {
                     fprintf(stderr, "Could not open file '%s'.\n", f_name);
                     fflush(stderr);
                     free(f_name);
-                    free(bytes->data);
-                    free(bytes);
+                    free(buf);
+                    free_encoded_file(bytes);
                     return 1;
                 }
                 f_idx++;
@@ -194,23 +245,24 @@ int main(int argc, char **argv) {
             if (!f_output) {
                 fprintf(stderr, "Error, output file is not open.");
                 fflush(stderr);
-                free(bytes->data);
-                free(bytes);
+                free_encoded_file(bytes);
                 free(f_name);
+                free(buf);
                 return 1;
             }
 
             //  write the actual output data until everything is written, or until max file size is reached
             uint64_t written;
-            fprintf(stdout, "Writing %llu MiB to file '%s'.\n", write_n / (1024 * 1024), f_name);
+            fprintf(stdout, "Writing %llu MiB to file '%s'.\n", (unsigned long long) write_n / (1024 * 1024), f_name);
             fflush(stdout);
-            written = fwrite64(bytes->data + bytes_offset, write_n, f_output);
+            written = write_encoded(bytes, bytes_offset, write_n, f_output, buf);
             if (written < write_n) {
                 fprintf(stderr, "Could not write to file '%s'.\n", f_name);
                 fflush(stderr);
-                free(bytes->data);
-                free(bytes);
+                free_encoded_file(bytes);
                 free(f_name);
+                free(buf);
+                fclose(f_output);
                 return 1;
             }
 
@@ -224,14 +276,12 @@ int main(int argc, char **argv) {
         }
 
         //  free all remaining recourses
-        if (bytes) {
-            free(bytes->data);
-            free(bytes);
-        }
+        free_encoded_file(bytes);
         if (f_output) {
             fclose(f_output);
         }
         free(f_name);
+        free(buf);
 
         //  open main output file, containing the information about the other files
         //  this includes file count and total size written to them
@@ -300,7 +350,6 @@ struct byte_string *read_bytes(char *filepath) {
     //  open the specified file
     FILE *file = fopen(filepath, "rb");
     if (!file) {
-        free(bytes->data);
         free(bytes);
         return NULL;
     }
@@ -418,191 +467,250 @@ uint64_t fwrite64(const void *str, uint64_t len_bytes, FILE *file) {
 }
 
 //  encode the file containing filename and content
-struct byte_string *encode_file(char *filepath) {
-    //  read all bytes of the specified file
+//  only the header is encoded in memory, the file-content is streamed later on by write_encoded
+struct encoded_file *encode_file(char *filepath) {
     fprintf(stdout, "Encoding file '%s'...\n", filepath + extract_filename(filepath, strlen(filepath)));
     fflush(stdout);
-    struct byte_string *bytes_f = read_bytes(filepath);
-    if (!bytes_f) {
-        fprintf(stderr, "Could not read file '%s'.\n", filepath);
+
+    //  allocate the struct for storing the encoded file
+    struct encoded_file *enc = calloc(1, sizeof (struct encoded_file));
+    if (!enc) {
+        fprintf(stderr, "Memory allocation error.\n");
         fflush(stderr);
         return NULL;
     }
+    enc->filepath = filepath;
 
-    //  encode the length of the file-content
-    char *bytes_len_f = to_bytes(bytes_f->len, LEN_SIZE);
-    if (!bytes_len_f) {
-        fprintf(stderr, "Error processing data.\n");
+    //  open the specified file, it stays open until the file-content is completely written
+    enc->file = fopen(filepath, "rb");
+    if (!enc->file) {
+        fprintf(stderr, "Could not read file '%s'.\n", filepath);
         fflush(stderr);
-        free(bytes_f->data);
-        free(bytes_f);
+        free(enc);
         return NULL;
     }
+    uint64_t f_len = f_size(filepath);
 
-    //  calculate and encode the length of the filename
+    //  calculate the length of the filename
     uint64_t path_len = strlen(filepath);
     uint64_t filename_offset = extract_filename(filepath, path_len);
     uint64_t name_len = path_len - filename_offset;
-    char *bytes_len_name = to_bytes(name_len, LEN_SIZE);
-    if (!bytes_len_name) {
-        fprintf(stderr, "Error processing data.\n");
-        fflush(stderr);
-        free(bytes_f->data);
-        free(bytes_f);
-        free(bytes_len_f);
-        return NULL;
-    }
 
-    //  allocate byte-string for storing the result
-    struct byte_string *bytes = malloc(sizeof (struct byte_string));
-    if (!bytes) {
+    //  allocate memory for storing the header
+    enc->header_len = LEN_SIZE * 2 + name_len;
+    enc->header = malloc(enc->header_len);
+    if (!enc->header) {
         fprintf(stderr, "Memory allocation error.\n");
         fflush(stderr);
-        free(bytes_f->data);
-        free(bytes_f);
-        free(bytes_len_f);
+        free_encoded_file(enc);
         return NULL;
     }
+    enc->len = enc->header_len + f_len;
 
-    //  allocate memory for storing the data
-    uint64_t buf_size = LEN_SIZE * 2 + bytes_f->len + name_len;
-    char *buf = malloc(buf_size);
-    if (!buf) {
-        fprintf(stderr, "Memory allocation error.\n");
+    //  encode the length of the filename and the file-content
+    char *bytes_len_name = to_bytes(name_len, LEN_SIZE);
+    char *bytes_len_f = to_bytes(f_len, LEN_SIZE);
+    if (!bytes_len_name || !bytes_len_f) {
+        fprintf(stderr, "Error processing data.\n");
         fflush(stderr);
-        free(bytes);
-        free(bytes_f->data);
-        free(bytes_f);
-        free(bytes_len_f);
         free(bytes_len_name);
+        free(bytes_len_f);
+        free_encoded_file(enc);
         return NULL;
     }
-    bytes->data = buf;
-    bytes->len = buf_size;
 
-    fprintf(stdout, "Extracting %llu MiB of data from file '%s'.\n", bytes->len / (1024 * 1024), filepath);
+    fprintf(stdout, "Extracting %llu MiB of data from file '%s'.\n", (unsigned long long) enc->len / (1024 * 1024), filepath);
     fflush(stdout);
-    //  encode the filename and file-content and corresponding lengths
+    //  encode the filename and corresponding lengths
     uint64_t idx = 0;
     //  length of filename
-    bytes_cpy(bytes_len_name, buf + idx, LEN_SIZE);
+    bytes_cpy(bytes_len_name, enc->header + idx, LEN_SIZE);
     idx += LEN_SIZE;
     //  filename
-    bytes_cpy(filepath + filename_offset, buf + idx, name_len);
+    bytes_cpy(filepath + filename_offset, enc->header + idx, name_len);
     idx += name_len;
     //  length of file content
-    bytes_cpy(bytes_len_f, buf + idx, LEN_SIZE);
-    idx += LEN_SIZE;
-    //  file content
-    bytes_cpy(bytes_f->data, buf + idx, bytes_f->len);
+    bytes_cpy(bytes_len_f, enc->header + idx, LEN_SIZE);
 
     //  clean-up
-    free(bytes_f->data);
-    free(bytes_f);
     free(bytes_len_f);
     free(bytes_len_name);
-    return bytes;
+    return enc;
 }
 
-//  extract all files that are encoded in the given byte-string
-int extract_files(struct byte_string *bytes_f) {
-    //  setup log file
-    FILE *log = fopen("parser.log", "wb+");
-    if (!log) {
-        fprintf(stderr, "Could not open file 'parser.log'.\n");
-        fflush(stderr);
-        return 1;
+//  close the input file and free the header of an encoded file
+void free_encoded_file(struct encoded_file *enc) {
+    if (!enc) {
+        return;
     }
-    char *separator = malloc(1);
-    if (!separator) {
-        fprintf(stderr, "Memory allocation error.\n");
-        fflush(stderr);
-        return 1;
+    if (enc->file) {
+        fclose(enc->file);
     }
-    *separator = '\n';
+    free(enc->header);
+    free(enc);
+}
 
-    //  iterate through the byte-string and extract the encoded file data
-    uint64_t pos = 0;
-    while (pos < bytes_f->len) {
-        //  decode length of filename
-        uint64_t name_len = from_bytes(pos, LEN_SIZE, bytes_f->data);
-        //  allocate memory for storing the filename
-        char *f_name = malloc(name_len + 1);
-        if (!f_name) {
-            fprintf(stderr, "Memory allocation error.\n");
-            fflush(stderr);
-            free(bytes_f->data);
-            free(bytes_f);
-            fclose(log);
-            free(separator);
-            return 1;
+//  write len bytes of the encoded file, starting at the given offset, to the output file
+//  offsets need to be consecutive, since the file-content is read sequentially through the given buffer
+uint64_t write_encoded(struct encoded_file *enc, uint64_t offset, uint64_t len, FILE *out, char *buf) {
+    uint64_t written_complete = 0;
+
+    //  write the part of the header that has not been written yet
+    if (offset < enc->header_len) {
+        uint64_t to_write = enc->header_len - offset;
+        if (len < to_write) {
+            to_write = len;
         }
-        //  copy the filename into the buffer
-        *(f_name + name_len) = 0;
-        pos += LEN_SIZE;
-        bytes_cpy(bytes_f->data + pos, f_name, name_len);
-        pos += name_len;
-
-        //  create corresponding output file
-        fprintf(stdout, "Writing file '%s'\n", f_name + extract_filename(f_name, name_len));
-        fflush(stdout);
-        FILE *out = fopen(f_name, "wb+");
-        if (!out) {
-            fprintf(stderr, "Could not create file '%s'.\n", f_name);
-            fflush(stderr);
-            free(bytes_f->data);
-            free(bytes_f);
-            free(f_name);
-            fclose(log);
-            free(separator);
-            return 1;
+        uint64_t written = fwrite64(enc->header + offset, to_write, out);
+        written_complete += written;
+        if (written < to_write) {
+            return written_complete;
         }
+    }
 
-        //  decode length of the file-content
-        uint64_t f_len = from_bytes(pos, LEN_SIZE, bytes_f->data);
-        pos += LEN_SIZE;
-        //  write file content to output file
-        uint64_t written = fwrite64(bytes_f->data + pos, f_len, out);
-        if (written < f_len) {
-            fprintf(stderr, "Could not write file '%s'.\n", f_name);
+    //  stream the file-content through the buffer
+    while (written_complete < len) {
+        uint64_t to_read = len - written_complete;
+        if (to_read > BUF_SIZE) {
+            to_read = BUF_SIZE;
+        }
+        uint64_t bytes_read = fread(buf, 1, to_read, enc->file);
+        if (bytes_read < to_read) {
+            fprintf(stderr, "Could not read file '%s' (file changed while encoding?).\n", enc->filepath);
             fflush(stderr);
-            free(bytes_f->data);
-            free(bytes_f);
-            fclose(out);
-            free(f_name);
-            fclose(log);
-            free(separator);
-            return 1;
+            return written_complete;
         }
+        uint64_t written = fwrite64(buf, bytes_read, out);
+        written_complete += written;
+        if (written < bytes_read) {
+            return written_complete;
+        }
+    }
 
-        //  write parser log
-        uint64_t written_log = fwrite64(f_name, name_len, log);
-        uint64_t written_log_separator = fwrite64(separator, 1, log);
-        if (written_log < name_len || written_log_separator < 1) {
-            fprintf(stderr, "Could not write file 'parser.log'.\n");
-            fflush(stderr);
-            free(bytes_f->data);
-            free(bytes_f);
-            fclose(out);
-            free(f_name);
-            fclose(log);
-            free(separator);
-            return 1;
+    return written_complete;
+}
+
+//  consume the next part of the concatenated data-files and extract the encoded files from it
+//  the data can be split at arbitrary positions, the progress is kept in the given state
+int extract_files(struct extract_state *st, const char *data, uint64_t len) {
+    uint64_t pos = 0;
+    while (pos < len) {
+        switch (st->step) {
+            case STEP_NAME_LEN:
+            case STEP_CONTENT_LEN: {
+                //  collect the length field, which might be split between two data-files
+                uint64_t n = LEN_SIZE - st->pos;
+                if (len - pos < n) {
+                    n = len - pos;
+                }
+                bytes_cpy(data + pos, st->len_buf + st->pos, n);
+                st->pos += n;
+                pos += n;
+                if (st->pos < LEN_SIZE) {
+                    break;
+                }
+                st->pos = 0;
+
+                if (st->step == STEP_NAME_LEN) {
+                    //  decode length of filename and allocate memory for storing the filename
+                    st->name_len = from_bytes(0, LEN_SIZE, st->len_buf);
+                    if (st->name_len > MAX_NAME_LEN) {
+                        fprintf(stderr, "Error, invalid filename length. Input file might be corrupted.\n");
+                        fflush(stderr);
+                        return 1;
+                    }
+                    st->f_name = malloc(st->name_len + 1);
+                    if (!st->f_name) {
+                        fprintf(stderr, "Memory allocation error.\n");
+                        fflush(stderr);
+                        return 1;
+                    }
+                    *(st->f_name + st->name_len) = 0;
+                    st->step = STEP_NAME;
+                } else {
+                    //  decode length of the file-content
+                    st->f_len = from_bytes(0, LEN_SIZE, st->len_buf);
+                    st->step = STEP_CONTENT;
+                }
+                break;
+            }
+            case STEP_NAME: {
+                //  copy the filename into the buffer
+                uint64_t n = st->name_len - st->pos;
+                if (len - pos < n) {
+                    n = len - pos;
+                }
+                bytes_cpy(data + pos, st->f_name + st->pos, n);
+                st->pos += n;
+                pos += n;
+                if (st->pos < st->name_len) {
+                    break;
+                }
+                st->pos = 0;
+
+                //  create corresponding output file
+                fprintf(stdout, "Writing file '%s'\n", st->f_name + extract_filename(st->f_name, st->name_len));
+                fflush(stdout);
+                st->out = fopen(st->f_name, "wb+");
+                if (!st->out) {
+                    fprintf(stderr, "Could not create file '%s'.\n", st->f_name);
+                    fflush(stderr);
+                    return 1;
+                }
+                st->step = STEP_CONTENT_LEN;
+                break;
+            }
+            case STEP_CONTENT: {
+                //  write file content to output file
+                uint64_t n = st->f_len - st->pos;
+                if (len - pos < n) {
+                    n = len - pos;
+                }
+                uint64_t written = fwrite64(data + pos, n, st->out);
+                if (written < n) {
+                    fprintf(stderr, "Could not write file '%s'.\n", st->f_name);
+                    fflush(stderr);
+                    return 1;
+                }
+                st->pos += n;
+                pos += n;
+                break;
+            }
         }
 
-        pos += f_len;
-        free(f_name);
-        fclose(out);
-    }
+        //  the current file is complete once all of its content is written
+        if (st->step == STEP_CONTENT && st->pos == st->f_len) {
+            //  write parser log
+            uint64_t written_log = fwrite64(st->f_name, st->name_len, st->log);
+            uint64_t written_log_separator = fwrite64("\n", 1, st->log);
+            if (written_log < st->name_len || written_log_separator < 1) {
+                fprintf(stderr, "Could not write file 'parser.log'.\n");
+                fflush(stderr);
+                return 1;
+            }
 
-    //  clean-up
-    free(bytes_f->data);
-    free(bytes_f);
-    fclose(log);
-    free(separator);
+            fclose(st->out);
+            st->out = NULL;
+            free(st->f_name);
+            st->f_name = NULL;
+            st->pos = 0;
+            st->step = STEP_NAME_LEN;
+        }
+    }
     return 0;
 }
 
+//  close all files and free all memory of the extraction state
+void free_extract_state(struct extract_state *st) {
+    if (st->out) {
+        fclose(st->out);
+    }
+    if (st->log) {
+        fclose(st->log);
+    }
+    free(st->f_name);
+}
+
 //  process the given input file
 int process_input_file(char *filepath) {
     //  read data from the given file
@@ -612,6 +720,13 @@ int process_input_file(char *filepath) {
         fflush(stderr);
         return 1;
     }
+    if (bytes_f->len < LEN_SIZE * 2) {
+        fprintf(stderr, "Error, file '%s' is too short. Input file might be corrupted.\n", filepath);
+        fflush(stderr);
+        free(bytes_f->data);
+        free(bytes_f);
+        return 1;
+    }
 
     //  read the information about the data that needs to be reads from the files
     uint64_t f_count = from_bytes(0, LEN_SIZE, bytes_f->data);
@@ -641,61 +756,76 @@ int process_input_file(char *filepath) {
         }
     }
 
-    //  allocate enough memory to read in all data-files
-    struct byte_string *bytes_complete = malloc(sizeof (struct byte_string));
-    if (!bytes_complete) {
+    //  the data-files are streamed through this buffer, so memory usage does not depend on the archive size
+    char *buf = malloc(BUF_SIZE);
+    if (!buf) {
         fprintf(stderr, "Could not allocate memory.\n");
         fflush(stderr);
         free(f_names);
         return 1;
     }
-    //  the actual bytes are stored here
-    char *data = malloc(size_total);
-    if (!data) {
-        fprintf(stderr, "Could not allocate memory.\n");
+
+    //  setup log file and extraction state
+    struct extract_state st = {0};
+    st.log = fopen("parser.log", "wb+");
+    if (!st.log) {
+        fprintf(stderr, "Could not open file 'parser.log'.\n");
         fflush(stderr);
         free(f_names);
-        free(bytes_complete);
+        free(buf);
         return 1;
     }
-    bytes_complete->data = data;
-    bytes_complete->len = size_total;
 
-    //  read all data from all data files
-    uint64_t cpy_offset = 0;
+    //  read all data from all data files and extract the files on the fly
+    uint64_t read_total = 0;
     for (uint32_t i = 0; i < f_count; i++) {
         fprintf(stdout, "Reading file '%s'\n", f_names + (i * f_name_len + extract_filename( f_names + (i * f_name_len), f_name_len)));
         fflush(stdout);
-        struct byte_string *bytes = read_bytes(f_names + (i * f_name_len));
-        if (!bytes) {
+        FILE *file = fopen(f_names + (i * f_name_len), "rb");
+        if (!file) {
             fprintf(stderr, "Error, could not read file '%s'.\n", f_names + (i * f_name_len));
             fflush(stderr);
             free(f_names);
-            free(bytes_complete);
-            free(data);
+            free(buf);
+            free_extract_state(&st);
             return 1;
         }
 
-        //  prevent buffer-overflow on corrupt input file
-        if (cpy_offset + bytes->len > size_total) {
-            fprintf(stderr, "Error, aborting to prevent buffer-overflow. Input file might be corrupted.\n");
-            fflush(stderr);
-            free(f_names);
-            free(bytes->data);
-            free(bytes);
-            free(bytes_complete);
-            free(data);
-            return 1;
-        }
-        //  the data of all data-files will be stored as one large byte-string
-        bytes_cpy(bytes->data, bytes_complete->data + cpy_offset, bytes->len);
-        cpy_offset += bytes->len;
+        uint64_t bytes_read;
+        while ((bytes_read = fread(buf, 1, BUF_SIZE, file))) {
+            //  abort on data-files that contain more data than specified in the main file
+            if (read_total + bytes_read > size_total) {
+                fprintf(stderr, "Error, data-files exceed the expected size. Input file might be corrupted.\n");
+                fflush(stderr);
+                fclose(file);
+                free(f_names);
+                free(buf);
+                free_extract_state(&st);
+                return 1;
+            }
+            read_total += bytes_read;
 
-        free(bytes->data);
-        free(bytes);
+            if (extract_files(&st, buf, bytes_read)) {
+                fclose(file);
+                free(f_names);
+                free(buf);
+                free_extract_state(&st);
+                return 1;
+            }
+        }
+        fclose(file);
     }
     free(f_names);
+    free(buf);
 
-    //  extract the files from the given bytes
-    return extract_files(bytes_complete);
+    //  all data must be consumed and the last file must be complete
+    if (read_total != size_total || st.step != STEP_NAME_LEN || st.pos) {
+        fprintf(stderr, "Error, data-files are incomplete. Input file might be corrupted.\n");
+        fflush(stderr);
+        free_extract_state(&st);
+        return 1;
+    }
+
+    free_extract_state(&st);
+    return 0;
 }
@@ -0,0 +1,125 @@
+#!/bin/bash
+#   benchmark of encode and decode on the generated corpus, compared with tar/split/cat
+#   usage: bench.sh <parser> <work directory> [scale in percent] [corpus tool] [runstat tool]
+#   environment:
+#   | BENCH_OPTS: options passed to the parser (e.g. '--threads 4 --io mmap')
+#   | BENCH_SIZES: partition sizes (default: '1K 1M 128M 0')
+#   | BENCH_SETS: sets of the corpus (default: all)
+#   | BENCH_RUNS: runs per measurement, the fastest one is reported (default: 3)
+#   | BENCH_MAX_PARTS: combinations that would create more data-files are skipped (default: 20000)
+#   the results are printed as a table and written to <work directory>/results.tsv
+#   all runs read from a warm page cache, the numbers are meant for comparing builds on the same machine
+
+set -u
+PARSER=$1
+WORK=$2
+SCALE=${3:-100}
+BIN=$(cd "$(dirname "$0")" && pwd)
+CORPUS_TOOL=${4:-$BIN/corpus}
+RUNSTAT=${5:-$BIN/runstat}
+SIZES=${BENCH_SIZES:-1K 1M 128M 0}
+SETS=${BENCH_SETS:-tiny_random tiny_text mixed_random mixed_text huge_random huge_text}
+RUNS=${BENCH_RUNS:-3}
+MAX_PARTS=${BENCH_MAX_PARTS:-20000}
+OPTS=${BENCH_OPTS:-}
+
+case "$PARSER" in
+    /*) ;;
+    *) PARSER=$(pwd)/$PARSER ;;
+esac
+mkdir -p "$WORK" || exit 1
+WORK=$(cd "$WORK" && pwd)
+
+#   the corpus is only generated again, if the scale changed
+if [ "$(cat "$WORK/corpus.scale" 2>/dev/null)" != "$SCALE" ]; then
+    echo "Generating corpus (scale $SCALE%) in '$WORK/corpus'..."
+    rm -rf "$WORK/corpus" "$WORK/corpus.scale"
+    "$CORPUS_TOOL" "$WORK/corpus" "$SCALE" || exit 1
+    echo "$SCALE" > "$WORK/corpus.scale"
+fi
+
+if stat -c %s / > /dev/null 2>&1; then
+    STAT_SIZE="stat -c %s"
+else
+    STAT_SIZE="stat -f %z"
+fi
+size_of() {
+    find "$1" -type f -exec $STAT_SIZE {} + | awk '{s += $1} END {print s + 0}'
+}
+bytes_of() {
+    case "$1" in
+        *K) echo $(( ${1%K} * 1024 )) ;;
+        *M) echo $(( ${1%M} * 1024 * 1024 )) ;;
+        *G) echo $(( ${1%G} * 1024 * 1024 * 1024 )) ;;
+        *) echo "$1" ;;
+    esac
+}
+
+#   run a command BENCH_RUNS times in the given directory (emptied before every run) and print the fastest run
+#   output: seconds, peak RSS in KiB, read/write syscalls, exit status
+measure() {
+    local dir=$1
+    shift
+    rm -f "$WORK/run.txt"
+    for _ in $(seq 1 "$RUNS"); do
+        rm -rf "$dir"
+        mkdir -p "$dir"
+        (cd "$dir" && "$RUNSTAT" "$WORK/run.txt" "$@" > /dev/null 2>&1)
+    done
+    sort -n "$WORK/run.txt" | awk '$4 != 0 {failed = $0} NR == 1 {best = $0} END {print failed != "" ? failed : best}'
+}
+
+RESULTS=$WORK/results.tsv
+printf "set\tsize\ttool\top\tseconds\tMB/s\tfiles/s\trss_KiB\tsyscalls\tstatus\n" > "$RESULTS"
+printf "%-13s %5s %-7s %-6s %9s %9s %10s %9s %10s\n" set size tool op seconds MB/s files/s rss_KiB syscalls
+report() {
+    local set=$1 size=$2 tool=$3 op=$4 bytes=$5 files=$6
+    read -r secs rss calls status
+    awk -v set="$set" -v size="$size" -v tool="$tool" -v op="$op" -v bytes="$bytes" -v files="$files" \
+        -v secs="$secs" -v rss="$rss" -v calls="$calls" -v status="$status" -v out="$RESULTS" 'BEGIN {
+        if (secs <= 0) secs = 0.000001
+        mbs = bytes / 1048576 / secs
+        fps = files / secs
+        if (calls < 0) calls = "n/a"
+        printf "%-13s %5s %-7s %-6s %9.3f %9.1f %10.0f %9d %10s%s\n", set, size, tool, op, secs, mbs, fps, rss, calls,
+               status != 0 ? "  FAILED (" status ")" : ""
+        printf "%s\t%s\t%s\t%s\t%.6f\t%.1f\t%.0f\t%d\t%s\t%d\n", set, size, tool, op, secs, mbs, fps, rss, calls, status >> out
+    }'
+}
+
+for set in $SETS; do
+    src=$WORK/corpus/$set
+    if [ ! -d "$src" ]; then
+        echo "Unknown set '$set'."
+        exit 1
+    fi
+    bytes=$(size_of "$src")
+    files=$(find "$src" -type f | wc -l | tr -d ' ')
+    for size in $SIZES; do
+        part=$(bytes_of "$size")
+        if [ "$part" != 0 ] && [ $(( bytes / part )) -gt "$MAX_PARTS" ]; then
+            printf "%-13s %5s skipped (more than %s data-files)\n" "$set" "$size" "$MAX_PARTS"
+            continue
+        fi
+        arc=$WORK/archive
+        out=$WORK/output
+
+        # shellcheck disable=SC2086
+        measure "$arc" "$PARSER" encode $OPTS "$size" out "$src" | report "$set" "$size" parser encode "$bytes" "$files"
+        # shellcheck disable=SC2086
+        measure "$out" "$PARSER" decode $OPTS "$arc/out" | report "$set" "$size" parser decode "$bytes" "$files"
+
+        #   baselines: tar piped into split (or a single tar file for unlimited sizes), cat piped into tar
+        if [ "$part" = 0 ]; then
+            measure "$arc" sh -c "tar -cf out.tar -C '$(dirname "$src")' '$set'" \
+                | report "$set" "$size" tar encode "$bytes" "$files"
+            measure "$out" tar -xf "$arc/out.tar" | report "$set" "$size" tar decode "$bytes" "$files"
+        else
+            measure "$arc" sh -c "tar -cf - -C '$(dirname "$src")' '$set' | split -b $part -a 6 - out_" \
+                | report "$set" "$size" split encode "$bytes" "$files"
+            measure "$out" sh -c "cat '$arc'/out_* | tar -xf -" | report "$set" "$size" cat decode "$bytes" "$files"
+        fi
+    done
+done
+rm -rf "$WORK/archive" "$WORK/output" "$WORK/run.txt"
+echo "Results written to '$RESULTS'."
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+//  generates the benchmark corpus, the content only depends on the seed, so every run measures the same data
+//  the corpus consists of four sets, which stress different parts of the parser:
+//  tiny (many files of up to 4 KiB in nested directories), mixed (sizes from 4 KiB to 8 MiB),
+//  huge (a few files of 256 MiB) and each of them with random and compressible (log-like text) content
+//  the scale (in percent) multiplies the number of files of tiny and mixed and the size of the huge files
+
+//  size of the buffer in which the file-contents are generated
+const uint64_t GEN_BUF = 1024 * 1024;
+
+//  state of the pseudo random number generator (xorshift64*)
+uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+//  fill the buffer with random bytes or with lines of a log, which compresses like typical text data
+void fill(char *buf, uint64_t len, int text) {
+    static const char *levels[] = {"info", "info", "info", "debug", "warn", "error"};
+    static const char *paths[] = {"items", "users", "orders", "search", "health", "metrics", "static/app.js"};
+    uint64_t pos = 0;
+    if (!text) {
+        while (pos + 8 <= len) {
+            uint64_t r = next_random();
+            memcpy(buf + pos, &r, 8);
+            pos += 8;
+        }
+        while (pos < len) {
+            buf[pos++] = (char) next_random();
+        }
+        return;
+    }
+    char line[160];
+    while (pos < len) {
+        uint64_t r = next_random();
+        int n = snprintf(line, sizeof (line), "2026-01-%02u %02u:%02u:%02u level=%s req=%08x path=/api/v1/%s/%u took=%ums\n",
+                         (unsigned) (r % 28 + 1), (unsigned) (r >> 8) % 24, (unsigned) (r >> 16) % 60, (unsigned) (r >> 24) % 60,
+                         levels[(r >> 32) % 6], (unsigned) (r >> 20), paths[(r >> 40) % 7], (unsigned) (r >> 44) % 1000,
+                         (unsigned) (r >> 54) % 500);
+        uint64_t to_copy = len - pos < (uint64_t) n ? len - pos : (uint64_t) n;
+        memcpy(buf + pos, line, to_copy);
+        pos += to_copy;
+    }
+}
+
+int make_dir(const char *path) {
+    if (mkdir(path, 0755) && errno != EEXIST) {
+        fprintf(stderr, "Could not create directory '%s'.\n", path);
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+int write_file(const char *path, uint64_t len, int text, char *buf) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not create file '%s'.\n", path);
+        fflush(stderr);
+        return 1;
+    }
+    while (len) {
+        uint64_t n = len < GEN_BUF ? len : GEN_BUF;
+        fill(buf, n, text);
+        if (fwrite(buf, 1, n, file) < n) {
+            fprintf(stderr, "Could not write file '%s'.\n", path);
+            fflush(stderr);
+            fclose(file);
+            return 1;
+        }
+        len -= n;
+    }
+    return fclose(file) != 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Syntax: %s <directory> [scale in percent (default: 100)]\n", argv[0]);
+        fflush(stderr);
+        return 1;
+    }
+    uint64_t scale = argc == 3 ? strtoull(argv[2], NULL, 10) : 100;
+    if (!scale) {
+        fprintf(stderr, "Invalid scale '%s'.\n", argv[2]);
+        fflush(stderr);
+        return 1;
+    }
+    char *buf = malloc(GEN_BUF);
+    uint64_t path_len = strlen(argv[1]) + 64;
+    char *path = malloc(path_len);
+    if (!buf || !path || make_dir(argv[1])) {
+        free(buf);
+        free(path);
+        return 1;
+    }
+
+    int err = 0;
+    for (int text = 0; text < 2 && !err; text++) {
+        const char *kind = text ? "text" : "random";
+
+        //  tiny files, 100 per directory
+        uint64_t n_tiny = 5000 * scale / 100;
+        snprintf(path, path_len, "%s/tiny_%s", argv[1], kind);
+        err = make_dir(path);
+        for (uint64_t i = 0; i < n_tiny && !err; i++) {
+            if (i % 100 == 0) {
+                snprintf(path, path_len, "%s/tiny_%s/d%03llu", argv[1], kind, (unsigned long long) i / 100);
+                err = make_dir(path);
+            }
+            snprintf(path, path_len, "%s/tiny_%s/d%03llu/f%05llu", argv[1], kind, (unsigned long long) i / 100,
+                     (unsigned long long) i);
+            err = err || write_file(path, next_random() % 4097, text, buf);
+        }
+
+        //  mixed sizes, distributed evenly on a logarithmic scale from 4 KiB to 8 MiB
+        uint64_t n_mixed = 200 * scale / 100;
+        snprintf(path, path_len, "%s/mixed_%s", argv[1], kind);
+        err = err || make_dir(path);
+        for (uint64_t i = 0; i < n_mixed && !err; i++) {
+            uint64_t len = (uint64_t) 4096 << (next_random() % 12);
+            len += next_random() % len;
+            snprintf(path, path_len, "%s/mixed_%s/f%04llu", argv[1], kind, (unsigned long long) i);
+            err = write_file(path, len, text, buf);
+        }
+
+        //  a few huge files
+        snprintf(path, path_len, "%s/huge_%s", argv[1], kind);
+        err = err || make_dir(path);
+        for (uint64_t i = 0; i < 2 && !err; i++) {
+            snprintf(path, path_len, "%s/huge_%s/f%llu", argv[1], kind, (unsigned long long) i);
+            err = write_file(path, (uint64_t) 256 * 1024 * 1024 * scale / 100, text, buf);
+        }
+    }
+    free(buf);
+    free(path);
+    return err;
+}
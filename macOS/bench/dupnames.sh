@@ -0,0 +1,64 @@
+#!/bin/bash
+#   test of archives that contain several files with the same name (e.g. 'd1/x' and 'd2/x' are both stored as 'x')
+#   usage: dupnames.sh <parser> [work directory]
+#   every decoder (sequential, with threads, with a central directory, with '--only', with '--hash') has to
+#   extract the last of these files, like the sequential decoder that overwrites the file, and must not mix them
+#   exits with 1 if a check fails
+
+set -u
+PARSER=$1
+WORK=${2:-$(mktemp -d)}
+
+case "$PARSER" in
+    /*) ;;
+    *) PARSER=$(pwd)/$PARSER ;;
+esac
+mkdir -p "$WORK" || exit 1
+WORK=$(cd "$WORK" && pwd)
+FAILED=0
+
+#   run a decode in an empty directory and compare the extracted 'x' with the expected file
+#   usage: check <name> <archive directory> <expected file> <decode options...>
+check() {
+    local name=$1 archive=$2 expected=$3
+    shift 3
+    rm -rf "$WORK/out" && mkdir -p "$WORK/out" && cp "$archive"/out* "$WORK/out/" || exit 1
+    if ! (cd "$WORK/out" && "$PARSER" decode "$@" out > /dev/null); then
+        echo "FAIL $name: decode failed"
+        FAILED=1
+    elif ! cmp -s "$WORK/out/x" "$expected"; then
+        echo "FAIL $name: 'x' is not the last file named 'x' ($(wc -c < "$WORK/out/x") bytes)"
+        FAILED=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+#   the files differ in size in both directions, so a file that is not truncated or written twice is noticed
+mkdir -p "$WORK/in/d1" "$WORK/in/d2" "$WORK/in/d3" || exit 1
+head -c 3000000 /dev/urandom > "$WORK/in/d1/x"
+head -c 5000000 /dev/urandom > "$WORK/in/d2/x"
+head -c 1000000 /dev/urandom > "$WORK/in/d3/x"
+echo "other" > "$WORK/in/y"
+
+for opts in "" "--directory" "--hash" "--compress fast" "--dedup"; do
+    for order in "d1 d2" "d2 d3"; do
+        set -- $order
+        last=$2
+        archive="$WORK/archive"
+        rm -rf "$archive" && mkdir -p "$archive" || exit 1
+        if ! (cd "$archive" && "$PARSER" encode $opts 1M out "$WORK/in/$1/x" "$WORK/in/y" "$WORK/in/$2/x" > /dev/null); then
+            echo "FAIL encode $opts $order"
+            FAILED=1
+            continue
+        fi
+        for dec in "" "--threads 4" "--only x" "--threads 4 --only x"; do
+            check "encode ${opts:-(default)} $order, decode ${dec:-(default)}" "$archive" "$WORK/in/$last/x" $dec
+        done
+    done
+done
+
+if [ $FAILED -ne 0 ]; then
+    exit 1
+fi
+echo "ALL OK"
@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libfpp.h"
+
+//  test of the callbacks of the library, linked against libfpp.a
+//  usage: libcheck encode <main file> <max. filesize> <flags> <files...>
+//         encodes the files into memory buffers through a struct fpp_sink, alternately with fpp_encoder_add_buffer()
+//         and fpp_encoder_add_file(), and compares the buffers with the archive that 'parser encode' wrote to
+//         <main file> and its data-files from the same files
+//  usage: libcheck decode <main file> <number of files>
+//         decodes the archive through a struct fpp_source and compares every file with the one of the same name in
+//         the current directory
+//  exits with 1 if a check fails
+
+//  the decoded content is read in pieces of this size, which does not match any block or chunk of the archive
+const size_t READ_BUF = 100000;
+
+//  a file of the archive, kept in memory
+struct buffer {
+    char *data;
+    uint64_t len;
+    uint64_t capacity;
+};
+
+//  the archive written by the encoder, the data-files and the main file, and how far they were closed
+//  the encoder has to write the data-files one after another and close each of them once it is complete,
+//  the main file is written and closed last
+struct memory_sink {
+    struct buffer *parts;
+    uint32_t n_parts;
+    uint32_t capacity;
+    uint32_t n_closed;
+    struct buffer main;
+    int main_closed;
+    const char *error;
+};
+
+//  a data-file or the main file of an archive on disk, the file of the last read is kept open
+struct disk_source {
+    const char *main_name;
+    uint32_t part;
+    FILE *file;
+};
+
+int fail(const char *msg, const char *detail) {
+    fprintf(stderr, "libcheck: %s%s%s\n", msg, detail ? ": " : "", detail ? detail : "");
+    fflush(stderr);
+    return 1;
+}
+
+//  the name of the data-file with the given index (or the main file), the caller frees it
+char *part_name(const char *main_name, uint32_t part) {
+    size_t len = strlen(main_name) + 32;
+    char *name = malloc(len);
+    if (!name) {
+        return NULL;
+    }
+    if (part == FPP_MAIN_FILE) {
+        snprintf(name, len, "%s", main_name);
+    } else {
+        snprintf(name, len, "%s_data%u", main_name, part);
+    }
+    return name;
+}
+
+//  read a whole file into memory, returns NULL if it does not exist or can not be read
+char *read_file(const char *path, uint64_t *len) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    uint64_t capacity = 1024 * 1024;
+    char *data = malloc(capacity);
+    *len = 0;
+    while (data) {
+        *len += fread(data + *len, 1, capacity - *len, file);
+        if (*len < capacity) {
+            break;
+        }
+        capacity *= 2;
+        char *new_data = realloc(data, capacity);
+        if (!new_data) {
+            free(data);
+        }
+        data = new_data;
+    }
+    if (data && ferror(file)) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+int buffer_append(struct buffer *buf, const void *data, size_t len) {
+    if (buf->len + len > buf->capacity) {
+        uint64_t capacity = buf->capacity ? buf->capacity : 64 * 1024;
+        while (buf->len + len > capacity) {
+            capacity *= 2;
+        }
+        char *new_data = realloc(buf->data, capacity);
+        if (!new_data) {
+            return 1;
+        }
+        buf->data = new_data;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return 0;
+}
+
+int sink_write(void *ctx, uint32_t part, const void *data, size_t len) {
+    struct memory_sink *sink = ctx;
+    if (part == FPP_MAIN_FILE) {
+        if (sink->n_closed != sink->n_parts) {
+            sink->error = "the main file was written before the last data-file was closed";
+            return 1;
+        }
+        return buffer_append(&sink->main, data, len);
+    }
+    if (sink->main.len || part < sink->n_closed || part > sink->n_parts) {
+        sink->error = "the data-files were not written one after another";
+        return 1;
+    }
+    if (part == sink->n_parts) {
+        if (sink->n_closed != sink->n_parts) {
+            sink->error = "a data-file was started before the previous one was closed";
+            return 1;
+        }
+        if (sink->n_parts == sink->capacity) {
+            uint32_t capacity = sink->capacity ? sink->capacity * 2 : 16;
+            struct buffer *parts = realloc(sink->parts, capacity * sizeof (struct buffer));
+            if (!parts) {
+                return 1;
+            }
+            sink->parts = parts;
+            sink->capacity = capacity;
+        }
+        memset(sink->parts + sink->n_parts, 0, sizeof (struct buffer));
+        sink->n_parts++;
+    }
+    return buffer_append(sink->parts + part, data, len);
+}
+
+int sink_close(void *ctx, uint32_t part) {
+    struct memory_sink *sink = ctx;
+    if (part == FPP_MAIN_FILE) {
+        if (sink->main_closed) {
+            sink->error = "the main file was closed twice";
+            return 1;
+        }
+        sink->main_closed = 1;
+        return 0;
+    }
+    if (part != sink->n_closed || part + 1 != sink->n_parts) {
+        sink->error = "a data-file was closed out of order";
+        return 1;
+    }
+    sink->n_closed++;
+    return 0;
+}
+
+int64_t source_read(void *ctx, uint32_t part, uint64_t off, void *buf, size_t len) {
+    struct disk_source *source = ctx;
+    if (!source->file || source->part != part) {
+        if (source->file) {
+            fclose(source->file);
+        }
+        char *name = part_name(source->main_name, part);
+        source->file = name ? fopen(name, "rb") : NULL;
+        source->part = part;
+        free(name);
+        if (!source->file) {
+            return -1;
+        }
+    }
+    if (fseeko(source->file, off, SEEK_SET)) {
+        return -1;
+    }
+    size_t n = fread(buf, 1, len, source->file);
+    return ferror(source->file) ? -1 : (int64_t) n;
+}
+
+int64_t file_read(void *ctx, void *buf, size_t len) {
+    FILE *file = ctx;
+    size_t n = fread(buf, 1, len, file);
+    return ferror(file) ? -1 : (int64_t) n;
+}
+
+//  add the file to the encoder, every second one through the read callback
+int add_file(struct fpp_encoder *enc, const char *path, int by_callback) {
+    if (by_callback) {
+        FILE *file = fopen(path, "rb");
+        if (!file) {
+            return fail("could not open file", path);
+        }
+        fseeko(file, 0, SEEK_END);
+        uint64_t len = ftello(file);
+        fseeko(file, 0, SEEK_SET);
+        int err = fpp_encoder_add_file(enc, path, len, file_read, file);
+        fclose(file);
+        return err ? fail("could not add file", fpp_encoder_error(enc)) : 0;
+    }
+    uint64_t len = 0;
+    char *data = read_file(path, &len);
+    if (!data) {
+        return fail("could not read file", path);
+    }
+    int err = fpp_encoder_add_buffer(enc, path, data, len);
+    free(data);
+    return err ? fail("could not add file", fpp_encoder_error(enc)) : 0;
+}
+
+//  compare a file written by the encoder with the one of the archive on disk
+int compare_part(const char *main_name, uint32_t part, const struct buffer *buf) {
+    char *name = part_name(main_name, part);
+    if (!name) {
+        return fail("memory allocation error", NULL);
+    }
+    uint64_t len = 0;
+    char *data = read_file(name, &len);
+    int err = 0;
+    if (!data) {
+        err = fail("missing in the archive of parser", name);
+    } else if (len != buf->len || memcmp(data, buf->data, len)) {
+        err = fail("differs from the archive of parser", name);
+    }
+    free(data);
+    free(name);
+    return err;
+}
+
+int check_encode(const char *main_name, uint64_t max_fsize, int flags, char **files, int n_files) {
+    struct memory_sink sink = {0};
+    struct fpp_sink callbacks = {&sink, sink_write, sink_close};
+    struct fpp_encoder *enc = fpp_encoder_new(max_fsize, flags, &callbacks);
+    if (!enc) {
+        return fail("could not create the encoder", NULL);
+    }
+    int err = 0;
+    for (int i = 0; i < n_files && !err; i++) {
+        err = add_file(enc, files[i], i % 2);
+    }
+    if (!err && fpp_encoder_finish(enc)) {
+        err = fail("could not finish the encode", sink.error ? sink.error : fpp_encoder_error(enc));
+    }
+    fpp_encoder_free(enc);
+
+    if (!err && (sink.n_closed != sink.n_parts || !sink.main_closed)) {
+        err = fail("not every file of the archive was closed", NULL);
+    }
+    for (uint32_t i = 0; i < sink.n_parts && !err; i++) {
+        err = compare_part(main_name, i, sink.parts + i);
+    }
+    //  the archive of parser must not have more data-files
+    char *name = part_name(main_name, sink.n_parts);
+    FILE *extra = name ? fopen(name, "rb") : NULL;
+    if (!err && extra) {
+        err = fail("the archive of parser has more data-files", name);
+    }
+    if (extra) {
+        fclose(extra);
+    }
+    free(name);
+    if (!err) {
+        err = compare_part(main_name, FPP_MAIN_FILE, &sink.main);
+    }
+
+    for (uint32_t i = 0; i < sink.n_parts; i++) {
+        free(sink.parts[i].data);
+    }
+    free(sink.parts);
+    free(sink.main.data);
+    return err;
+}
+
+//  compare the content of the current entry with the file of the same name, piece by piece
+//  the entry is read to its end in any case, so an error of the decoder (e.g. a checksum) is reported first
+int compare_entry(struct fpp_decoder *dec, const struct fpp_entry *entry, char *buf, char *expected) {
+    FILE *file = fopen(entry->name, "rb");
+    if (!file) {
+        return fail("no such file", entry->name);
+    }
+    uint64_t total = 0;
+    int64_t n;
+    int differs = 0;
+    while ((n = fpp_decoder_read(dec, buf, READ_BUF)) > 0) {
+        if (!differs && (fread(expected, 1, n, file) != (size_t) n || memcmp(buf, expected, n))) {
+            differs = 1;
+        }
+        total += n;
+    }
+    int err = 0;
+    if (n < 0) {
+        err = fail("could not read an entry", fpp_decoder_error(dec));
+    } else if (differs || fread(expected, 1, 1, file) || (entry->size != FPP_UNKNOWN_SIZE && entry->size != total)) {
+        err = fail("decoded content differs", entry->name);
+    }
+    fclose(file);
+    return err;
+}
+
+int check_decode(const char *main_name, uint64_t n_files) {
+    struct disk_source source = {main_name, 0, NULL};
+    struct fpp_source callbacks = {&source, source_read};
+    struct fpp_decoder *dec = fpp_decoder_new(&callbacks);
+    char *buf = malloc(READ_BUF);
+    char *expected = malloc(READ_BUF);
+    if (!dec || !buf || !expected) {
+        fpp_decoder_free(dec);
+        free(buf);
+        free(expected);
+        return fail("memory allocation error", NULL);
+    }
+    struct fpp_entry entry;
+    uint64_t n_entries = 0;
+    int err = 0;
+    int res = 0;
+    while (!err && (res = fpp_decoder_next_entry(dec, &entry)) == 1) {
+        err = compare_entry(dec, &entry, buf, expected);
+        n_entries++;
+    }
+    if (!err && res < 0) {
+        err = fail("could not decode the archive", fpp_decoder_error(dec));
+    }
+    if (!err && n_entries != n_files) {
+        err = fail("wrong number of files", NULL);
+    }
+    if (source.file) {
+        fclose(source.file);
+    }
+    fpp_decoder_free(dec);
+    free(buf);
+    free(expected);
+    return err;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 6 && !strcmp(argv[1], "encode")) {
+        return check_encode(argv[2], strtoull(argv[3], NULL, 10), atoi(argv[4]), argv + 5, argc - 5);
+    }
+    if (argc == 4 && !strcmp(argv[1], "decode")) {
+        return check_decode(argv[2], strtoull(argv[3], NULL, 10));
+    }
+    fprintf(stderr, "usage: libcheck encode <main file> <max. filesize> <flags> <files...>\n"
+                    "       libcheck decode <main file> <number of files>\n");
+    fflush(stderr);
+    return 1;
+}
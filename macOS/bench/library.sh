@@ -0,0 +1,114 @@
+#!/bin/bash
+#   test of the callbacks of the library (fpp_encoder_* and fpp_decoder_*) with bench/libcheck
+#   usage: library.sh <parser> <libcheck> [work directory]
+#   the encoder has to write the same archive from memory buffers as 'parser encode' writes from the files, and the
+#   decoder has to read every archive of 'parser encode' (raw, compressed, deduplicated, from the standard input)
+#   and a corrupted data-file has to fail the decode
+#   exits with 1 if a check fails
+
+set -u
+PARSER=$1
+LIBCHECK=$2
+WORK=${3:-$(mktemp -d)}
+
+case "$PARSER" in
+    /*) ;;
+    *) PARSER=$(pwd)/$PARSER ;;
+esac
+case "$LIBCHECK" in
+    /*) ;;
+    *) LIBCHECK=$(pwd)/$LIBCHECK ;;
+esac
+mkdir -p "$WORK" || exit 1
+WORK=$(cd "$WORK" && pwd)
+FAILED=0
+
+#   the files span several data-files of 1 MiB, with files across their ends, a few small ones and an empty one
+#   they are given by name, so the archives of parser store the same names as the library
+rm -rf "$WORK/in" && mkdir -p "$WORK/in" || exit 1
+head -c 3500000 /dev/urandom > "$WORK/in/a"
+head -c 700000 /dev/urandom > "$WORK/in/b"
+for i in 1 2 3 4 5; do
+    echo "small file $i" > "$WORK/in/s$i"
+done
+: > "$WORK/in/empty"
+head -c 2000000 /dev/zero > "$WORK/in/z"
+cat "$WORK/in/a" "$WORK/in/b" "$WORK/in/a" > "$WORK/in/twice"
+FILES="a s1 b s2 empty s3 z s4 twice s5"
+N_FILES=10
+
+#   encode the files with parser into $WORK/archive
+#   usage: run_encode <options...>
+run_encode() {
+    rm -rf "$WORK/archive" && mkdir -p "$WORK/archive" || exit 1
+    (cd "$WORK/in" && "$PARSER" encode "$@" > /dev/null 2> "$WORK/err")
+}
+
+#   the library writes the archive of parser, with and without a central directory
+#   usage: check_encode <name> <max. filesize of parser> <max. filesize in bytes> <flags> <options of parser...>
+check_encode() {
+    local name=$1 size=$2 bytes=$3 flags=$4
+    shift 4
+    if ! run_encode "$@" $size "$WORK/archive/out" $FILES; then
+        echo "FAIL $name: parser failed: $(cat "$WORK/err")"
+        FAILED=1
+    elif ! (cd "$WORK/in" && "$LIBCHECK" encode "$WORK/archive/out" $bytes $flags $FILES 2> "$WORK/err"); then
+        echo "FAIL $name: $(cat "$WORK/err")"
+        FAILED=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+check_encode "encode" 1M 1048576 0
+check_encode "encode directory" 1M 1048576 1 --directory
+check_encode "encode unlimited" 0 0 0
+check_encode "encode small data-files" 300K 307200 1 --directory
+
+#   the library reads the archives of parser
+#   usage: check_decode <name> <number of files>
+check_decode() {
+    local name=$1 n=$2
+    if ! (cd "$WORK/in" && "$LIBCHECK" decode "$WORK/archive/out" $n 2> "$WORK/err"); then
+        echo "FAIL $name: $(cat "$WORK/err")"
+        FAILED=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+for opts in "" "--directory" "--compress fast" "--compress high" "--dedup" "--threads 4"; do
+    if ! run_encode $opts 1M "$WORK/archive/out" $FILES; then
+        echo "FAIL decode ${opts:-(default)}: parser failed: $(cat "$WORK/err")"
+        FAILED=1
+        continue
+    fi
+    check_decode "decode ${opts:-(default)}" $N_FILES
+done
+
+#   a file from the standard input is stored in chunks, its size is not known up front
+if ! (cd "$WORK/in" && "$PARSER" encode --stdin-name twice 1M "$WORK/archive/out" a - < twice > /dev/null 2> "$WORK/err"); then
+    echo "FAIL decode standard input: parser failed: $(cat "$WORK/err")"
+    FAILED=1
+else
+    check_decode "decode standard input" 2
+fi
+
+#   a changed byte in a data-file has to fail the decode, the data-file is in the middle of the zeros of 'z'
+if run_encode 1M "$WORK/archive/out" $FILES; then
+    printf '\xff' | dd of="$WORK/archive/out_data4" bs=1 seek=500000 conv=notrunc 2> /dev/null
+    if (cd "$WORK/in" && "$LIBCHECK" decode "$WORK/archive/out" $N_FILES 2> "$WORK/err"); then
+        echo "FAIL decode corrupted data-file: the archive was accepted"
+        FAILED=1
+    elif ! grep -q "corrupted" "$WORK/err"; then
+        echo "FAIL decode corrupted data-file: not found by its checksum: $(cat "$WORK/err")"
+        FAILED=1
+    else
+        echo "ok   decode corrupted data-file"
+    fi
+fi
+
+if [ $FAILED -ne 0 ]; then
+    exit 1
+fi
+echo "ALL OK"
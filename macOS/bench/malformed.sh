@@ -0,0 +1,72 @@
+#!/bin/bash
+#   test of corrupted main files
+#   usage: malformed.sh <parser> [work directory]
+#   every mode that reads the main file ('list', 'decode', 'verify' and 'manifest') has to reject a corrupted one
+#   with an error, quickly and without allocating memory for it
+#   exits with 1 if a check fails
+
+set -u
+PARSER=$1
+WORK=${2:-$(mktemp -d)}
+
+case "$PARSER" in
+    /*) ;;
+    *) PARSER=$(pwd)/$PARSER ;;
+esac
+mkdir -p "$WORK" || exit 1
+WORK=$(cd "$WORK" && pwd)
+FAILED=0
+
+#   write the given bytes (as escapes for printf) to the main file $WORK/<name>/out
+#   usage: write_main <name> <bytes>
+write_main() {
+    rm -rf "$WORK/$1" && mkdir -p "$WORK/$1/out.d" || exit 1
+    printf "$2" > "$WORK/$1/out" || exit 1
+}
+
+#   every mode has to fail on the main file $WORK/<name>/out within 10 seconds
+#   usage: check_rejected <name>
+check_rejected() {
+    local name=$1 mode status
+    for mode in list decode verify manifest; do
+        (cd "$WORK/$name/out.d" && timeout 10 "$PARSER" $mode "$WORK/$name/out" > /dev/null 2> "$WORK/err")
+        status=$?
+        if [ $status -eq 0 ]; then
+            echo "FAIL $name $mode: the main file was accepted"
+            FAILED=1
+        elif [ $status -eq 124 ]; then
+            echo "FAIL $name $mode: did not finish"
+            FAILED=1
+        elif [ ! -s "$WORK/err" ]; then
+            echo "FAIL $name $mode: no error message"
+            FAILED=1
+        else
+            echo "ok   $name $mode"
+        fi
+    done
+}
+
+#   a main file without sections (as written by older versions) with more data-files than can be numbered
+write_main "f_count" '\x07\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00'
+check_rejected "f_count"
+
+#   the largest count that is still valid, without the data-files
+write_main "missing" '\xfe\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00'
+check_rejected "missing"
+
+#   shorter than the two counts
+write_main "short" '\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00'
+check_rejected "short"
+
+#   a checksum section that does not hold 4 bytes per data-file
+write_main "checksums" '\x02\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x02\x00\x00\x00\x00\x00\x00\x00\x04\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00'
+check_rejected "checksums"
+
+#   a section that is longer than the file
+write_main "section" '\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x09\x00\x00\x00\x00\x00\x00\x00\x40\x00\x00\x00\x00\x00\x00\x00'
+check_rejected "section"
+
+if [ $FAILED -ne 0 ]; then
+    exit 1
+fi
+echo "ALL OK"
@@ -0,0 +1,200 @@
+#!/bin/bash
+#   round-trip test of the modes of the command line tool
+#   usage: roundtrip.sh <parser> [work directory]
+#   every encode (with every I/O backend, threads, central directory, compression, deduplication, hashes) has to
+#   decode to its input with every decoder and pass 'verify', 'list' and '--only' have to see the files of the
+#   archive, an interrupted encode or decode has to continue with '--resume', '--append' has to write the archive
+#   of a single encode, and a corrupted data-file has to fail 'decode' and 'verify' with its checksum
+#   exits with 1 if a check fails
+
+set -u
+PARSER=$1
+WORK=${2:-$(mktemp -d)}
+
+case "$PARSER" in
+    /*) ;;
+    *) PARSER=$(pwd)/$PARSER ;;
+esac
+mkdir -p "$WORK" || exit 1
+WORK=$(cd "$WORK" && pwd)
+FAILED=0
+
+#   the input spans several data-files of 1 MiB, with files across their ends, small, empty and compressible ones
+rm -rf "$WORK/in" && mkdir -p "$WORK/in/d/e" || exit 1
+head -c 3500000 /dev/urandom > "$WORK/in/a"
+head -c 900000 /dev/urandom > "$WORK/in/d/b"
+for i in 1 2 3; do
+    echo "small file $i" > "$WORK/in/d/e/s$i"
+done
+: > "$WORK/in/d/empty"
+seq 1 300000 > "$WORK/in/t"
+head -c 2000000 /dev/zero > "$WORK/in/z"
+
+fail() {
+    echo "FAIL $1"
+    FAILED=1
+}
+
+#   encode $WORK/in into $WORK/archive
+#   usage: run_encode <options...> <max. filesize>
+run_encode() {
+    rm -rf "$WORK/archive" && mkdir -p "$WORK/archive" || exit 1
+    (cd "$WORK" && "$PARSER" encode "$@" archive/out in > /dev/null 2> "$WORK/err")
+}
+
+#   decode $WORK/archive in an empty directory $WORK/out
+#   usage: run_decode <options...>
+run_decode() {
+    rm -rf "$WORK/out" && mkdir -p "$WORK/out" || exit 1
+    (cd "$WORK/out" && "$PARSER" decode "$@" "$WORK/archive/out" > /dev/null 2> "$WORK/err")
+}
+
+#   decode the archive with the given options and compare the extracted files with the input
+#   usage: check_decode <name> <options...>
+check_decode() {
+    local name=$1
+    shift
+    if ! run_decode "$@"; then
+        fail "$name: decode failed: $(cat "$WORK/err")"
+    elif ! diff -r "$WORK/in" "$WORK/out/in" > /dev/null; then
+        fail "$name: the decoded files differ from the input"
+    else
+        echo "ok   $name"
+    fi
+}
+
+#   'verify' has to accept the archive and 'list' has to print every file with its size
+#   usage: check_list <name>
+check_list() {
+    local name=$1
+    if ! "$PARSER" verify "$WORK/archive/out" > /dev/null 2> "$WORK/err"; then
+        fail "$name: verify failed: $(cat "$WORK/err")"
+        return
+    fi
+    (cd "$WORK" && find in -type f -exec wc -c {} + | awk '$2 != "total" {print $1, $2}' | sort) > "$WORK/expected"
+    "$PARSER" list "$WORK/archive/out" 2> "$WORK/err" | awk '{print $1, $2}' | sort > "$WORK/listed"
+    if ! cmp -s "$WORK/expected" "$WORK/listed"; then
+        fail "$name: list does not print the input files"
+    else
+        echo "ok   $name"
+    fi
+}
+
+for size in 1M 0; do
+    for opts in "" "--io mmap" "--io uring" "--io pipeline" "--threads 4" "--directory" "--hash" "--compress fast" \
+                "--compress high" "--dedup" "--threads 4 --compress fast"; do
+        name="encode ${opts:-(default)} $size"
+        if ! run_encode $opts $size; then
+            fail "$name: encode failed: $(cat "$WORK/err")"
+            continue
+        fi
+        for dec in "" "--io mmap" "--io uring" "--io pipeline" "--threads 4"; do
+            check_decode "$name, decode ${dec:-(default)}" $dec
+        done
+        check_list "$name, verify and list"
+    done
+done
+
+#   '--only' extracts and lists the matching files (names and shell patterns) and nothing else
+for opts in "" "--directory"; do
+    run_encode $opts 1M || fail "only ${opts:-(default)}: encode failed: $(cat "$WORK/err")"
+    for dec in "" "--threads 4"; do
+        name="only ${opts:-(default)}, decode ${dec:-(default)}"
+        if ! run_decode $dec --only 'in/d/*' --only in/t; then
+            fail "$name: decode failed: $(cat "$WORK/err")"
+        elif [ -e "$WORK/out/in/a" ] || [ -e "$WORK/out/in/z" ] || ! cmp -s "$WORK/in/t" "$WORK/out/in/t" \
+            || ! diff -r "$WORK/in/d" "$WORK/out/in/d" > /dev/null; then
+            fail "$name: the extracted files do not match '--only'"
+        else
+            echo "ok   $name"
+        fi
+    done
+    if [ "$("$PARSER" list --only 'in/d/e/*' --only in/a "$WORK/archive/out" | awk '{print $2}' | sort | tr '\n' ' ')" \
+         != "in/a in/d/e/s1 in/d/e/s2 in/d/e/s3 " ]; then
+        fail "only ${opts:-(default)}, list: the listed files do not match '--only'"
+    else
+        echo "ok   only ${opts:-(default)}, list"
+    fi
+done
+
+#   an encode that is stopped by a failing sink continues with '--resume' and writes the archive of a single encode
+for opts in "" "--directory"; do
+    name="resume encode ${opts:-(default)}"
+    run_encode $opts 1M && mv "$WORK/archive" "$WORK/single" || exit 1
+    if run_encode $opts --resume --sink-exec "case %f in *out_data2) exit 1;; esac" 1M; then
+        fail "$name: the failing sink did not stop the encode"
+    elif ! (cd "$WORK" && "$PARSER" encode $opts --resume 1M archive/out in > "$WORK/log" 2> "$WORK/err"); then
+        fail "$name: resumed encode failed: $(cat "$WORK/err")"
+    elif ! grep -q "^Resuming" "$WORK/log"; then
+        fail "$name: the encode started over"
+    elif ! diff -r "$WORK/single" "$WORK/archive" > /dev/null; then
+        fail "$name: the archive differs from a single encode"
+    else
+        echo "ok   $name"
+    fi
+    rm -rf "$WORK/single"
+done
+
+#   a decode that stops at a corrupted data-file continues with '--resume' once the data-file is repaired
+for dec in "" "--io mmap"; do
+    name="resume decode ${dec:-(default)}"
+    run_encode 1M || exit 1
+    cp "$WORK/archive/out_data4" "$WORK/saved" || exit 1
+    printf '\x01\x02\x03\x04' | dd of="$WORK/archive/out_data4" bs=1 seek=500000 conv=notrunc 2> /dev/null
+    if run_decode $dec --resume; then
+        fail "$name: the corrupted data-file did not stop the decode"
+        continue
+    fi
+    cp "$WORK/saved" "$WORK/archive/out_data4" || exit 1
+    if ! (cd "$WORK/out" && "$PARSER" decode $dec --resume "$WORK/archive/out" > "$WORK/log" 2> "$WORK/err"); then
+        fail "$name: resumed decode failed: $(cat "$WORK/err")"
+    elif ! grep -q "^Resuming" "$WORK/log"; then
+        fail "$name: the decode started over"
+    elif ! diff -r "$WORK/in" "$WORK/out/in" > /dev/null; then
+        fail "$name: the decoded files differ from the input"
+    else
+        echo "ok   $name"
+    fi
+done
+
+#   appending the files in three steps writes the archive of a single encode
+for opts in "" "--directory" "--compress fast"; do
+    name="append ${opts:-(default)}"
+    rm -rf "$WORK/single" "$WORK/archive" && mkdir -p "$WORK/single" "$WORK/archive" || exit 1
+    (cd "$WORK" && "$PARSER" encode $opts 1M single/out in/a in/d in/t in/z > /dev/null) || exit 1
+    if ! (cd "$WORK" && "$PARSER" encode $opts 1M archive/out in/a > /dev/null \
+          && "$PARSER" encode $opts --append 1M archive/out in/d > /dev/null \
+          && "$PARSER" encode $opts --append 1M archive/out in/t in/z > /dev/null 2> "$WORK/err"); then
+        fail "$name: encode failed: $(cat "$WORK/err")"
+    elif ! diff -r "$WORK/single" "$WORK/archive" > /dev/null; then
+        fail "$name: the archive differs from a single encode"
+    elif ! run_decode || ! cmp -s "$WORK/in/a" "$WORK/out/a" || ! diff -r "$WORK/in/d" "$WORK/out/d" > /dev/null \
+        || ! cmp -s "$WORK/in/t" "$WORK/out/t" || ! cmp -s "$WORK/in/z" "$WORK/out/z"; then
+        fail "$name: the decoded files differ from the input"
+    else
+        echo "ok   $name"
+    fi
+done
+rm -rf "$WORK/single"
+
+#   a changed byte in a data-file has to fail 'decode' and 'verify' with its checksum
+for opts in "" "--directory" "--compress fast"; do
+    run_encode $opts 1M || exit 1
+    printf '\x01\x02\x03\x04' | dd of="$WORK/archive/out_data1" bs=1 seek=1000 conv=notrunc 2> /dev/null
+    for mode in "decode" "decode --threads 4" "verify"; do
+        name="corrupted ${opts:-(default)}, $mode"
+        rm -rf "$WORK/out" && mkdir -p "$WORK/out" || exit 1
+        if (cd "$WORK/out" && "$PARSER" $mode "$WORK/archive/out" > /dev/null 2> "$WORK/err"); then
+            fail "$name: the corrupted data-file was accepted"
+        elif ! grep -q "out_data1" "$WORK/err" || ! grep -q "checksum" "$WORK/err"; then
+            fail "$name: the data-file was not reported by its checksum: $(cat "$WORK/err")"
+        else
+            echo "ok   $name"
+        fi
+    done
+done
+
+if [ $FAILED -ne 0 ]; then
+    exit 1
+fi
+echo "ALL OK"
@@ -0,0 +1,92 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+//  runs a command and appends one line of measurements to the given file:
+//  wall time in seconds, peak RSS in KiB, number of read and write syscalls (-1 if unknown) and the exit status
+//  the syscalls are taken from /proc/<pid>/io (Linux), which is read before the exited child is reaped
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Syntax: %s <result file> <command> [args ...]\n", argv[0]);
+        fflush(stderr);
+        return 2;
+    }
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Could not start '%s'.\n", argv[2]);
+        fflush(stderr);
+        return 2;
+    }
+    if (!pid) {
+        execvp(argv[2], argv + 2);
+        fprintf(stderr, "Could not execute '%s'.\n", argv[2]);
+        fflush(stderr);
+        _exit(127);
+    }
+
+    //  wait for the child without reaping it, so its I/O counters can still be read
+    long long syscalls = -1;
+#ifdef __linux__
+    siginfo_t info;
+    memset(&info, 0, sizeof (info));
+    if (!waitid(P_PID, pid, &info, WEXITED | WNOWAIT)) {
+        char path[64];
+        snprintf(path, sizeof (path), "/proc/%d/io", (int) pid);
+        FILE *io = fopen(path, "r");
+        char line[128];
+        long long syscr = -1;
+        long long syscw = -1;
+        while (io && fgets(line, sizeof (line), io)) {
+            sscanf(line, "syscr: %lld", &syscr);
+            sscanf(line, "syscw: %lld", &syscw);
+        }
+        if (io) {
+            fclose(io);
+        }
+        if (syscr >= 0 && syscw >= 0) {
+            syscalls = syscr + syscw;
+        }
+    }
+#endif
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        fprintf(stderr, "Could not wait for '%s'.\n", argv[2]);
+        fflush(stderr);
+        return 2;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    //  ru_maxrss is in KiB on Linux and in bytes on macOS
+#ifdef __APPLE__
+    long max_rss = usage.ru_maxrss / 1024;
+#else
+    long max_rss = usage.ru_maxrss;
+#endif
+    double wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    FILE *out = fopen(argv[1], "a");
+    if (!out) {
+        fprintf(stderr, "Could not open file '%s'.\n", argv[1]);
+        fflush(stderr);
+        return 2;
+    }
+    fprintf(out, "%.6f %ld %lld %d\n", wall, max_rss, syscalls, code);
+    fclose(out);
+    return code;
+}
@@ -0,0 +1,190 @@
+#!/bin/bash
+#   test of the sinks of encode ('--sink-exec' and '--sink-socket')
+#   usage: sink.sh <parser> [work directory]
+#   the consumer takes a copy of every file it is handed, every data-file has to be handed over exactly once and
+#   only once it is complete (the copy equals the final file), the main file last, and the copies have to decode
+#   to the input; a consumer that fails has to fail the encode
+#   the socket consumer is a small python3 server, that part is skipped without python3
+#   exits with 1 if a check fails
+
+set -u
+PARSER=$1
+WORK=${2:-$(mktemp -d)}
+
+case "$PARSER" in
+    /*) ;;
+    *) PARSER=$(pwd)/$PARSER ;;
+esac
+mkdir -p "$WORK" || exit 1
+WORK=$(cd "$WORK" && pwd)
+FAILED=0
+
+#   check the files that were taken by a consumer against the archive in $WORK/archive
+#   usage: check_taken <name>
+#   $WORK/taken/log has a line with the name of every file the consumer was handed, $WORK/taken/copy a copy of each
+check_taken() {
+    local name=$1 f n
+    local parts=$(cd "$WORK/archive" && ls out_data* 2>/dev/null)
+    if [ -z "$parts" ]; then
+        echo "FAIL $name: no data-files"
+        FAILED=1
+        return
+    fi
+    for f in $parts out; do
+        n=$(grep -cx "$f" "$WORK/taken/log")
+        if [ "$n" -ne 1 ]; then
+            echo "FAIL $name: '$f' was handed over $n times"
+            FAILED=1
+            return
+        fi
+        if ! cmp -s "$WORK/taken/copy/$f" "$WORK/archive/$f"; then
+            echo "FAIL $name: '$f' was handed over before it was complete"
+            FAILED=1
+            return
+        fi
+    done
+    if [ "$(wc -l < "$WORK/taken/log")" -ne $(($(echo $parts | wc -w) + 1)) ]; then
+        echo "FAIL $name: other files were handed over"
+        FAILED=1
+        return
+    fi
+    if [ "$(tail -n 1 "$WORK/taken/log")" != "out" ]; then
+        echo "FAIL $name: the main file was not handed over last"
+        FAILED=1
+        return
+    fi
+    #   only the copies are decoded, the archive itself could hide a file that the consumer got incomplete
+    rm -rf "$WORK/out" && mkdir -p "$WORK/out" || exit 1
+    if ! (cd "$WORK/out" && "$PARSER" decode "$WORK/taken/copy/out" > /dev/null) \
+        || ! diff -r "$WORK/in" "$WORK/out/in" > /dev/null; then
+        echo "FAIL $name: the copies do not decode to the input"
+        FAILED=1
+        return
+    fi
+    echo "ok   $name"
+}
+
+#   run an encode of $WORK/in into $WORK/archive
+#   usage: run_encode <options...>
+run_encode() {
+    rm -rf "$WORK/archive" "$WORK/taken" && mkdir -p "$WORK/archive" "$WORK/taken/copy" || exit 1
+    touch "$WORK/taken/log" || exit 1
+    (cd "$WORK" && "$PARSER" encode "$@" 1M archive/out in > /dev/null 2> "$WORK/err")
+}
+
+#   the consumer of '--sink-exec', it copies the file and records its name
+cat > "$WORK/take.sh" << 'EOF'
+#!/bin/sh
+cp "$2" "$1/copy/" || exit 1
+echo "${2##*/}" >> "$1/log"
+EOF
+chmod +x "$WORK/take.sh" || exit 1
+
+#   the consumer of '--sink-socket', every connection gets its own thread and every line is a path
+#   usage: python3 server.py <socket> <taken directory> <name of a file to refuse, or ''>
+cat > "$WORK/server.py" << 'EOF'
+import os, shutil, socket, sys, threading
+
+path, taken, refuse = sys.argv[1:4]
+lock = threading.Lock()
+
+def serve(conn):
+    with conn, conn.makefile('rwb') as stream:
+        for line in stream:
+            name = line.decode().rstrip('\n')
+            if os.path.basename(name) == refuse:
+                stream.write(b'refused\n')
+            else:
+                shutil.copy(name, os.path.join(taken, 'copy'))
+                with lock, open(os.path.join(taken, 'log'), 'a') as log:
+                    log.write(os.path.basename(name) + '\n')
+                stream.write(b'ok\n')
+            stream.flush()
+
+server = socket.socket(socket.AF_UNIX)
+server.bind(path)
+server.listen()
+print('ready', flush=True)
+while True:
+    conn, _ = server.accept()
+    threading.Thread(target=serve, args=(conn,), daemon=True).start()
+EOF
+
+#   the input spans several data-files, with files across their ends and a few small ones
+mkdir -p "$WORK/in/d" || exit 1
+head -c 3500000 /dev/urandom > "$WORK/in/a"
+head -c 700000 /dev/urandom > "$WORK/in/d/b"
+for i in 1 2 3 4 5; do
+    echo "small file $i" > "$WORK/in/d/s$i"
+done
+head -c 2000000 /dev/zero > "$WORK/in/z"
+
+for opts in "" "--threads 4" "--io pipeline" "--compress fast" "--sink-jobs 1" "--threads 3 --sink-jobs 4"; do
+    if ! run_encode $opts --sink-exec "$WORK/take.sh $WORK/taken %f"; then
+        echo "FAIL exec ${opts:-(default)}: encode failed: $(cat "$WORK/err")"
+        FAILED=1
+        continue
+    fi
+    check_taken "exec ${opts:-(default)}"
+done
+
+#   a consumer that fails on the second data-file or on the main file has to fail the encode
+for refuse in out_data1 out; do
+    for opts in "" "--threads 4"; do
+        if run_encode $opts --sink-exec "case %f in *$refuse) exit 1;; esac"; then
+            echo "FAIL exec failing on $refuse ${opts:-(default)}: encode succeeded"
+            FAILED=1
+        else
+            echo "ok   exec failing on $refuse ${opts:-(default)}"
+        fi
+    done
+done
+
+if command -v python3 > /dev/null; then
+    for refuse in "" out_data1 out; do
+        for opts in "" "--threads 4" "--sink-jobs 3"; do
+            rm -f "$WORK/sock" "$WORK/ready"
+            rm -rf "$WORK/taken" && mkdir -p "$WORK/taken/copy" && touch "$WORK/taken/log" || exit 1
+            python3 "$WORK/server.py" "$WORK/sock" "$WORK/taken" "$refuse" > "$WORK/ready" &
+            server=$!
+            for i in $(seq 50); do
+                [ -s "$WORK/ready" ] && break
+                sleep 0.1
+            done
+            rm -rf "$WORK/archive" && mkdir -p "$WORK/archive" || exit 1
+            (cd "$WORK" && "$PARSER" encode $opts --sink-socket "$WORK/sock" 1M archive/out in > /dev/null 2> "$WORK/err")
+            status=$?
+            kill $server 2> /dev/null
+            wait $server 2> /dev/null
+            name="socket${refuse:+ refusing $refuse} ${opts:-(default)}"
+            if [ -n "$refuse" ]; then
+                if [ $status -eq 0 ]; then
+                    echo "FAIL $name: encode succeeded"
+                    FAILED=1
+                else
+                    echo "ok   $name"
+                fi
+            elif [ $status -ne 0 ]; then
+                echo "FAIL $name: encode failed: $(cat "$WORK/err")"
+                FAILED=1
+            else
+                check_taken "$name"
+            fi
+        done
+    done
+    #   without a consumer listening, the encode has to fail
+    rm -f "$WORK/sock"
+    if run_encode --sink-socket "$WORK/sock"; then
+        echo "FAIL socket without consumer: encode succeeded"
+        FAILED=1
+    else
+        echo "ok   socket without consumer"
+    fi
+else
+    echo "skip socket: python3 not found"
+fi
+
+if [ $FAILED -ne 0 ]; then
+    exit 1
+fi
+echo "ALL OK"
@@ -0,0 +1,10599 @@
+#define __DARWIN_64_BIT_INO_T 1
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+#include "libfpp.h"
+//  CRC32C instructions of the CPU, used if they are available
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HARDWARE 1
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#define CRC32C_U64(crc, word) _mm_crc32_u64(crc, word)
+#define CRC32C_U8(crc, byte) _mm_crc32_u8(crc, byte)
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HARDWARE 1
+#define CRC32C_TARGET
+#define CRC32C_U64(crc, word) __crc32cd(crc, word)
+#define CRC32C_U8(crc, byte) __crc32cb(crc, byte)
+#endif
+//  the BLAKE3 lanes are compiled for AVX2 as well, the variant for the CPU is selected when the program is loaded
+#if defined(__x86_64__) && defined(__linux__)
+#define BLAKE3_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define BLAKE3_CLONES
+#endif
+#define BLAKE3_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+//  mixing function of BLAKE3 on four words of the state, it works on single states and on vectors of states
+#define BLAKE3_G(v, a, b, c, d, x, y) do { \
+    v[a] = v[a] + v[b] + (x); v[d] = BLAKE3_ROTR(v[d] ^ v[a], 16); \
+    v[c] = v[c] + v[d]; v[b] = BLAKE3_ROTR(v[b] ^ v[c], 12); \
+    v[a] = v[a] + v[b] + (y); v[d] = BLAKE3_ROTR(v[d] ^ v[a], 8); \
+    v[c] = v[c] + v[d]; v[b] = BLAKE3_ROTR(v[b] ^ v[c], 7); \
+} while (0)
+//  a round mixes the columns and then the diagonals of the state, s is the order of the message words
+#define BLAKE3_ROUND(v, m, s) do { \
+    BLAKE3_G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]); BLAKE3_G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]); \
+    BLAKE3_G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]); BLAKE3_G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]); \
+    BLAKE3_G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]); BLAKE3_G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]); \
+    BLAKE3_G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]); BLAKE3_G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]); \
+} while (0)
+
+//  constant number of bytes which the length of byte-strings gets encoded
+static const uint64_t LEN_SIZE = 8;
+//  size of the buffer that file contents are streamed through
+static const uint64_t BUF_SIZE = 4 * 1024 * 1024;
+//  maximum number of bytes moved by a single copy_file_range / sendfile call
+static const uint64_t ZERO_COPY_CHUNK = 1024 * 1024 * 1024;
+//  file-contents of at least this size are copied by the kernel while decoding, smaller ones go through the buffer
+static const uint64_t ZERO_COPY_MIN = 64 * 1024;
+//  size of the window of a memory-mapped file that is prefetched at once
+static const uint64_t MAP_WINDOW = 64 * 1024 * 1024;
+
+//  size of the buffers that are used by the io_uring backend
+static const uint32_t URING_CHUNK = 1024 * 1024;
+//  default number of io_uring requests that are in flight at once
+static const unsigned URING_DEPTH = 32;
+
+//  number of events in a block of the trace
+static const uint32_t TRACE_BLOCK = 16384;
+//  bytes of file names in a block of the trace, the end of a longer name is kept (it tells the files apart)
+static const uint32_t TRACE_DETAILS = 64 * 1024;
+static const uint32_t TRACE_DETAIL = 62;
+//  size of the buffer the trace is formatted into, small enough to stay in the cache
+static const uint64_t TRACE_OUT = 256 * 1024;
+//  maximum depth of nested spans that are written as single events
+#define TRACE_DEPTH 64
+//  files below this size are traced as a single span, the steps of a small file take less time than recording them
+static const uint64_t TRACE_SMALL = 64 * 1024;
+//  size of the ranges of the output that are written by the threads of the parallel encoder
+static const uint64_t TASK_SIZE = 16 * 1024 * 1024;
+//  upper bound for the number of threads
+static const unsigned MAX_THREADS = FPP_MAX_THREADS;
+//  size of the window of the data-files that is read at once while scanning the headers
+//  small enough to skip most of the content of large files, large enough to hold the longest filename
+static const uint64_t SCAN_WINDOW = 64 * 1024;
+//  polynomial of CRC32C (Castagnoli) in reversed bit order
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+//  number of bytes per lane of the hardware CRC32C, three lanes are computed at once to hide the latency of the instruction
+static const uint64_t CRC_LANE = 4096;
+//  size of the blocks that the content of compressed entries is split into, the same as the units of the content hash
+static const uint64_t COMPRESS_BLOCK = 1024 * 1024;
+//  upper bound for the block size of compressed entries, protects against corrupted input files
+static const uint64_t MAX_BLOCK = 16 * 1024 * 1024;
+//  number of blocks every thread compresses per batch, the batch is kept in memory until it is written
+static const uint64_t BLOCKS_PER_THREAD = 4;
+//  size of the samples of an input file that decide if it is compressed at all
+static const uint64_t SAMPLE_SIZE = 64 * 1024;
+//  number of bytes of the fields in front of the block table (codec, length, block size, number of blocks)
+static const uint64_t BLOCK_FIELDS = 32;
+//  flag in the stored length of a block, that marks blocks which are stored uncompressed
+static const uint64_t BLOCK_RAW = (uint64_t) 1 << 63;
+//  the kind of an entry is stored in the top byte of the length of its filename
+static const unsigned KIND_SHIFT = 56;
+//  default average size of the chunks of deduplicated entries, the minimum is a quarter and the maximum four times of it
+static const uint64_t DEDUP_CHUNK = 64 * 1024;
+//  bounds for the average chunk size that can be chosen with '--chunk-size'
+static const uint64_t MIN_CHUNK_AVG = FPP_MIN_CHUNK_SIZE;
+static const uint64_t MAX_CHUNK_AVG = FPP_MAX_CHUNK_SIZE;
+//  number of bytes of the fields in front of the reference table (original length, number of references)
+static const uint64_t DEDUP_FIELDS = 16;
+//  number of bytes of a reference (source offset, length)
+static const uint64_t REF_SIZE = 16;
+//  flag in the source offset of a reference, that marks chunks which follow the table of the entry itself
+static const uint64_t REF_STREAM = (uint64_t) 1 << 63;
+//  content length in the header of stream entries, whose length is not known when the header is written
+static const uint64_t STREAM_LEN = UINT64_MAX;
+//  max. size of the chunks of stream entries, every chunk is collected in memory before it is written
+static const uint64_t STREAM_CHUNK = 4 * 1024 * 1024;
+//  minimum number of threads that list the directories of the inputs
+static const unsigned WALK_THREADS = 4;
+//  size of the buffer that the entries of a directory are read into
+static const uint64_t WALK_BUF = 64 * 1024;
+//  alignment of the offsets, lengths and buffers of reads and writes that bypass the page cache
+static const uint64_t DIRECT_ALIGN = 4096;
+//  number of buffers (of BUF_SIZE bytes) between the reader and the writer of the pipelined backend
+static const unsigned PIPE_SLOTS = 8;
+//  default number of consumers of the data-files, that are handed to a sink
+static const unsigned SINK_JOBS = 2;
+//  max. length of the reply line of a sink socket
+static const uint64_t SINK_REPLY = 256;
+//  length of the BLAKE3 hashes of the file-contents
+static const uint64_t HASH_LEN = 32;
+//  size of the blocks and chunks of BLAKE3, the chunks are the leaves of its hash tree
+static const uint64_t BLAKE3_BLOCK = 64;
+static const uint64_t BLAKE3_CHUNK = 1024;
+//  number of chunks that are compressed at once in the lanes of the vectors
+static const unsigned BLAKE3_LANES = 8;
+//  size of the subtrees (units) of the content hash, which are hashed separately by the threads that read them
+static const uint64_t HASH_TASK = 1024 * 1024;
+//  initial chaining value of BLAKE3 and the order of the message words in its seven rounds
+static const uint32_t BLAKE3_IV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+static const uint8_t BLAKE3_SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13}
+};
+
+//  lookup tables of the portable CRC32C and the implementation that is selected for the CPU, set up once
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_lane_shift[2];
+static uint32_t (*crc32c_update)(uint32_t, const unsigned char *, uint64_t);
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+//  random values of the gear hash of the chunker, set up once
+static uint64_t gear_table[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+//  I/O backends that can be used for reading input files and data-files
+enum io_backend {
+    IO_STDIO = FPP_IO_STDIO,
+    IO_MMAP = FPP_IO_MMAP,
+    IO_URING = FPP_IO_URING,
+    IO_PIPELINE = FPP_IO_PIPELINE
+};
+
+//  codecs for compressed entries, a fast LZ4-style codec and zlib with the highest compression level
+enum codec {
+    CODEC_NONE = FPP_COMPRESS_NONE,
+    CODEC_FAST = FPP_COMPRESS_FAST,
+    CODEC_HIGH = FPP_COMPRESS_HIGH
+};
+
+//  kinds of entries, the content of compressed entries starts with a table of independently compressed blocks,
+//  the content of deduplicated entries starts with a table of references to chunks
+//  the content of stream entries (read from the standard input) is a sequence of chunks with their length in front,
+//  ended by an empty chunk
+enum entry_kind {
+    ENTRY_RAW,
+    ENTRY_COMPRESSED,
+    ENTRY_DEDUP,
+    ENTRY_STREAM
+};
+
+//  domain flags of the compressions of BLAKE3
+enum blake3_flag {
+    BLAKE3_CHUNK_START = 1,
+    BLAKE3_CHUNK_END = 2,
+    BLAKE3_PARENT = 4,
+    BLAKE3_ROOT = 8
+};
+
+//  vector of the words of BLAKE3_LANES states, one per lane
+typedef uint32_t blake3_vec __attribute__((vector_size(32)));
+
+//  struct for the state of an incremental BLAKE3 hash
+//  stack holds the chaining values of the complete subtrees (at most one per level), chunks counts the chunks
+//  before the current one, whose state is cv and the buffered block
+//  the current chunk is only finished once more input follows, so the last chunk can be marked as the root
+struct blake3 {
+    uint32_t stack[54][8];
+    uint32_t n_stack;
+    uint64_t chunks;
+    uint32_t cv[8];
+    unsigned char block[64];
+    uint32_t block_len;
+    uint32_t blocks;
+};
+
+//  struct for a BLAKE3 hash, whose units of HASH_TASK bytes are hashed separately, by any thread and in any order
+//  the units before the last one are complete subtrees, their chaining values are stored in cvs, the last unit
+//  (the one with the last byte, it might be shorter) is hashed into tail, starting at its first chunk
+struct unit_hash {
+    uint64_t n_units;
+    uint32_t (*cvs)[8];
+    struct blake3 *tail;
+};
+
+#ifdef __linux__
+//  struct for a minimal io_uring instance, the queues are shared with the kernel
+//  the buffers are split into depth / 2 slots, each slot is used by one linked read-write pair
+struct uring {
+    int fd;
+    unsigned depth;
+    unsigned slots;
+    char *bufs;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+};
+#endif
+
+#ifdef __linux__
+//  struct for an entry of a directory as it is returned by getdents64
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+//  struct for a directory of the inputs, its regular files and subdirectories are sorted by name
+//  name_off is the offset of the stored name in the paths of its files, ready is set once it is listed
+struct walk_node {
+    char *path;
+    uint64_t name_off;
+    char **files;
+    uint32_t n_files;
+    struct walk_node **dirs;
+    uint32_t n_dirs;
+    int ready;
+    int failed;
+};
+
+//  struct for a directory on the stack of the traversal, with the index of its next file and subdirectory
+struct walk_frame {
+    struct walk_node *node;
+    uint32_t file_idx;
+    uint32_t dir_idx;
+};
+
+//  struct for the walk over the inputs of the encoder
+//  the directories are listed by the threads in the background, while the files are taken in a fixed order
+//  (the inputs in the given order, the files of a directory before its subdirectories, both sorted by name)
+//  roots holds the directories of the inputs that were not taken yet, queue the directories that are not listed yet
+struct input_walk {
+    char **args;
+    uint32_t n_args;
+    uint32_t arg_idx;
+    struct walk_node **roots;
+    struct walk_frame *stack;
+    uint32_t depth;
+    uint32_t stack_capacity;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t ready_cond;
+    struct walk_node **queue;
+    uint64_t n_queued;
+    uint64_t queue_capacity;
+    unsigned active;
+    int stop;
+    pthread_t *threads;
+    unsigned n_threads;
+};
+
+//  struct for the entry that is read from the standard input, its length is only known once the input ends
+//  content_start is the position of its content in the concatenated data-files, f_len and orig_len grow with
+//  every chunk, finished is set once the empty chunk at the end is encoded
+//  with '--hash', hasher is updated with every chunk that is read
+struct stream_input {
+    char *name;
+    uint64_t content_start;
+    uint64_t f_len;
+    uint64_t orig_len;
+    int finished;
+    int hash;
+    struct blake3 hasher;
+};
+
+//  struct for an input file, name is the name it is stored under and points into path
+struct input_file {
+    char *path;
+    char *name;
+};
+
+//  struct for a buffer of the ring of the pipelined backend
+struct pipe_slot {
+    char *data;
+    uint64_t len;
+};
+
+//  struct for the ring of buffers between the reader and the writer thread of the pipelined backend
+//  the reader fills the slot at head, the writer consumes the slot at tail, both only ever increase
+//  done and failed are set by the reader, aborted by the writer
+struct pipe_ring {
+    struct pipe_slot *slots;
+    uint64_t head;
+    uint64_t tail;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t emptied;
+    int ready;
+    int done;
+    int failed;
+    int aborted;
+};
+
+//  struct for the state of the reader thread of the pipelined encoder
+struct pipe_encoder {
+    struct pipe_ring *ring;
+    struct input_walk *walk;
+    char *out_name;
+    uint64_t max_fsize;
+    const struct fpp_options *opts;
+    struct directory *dir;
+    struct manifest *manifest;
+    struct dedup_index *index;
+};
+
+//  struct for the state of the reader thread of the pipelined decoder
+struct pipe_decoder {
+    struct pipe_ring *ring;
+    char *f_names;
+    uint32_t f_name_len;
+    uint32_t f_count;
+    uint64_t size_total;
+    uint32_t *crcs;
+    char *buf;
+};
+
+//  struct for storing byte-strings and their length
+struct byte_string {
+    uint64_t len;
+    char *data;
+};
+
+//  struct for a read-only memory-mapped file
+//  released marks the start of the pages that have not been released yet
+struct mapped_file {
+    uint64_t len;
+    char *data;
+    uint64_t released;
+};
+
+//  struct for an input file that is being encoded
+//  only the header (length of filename, filename, length of file-content) is kept in memory,
+//  the file-content is streamed from the still open (or memory-mapped) input file
+//  for compressed entries, the header includes the block table and the blocks are streamed from a temporary file
+//  for deduplicated entries, the header includes the reference table and the new chunks are streamed from the
+//  temporary file of the index, starting at src_off
+//  content_off is the offset of the content (behind its length) in the encoded file
+//  hash is the BLAKE3 hash of the original file-content, with '--hash'
+//  the content of raw entries is hashed by hasher while it is written, the hash is set once all of it is written
+//  traced is set for files whose steps are recorded with '--trace' (see TRACE_SMALL)
+struct encoded_file {
+    uint64_t len;
+    uint64_t header_len;
+    char *header;
+    FILE *file;
+    struct mapped_file *map;
+    char *filepath;
+    char *name;
+    enum entry_kind kind;
+    uint64_t content_off;
+    uint64_t orig_len;
+    uint64_t src_off;
+    struct blake3 *hasher;
+    unsigned char hash[32];
+    int traced;
+};
+
+//  struct for an input file in the partition plan of the parallel encoder
+//  start is the offset of the header in the concatenated data of all entries
+//  the content of compressed and deduplicated entries is read from the temporary file of the plan, starting at src_off
+//  with '--hash', the units of raw entries are hashed by the workers that copy them, the hashes of compressed and
+//  deduplicated entries are calculated while they are planned
+struct plan_entry {
+    char *filepath;
+    char *name;
+    uint64_t start;
+    uint64_t header_len;
+    char *header;
+    uint64_t f_len;
+    enum entry_kind kind;
+    uint64_t content_off;
+    uint64_t orig_len;
+    uint64_t src_off;
+    struct unit_hash units;
+    unsigned char hash[32];
+};
+
+//  struct for the partition plan of the parallel encoder
+//  the concatenated data is split into tasks of TASK_SIZE bytes, which are taken by the workers in order
+//  with a sink, part_left counts the bytes of every data-file that are not written yet, the worker that writes
+//  the last bytes of a data-file hands it to the sink
+struct encode_plan {
+    char *out_name;
+    uint64_t max_fsize;
+    struct plan_entry *entries;
+    uint32_t n_entries;
+    uint64_t total;
+    uint32_t n_parts;
+    uint64_t n_tasks;
+    uint64_t next_task;
+    struct task_crc *task_crcs;
+    uint64_t *part_left;
+    int tmp_fd;
+    uint64_t tmp_len;
+    int direct;
+    int direct_warned;
+    int hash;
+    int checksums;
+    int failed;
+};
+
+//  struct for a batch of blocks of an input file, that is compressed by the threads of the pool
+//  every block of the batch has its own output buffer, stored holds the stored length of the blocks
+//  with units, every block is also hashed as a unit of the content hash, which is finished into hash
+struct compress_job {
+    int in_fd;
+    uint64_t f_len;
+    enum codec codec;
+    uint64_t first;
+    uint64_t n_blocks;
+    char **outs;
+    uint64_t *stored;
+    uint64_t next;
+    struct unit_hash *units;
+    unsigned char *hash;
+    int failed;
+};
+
+//  struct for the checksum of a part of a data-file, that is written by a single task of the parallel encoder
+struct crc_piece {
+    uint32_t part;
+    uint32_t crc;
+    uint64_t len;
+};
+
+//  struct for the checksums of the pieces of a task, in the order they appear in the data-files
+struct task_crc {
+    struct crc_piece *pieces;
+    uint64_t n_pieces;
+    uint64_t capacity;
+};
+
+//  struct for a worker thread of the parallel encoder
+//  the last used input file and data-file stay open, since consecutive segments mostly use the same files
+//  with direct I/O, the data of a task is collected in the aligned stage and written with out_fd, which bypasses
+//  the page cache, only its unaligned start and end are written with buffered_fd
+//  stage_off is the offset of the staged data in the data-file, the stage starts at the aligned offset before it
+//  with '--hash', a unit of a raw entry that is not copied at once is collected in unit, unit_fill bytes of it so far
+struct plan_worker {
+    pthread_t thread;
+    struct encode_plan *plan;
+    char *buf;
+    int in_fd;
+    uint32_t in_entry;
+    int out_fd;
+    uint32_t out_part;
+    int buffered_fd;
+    char *stage;
+    uint32_t stage_part;
+    uint64_t stage_off;
+    uint64_t stage_len;
+    char *unit;
+    int unit_open;
+    uint32_t unit_entry;
+    uint64_t unit_idx;
+    uint64_t unit_fill;
+};
+
+//  struct for a block of a compressed entry, start is the offset in the concatenated data-files
+struct block_ref {
+    uint64_t start;
+    uint64_t len;
+    int raw;
+};
+
+//  struct for a reference of a deduplicated entry in the parallel decoder
+//  start is the offset of the chunk in the concatenated data-files, out_off its offset in the extracted file
+struct chunk_ref {
+    uint64_t start;
+    uint64_t len;
+    uint64_t out_off;
+};
+
+//  struct for a unique chunk in the index of the deduplicating encoder
+//  off is the offset of the chunk in the concatenated data-files (relative to the literals of the entry
+//  that is currently encoded, until its header is built), tmp_off is its offset in the temporary file
+struct dedup_chunk {
+    uint32_t crc;
+    uint64_t len;
+    uint64_t off;
+    uint64_t tmp_off;
+};
+
+//  struct for the index of the unique chunks of all encoded files, the chunks are staged in a temporary file
+//  buckets is a hash table with open addressing, which holds the index of the chunk plus one (0 is empty)
+struct dedup_index {
+    int tmp_fd;
+    uint64_t tmp_len;
+    struct dedup_chunk *chunks;
+    uint64_t n_chunks;
+    uint64_t capacity;
+    uint64_t *buckets;
+    uint64_t n_buckets;
+    uint64_t chunk_min;
+    uint64_t chunk_avg;
+    uint64_t chunk_max;
+    uint64_t mask_small;
+    uint64_t mask_large;
+    char *window;
+    uint64_t window_len;
+    char *cmp;
+};
+
+//  kinds of references of a deduplicated entry while it is encoded
+//  new chunks follow the table, own chunks are earlier chunks of the same entry, prior chunks belong to earlier entries
+enum ref_kind {
+    REF_NEW,
+    REF_OWN,
+    REF_PRIOR
+};
+
+//  struct for a reference of a deduplicated entry while it is encoded, consecutive chunks are merged into one reference
+struct dedup_ref {
+    enum ref_kind kind;
+    uint64_t src;
+    uint64_t len;
+};
+
+//  struct for an encoded file in the table of entries of the parallel decoder
+//  start is the offset of the file-content in the concatenated data-files, f_len its stored length
+//  idx is the position of the entry in the archive, which is kept when entries are selected
+//  superseded entries are overwritten by a later entry with the same name and are not extracted
+//  the blocks of compressed entries and the references of deduplicated entries are loaded after the entries are selected
+//  with a manifest, the units of the extracted file are hashed by the workers that write them, only compressed entries
+//  whose blocks are not made of whole units are hashed again after they are extracted (rehash)
+struct decode_entry {
+    char *f_name;
+    uint64_t name_len;
+    uint64_t idx;
+    int superseded;
+    uint64_t start;
+    uint64_t f_len;
+    enum entry_kind kind;
+    uint64_t orig_len;
+    enum codec codec;
+    uint64_t block_size;
+    uint64_t n_blocks;
+    struct block_ref *blocks;
+    uint64_t n_refs;
+    struct chunk_ref *refs;
+    struct unit_hash units;
+    int rehash;
+    unsigned char hash[32];
+};
+
+//  struct for a range of the content of an entry, which is extracted by a single worker
+struct decode_item {
+    uint64_t entry;
+    uint64_t off;
+    uint64_t len;
+};
+
+//  struct for the queue of items of a worker, items are taken from the head by the owner and stolen from the tail
+struct item_queue {
+    pthread_mutex_t lock;
+    struct decode_item *items;
+    uint64_t head;
+    uint64_t tail;
+};
+
+//  struct for the table of entries and the work of the parallel decoder
+//  part_start holds the offsets of the data-files in the concatenated data (f_count + 1 values)
+struct decode_plan {
+    char *f_names;
+    uint32_t f_name_len;
+    uint32_t f_count;
+    uint64_t *part_start;
+    uint64_t size_total;
+    struct decode_entry *entries;
+    uint64_t n_entries;
+    struct item_queue *queues;
+    uint32_t n_workers;
+    int hash;
+    int failed;
+};
+
+//  struct for the directories of the last output file of the decoder
+//  path holds the components of the directory separated by zeros, ends the end of every component in it
+//  and fds the open descriptor of every component
+struct dir_cache {
+    char *path;
+    uint64_t capacity;
+    int *fds;
+    uint64_t *ends;
+    uint32_t depth;
+};
+
+//  struct for a worker thread of the parallel decoder
+//  with a manifest, raw and deduplicated entries are extracted unit by unit through the unit buffer
+struct decode_worker {
+    pthread_t thread;
+    struct decode_plan *plan;
+    uint32_t id;
+    char *buf;
+    char *unit;
+    char *block;
+    char *plain;
+    int part_fd;
+    uint32_t part;
+    int out_fd;
+    uint64_t out_entry;
+    struct dir_cache dirs;
+};
+
+//  struct for the window of the concatenated data-files that is buffered while scanning the headers
+//  the last opened data-file is kept open, so consecutive headers in the same data-file share one open()
+struct scan_window {
+    char *data;
+    uint64_t start;
+    uint64_t len;
+    int fd;
+    uint32_t part;
+};
+
+//  types of the optional sections of the main file
+enum section_type {
+    SECTION_DIRECTORY = 1,
+    SECTION_CHECKSUMS = 2,
+    SECTION_MTIMES = 3,
+    SECTION_HASHES = 4
+};
+
+//  struct for an entry of the central directory
+//  part and part_off locate the start of the file-content (index of the data-file and offset in it)
+//  the original length is only stored for compressed entries
+//  the modification time of the input file (in ns) is stored in its own section, for incremental encodes
+struct dir_entry {
+    char *name;
+    uint64_t name_len;
+    uint64_t f_len;
+    uint64_t part;
+    uint64_t part_off;
+    enum entry_kind kind;
+    uint64_t orig_len;
+    uint64_t mtime;
+};
+
+//  struct for the central directory, which lists all entries and is stored in the main file
+//  buckets is a hash table of the filenames (index of the entry + 1, 0 for empty buckets)
+//  mtimes is set if the modification times of the entries are known (archives encoded with '--incremental')
+struct directory {
+    uint64_t max_fsize;
+    int mtimes;
+    struct dir_entry *entries;
+    uint64_t n_entries;
+    uint64_t capacity;
+    uint64_t *buckets;
+    uint64_t n_buckets;
+};
+
+//  struct for the BLAKE3 hash of the content of an entry
+struct hash_entry {
+    char *name;
+    uint64_t name_len;
+    unsigned char hash[32];
+};
+
+//  struct for the content hashes of all entries (in the order of the archive), stored in the main file with '--hash'
+//  the names are stored with the hashes, so the manifest can be listed without reading the data-files
+struct manifest {
+    struct hash_entry *entries;
+    uint64_t n_entries;
+    uint64_t capacity;
+};
+
+//  struct for the content of the main file, the optional sections are NULL if they are not present
+//  crcs holds the CRC32C of every data-file
+struct main_file {
+    uint64_t f_count;
+    uint64_t size_total;
+    struct directory *dir;
+    uint32_t *crcs;
+    struct manifest *manifest;
+};
+
+//  struct for a file whose BLAKE3 hash is calculated by multiple threads
+//  every task is a subtree of HASH_TASK bytes, whose chaining value is stored in cvs
+struct hash_job {
+    int fd;
+    uint64_t n_tasks;
+    uint64_t next;
+    uint32_t (*cvs)[8];
+    int failed;
+};
+
+//  struct for the data-files that are checksummed by multiple threads
+//  only the selected data-files are read (all of them if selected is NULL), the checksums are stored in crcs
+struct checksum_job {
+    char *f_names;
+    uint32_t f_name_len;
+    uint32_t f_count;
+    const char *selected;
+    uint32_t *crcs;
+    uint32_t next;
+    int failed;
+};
+
+//  types of the records of the journals, which are written while encoding or decoding with '--resume'
+//  every record consists of its type, its length and its content, like the sections of the main file
+enum journal_type {
+    JOURNAL_HEADER = 1,
+    JOURNAL_ENTRY = 2,
+    JOURNAL_PART = 3,
+    JOURNAL_FILE = 4
+};
+
+//  struct for the position where an interrupted encode continues
+//  the first n_parts data-files are complete (with their checksums in crcs), the encoding continues with the
+//  entry at index entry, of which the first off bytes are already written (f_len is the length of its content)
+struct encode_cursor {
+    uint32_t n_parts;
+    uint32_t *crcs;
+    uint64_t entry;
+    uint64_t off;
+    uint64_t f_len;
+};
+
+//  upper bound for the length of encoded filenames, protects against corrupted input files
+static const uint64_t MAX_NAME_LEN = FPP_MAX_NAME_LEN;
+
+//  steps of the extraction, every encoded file consists of these fields in this order
+//  the content of compressed entries consists of the block fields, the block table and the blocks
+//  the content of deduplicated entries consists of its fields, the reference table and the new chunks
+//  the content of stream entries consists of chunks, each with its length in front
+enum extract_step {
+    STEP_NAME_LEN,
+    STEP_NAME,
+    STEP_CONTENT_LEN,
+    STEP_CONTENT,
+    STEP_BLOCK_FIELDS,
+    STEP_BLOCK_TABLE,
+    STEP_BLOCK,
+    STEP_DEDUP_FIELDS,
+    STEP_DEDUP_TABLE,
+    STEP_DEDUP_DATA,
+    STEP_CHUNK_LEN,
+    STEP_CHUNK
+};
+
+//  struct for the progress of the extraction, which can be interrupted after any byte
+//  for compressed and deduplicated entries, pos counts the consumed bytes of the whole content
+//  chunks of deduplicated entries, that are stored earlier in the archive, are read from the data-files (part_fd)
+//  with a manifest, every extracted file is compared with the hash of the entry at entry_idx,
+//  its hash is calculated by hasher from the data as it is written
+struct extract_state {
+    enum extract_step step;
+    uint64_t pos;
+    char len_buf[8];
+    uint64_t name_len;
+    char *f_name;
+    uint64_t f_len;
+    FILE *out;
+    FILE *log;
+    int zero_copy;
+    enum entry_kind kind;
+    char fields[32];
+    enum codec codec;
+    uint64_t orig_len;
+    uint64_t block_size;
+    uint64_t n_blocks;
+    char *table;
+    uint64_t block_idx;
+    uint64_t block_start;
+    char *block;
+    char *plain;
+    uint64_t n_refs;
+    uint64_t ref_idx;
+    uint64_t ref_start;
+    uint64_t chunk_len;
+    uint64_t chunk_start;
+    char *f_names;
+    uint32_t f_name_len;
+    uint32_t f_count;
+    uint64_t *part_start;
+    int part_fd;
+    uint32_t part;
+    struct dir_cache dirs;
+    FILE *journal;
+    char *journal_buf;
+    uint64_t stream_pos;
+    struct manifest *manifest;
+    uint64_t entry_idx;
+    uint64_t mismatched;
+    struct blake3 hasher;
+};
+
+//  struct for the state of an encoder of the library, the data is written through the callbacks of the sink
+//  after an error the archive is incomplete, so all further calls fail
+struct fpp_encoder {
+    struct fpp_sink sink;
+    uint64_t max_fsize;
+    uint64_t written_total;
+    uint32_t f_idx;
+    uint64_t crcs_capacity;
+    uint32_t *crcs;
+    struct directory *dir;
+    char *buf;
+    int failed;
+    const char *error;
+};
+
+//  struct for the state of a decoder of the library
+//  the data-files are read in order through buf, fetched counts the bytes read from them and pos the bytes consumed,
+//  the checksum of every data-file is verified once it is read completely
+//  the length of stream entries is STREAM_LEN until the empty chunk at their end is read
+//  chunks of deduplicated entries, that are stored earlier in the archive, are read at their position, which needs
+//  the size of the data-files (part_len, known once the first data-file is read completely)
+struct fpp_decoder {
+    struct fpp_source source;
+    uint32_t f_count;
+    uint64_t size_total;
+    uint32_t *crcs;
+    uint64_t fetched;
+    uint64_t pos;
+    uint32_t part;
+    uint64_t part_off;
+    uint64_t part_len;
+    uint32_t crc;
+    char *buf;
+    uint64_t buf_pos;
+    uint64_t buf_len;
+    int active;
+    enum entry_kind kind;
+    char *name;
+    uint64_t name_len;
+    uint64_t f_len;
+    uint64_t content_pos;
+    uint64_t orig_len;
+    uint64_t out_pos;
+    char fields[32];
+    enum codec codec;
+    uint64_t block_size;
+    uint64_t n_blocks;
+    uint64_t block_idx;
+    char *table;
+    char *block;
+    char *plain;
+    uint64_t plain_pos;
+    uint64_t plain_len;
+    uint64_t n_refs;
+    uint64_t ref_idx;
+    uint64_t ref_pos;
+    uint64_t chunk_left;
+    int failed;
+    const char *error;
+};
+
+//  phases of encode and decode, that are timed for '--stats'
+//  scan: walking the inputs or reading the main file and the headers, read: opening and preparing the input files
+//  (compression, deduplication) or verifying the data-files, write: writing the data-files or extracting the files,
+//  close: closing the written files, main_file: writing the main file
+enum stats_phase {
+    PHASE_SCAN,
+    PHASE_READ,
+    PHASE_WRITE,
+    PHASE_CLOSE,
+    PHASE_MAIN_FILE,
+    N_PHASES
+};
+
+//  struct for the statistics of a run, which are printed as JSON with '--stats json'
+//  the phases are measured in ns, latency counts the data-files by the time from opening to closing them
+//  (bucket i holds the data-files that took less than 2^i us, the last bucket the slower ones), the parallel
+//  encoder and decoder write the data-files in pieces, they only time the phases as a whole
+struct run_stats {
+    int enabled;
+    uint64_t start;
+    uint64_t phases[N_PHASES];
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t entries;
+    uint64_t largest_entry;
+    uint64_t partitions;
+    uint64_t latency[28];
+};
+
+//  statistics of the current run, every field is only updated by one thread (the pipelined encoder times
+//  scan and read in its reader thread and the rest in the main thread)
+static struct run_stats stats;
+
+//  struct for an event of the trace, a begin ('B') or end ('E') of a span on the thread that recorded it
+//  ts is the raw value of the trace clock, detail is the end of the name of the file the span is about (or NULL)
+struct trace_event {
+    uint64_t ts;
+    const char *name;
+    const char *detail;
+    char phase;
+};
+
+//  struct for a block of the events of a thread, together with the details they point to (and no other block does)
+//  the blocks of a thread are chained and never moved, so a full block is not copied
+struct trace_block {
+    struct trace_block *next;
+    uint32_t n_events;
+    uint32_t details_len;
+    struct trace_event *events;
+    char *details;
+};
+
+//  struct for the events of a single thread, the buffer is registered in a global list once and only the
+//  thread that owns it appends to it, so recording an event needs no lock
+//  a new block is allocated once the last one is full, consecutive events of a file share the copy of its name
+struct trace_buffer {
+    struct trace_buffer *next;
+    uint32_t tid;
+    uint64_t dropped;
+    struct trace_block *first;
+    struct trace_block *last;
+    const char *detail;
+    uint64_t detail_len;
+};
+
+//  tracing with '--trace <file>', the buffers of all threads are written as Chrome trace-event JSON at the end
+//  the raw trace clock and the monotonic clock are taken at the start and at the end, to convert the timestamps
+static int trace_enabled;
+static uint64_t trace_start;
+static uint64_t trace_start_ns;
+static uint32_t trace_threads;
+static struct trace_buffer *trace_buffers;
+static __thread struct trace_buffer *trace_local;
+
+//  recording an event costs a single branch, if tracing is disabled
+//  the steps of a file are only recorded if cond holds, it is not evaluated without tracing, TRACE_CLOCK takes the
+//  start of a step whose span is only recorded once cond is known (TRACE_SPAN_IF)
+#define TRACE_BEGIN(name, detail) do { if (__builtin_expect(trace_enabled, 0)) trace_event('B', name, detail); } while (0)
+#define TRACE_END(name) do { if (__builtin_expect(trace_enabled, 0)) trace_event('E', name, NULL); } while (0)
+#define TRACE_BEGIN_IF(cond, name, detail) \
+    do { if (__builtin_expect(trace_enabled, 0) && (cond)) trace_event('B', name, detail); } while (0)
+#define TRACE_END_IF(cond, name) do { if (__builtin_expect(trace_enabled, 0) && (cond)) trace_event('E', name, NULL); } while (0)
+#define TRACE_CLOCK() (__builtin_expect(trace_enabled, 0) ? trace_clock() : 0)
+#define TRACE_SPAN_IF(cond, name, detail, start) \
+    do { if (__builtin_expect(trace_enabled, 0) && (cond)) trace_span(name, detail, start); } while (0)
+
+//  struct for the consumers of complete data-files, a command ('--sink-exec') or a unix socket ('--sink-socket')
+//  the paths of the data-files are queued for the n_jobs consumer threads, the queue holds at most n_jobs paths,
+//  so the encoder waits once the consumers fall behind
+//  aborted drops the queued paths of a failed encode, failed is set by the first consumer that fails
+struct part_sink {
+    const char *exec;
+    const char *socket_path;
+    unsigned n_jobs;
+    pthread_t *threads;
+    unsigned started;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t taken;
+    char **queue;
+    unsigned head;
+    unsigned n_queued;
+    uint64_t n_consumed;
+    int done;
+    int aborted;
+    int failed;
+};
+
+//  the sink of the current encode, NULL if the data-files are only written
+static struct part_sink *partition_sink;
+//  the environment of the sink commands
+extern char **environ;
+
+//  writes to a closed sink socket fail instead of raising SIGPIPE (macOS sets SO_NOSIGPIPE on the socket instead)
+#ifdef MSG_NOSIGNAL
+#define SINK_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SINK_SEND_FLAGS 0
+#endif
+
+//  function declarations
+static uint64_t now_ns(void);
+static uint64_t stats_clock(void);
+static void stats_add(enum stats_phase, uint64_t);
+static void stats_entry(uint64_t);
+static void stats_partition(uint64_t);
+static void print_stats(const char *, int);
+static uint64_t trace_clock(void);
+static struct trace_block *trace_block(void);
+static void free_trace_block(struct trace_block *);
+static struct trace_buffer *trace_buffer(void);
+static void trace_event(char, const char *, const char *);
+static void trace_record(char, const char *, const char *, uint64_t);
+static void trace_span(const char *, const char *, uint64_t);
+static uint32_t format_str(char *, const char *);
+static uint32_t format_uint(char *, uint64_t);
+static uint32_t format_json_string(char *, const char *);
+static uint32_t format_trace_time(char *, uint64_t);
+static uint32_t format_trace_event(char *, const struct trace_event *, const struct trace_event *, const char *, double);
+static int write_trace(const char *);
+static int start_sink(const struct fpp_options *);
+static int sink_submit(const char *);
+static void *sink_worker_run(void *);
+static int sink_consume(struct part_sink *, const char *, int *);
+static uint64_t quote_path(char *, const char *);
+static int sink_exec(const char *, const char *);
+static int sink_send(const char *, const char *, int *);
+static int finish_sink(const char *);
+static int encode_files(char *, struct input_walk *, uint64_t, const struct fpp_options *);
+static int open_append(char *, uint64_t, const struct fpp_options *, struct main_file *);
+static int append_journal(FILE *, uint64_t, const char *, uint64_t);
+static uint64_t next_journal_record(const struct byte_string *, uint64_t, uint64_t *, uint64_t *);
+static struct byte_string *read_journal(char *);
+static void free_journal(struct byte_string *);
+static void close_journal(FILE *);
+static int check_partition(char *, uint64_t, uint32_t, char *);
+static FILE *open_encode_journal(char *, struct input_walk *, uint64_t, const struct fpp_options *, struct directory *,
+                          struct encode_cursor *);
+static int journal_entry(FILE *, const char *, uint64_t, uint64_t, uint64_t, enum entry_kind, uint64_t);
+static int journal_part(FILE *, uint32_t, uint32_t, uint64_t, uint64_t, uint64_t);
+static FILE *open_decode_journal(uint64_t, uint32_t, const uint32_t *, FILE *, uint64_t *, uint64_t *);
+static int journal_file(struct extract_state *);
+static struct input_walk *start_walk(char **, uint32_t, const struct fpp_options *);
+static struct walk_node *new_walk_node(const char *, uint64_t, uint64_t);
+static char *join_path(const char *, const char *);
+static int queue_walk_node(struct input_walk *, struct walk_node *);
+static void *walk_worker_run(void *);
+static int add_walk_entry(struct walk_node *, const char *, int, uint32_t *, uint32_t *);
+static int list_directory(struct walk_node *, char *);
+static int compare_names(const void *, const void *);
+static int compare_nodes(const void *, const void *);
+static int compare_entry_names(const void *, const void *);
+static int next_input(struct input_walk *, struct input_file *);
+static int push_walk_frame(struct input_walk *, struct walk_node *);
+static void free_walk_node(struct walk_node *);
+static void free_walk_tree(struct walk_node *);
+static void free_walk(struct input_walk *);
+static int write_main_file(char *, const struct main_file *);
+static int read_main_file(char *, struct main_file *);
+static char *serialize_main_file(const struct main_file *, uint64_t *);
+static int parse_main_file(const char *, uint64_t, struct main_file *);
+static int fpp_emit(struct fpp_encoder *, const char *, uint64_t);
+static int fpp_begin_entry(struct fpp_encoder *, const char *, uint64_t);
+static int fpp_fail(struct fpp_encoder *, const char *);
+static int fpp_stream_read(struct fpp_decoder *, char *, uint64_t);
+static int fpp_read_at(struct fpp_decoder *, uint64_t, char *, uint64_t);
+static int fpp_read_main_file(struct fpp_decoder *);
+static int fpp_next_part(struct fpp_decoder *);
+static int fpp_open_entry(struct fpp_decoder *);
+static int fpp_next_chunk(struct fpp_decoder *);
+static void fpp_close_entry(struct fpp_decoder *);
+static int fpp_error(struct fpp_decoder *, const char *);
+static void free_main_file(struct main_file *);
+static struct directory *new_directory(uint64_t);
+static void free_directory(struct directory *);
+static int directory_add(struct directory *, const char *, uint64_t, uint64_t, uint64_t, uint64_t, enum entry_kind, uint64_t);
+static uint64_t hash_name(const char *, uint64_t);
+static int directory_build_index(struct directory *);
+static struct dir_entry *directory_lookup(const struct directory *, const char *);
+static char *serialize_directory(struct directory *, uint64_t *);
+static struct directory *parse_directory(const char *, uint64_t);
+static struct manifest *new_manifest(void);
+static void free_manifest(struct manifest *);
+static int manifest_add(struct manifest *, const char *, uint64_t, const unsigned char *);
+static char *serialize_manifest(const struct manifest *, uint64_t *);
+static struct manifest *parse_manifest(const char *, uint64_t);
+static int encode_files_parallel(char *, struct input_walk *, uint64_t, const struct fpp_options *);
+static struct pipe_ring *new_pipe_ring(void);
+static void free_pipe_ring(struct pipe_ring *);
+static struct pipe_slot *pipe_acquire(struct pipe_ring *);
+static void pipe_publish(struct pipe_ring *);
+static struct pipe_slot *pipe_take(struct pipe_ring *);
+static void pipe_release(struct pipe_ring *);
+static void pipe_finish(struct pipe_ring *, int);
+static void pipe_abort(struct pipe_ring *);
+static void *pipe_read_inputs(void *);
+static int encode_files_pipelined(char *, struct input_walk *, uint64_t, const struct fpp_options *);
+static void *pipe_read_partitions(void *);
+static int extract_pipelined(struct extract_state *, char *, uint32_t, uint32_t, uint64_t, uint32_t *, char *, uint64_t *);
+static struct encode_plan *plan_encode(char *, struct input_walk *, uint64_t, const struct fpp_options *);
+static int plan_compressed(struct encode_plan *, struct plan_entry *, const struct fpp_options *);
+static int plan_dedup(struct encode_plan *, struct plan_entry *, struct dedup_index *, const struct fpp_options *);
+static void free_encode_plan(struct encode_plan *);
+static int add_crc_piece(struct task_crc *, const struct crc_piece *);
+static int part_written(struct encode_plan *, uint32_t, uint64_t);
+static int write_task(struct encode_plan *, struct plan_worker *, uint64_t);
+static int copy_hashed(struct encode_plan *, struct plan_worker *, uint32_t, uint64_t, uint64_t, uint64_t, uint64_t, uint32_t *);
+static int hash_segment(struct encode_plan *, struct plan_worker *, uint32_t, uint64_t, uint64_t, const char *, uint64_t);
+static int finish_unit(struct encode_plan *, struct plan_worker *);
+static void *plan_worker_run(void *);
+static int open_partition(struct encode_plan *, uint32_t, int);
+static int open_direct(const char *, int, int *);
+static int stage_segment(struct encode_plan *, struct plan_worker *, uint32_t, uint64_t, uint64_t, uint32_t, uint64_t);
+static int flush_stage(struct encode_plan *, struct plan_worker *);
+static uint64_t read_direct(int, char *, char *, uint64_t, uint64_t);
+static uint64_t pwrite_direct(int, int, const char *, uint64_t, uint64_t);
+static uint64_t copy_positional(int, uint64_t, int, uint64_t, uint64_t, char *, uint32_t *);
+static uint64_t pwrite_all(int, const char *, uint64_t, uint64_t);
+static int extract_files_parallel(char *, uint32_t, uint32_t, uint64_t, const struct directory *, const uint32_t *,
+                           const struct manifest *, const struct fpp_options *);
+static int prepare_decode_plan(struct decode_plan *, char *, uint32_t, uint32_t, uint64_t, const struct directory *,
+                        const struct fpp_options *);
+static int filter_entries(struct decode_plan *, const struct fpp_options *);
+static int mark_superseded(struct decode_plan *);
+static int load_block_tables(struct decode_plan *);
+static int load_ref_tables(struct decode_plan *);
+static int scan_stream(struct decode_plan *, struct scan_window *, struct decode_entry *);
+static int load_stream_tables(struct decode_plan *);
+static int list_files(char *, const struct fpp_options *);
+static int print_manifest(char *, const struct fpp_options *);
+static int entries_from_directory(struct decode_plan *, const struct directory *, const char *);
+static char *select_from_directory(const struct directory *, const struct fpp_options *);
+static int scan_entries(struct decode_plan *);
+static int scan_read(struct decode_plan *, struct scan_window *, uint64_t, char *, uint64_t);
+static void free_scan_window(struct scan_window *);
+static uint32_t find_partition(struct decode_plan *, uint64_t);
+static uint32_t locate_partition(const uint64_t *, uint32_t, uint64_t);
+static int take_item(struct decode_plan *, uint32_t, struct decode_item *);
+static int extract_item(struct decode_plan *, struct decode_worker *, struct decode_item *);
+static int extract_block(struct decode_plan *, struct decode_worker *, struct decode_item *);
+static int extract_chunks(struct decode_plan *, struct decode_worker *, struct decode_item *);
+static uint64_t find_ref(const struct decode_entry *, uint64_t);
+static int read_chunks(struct decode_plan *, struct decode_worker *, const struct decode_entry *, uint64_t, char *, uint64_t);
+static int write_unit(struct decode_worker *, struct decode_entry *, uint64_t, uint64_t);
+static int open_part(struct decode_plan *, struct decode_worker *, uint32_t);
+static int read_range(struct decode_plan *, struct decode_worker *, uint64_t, char *, uint64_t);
+static void *decode_worker_run(void *);
+static void free_decode_plan(struct decode_plan *);
+static struct byte_string *read_bytes(char *);
+static struct mapped_file *map_file(char *);
+static void unmap_file(struct mapped_file *);
+static void advise_window(struct mapped_file *, uint64_t);
+static uint64_t f_size(char *);
+static uint64_t f_mtime(char *);
+static uint64_t from_bytes(uint64_t, uint64_t, const char *);
+static char *to_bytes(uint64_t, uint64_t);
+static void store_bytes(uint64_t, uint64_t, char *);
+static int process_input_file(char *, const struct fpp_options *);
+static int extract_files(struct extract_state *, const char *, uint64_t, uint64_t *);
+static int complete_entry(struct extract_state *);
+static void check_entry_hash(struct extract_state *);
+static uint64_t write_output(struct extract_state *, const char *, uint64_t);
+static int check_extracted_hashes(struct decode_plan *, const struct manifest *, unsigned);
+static int extract_block_step(struct extract_state *, const char *, uint64_t, uint64_t *);
+static int check_block_fields(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+static int check_block_table(const char *, uint64_t, uint64_t, uint64_t, uint64_t);
+static int extract_dedup_step(struct extract_state *, const char *, uint64_t, uint64_t *);
+static int extract_stream_step(struct extract_state *, const char *, uint64_t, uint64_t *);
+static int check_ref_table(const char *, uint64_t, uint64_t, uint64_t, uint64_t);
+static int copy_prior_refs(struct extract_state *);
+static int load_partitions(struct extract_state *);
+static void free_extract_state(struct extract_state *);
+static char *encode_header(const char *, uint64_t, uint64_t *);
+static struct encoded_file *encode_file(char *, char *, char *, const struct fpp_options *, struct dedup_index *, uint64_t);
+static struct encoded_file *read_stream_chunk(struct stream_input *);
+static int dedup_encoded(struct encoded_file *, struct dedup_index *, uint64_t, unsigned char *);
+static int compress_file(struct encoded_file *, char *, const struct fpp_options *);
+static void free_encoded_file(struct encoded_file *);
+static uint64_t write_encoded(struct encoded_file *, uint64_t, uint64_t, FILE *, char *, struct uring *, uint32_t *);
+static uint64_t fwrite64(const void *, uint64_t, FILE *);
+static uint64_t copy_range(FILE *, uint64_t, FILE *, uint64_t, char *, struct uring *, uint32_t *, struct blake3 *);
+static struct uring *setup_uring(const struct fpp_options *);
+static struct uring *uring_init(unsigned);
+static void uring_free(struct uring *);
+static void uring_queue(struct uring *, uint8_t, int, char *, uint32_t, uint64_t, uint8_t, uint64_t);
+static uint64_t uring_copy(struct uring *, int, uint64_t, int, uint64_t, uint64_t, uint32_t *, struct blake3 *);
+static void bytes_cpy(const char *, char *, uint64_t);
+static uint64_t extract_filename(const char *, uint64_t);
+static int open_output(struct dir_cache *, const char *, uint64_t, int);
+static void free_dir_cache(struct dir_cache *);
+static uint32_t crc32c_multiply(uint32_t, uint32_t);
+static uint32_t crc32c_shift(uint64_t);
+static uint32_t crc32c_combine(uint32_t, uint32_t, uint64_t);
+static uint32_t crc32c_portable(uint32_t, const unsigned char *, uint64_t);
+#ifdef CRC32C_HARDWARE
+static CRC32C_TARGET uint32_t crc32c_hardware(uint32_t, const unsigned char *, uint64_t);
+#endif
+static void crc32c_init(void);
+static uint32_t crc32c(uint32_t, const char *, uint64_t);
+static int checksum_range(int, uint64_t, uint64_t, char *, uint32_t *);
+static void *checksum_worker_run(void *);
+static int verify_partitions(char *, uint32_t, uint32_t, const char *, const uint32_t *, unsigned);
+static int verify_files(char *, const struct fpp_options *);
+static void blake3_words(const unsigned char *, uint32_t *);
+static void blake3_compress(const uint32_t *, const uint32_t *, uint64_t, uint32_t, uint32_t, uint32_t *);
+static void blake3_parent(const uint32_t *, const uint32_t *, uint32_t, uint32_t *);
+static void blake3_chunk(const unsigned char *, uint64_t, uint32_t *);
+static BLAKE3_CLONES void blake3_lanes(const unsigned char *, uint64_t, uint32_t (*)[8]);
+static void blake3_chunks(const unsigned char *, uint64_t, uint64_t, uint32_t (*)[8]);
+static void blake3_subtree(const unsigned char *, uint64_t, uint64_t, uint32_t (*)[8], uint32_t *);
+static void blake3_init(struct blake3 *);
+static void blake3_push(struct blake3 *, const uint32_t *, uint64_t);
+static void blake3_update(struct blake3 *, const unsigned char *, uint64_t);
+static void blake3_final(struct blake3 *, unsigned char *);
+static void *hash_worker_run(void *);
+static int hash_fd(int, uint64_t, unsigned, unsigned char *);
+static int hash_path(const char *, unsigned, unsigned char *);
+static int unit_hash_init(struct unit_hash *, uint64_t);
+static int hash_unit(struct unit_hash *, uint64_t, const unsigned char *, uint64_t, unsigned char *);
+static void unit_hash_final(struct unit_hash *, unsigned char *);
+static void free_unit_hash(struct unit_hash *);
+static uint64_t lz_compress(const unsigned char *, uint64_t, unsigned char *, uint64_t);
+static int lz_decompress(const unsigned char *, uint64_t, unsigned char *, uint64_t);
+static uint64_t compress_block(enum codec, const char *, uint64_t, char *);
+static int decompress_block(enum codec, const char *, uint64_t, char *, uint64_t);
+static uint64_t pread_all(int, char *, uint64_t, uint64_t);
+static int is_compressible(int, uint64_t);
+static void *compress_worker_run(void *);
+static uint64_t *compress_entry(int, uint64_t, const struct fpp_options *, int, uint64_t, uint64_t *, unsigned char *);
+static char *encode_compressed_header(const char *, uint64_t, enum codec, const uint64_t *, uint64_t, uint64_t *);
+static int temp_file(const char *);
+static void gear_init(void);
+static struct dedup_index *new_dedup_index(const char *, const struct fpp_options *);
+static void free_dedup_index(struct dedup_index *);
+static uint64_t next_chunk(const struct dedup_index *, const unsigned char *, uint64_t);
+static uint64_t chunk_bucket(const struct dedup_index *, uint32_t, uint64_t);
+static int64_t find_chunk(struct dedup_index *, const char *, uint64_t, uint32_t);
+static int add_chunk(struct dedup_index *, const struct dedup_chunk *);
+static int add_ref(struct dedup_ref **, uint64_t *, uint64_t *, enum ref_kind, uint64_t, uint64_t);
+static struct dedup_ref *dedup_entry(struct dedup_index *, int, uint64_t, uint64_t *, uint64_t *, struct blake3 *);
+static char *encode_dedup_header(const char *, uint64_t, const struct dedup_ref *, uint64_t, uint64_t, uint64_t, struct dedup_index *,
+                          uint64_t, uint64_t *);
+static char *dedup_file(struct dedup_index *, char *, const char *, uint64_t, uint64_t, uint64_t *, uint64_t *, uint64_t *,
+                 unsigned char *);
+
+//  the file-based modes of the command line tool, which only parses its arguments and calls these
+
+//  the number of threads that use all CPUs
+static unsigned cpu_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 1 ? (cpus < MAX_THREADS ? cpus : MAX_THREADS) : 1;
+}
+
+//  set the default options, large files are always hashed by all CPUs
+void fpp_options_init(struct fpp_options *opts) {
+    memset(opts, 0, sizeof (struct fpp_options));
+    opts->io = FPP_IO_STDIO;
+    opts->queue_depth = URING_DEPTH;
+    opts->chunk_avg = DEDUP_CHUNK;
+    opts->sink_jobs = SINK_JOBS;
+    opts->hash_threads = cpu_threads();
+}
+
+//  start the statistics and the trace of an encode or decode, if the options ask for them
+static void start_run(const struct fpp_options *opts) {
+    stats.enabled = opts->stats;
+    stats.start = stats_clock();
+    trace_enabled = opts->trace != NULL;
+    trace_start_ns = trace_enabled ? now_ns() : 0;
+    trace_start = trace_enabled ? trace_clock() : 0;
+}
+
+//  encode the input files and directories into the main file out_name and its data-files
+int fpp_encode(const char *out_name, char **inputs, uint32_t n_inputs, uint64_t max_fsize,
+               const struct fpp_options *options) {
+    struct fpp_options opts = *options;
+    if (!opts.threads) {
+        opts.threads = 1;
+    }
+    if (opts.n_only) {
+        fprintf(stderr, "Option '--only' can not be used with mode 'encode'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    if (opts.dedup && opts.compress) {
+        fprintf(stderr, "Options '--dedup' and '--compress' can not be combined.\n");
+        fflush(stderr);
+        return 1;
+    }
+    //  the chunker cuts where the low bits of the gear hash are zero, so the average chunk size is a power of two
+    if (opts.chunk_avg < MIN_CHUNK_AVG || opts.chunk_avg > MAX_CHUNK_AVG || (opts.chunk_avg & (opts.chunk_avg - 1))) {
+        fprintf(stderr, "Invalid chunk size %llu (valid are: powers of two from 4K to 4M).\n",
+                (unsigned long long) opts.chunk_avg);
+        fflush(stderr);
+        return 1;
+    }
+    if (opts.direct && opts.io != IO_STDIO) {
+        fprintf(stderr, "Option '--direct' can only be used with the I/O backend 'stdio'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    //  the progress of an encode can only be resumed, if the data-files are written one after another
+    if (opts.resume && (opts.threads > 1 || opts.direct || opts.io == IO_PIPELINE || opts.dedup)) {
+        fprintf(stderr, "Option '--resume' can not be combined with '--threads', '--direct', '--io pipeline' or '--dedup'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    //  appending continues the last data-file of the archive, which is done by the serial encoder
+    if (opts.append && (opts.threads > 1 || opts.direct || opts.io == IO_PIPELINE || opts.resume)) {
+        fprintf(stderr, "Option '--append' can not be combined with '--threads', '--direct', '--io pipeline' or '--resume'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    if (opts.incremental && (opts.threads > 1 || opts.direct || opts.io == IO_PIPELINE || opts.resume || opts.append)) {
+        fprintf(stderr, "Option '--incremental' can not be combined with '--threads', '--direct', '--io pipeline', "
+                        "'--resume' or '--append'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    if (opts.sink_exec && opts.sink_socket) {
+        fprintf(stderr, "Options '--sink-exec' and '--sink-socket' can not be combined.\n");
+        fflush(stderr);
+        return 1;
+    }
+    //  the journal and extended archives rely on the checksums of the data-files
+    if (opts.no_checksums && (opts.resume || opts.append || opts.incremental)) {
+        fprintf(stderr, "Option '--no-checksums' can not be combined with '--resume', '--append' or '--incremental'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    //  the hashes are calculated from the whole input files, resumed and incremental encodes skip some of them
+    if (opts.hash && (opts.resume || opts.incremental)) {
+        fprintf(stderr, "Option '--hash' can not be combined with '--resume' or '--incremental'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    //  the standard input ('-') can only be read once and its length is not known in advance,
+    //  so it is encoded by the serial encoder, which writes the data-files one after another
+    int n_stdin = 0;
+    for (uint32_t i = 0; i < n_inputs; i++) {
+        n_stdin += !strcmp(inputs[i], "-");
+    }
+    if (n_stdin > 1) {
+        fprintf(stderr, "The standard input ('-') can only be given once.\n");
+        fflush(stderr);
+        return 1;
+    }
+    if (n_stdin && (opts.threads > 1 || opts.direct || opts.io == IO_PIPELINE || opts.resume || opts.incremental)) {
+        fprintf(stderr, "The standard input ('-') can not be combined with '--threads', '--direct', '--io pipeline', "
+                        "'--resume' or '--incremental'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    if (!max_fsize) {
+        max_fsize--;
+    }
+    start_run(&opts);
+
+    //  directories among the inputs are walked in the background while the files are encoded
+    struct input_walk *walk = start_walk(inputs, n_inputs, &opts);
+    if (!walk) {
+        return 1;
+    }
+    //  the data-files are handed to the sink while the next ones are written, the main file at the end
+    if ((opts.sink_exec || opts.sink_socket) && start_sink(&opts)) {
+        free_walk(walk);
+        return 1;
+    }
+    //  the internal functions take the names of the files as char *, they do not change them
+    char *out = (char *) out_name;
+    int err;
+    TRACE_BEGIN("encode", out);
+    //  direct I/O writes every data-file at fixed offsets, which is what the parallel encoder does already
+    if (opts.threads > 1 || opts.direct) {
+        err = encode_files_parallel(out, walk, max_fsize, &opts);
+    } else if (opts.io == IO_PIPELINE) {
+        err = encode_files_pipelined(out, walk, max_fsize, &opts);
+    } else {
+        err = encode_files(out, walk, max_fsize, &opts);
+    }
+    free_walk(walk);
+    if (finish_sink(err ? NULL : out)) {
+        err = 1;
+    }
+    TRACE_END("encode");
+    if (trace_enabled && write_trace(opts.trace)) {
+        err = 1;
+    }
+    print_stats("encode", err);
+    return err;
+}
+
+//  extract the files of the archive with the given main file
+int fpp_decode(const char *main_name, const struct fpp_options *options) {
+    struct fpp_options opts = *options;
+    if (!opts.threads) {
+        opts.threads = 1;
+    }
+    if (opts.resume && (opts.threads > 1 || opts.n_only || opts.io == IO_PIPELINE)) {
+        fprintf(stderr, "Option '--resume' can not be combined with '--threads', '--only' or '--io pipeline'.\n");
+        fflush(stderr);
+        return 1;
+    }
+    start_run(&opts);
+
+    TRACE_BEGIN("decode", main_name);
+    int err = process_input_file((char *) main_name, &opts);
+    TRACE_END("decode");
+    if (trace_enabled && write_trace(opts.trace)) {
+        err = 1;
+    }
+    if (!err) {
+        fprintf(stdout, opts.n_only ? "Successfully extracted the selected files.\n"
+                                    : "Successfully extracted all files.\n");
+        fflush(stdout);
+    }
+    print_stats("decode", err);
+    return err;
+}
+
+//  print name and size of the files of the archive with the given main file
+int fpp_list(const char *main_name, const struct fpp_options *opts) {
+    return list_files((char *) main_name, opts);
+}
+
+//  check the data-files of the archive with the given main file, concurrently by default
+int fpp_verify(const char *main_name, const struct fpp_options *options) {
+    struct fpp_options opts = *options;
+    if (!opts.threads) {
+        opts.threads = cpu_threads();
+    }
+    return verify_files((char *) main_name, &opts);
+}
+
+//  print the content hashes stored in the given main file
+int fpp_manifest(const char *main_name, const struct fpp_options *opts) {
+    return print_manifest((char *) main_name, opts);
+}
+
+//  write the main output file, containing the information about the data-files
+static int write_main_file(char *out_name, const struct main_file *info) {
+    uint64_t len = 0;
+    char *data = serialize_main_file(info, &len);
+    if (!data) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    FILE *f_output = fopen(out_name, "wb+");
+    if (!f_output) {
+        fprintf(stderr, "Could not open file '%s'.\n", out_name);
+        fflush(stderr);
+        free(data);
+        return 1;
+    }
+    uint64_t written = fwrite64(data, len, f_output);
+    free(data);
+    if (fclose(f_output) || written < len) {
+        fprintf(stderr, "Could not write to file '%s'.\n", out_name);
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+//  serialize the main file, the file count and total size written to the data-files, followed by the optional sections
+//  every section consists of its type, its length and its content, returns NULL if memory can not be allocated
+static char *serialize_main_file(const struct main_file *info, uint64_t *len) {
+    uint64_t dir_len = 0;
+    char *dir_section = NULL;
+    if (info->dir) {
+        dir_section = serialize_directory(info->dir, &dir_len);
+        if (!dir_section) {
+            return NULL;
+        }
+    }
+    uint64_t hashes_len = 0;
+    char *hashes_section = NULL;
+    if (info->manifest) {
+        hashes_section = serialize_manifest(info->manifest, &hashes_len);
+        if (!hashes_section) {
+            free(dir_section);
+            return NULL;
+        }
+    }
+    uint64_t crcs_len = info->crcs ? LEN_SIZE * 2 + info->f_count * 4 : 0;
+    uint64_t mtimes_len = info->dir && info->dir->mtimes ? LEN_SIZE * (2 + info->dir->n_entries) : 0;
+    *len = LEN_SIZE * 2 + dir_len + crcs_len + mtimes_len + hashes_len;
+    char *data = malloc(*len);
+    if (!data) {
+        free(dir_section);
+        free(hashes_section);
+        return NULL;
+    }
+    store_bytes(info->f_count, LEN_SIZE, data);
+    store_bytes(info->size_total, LEN_SIZE, data + LEN_SIZE);
+    uint64_t pos = LEN_SIZE * 2;
+    if (dir_section) {
+        bytes_cpy(dir_section, data + pos, dir_len);
+        free(dir_section);
+        pos += dir_len;
+    }
+    //  the checksums are stored as 4 bytes per data-file
+    if (info->crcs) {
+        store_bytes(SECTION_CHECKSUMS, LEN_SIZE, data + pos);
+        store_bytes(info->f_count * 4, LEN_SIZE, data + pos + LEN_SIZE);
+        for (uint64_t i = 0; i < info->f_count; i++) {
+            store_bytes(info->crcs[i], 4, data + pos + LEN_SIZE * 2 + i * 4);
+        }
+        pos += crcs_len;
+    }
+    //  the modification times are stored as 8 bytes per entry of the central directory
+    if (mtimes_len) {
+        store_bytes(SECTION_MTIMES, LEN_SIZE, data + pos);
+        store_bytes(LEN_SIZE * info->dir->n_entries, LEN_SIZE, data + pos + LEN_SIZE);
+        for (uint64_t i = 0; i < info->dir->n_entries; i++) {
+            store_bytes(info->dir->entries[i].mtime, LEN_SIZE, data + pos + LEN_SIZE * (2 + i));
+        }
+        pos += mtimes_len;
+    }
+    if (hashes_section) {
+        bytes_cpy(hashes_section, data + pos, hashes_len);
+        free(hashes_section);
+    }
+    return data;
+}
+
+//  read the main file, containing the information about the data-files and the optional sections
+static int read_main_file(char *filepath, struct main_file *info) {
+    memset(info, 0, sizeof (struct main_file));
+    struct byte_string *bytes_f = read_bytes(filepath);
+    if (!bytes_f) {
+        fprintf(stderr, "Could not read file '%s'.\n", filepath);
+        fflush(stderr);
+        return 1;
+    }
+    int err = parse_main_file(bytes_f->data, bytes_f->len, info);
+    free(bytes_f->data);
+    free(bytes_f);
+    if (err == 1) {
+        fprintf(stderr, "Error, file '%s' is too short. Input file might be corrupted.\n", filepath);
+        fflush(stderr);
+        return 1;
+    }
+    if (err == 3) {
+        fprintf(stderr, "Error, file '%s' names too many data-files. Input file might be corrupted.\n", filepath);
+        fflush(stderr);
+        return 1;
+    }
+    if (err) {
+        fprintf(stderr, "Error, file '%s' contains an invalid section. Input file might be corrupted.\n", filepath);
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+//  parse the content of a main file, main files without sections (written by older versions) are valid as well,
+//  unknown sections are skipped
+//  returns 1 if it is too short, 2 if it contains an invalid section and 3 if the number of data-files can not be valid
+static int parse_main_file(const char *data, uint64_t data_len, struct main_file *info) {
+    memset(info, 0, sizeof (struct main_file));
+    if (data_len < LEN_SIZE * 2) {
+        return 1;
+    }
+
+    //  read the information about the data that needs to be reads from the files
+    info->f_count = from_bytes(0, LEN_SIZE, data);
+    info->size_total = from_bytes(LEN_SIZE, LEN_SIZE, data);
+    //  the data-files are numbered with 32 bits, a larger count only comes from a corrupted file
+    if (info->f_count > UINT32_MAX - 1) {
+        return 3;
+    }
+
+    uint64_t pos = LEN_SIZE * 2;
+    while (pos < data_len) {
+        if (data_len - pos < LEN_SIZE * 2) {
+            break;
+        }
+        uint64_t type = from_bytes(pos, LEN_SIZE, data);
+        uint64_t len = from_bytes(pos + LEN_SIZE, LEN_SIZE, data);
+        //  a section that reaches past the end leaves pos short of it, so the file is rejected below
+        if (len > data_len - pos - LEN_SIZE * 2) {
+            break;
+        }
+        pos += LEN_SIZE * 2;
+        if (type == SECTION_DIRECTORY && !info->dir) {
+            info->dir = parse_directory(data + pos, len);
+            if (!info->dir) {
+                break;
+            }
+        }
+        //  the checksums are stored as 4 bytes per data-file
+        if (type == SECTION_CHECKSUMS && !info->crcs) {
+            if (len % 4 || len / 4 != info->f_count) {
+                break;
+            }
+            info->crcs = malloc(len ? len : 1);
+            if (!info->crcs) {
+                break;
+            }
+            for (uint64_t i = 0; i < info->f_count; i++) {
+                info->crcs[i] = from_bytes(pos + i * 4, 4, data);
+            }
+        }
+        //  the modification times belong to the entries of the central directory, which comes first
+        if (type == SECTION_MTIMES && info->dir && !info->dir->mtimes) {
+            if (len % LEN_SIZE || len / LEN_SIZE != info->dir->n_entries) {
+                break;
+            }
+            for (uint64_t i = 0; i < info->dir->n_entries; i++) {
+                info->dir->entries[i].mtime = from_bytes(pos + i * LEN_SIZE, LEN_SIZE, data);
+            }
+            info->dir->mtimes = 1;
+        }
+        if (type == SECTION_HASHES && !info->manifest) {
+            info->manifest = parse_manifest(data + pos, len);
+            if (!info->manifest) {
+                break;
+            }
+        }
+        pos += len;
+    }
+    if (pos != data_len) {
+        free_main_file(info);
+        return 2;
+    }
+    return 0;
+}
+
+//  free the optional sections of the main file
+static void free_main_file(struct main_file *info) {
+    free_directory(info->dir);
+    info->dir = NULL;
+    free(info->crcs);
+    info->crcs = NULL;
+    free_manifest(info->manifest);
+    info->manifest = NULL;
+}
+
+//  the central directory and the manifest are used by the callbacks of the library as well, so their functions
+//  print nothing and leave reporting a failed allocation (NULL or 1) to the caller
+
+//  allocate an empty central directory for data-files with the given max. size
+static struct directory *new_directory(uint64_t max_fsize) {
+    struct directory *dir = calloc(1, sizeof (struct directory));
+    if (!dir) {
+        return NULL;
+    }
+    dir->max_fsize = max_fsize;
+    return dir;
+}
+
+//  free a central directory including the names of its entries
+static void free_directory(struct directory *dir) {
+    if (!dir) {
+        return;
+    }
+    for (uint64_t i = 0; i < dir->n_entries; i++) {
+        free(dir->entries[i].name);
+    }
+    free(dir->entries);
+    free(dir->buckets);
+    free(dir);
+}
+
+//  add an entry to the central directory
+//  part and part_off are the index of the data-file and the offset in it, where the file-content starts
+static int directory_add(struct directory *dir, const char *name, uint64_t name_len, uint64_t f_len, uint64_t part, uint64_t part_off,
+                  enum entry_kind kind, uint64_t orig_len) {
+    if (dir->n_entries == dir->capacity) {
+        uint64_t capacity = dir->capacity ? dir->capacity * 2 : 64;
+        struct dir_entry *entries = realloc(dir->entries, capacity * sizeof (struct dir_entry));
+        if (!entries) {
+            return 1;
+        }
+        dir->entries = entries;
+        dir->capacity = capacity;
+    }
+    struct dir_entry *entry = dir->entries + dir->n_entries;
+    entry->name = malloc(name_len + 1);
+    if (!entry->name) {
+        return 1;
+    }
+    bytes_cpy(name, entry->name, name_len);
+    *(entry->name + name_len) = 0;
+    entry->name_len = name_len;
+    entry->f_len = f_len;
+    entry->part = part;
+    entry->part_off = part_off;
+    entry->kind = kind;
+    entry->orig_len = orig_len;
+    entry->mtime = 0;
+    dir->n_entries++;
+    return 0;
+}
+
+//  hash a filename for the hash table of the central directory (FNV-1a)
+static uint64_t hash_name(const char *name, uint64_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint64_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//  build the hash table of the central directory (open addressing, at most half of the buckets are used)
+static int directory_build_index(struct directory *dir) {
+    free(dir->buckets);
+    dir->n_buckets = 16;
+    while (dir->n_buckets < dir->n_entries * 2) {
+        dir->n_buckets *= 2;
+    }
+    dir->buckets = calloc(dir->n_buckets, sizeof (uint64_t));
+    if (!dir->buckets) {
+        return 1;
+    }
+    for (uint64_t i = 0; i < dir->n_entries; i++) {
+        uint64_t bucket = hash_name(dir->entries[i].name, dir->entries[i].name_len) & (dir->n_buckets - 1);
+        while (dir->buckets[bucket]) {
+            bucket = (bucket + 1) & (dir->n_buckets - 1);
+        }
+        dir->buckets[bucket] = i + 1;
+    }
+    return 0;
+}
+
+//  find the first entry with the given name in the central directory, returns NULL if there is none
+static struct dir_entry *directory_lookup(const struct directory *dir, const char *name) {
+    if (!dir->n_buckets) {
+        return NULL;
+    }
+    uint64_t len = strlen(name);
+    uint64_t bucket = hash_name(name, len) & (dir->n_buckets - 1);
+    while (dir->buckets[bucket]) {
+        struct dir_entry *entry = dir->entries + dir->buckets[bucket] - 1;
+        if (entry->name_len == len && !memcmp(entry->name, name, len)) {
+            return entry;
+        }
+        bucket = (bucket + 1) & (dir->n_buckets - 1);
+    }
+    return NULL;
+}
+
+//  serialize the central directory as a section of the main file
+//  content: max. size of the data-files, number of entries, the entries
+//  (length of filename, filename, length of file-content, index of the data-file and offset of the file-content in it),
+//  number of buckets and the buckets of the hash table (offset of the entry in the content + 1, 0 for empty buckets),
+//  so a single entry can be looked up in the main file without parsing all entries
+static char *serialize_directory(struct directory *dir, uint64_t *len) {
+    if (directory_build_index(dir)) {
+        return NULL;
+    }
+    uint64_t *offsets = malloc((dir->n_entries + 1) * sizeof (uint64_t));
+    if (!offsets) {
+        return NULL;
+    }
+    uint64_t content_len = LEN_SIZE * 3 + dir->n_buckets * LEN_SIZE;
+    for (uint64_t i = 0; i < dir->n_entries; i++) {
+        content_len += LEN_SIZE * (dir->entries[i].kind ? 5 : 4) + dir->entries[i].name_len;
+    }
+    *len = LEN_SIZE * 2 + content_len;
+    char *section = malloc(*len);
+    if (!section) {
+        free(offsets);
+        return NULL;
+    }
+
+    uint64_t pos = 0;
+    store_bytes(SECTION_DIRECTORY, LEN_SIZE, section + pos);
+    pos += LEN_SIZE;
+    store_bytes(content_len, LEN_SIZE, section + pos);
+    pos += LEN_SIZE;
+    store_bytes(dir->max_fsize, LEN_SIZE, section + pos);
+    pos += LEN_SIZE;
+    store_bytes(dir->n_entries, LEN_SIZE, section + pos);
+    pos += LEN_SIZE;
+    for (uint64_t i = 0; i < dir->n_entries; i++) {
+        struct dir_entry *entry = dir->entries + i;
+        offsets[i] = pos - LEN_SIZE * 2;
+        store_bytes(entry->name_len | (uint64_t) entry->kind << KIND_SHIFT, LEN_SIZE, section + pos);
+        pos += LEN_SIZE;
+        bytes_cpy(entry->name, section + pos, entry->name_len);
+        pos += entry->name_len;
+        store_bytes(entry->f_len, LEN_SIZE, section + pos);
+        pos += LEN_SIZE;
+        store_bytes(entry->part, LEN_SIZE, section + pos);
+        pos += LEN_SIZE;
+        store_bytes(entry->part_off, LEN_SIZE, section + pos);
+        pos += LEN_SIZE;
+        //  compressed entries additionally store the length of the original file
+        if (entry->kind) {
+            store_bytes(entry->orig_len, LEN_SIZE, section + pos);
+            pos += LEN_SIZE;
+        }
+    }
+    store_bytes(dir->n_buckets, LEN_SIZE, section + pos);
+    pos += LEN_SIZE;
+    for (uint64_t i = 0; i < dir->n_buckets; i++) {
+        store_bytes(dir->buckets[i] ? offsets[dir->buckets[i] - 1] + 1 : 0, LEN_SIZE, section + pos);
+        pos += LEN_SIZE;
+    }
+    free(offsets);
+    return section;
+}
+
+//  parse the content of the central directory section, returns NULL if it is invalid
+static struct directory *parse_directory(const char *data, uint64_t len) {
+    if (len < LEN_SIZE * 2) {
+        return NULL;
+    }
+    struct directory *dir = new_directory(from_bytes(0, LEN_SIZE, data));
+    if (!dir) {
+        return NULL;
+    }
+    uint64_t n_entries = from_bytes(LEN_SIZE, LEN_SIZE, data);
+    uint64_t pos = LEN_SIZE * 2;
+    //  the buckets store the offsets of the entries, so the offset of every entry is kept to map them back to indices
+    uint64_t *offsets = NULL;
+    char *referenced = NULL;
+    if (n_entries <= (len - pos) / (LEN_SIZE * 4)) {
+        offsets = malloc((n_entries + 1) * sizeof (uint64_t));
+        referenced = calloc(n_entries + 1, 1);
+    }
+    if (!offsets || !referenced) {
+        free(offsets);
+        free(referenced);
+        free_directory(dir);
+        return NULL;
+    }
+    for (uint64_t i = 0; i < n_entries; i++) {
+        if (len - pos < LEN_SIZE) {
+            goto invalid;
+        }
+        offsets[i] = pos;
+        uint64_t name_len = from_bytes(pos, LEN_SIZE, data);
+        enum entry_kind kind = name_len >> KIND_SHIFT;
+        name_len &= ((uint64_t) 1 << KIND_SHIFT) - 1;
+        uint64_t fields = kind ? 4 : 3;
+        pos += LEN_SIZE;
+        if (name_len > MAX_NAME_LEN || kind > ENTRY_STREAM || len - pos < name_len + LEN_SIZE * fields) {
+            goto invalid;
+        }
+        uint64_t f_len = from_bytes(pos + name_len, LEN_SIZE, data);
+        uint64_t part = from_bytes(pos + name_len + LEN_SIZE, LEN_SIZE, data);
+        uint64_t part_off = from_bytes(pos + name_len + LEN_SIZE * 2, LEN_SIZE, data);
+        uint64_t orig_len = kind ? from_bytes(pos + name_len + LEN_SIZE * 3, LEN_SIZE, data) : f_len;
+        if (directory_add(dir, data + pos, name_len, f_len, part, part_off, kind, orig_len)) {
+            goto invalid;
+        }
+        pos += name_len + LEN_SIZE * fields;
+    }
+
+    //  the stored hash table is used as it is, it has to be a power of two with free buckets
+    //  and has to reference every entry exactly once, otherwise lookups could miss entries
+    if (len - pos < LEN_SIZE) {
+        goto invalid;
+    }
+    uint64_t n_buckets = from_bytes(pos, LEN_SIZE, data);
+    pos += LEN_SIZE;
+    if (!n_buckets) {
+        if (directory_build_index(dir)) {
+            goto invalid;
+        }
+        free(offsets);
+        free(referenced);
+        return dir;
+    }
+    if (n_buckets > (len - pos) / LEN_SIZE || n_buckets & (n_buckets - 1) || n_buckets <= n_entries) {
+        goto invalid;
+    }
+    dir->buckets = calloc(n_buckets, sizeof (uint64_t));
+    if (!dir->buckets) {
+        goto invalid;
+    }
+    dir->n_buckets = n_buckets;
+    uint64_t n_used = 0;
+    for (uint64_t i = 0; i < n_buckets; i++) {
+        uint64_t value = from_bytes(pos + i * LEN_SIZE, LEN_SIZE, data);
+        if (!value) {
+            continue;
+        }
+        //  the offsets are increasing, so the entry is found with a binary search
+        uint64_t low = 0, high = n_entries;
+        while (low < high) {
+            uint64_t mid = low + (high - low) / 2;
+            if (offsets[mid] < value - 1) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (low == n_entries || offsets[low] != value - 1 || referenced[low]) {
+            goto invalid;
+        }
+        referenced[low] = 1;
+        dir->buckets[i] = low + 1;
+        n_used++;
+    }
+    if (n_used != n_entries) {
+        goto invalid;
+    }
+    //  every entry has to be reachable from the bucket of its name without crossing an empty bucket
+    for (uint64_t i = 0; i < n_buckets; i++) {
+        if (!dir->buckets[i]) {
+            continue;
+        }
+        struct dir_entry *entry = dir->entries + dir->buckets[i] - 1;
+        for (uint64_t bucket = hash_name(entry->name, entry->name_len) & (n_buckets - 1); bucket != i;
+             bucket = (bucket + 1) & (n_buckets - 1)) {
+            if (!dir->buckets[bucket]) {
+                goto invalid;
+            }
+        }
+    }
+    free(offsets);
+    free(referenced);
+    return dir;
+
+invalid:
+    free(offsets);
+    free(referenced);
+    free_directory(dir);
+    return NULL;
+}
+
+//  allocate an empty manifest of content hashes
+static struct manifest *new_manifest(void) {
+    return calloc(1, sizeof (struct manifest));
+}
+
+//  free a manifest including the names of its entries
+static void free_manifest(struct manifest *manifest) {
+    if (!manifest) {
+        return;
+    }
+    for (uint64_t i = 0; i < manifest->n_entries; i++) {
+        free(manifest->entries[i].name);
+    }
+    free(manifest->entries);
+    free(manifest);
+}
+
+//  add the hash of the content of the next entry of the archive to the manifest
+static int manifest_add(struct manifest *manifest, const char *name, uint64_t name_len, const unsigned char *hash) {
+    if (manifest->n_entries == manifest->capacity) {
+        uint64_t capacity = manifest->capacity ? manifest->capacity * 2 : 64;
+        struct hash_entry *entries = realloc(manifest->entries, capacity * sizeof (struct hash_entry));
+        if (!entries) {
+            return 1;
+        }
+        manifest->entries = entries;
+        manifest->capacity = capacity;
+    }
+    struct hash_entry *entry = manifest->entries + manifest->n_entries;
+    entry->name = malloc(name_len + 1);
+    if (!entry->name) {
+        return 1;
+    }
+    bytes_cpy(name, entry->name, name_len);
+    *(entry->name + name_len) = 0;
+    entry->name_len = name_len;
+    memcpy(entry->hash, hash, HASH_LEN);
+    manifest->n_entries++;
+    return 0;
+}
+
+//  serialize the manifest as a section of the main file
+//  content: number of entries, the entries (length of filename, filename, BLAKE3 hash of the file-content)
+static char *serialize_manifest(const struct manifest *manifest, uint64_t *len) {
+    uint64_t content_len = LEN_SIZE;
+    for (uint64_t i = 0; i < manifest->n_entries; i++) {
+        content_len += LEN_SIZE + manifest->entries[i].name_len + HASH_LEN;
+    }
+    *len = LEN_SIZE * 2 + content_len;
+    char *section = malloc(*len);
+    if (!section) {
+        return NULL;
+    }
+    store_bytes(SECTION_HASHES, LEN_SIZE, section);
+    store_bytes(content_len, LEN_SIZE, section + LEN_SIZE);
+    store_bytes(manifest->n_entries, LEN_SIZE, section + LEN_SIZE * 2);
+    uint64_t pos = LEN_SIZE * 3;
+    for (uint64_t i = 0; i < manifest->n_entries; i++) {
+        const struct hash_entry *entry = manifest->entries + i;
+        store_bytes(entry->name_len, LEN_SIZE, section + pos);
+        pos += LEN_SIZE;
+        bytes_cpy(entry->name, section + pos, entry->name_len);
+        pos += entry->name_len;
+        memcpy(section + pos, entry->hash, HASH_LEN);
+        pos += HASH_LEN;
+    }
+    return section;
+}
+
+//  parse the content of the manifest section, returns NULL if it is invalid
+static struct manifest *parse_manifest(const char *data, uint64_t len) {
+    if (len < LEN_SIZE) {
+        return NULL;
+    }
+    struct manifest *manifest = new_manifest();
+    if (!manifest) {
+        return NULL;
+    }
+    uint64_t n_entries = from_bytes(0, LEN_SIZE, data);
+    uint64_t pos = LEN_SIZE;
+    for (uint64_t i = 0; i < n_entries; i++) {
+        if (len - pos < LEN_SIZE) {
+            free_manifest(manifest);
+            return NULL;
+        }
+        uint64_t name_len = from_bytes(pos, LEN_SIZE, data);
+        pos += LEN_SIZE;
+        if (name_len > MAX_NAME_LEN || len - pos < name_len + HASH_LEN
+            || manifest_add(manifest, data + pos, name_len, (const unsigned char *) data + pos + name_len)) {
+            free_manifest(manifest);
+            return NULL;
+        }
+        pos += name_len + HASH_LEN;
+    }
+    if (pos != len) {
+        free_manifest(manifest);
+        return NULL;
+    }
+    return manifest;
+}
+
+//  get the time of the monotonic clock in ns
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//  get the start time of a timed phase, which is only needed if statistics are collected
+static uint64_t stats_clock(void) {
+    return stats.enabled ? now_ns() : 0;
+}
+
+//  add the time since the given start time to a phase
+static void stats_add(enum stats_phase phase, uint64_t since) {
+    if (stats.enabled) {
+        stats.phases[phase] += now_ns() - since;
+    }
+}
+
+//  count an encoded or extracted file with the given (original) length
+static void stats_entry(uint64_t len) {
+    stats.entries++;
+    if (len > stats.largest_entry) {
+        stats.largest_entry = len;
+    }
+}
+
+//  count a data-file, that was opened at the given time and is closed now
+static void stats_partition(uint64_t since) {
+    if (!stats.enabled) {
+        return;
+    }
+    uint64_t us = (now_ns() - since) / 1000;
+    unsigned n_buckets = sizeof (stats.latency) / sizeof (uint64_t);
+    unsigned bucket = 0;
+    while (bucket + 1 < n_buckets && us >= (uint64_t) 1 << bucket) {
+        bucket++;
+    }
+    stats.latency[bucket]++;
+    stats.partitions++;
+}
+
+//  print the statistics of the run as a single line of JSON to the standard error, after everything else was printed
+//  the progress messages stay on the standard output, so the JSON can be piped on its own ('2>&1 >/dev/null | jq')
+//  the line is assembled in memory first and written at once
+static void print_stats(const char *mode, int err) {
+    if (!stats.enabled) {
+        return;
+    }
+    static const char *phase_names[] = {"scan", "read", "write", "close", "main_file"};
+    double wall = (now_ns() - stats.start) / 1e9;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    //  ru_maxrss is in KiB on Linux and in bytes on macOS
+#ifdef __APPLE__
+    long max_rss = usage.ru_maxrss / 1024;
+#else
+    long max_rss = usage.ru_maxrss;
+#endif
+    char *line = NULL;
+    size_t line_len = 0;
+    FILE *out = open_memstream(&line, &line_len);
+    if (!out) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return;
+    }
+
+    fprintf(out, "{\"mode\":\"%s\",\"success\":%s,\"wall_s\":%.6f,\"phases_s\":{", mode, err ? "false" : "true", wall);
+    for (unsigned i = 0; i < N_PHASES; i++) {
+        fprintf(out, "%s\"%s\":%.6f", i ? "," : "", phase_names[i], stats.phases[i] / 1e9);
+    }
+    fprintf(out, "},\"bytes_read\":%llu,\"bytes_written\":%llu,\"entries\":%llu,\"largest_entry\":%llu,"
+                    "\"partitions\":%llu,\"partition_latency_us\":[",
+            (unsigned long long) stats.bytes_read, (unsigned long long) stats.bytes_written,
+            (unsigned long long) stats.entries, (unsigned long long) stats.largest_entry,
+            (unsigned long long) stats.partitions);
+    //  only the buckets that are not empty are listed, the last bucket is open-ended
+    unsigned n_buckets = sizeof (stats.latency) / sizeof (uint64_t);
+    const char *separator = "";
+    for (unsigned i = 0; i < n_buckets; i++) {
+        if (!stats.latency[i]) {
+            continue;
+        }
+        if (i + 1 < n_buckets) {
+            fprintf(out, "%s{\"lt\":%llu,\"count\":%llu}", separator, (unsigned long long) 1 << i,
+                    (unsigned long long) stats.latency[i]);
+        } else {
+            fprintf(out, "%s{\"lt\":null,\"count\":%llu}", separator, (unsigned long long) stats.latency[i]);
+        }
+        separator = ",";
+    }
+    fprintf(out, "],\"peak_rss_kib\":%ld,\"throughput_mib_s\":%.1f}\n", max_rss,
+            wall > 0 ? stats.bytes_read / wall / (1024 * 1024) : 0.0);
+    if (fclose(out)) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free(line);
+        return;
+    }
+    fflush(stdout);
+    fwrite(line, 1, line_len, stderr);
+    fflush(stderr);
+    free(line);
+}
+
+//  read the clock of the trace, the time stamp counter of the CPU where there is one (it runs at a constant rate
+//  on current CPUs), reading it costs a fraction of clock_gettime, the values are converted to ns at the end
+static uint64_t trace_clock(void) {
+#if defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (value));
+    return value;
+#else
+    return now_ns();
+#endif
+}
+
+//  allocate an empty block of the trace, its events and details follow the struct
+//  the pages are mapped at once where the system supports it, instead of a page fault in the middle of the events
+static struct trace_block *trace_block(void) {
+    uint64_t size = sizeof (struct trace_block) + TRACE_BLOCK * sizeof (struct trace_event) + TRACE_DETAILS;
+#ifdef MAP_POPULATE
+    struct trace_block *block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (block == MAP_FAILED) {
+        return NULL;
+    }
+#else
+    struct trace_block *block = malloc(size);
+    if (!block) {
+        return NULL;
+    }
+#endif
+    block->next = NULL;
+    block->n_events = 0;
+    block->details_len = 0;
+    block->events = (struct trace_event *) (block + 1);
+    block->details = (char *) (block->events + TRACE_BLOCK);
+    return block;
+}
+
+//  free a block of the trace
+static void free_trace_block(struct trace_block *block) {
+#ifdef MAP_POPULATE
+    munmap(block, sizeof (struct trace_block) + TRACE_BLOCK * sizeof (struct trace_event) + TRACE_DETAILS);
+#else
+    free(block);
+#endif
+}
+
+//  create the buffer of the calling thread with its first block and register it
+static struct trace_buffer *trace_buffer(void) {
+    struct trace_buffer *buf = calloc(1, sizeof (struct trace_buffer));
+    if (!buf) {
+        return NULL;
+    }
+    buf->first = trace_block();
+    if (!buf->first) {
+        free(buf);
+        return NULL;
+    }
+    buf->last = buf->first;
+    buf->tid = __atomic_add_fetch(&trace_threads, 1, __ATOMIC_RELAXED);
+    buf->next = __atomic_load_n(&trace_buffers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_buffers, &buf->next, buf, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    trace_local = buf;
+    return buf;
+}
+
+//  record an event of the calling thread, only the raw clock and pointers are stored, the JSON is formatted at the end
+static void trace_event(char phase, const char *name, const char *detail) {
+    trace_record(phase, name, detail, trace_clock());
+}
+
+//  record a span of the calling thread that started at the given time of the trace clock and ends now
+static void trace_span(const char *name, const char *detail, uint64_t start) {
+    trace_record('B', name, detail, start);
+    trace_record('E', name, NULL, trace_clock());
+}
+
+//  record an event with the given time of the trace clock
+//  events that do not fit into memory anymore are dropped and counted
+static void trace_record(char phase, const char *name, const char *detail, uint64_t ts) {
+    struct trace_buffer *buf = trace_local;
+    if (!buf) {
+        buf = trace_buffer();
+        if (!buf) {
+            return;
+        }
+    }
+    uint64_t len = 0;
+    if (detail) {
+        len = strlen(detail);
+        if (len > TRACE_DETAIL) {
+            detail += len - TRACE_DETAIL;
+            len = TRACE_DETAIL;
+        }
+    }
+    struct trace_block *block = buf->last;
+    if (block->n_events == TRACE_BLOCK || block->details_len + len + 1 > TRACE_DETAILS) {
+        block = trace_block();
+        if (!block) {
+            buf->dropped++;
+            return;
+        }
+        buf->last->next = block;
+        buf->last = block;
+        buf->detail = NULL;
+    }
+    struct trace_event *ev = block->events + block->n_events++;
+    ev->ts = ts;
+    ev->name = name;
+    ev->phase = phase;
+    ev->detail = NULL;
+    if (detail) {
+        //  the spans of a file follow each other, so its name is only copied once
+        if (!buf->detail || buf->detail_len != len || memcmp(buf->detail, detail, len)) {
+            char *dest = block->details + block->details_len;
+            memcpy(dest, detail, len);
+            dest[len] = 0;
+            block->details_len += len + 1;
+            buf->detail = dest;
+            buf->detail_len = len;
+        }
+        ev->detail = buf->detail;
+    }
+}
+
+//  copy a string without its terminating null byte to dest, returns its length
+static uint32_t format_str(char *dest, const char *str) {
+    uint32_t len = strlen(str);
+    memcpy(dest, str, len);
+    return len;
+}
+
+//  format a number in decimal into dest, returns the number of digits
+static uint32_t format_uint(char *dest, uint64_t value) {
+    char digits[20];
+    uint32_t n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    for (uint32_t i = 0; i < n; i++) {
+        dest[i] = digits[n - 1 - i];
+    }
+    return n;
+}
+
+//  format a string as a JSON string into dest, quotes, backslashes and control characters are escaped
+//  dest needs room for 6 bytes per character and the quotes, returns the number of bytes
+static uint32_t format_json_string(char *dest, const char *str) {
+    static const char hex[] = "0123456789abcdef";
+    uint32_t n = 0;
+    dest[n++] = '"';
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\') {
+            dest[n++] = '\\';
+            dest[n++] = c;
+        } else if (c < 0x20) {
+            memcpy(dest + n, "\\u00", 4);
+            dest[n + 4] = hex[c >> 4];
+            dest[n + 5] = hex[c & 15];
+            n += 6;
+        } else {
+            dest[n++] = c;
+        }
+    }
+    dest[n++] = '"';
+    return n;
+}
+
+//  format a time of the trace in us with 3 decimals into dest, returns the number of bytes
+static uint32_t format_trace_time(char *dest, uint64_t ns) {
+    uint32_t n = format_uint(dest, ns / 1000);
+    dest[n++] = '.';
+    dest[n++] = '0' + ns / 100 % 10;
+    dest[n++] = '0' + ns / 10 % 10;
+    dest[n++] = '0' + ns % 10;
+    return n;
+}
+
+//  format an event of the trace as JSON into dest, a span that ended is written as a single complete event ('X')
+//  from its begin and end, otherwise end is NULL and the begin or end is written as it is
+//  dest needs room for 512 bytes (the longest part is an escaped detail), returns the number of bytes
+static uint32_t format_trace_event(char *dest, const struct trace_event *ev, const struct trace_event *end, const char *tid,
+                            double scale) {
+    uint64_t ns = ev->ts > trace_start ? (uint64_t) ((ev->ts - trace_start) * scale) : 0;
+    uint32_t n = format_str(dest, "\n{\"name\":\"");
+    n += format_str(dest + n, ev->name);
+    n += format_str(dest + n, "\",\"ph\":\"");
+    dest[n++] = end ? 'X' : ev->phase;
+    n += format_str(dest + n, "\",\"ts\":");
+    n += format_trace_time(dest + n, ns);
+    if (end) {
+        n += format_str(dest + n, ",\"dur\":");
+        n += format_trace_time(dest + n, end->ts > ev->ts ? (uint64_t) ((end->ts - ev->ts) * scale) : 0);
+    }
+    n += format_str(dest + n, ",\"pid\":1,\"tid\":");
+    n += format_str(dest + n, tid);
+    if (ev->detail) {
+        n += format_str(dest + n, ",\"args\":{\"file\":");
+        n += format_json_string(dest + n, ev->detail);
+        dest[n++] = '}';
+    }
+    dest[n++] = '}';
+    return n;
+}
+
+//  write the events of all threads as Chrome trace-event JSON (for chrome://tracing or Perfetto) and free them
+//  all threads that recorded events have to be finished
+static int write_trace(const char *path) {
+    //  the rate of the trace clock is measured over the whole run
+    uint64_t end = trace_clock();
+    uint64_t end_ns = now_ns();
+    double scale = end > trace_start ? (double) (end_ns - trace_start_ns) / (end - trace_start) : 1.0;
+
+    FILE *file = fopen(path, "wb");
+    char *out = file ? malloc(TRACE_OUT) : NULL;
+    if (!file) {
+        fprintf(stderr, "Could not open file '%s'.\n", path);
+        fflush(stderr);
+    } else if (!out) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        fclose(file);
+        file = NULL;
+    }
+    uint64_t dropped = 0;
+    uint64_t written_events = 0;
+    uint64_t n = 0;
+    if (file) {
+        n = format_str(out, "{\"traceEvents\":[");
+    }
+    struct trace_buffer *buf = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE);
+    while (buf) {
+        //  the events are formatted by hand into a large buffer, with fprintf most of the time of the run would be
+        //  spent here, the spans of a thread are nested, so an end closes the last begin that is still open
+        char tid[24];
+        tid[format_uint(tid, buf->tid)] = 0;
+        const struct trace_event *open[TRACE_DEPTH];
+        uint32_t depth = 0;
+        for (struct trace_block *block = buf->first; file && block; block = block->next) {
+            for (uint32_t i = 0; i < block->n_events; i++) {
+                const struct trace_event *ev = block->events + i;
+                if (ev->phase == 'B' && depth < TRACE_DEPTH) {
+                    open[depth++] = ev;
+                    continue;
+                }
+                if (n > TRACE_OUT - 512) {
+                    fwrite(out, 1, n, file);
+                    n = 0;
+                }
+                if (written_events++) {
+                    out[n++] = ',';
+                }
+                if (ev->phase == 'E' && depth && !strcmp(open[depth - 1]->name, ev->name)) {
+                    depth--;
+                    n += format_trace_event(out + n, open[depth], ev, tid, scale);
+                } else {
+                    n += format_trace_event(out + n, ev, NULL, tid, scale);
+                }
+            }
+        }
+        //  spans that did not end (e.g. after an error) are written as begins
+        for (uint32_t i = 0; file && i < depth; i++) {
+            if (n > TRACE_OUT - 512) {
+                fwrite(out, 1, n, file);
+                n = 0;
+            }
+            if (written_events++) {
+                out[n++] = ',';
+            }
+            n += format_trace_event(out + n, open[i], NULL, tid, scale);
+        }
+        for (struct trace_block *block = buf->first; block;) {
+            struct trace_block *next = block->next;
+            free_trace_block(block);
+            block = next;
+        }
+        dropped += buf->dropped;
+        struct trace_buffer *next = buf->next;
+        free(buf);
+        buf = next;
+    }
+    trace_buffers = NULL;
+    trace_local = NULL;
+    if (!file) {
+        return 1;
+    }
+    n += format_str(out + n, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    uint64_t written = fwrite(out, 1, n, file);
+    free(out);
+    if (fclose(file) || written < n) {
+        fprintf(stderr, "Could not write file '%s'.\n", path);
+        fflush(stderr);
+        return 1;
+    }
+    if (dropped) {
+        fprintf(stderr, "%llu events were dropped from the trace (out of memory).\n", (unsigned long long) dropped);
+        fflush(stderr);
+    }
+    return 0;
+}
+
+//  start the consumer threads of the sink that is given by the options
+static int start_sink(const struct fpp_options *opts) {
+    struct part_sink *s = calloc(1, sizeof (struct part_sink));
+    if (s) {
+        s->threads = calloc(opts->sink_jobs, sizeof (pthread_t));
+        s->queue = calloc(opts->sink_jobs, sizeof (char *));
+    }
+    if (!s || !s->threads || !s->queue) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        if (s) {
+            free(s->threads);
+            free(s->queue);
+            free(s);
+        }
+        return 1;
+    }
+    s->exec = opts->sink_exec;
+    s->socket_path = opts->sink_socket;
+    s->n_jobs = opts->sink_jobs;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->queued, NULL);
+    pthread_cond_init(&s->taken, NULL);
+    partition_sink = s;
+    for (unsigned i = 0; i < s->n_jobs; i++) {
+        if (pthread_create(s->threads + i, NULL, sink_worker_run, s)) {
+            fprintf(stderr, "Could not start worker thread.\n");
+            fflush(stderr);
+            finish_sink(NULL);
+            return 1;
+        }
+        s->started++;
+    }
+    return 0;
+}
+
+//  hand a complete data-file to the sink, waits while the queue is full
+//  returns 1 if a consumer failed, the encode is aborted then (the consumer reported the error already)
+static int sink_submit(const char *path) {
+    struct part_sink *s = partition_sink;
+    if (!s) {
+        return 0;
+    }
+    char *copy = strdup(path);
+    if (!copy) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    pthread_mutex_lock(&s->lock);
+    if (s->n_queued == s->n_jobs && !s->failed) {
+        TRACE_BEGIN("sink wait", path);
+        while (s->n_queued == s->n_jobs && !s->failed) {
+            pthread_cond_wait(&s->taken, &s->lock);
+        }
+        TRACE_END("sink wait");
+    }
+    int failed = s->failed;
+    if (!failed) {
+        s->queue[(s->head + s->n_queued) % s->n_jobs] = copy;
+        s->n_queued++;
+        pthread_cond_signal(&s->queued);
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (failed) {
+        free(copy);
+    }
+    return failed;
+}
+
+//  consumer thread of the sink, it takes the next queued data-file until the sink is finished
+static void *sink_worker_run(void *arg) {
+    struct part_sink *s = arg;
+    int conn = -1;
+    while (1) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->n_queued && !s->done) {
+            pthread_cond_wait(&s->queued, &s->lock);
+        }
+        if (!s->n_queued) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        char *path = s->queue[s->head];
+        s->head = (s->head + 1) % s->n_jobs;
+        s->n_queued--;
+        int skip = s->failed || s->aborted;
+        pthread_cond_signal(&s->taken);
+        pthread_mutex_unlock(&s->lock);
+
+        int err = skip ? 0 : sink_consume(s, path, &conn);
+        free(path);
+        pthread_mutex_lock(&s->lock);
+        if (err) {
+            //  the encoder might wait for a free slot of the queue
+            s->failed = 1;
+            pthread_cond_broadcast(&s->taken);
+        } else if (!skip) {
+            s->n_consumed++;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    if (conn >= 0) {
+        close(conn);
+    }
+    return NULL;
+}
+
+//  hand a single file to the sink, by running the command or by sending its path over the connection of the consumer
+//  the connection is opened for the first file and kept for the next ones
+static int sink_consume(struct part_sink *s, const char *path, int *conn) {
+    TRACE_BEGIN("sink", path);
+    int err = s->exec ? sink_exec(s->exec, path) : sink_send(s->socket_path, path, conn);
+    TRACE_END("sink");
+    return err;
+}
+
+//  write the path as a single-quoted word of the shell (a quote in the path becomes '\''), returns its length
+static uint64_t quote_path(char *dest, const char *path) {
+    uint64_t n = 0;
+    dest[n++] = '\'';
+    for (const char *c = path; *c; c++) {
+        if (*c == '\'') {
+            memcpy(dest + n, "'\\''", 4);
+            n += 4;
+        } else {
+            dest[n++] = *c;
+        }
+    }
+    dest[n++] = '\'';
+    return n;
+}
+
+//  run the command of '--sink-exec' with the shell and wait for it, it has to exit with status 0
+//  '%f' is replaced by the quoted path of the file and '%%' by '%', the path is appended if there is no '%f'
+static int sink_exec(const char *exec, const char *path) {
+    uint64_t quoted_len = 2;
+    for (const char *c = path; *c; c++) {
+        quoted_len += *c == '\'' ? 4 : 1;
+    }
+    uint64_t n_percent = 0;
+    for (const char *c = exec; *c; c++) {
+        n_percent += *c == '%';
+    }
+    char *cmd = malloc(strlen(exec) + (n_percent + 1) * quoted_len + 2);
+    if (!cmd) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    uint64_t n = 0;
+    int has_path = 0;
+    for (const char *c = exec; *c; c++) {
+        if (c[0] == '%' && c[1] == 'f') {
+            n += quote_path(cmd + n, path);
+            has_path = 1;
+            c++;
+        } else if (c[0] == '%' && c[1] == '%') {
+            cmd[n++] = '%';
+            c++;
+        } else {
+            cmd[n++] = *c;
+        }
+    }
+    if (!has_path) {
+        cmd[n++] = ' ';
+        n += quote_path(cmd + n, path);
+    }
+    cmd[n] = 0;
+
+    char *argv[] = {"sh", "-c", cmd, NULL};
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", NULL, NULL, argv, environ);
+    free(cmd);
+    if (err) {
+        fprintf(stderr, "Could not run the sink command for file '%s'.\n", path);
+        fflush(stderr);
+        return 1;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Could not wait for the sink command of file '%s'.\n", path);
+            fflush(stderr);
+            return 1;
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        fprintf(stderr, "The sink command failed for file '%s' (status %d).\n", path,
+                WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+//  send the absolute path of the file as a line over the unix socket of '--sink-socket' and wait for the reply line,
+//  'ok' means the file was taken, every other reply is reported as error
+static int sink_send(const char *socket_path, const char *path, int *conn) {
+    char *full = realpath(path, NULL);
+    if (!full || strchr(full, '\n')) {
+        fprintf(stderr, "Could not resolve the path of file '%s' for the sink.\n", path);
+        fflush(stderr);
+        free(full);
+        return 1;
+    }
+    if (*conn < 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof (struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, socket_path, strlen(socket_path));
+        *conn = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (*conn >= 0 && connect(*conn, (struct sockaddr *) &addr, sizeof (struct sockaddr_un))) {
+            close(*conn);
+            *conn = -1;
+        }
+        if (*conn < 0) {
+            fprintf(stderr, "Could not connect to the sink socket '%s'.\n", socket_path);
+            fflush(stderr);
+            free(full);
+            return 1;
+        }
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(*conn, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof (int));
+#endif
+    }
+
+    //  the path and its line break are sent together, the line break takes the place of the terminating zero
+    uint64_t len = strlen(full);
+    char *line = full;
+    line[len++] = '\n';
+    uint64_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(*conn, line + sent, len - sent, SINK_SEND_FLAGS);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        sent += n;
+    }
+    free(line);
+
+    //  the reply is read byte by byte, so nothing behind its line break is consumed
+    char reply[SINK_REPLY];
+    uint64_t n_reply = 0;
+    int complete = 0;
+    while (sent == len && n_reply < SINK_REPLY - 1) {
+        ssize_t n = recv(*conn, reply + n_reply, 1, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        if (reply[n_reply] == '\n') {
+            complete = 1;
+            break;
+        }
+        n_reply++;
+    }
+    reply[n_reply] = 0;
+    if (sent < len || !complete) {
+        fprintf(stderr, "The sink socket '%s' closed the connection for file '%s'.\n", socket_path, path);
+        fflush(stderr);
+        return 1;
+    }
+    if (strcmp(reply, "ok")) {
+        fprintf(stderr, "The sink socket '%s' rejected file '%s': %s\n", socket_path, path, reply);
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+//  wait until the consumers handled the queued data-files and stop them, then hand over the main file, so a
+//  consumer can take a complete archive once the main file arrived
+//  main_path is NULL if the encode failed, the queued data-files are dropped then
+//  returns 1 if a consumer failed
+static int finish_sink(const char *main_path) {
+    struct part_sink *s = partition_sink;
+    if (!s) {
+        return 0;
+    }
+    pthread_mutex_lock(&s->lock);
+    s->done = 1;
+    s->aborted = !main_path;
+    pthread_cond_broadcast(&s->queued);
+    pthread_mutex_unlock(&s->lock);
+    TRACE_BEGIN("sink drain", NULL);
+    for (unsigned i = 0; i < s->started; i++) {
+        pthread_join(s->threads[i], NULL);
+    }
+    TRACE_END("sink drain");
+
+    int err = s->failed;
+    if (!err && main_path) {
+        int conn = -1;
+        err = sink_consume(s, main_path, &conn);
+        if (conn >= 0) {
+            close(conn);
+        }
+        if (!err) {
+            s->n_consumed++;
+            fprintf(stdout, "Handed %llu files to the sink.\n", (unsigned long long) s->n_consumed);
+            fflush(stdout);
+        }
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->queued);
+    pthread_cond_destroy(&s->taken);
+    free(s->threads);
+    free(s->queue);
+    free(s);
+    partition_sink = NULL;
+    return err;
+}
+
+//  encode the given input files into data-files with the given maximum size and write the main file
+static int encode_files(char *out_name, struct input_walk *walk, uint64_t max_fsize, const struct fpp_options *opts) {
+    //  the resources of the encode, all of them are released at the end, whether the encode failed or not
+    int ret = 1;
+    char *f_name = NULL;
+    char *buf = NULL;
+    uint32_t *crcs = NULL;
+    struct uring *ring = NULL;
+    struct directory *dir = NULL;
+    struct directory *prev = NULL;
+    struct manifest *manifest = NULL;
+    struct dedup_index *index = NULL;
+    FILE *journal = NULL;
+    struct encoded_file *bytes = NULL;
+    struct input_file input = {NULL, NULL};
+    FILE *f_output = NULL;
+
+    uint32_t f_name_len = strlen(out_name);
+    f_name = malloc(f_name_len + 32);
+    if (!f_name) {
+        fprintf(stderr, "Could not allocate memory'.\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    //  setting up all the variables, that need to be persistent over potentially many iterations
+    //  all are adjusted within the loop to reflect the current state of the data output process
+    uint64_t written_total = 0;
+    uint64_t bytes_carry = 0;
+    uint64_t bytes_offset = 0;
+    uint32_t f_idx = 0;
+    uint64_t part_start = 0;
+
+    //  the file-contents are streamed through this buffer, so memory usage does not depend on the input size
+    buf = malloc(BUF_SIZE);
+    if (!buf) {
+        fprintf(stderr, "Could not allocate memory'.\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    //  the CRC32C of every data-file is calculated while writing it
+    uint64_t crcs_capacity = 0;
+
+    //  the io_uring backend falls back to the stdio backend if io_uring is not available
+    ring = setup_uring(opts);
+
+    //  when appending, the data-files of the archive are continued and only the main file is written again
+    //  the central directory and the checksums of the archive are extended
+    //  an incremental encode continues the archive as well, if it exists, but builds a new central directory,
+    //  the one of the archive (prev) tells which files are unchanged
+    uint32_t prev_count = 0;
+    uint64_t prev_total = 0;
+    uint64_t n_kept = 0;
+    if (opts->append || (opts->incremental && access(out_name, F_OK) == 0)) {
+        struct main_file info;
+        if (open_append(out_name, max_fsize, opts, &info)) {
+            goto cleanup;
+        }
+        dir = info.dir;
+        crcs = info.crcs;
+        manifest = info.manifest;
+        crcs_capacity = info.f_count;
+        f_idx = info.f_count;
+        written_total = info.size_total;
+        prev_count = f_idx;
+        prev_total = written_total;
+        if (opts->incremental) {
+            prev = dir;
+            dir = NULL;
+        }
+
+        //  a data-file that is not full yet is filled up first
+        if (written_total % max_fsize) {
+            snprintf(f_name, f_name_len + 32, "%s_data%u", out_name, f_idx - 1);
+            TRACE_BEGIN("open", f_name);
+            f_output = fopen(f_name, "rb+");
+            TRACE_END("open");
+            part_start = stats_clock();
+            if (!f_output || fseeko(f_output, 0, SEEK_END)) {
+                fprintf(stderr, "Could not open file '%s'.\n", f_name);
+                fflush(stderr);
+                goto cleanup;
+            }
+        }
+    }
+
+    //  the central directory is filled while encoding, if it is requested
+    //  incremental encodes need it, together with the modification times of the files
+    if ((opts->directory || opts->incremental) && !dir) {
+        dir = new_directory(max_fsize);
+        if (!dir) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            goto cleanup;
+        }
+        dir->mtimes = opts->incremental;
+    }
+    //  the manifest is filled with the hashes of the files while encoding, if they are requested
+    if (opts->hash && !manifest) {
+        manifest = new_manifest();
+        if (!manifest) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            goto cleanup;
+        }
+    }
+
+    //  the index of unique chunks is shared by all input files, if deduplication is requested
+    if (opts->dedup) {
+        index = new_dedup_index(out_name, opts);
+        if (!index) {
+            goto cleanup;
+        }
+    }
+
+    //  with '--resume', the complete data-files of an interrupted encode are kept and the encoding continues
+    //  behind them, the journal records the progress until the main file is written
+    uint64_t n_entries = 0;
+    uint64_t resume_off = 0;
+    uint64_t resume_len = 0;
+    if (opts->resume) {
+        struct encode_cursor cursor;
+        journal = open_encode_journal(out_name, walk, max_fsize, opts, dir, &cursor);
+        if (!journal) {
+            goto cleanup;
+        }
+        crcs = cursor.crcs;
+        crcs_capacity = cursor.n_parts;
+        f_idx = cursor.n_parts;
+        written_total = (uint64_t) cursor.n_parts * max_fsize;
+        n_entries = cursor.entry + (cursor.off ? 1 : 0);
+        resume_off = cursor.off;
+        resume_len = cursor.f_len;
+    }
+
+    //  the standard input is encoded chunk by chunk, it is active while its name is set
+    struct stream_input stream = {0};
+
+    //  iterate through all input files, as they are found by the walk
+    //  one file can be written in multiple iterations depending on the maximum output file size
+    while (1) {
+        //  the next chunk of the standard input is read once the previous one is written
+        //  its entry is added to the central directory after the empty chunk at the end, only then its length is known
+        if (!bytes_carry && stream.name) {
+            if (stream.finished) {
+                unsigned char hash[32];
+                if (manifest) {
+                    blake3_final(&stream.hasher, hash);
+                }
+                if ((dir && directory_add(dir, stream.name, strlen(stream.name), stream.f_len,
+                                          stream.content_start / max_fsize, stream.content_start % max_fsize, ENTRY_STREAM,
+                                          stream.orig_len)) ||
+                    (manifest && manifest_add(manifest, stream.name, strlen(stream.name), hash))) {
+                    fprintf(stderr, "Memory allocation error.\n");
+                    fflush(stderr);
+                    goto cleanup;
+                }
+                fprintf(stdout, "Extracted %llu MiB of data from the standard input.\n",
+                        (unsigned long long) stream.orig_len / (1024 * 1024));
+                fflush(stdout);
+                stats_entry(stream.orig_len);
+                memset(&stream, 0, sizeof (struct stream_input));
+            } else {
+                free_encoded_file(bytes);
+                uint64_t t = stats_clock();
+                bytes = read_stream_chunk(&stream);
+                stats_add(PHASE_READ, t);
+                if (!bytes) {
+                    goto cleanup;
+                }
+                //  only the first chunk starts with the header of the entry
+                if (bytes->content_off) {
+                    stream.content_start = written_total + bytes->content_off;
+                }
+                bytes_offset = 0;
+                stats.bytes_read += bytes->orig_len;
+            }
+        }
+
+        //  when there is no carry, the current input file needs to be closed and a new file needs to be opened
+        if (!bytes_carry && !stream.name) {
+            free_encoded_file(bytes);
+            bytes = NULL;
+            free(input.path);
+            input.path = NULL;
+            uint64_t t = stats_clock();
+            int found = next_input(walk, &input);
+            stats_add(PHASE_SCAN, t);
+            if (!found) {
+                break;
+            }
+            if (found < 0) {
+                goto cleanup;
+            }
+
+            //  '-' is the standard input, its chunks are read at the start of the next iterations
+            if (!strcmp(input.path, "-")) {
+                stream.name = opts->stdin_name ? opts->stdin_name : "stdin";
+                stream.hash = opts->hash;
+                blake3_init(&stream.hasher);
+                fprintf(stdout, "Encoding the standard input as '%s'...\n", stream.name);
+                fflush(stdout);
+                continue;
+            }
+
+            //  the data of unchanged files stays where it is in the archive, only their entry is taken over
+            //  files are unchanged if their size and modification time match the previous encode
+            struct dir_entry *old = prev ? directory_lookup(prev, input.name) : NULL;
+            if (old && old->orig_len == f_size(input.path) && old->mtime == f_mtime(input.path)) {
+                if (directory_add(dir, old->name, old->name_len, old->f_len, old->part, old->part_off, old->kind,
+                                  old->orig_len)) {
+                    fprintf(stderr, "Memory allocation error.\n");
+                    fflush(stderr);
+                    goto cleanup;
+                }
+                dir->entries[dir->n_entries - 1].mtime = old->mtime;
+                n_kept++;
+                continue;
+            }
+
+            //  encode the header of the new file, the file is traced as a whole until all of it is written
+            t = stats_clock();
+            TRACE_BEGIN("file", input.name);
+            bytes = encode_file(input.path, input.name, out_name, opts, index, written_total);
+            stats_add(PHASE_READ, t);
+            if (!bytes) {
+                fprintf(stderr, "Could not encode file '%s'.\n", input.path);
+                fflush(stderr);
+                goto cleanup;
+            }
+            bytes_offset = 0;
+            stats_entry(bytes->orig_len);
+            stats.bytes_read += bytes->orig_len;
+
+            //  the entry, that was interrupted by the resumed encode, continues behind the complete data-files
+            //  it is in the central directory and in the journal already
+            if (resume_off) {
+                if (bytes->len - bytes->content_off != resume_len || bytes->len <= resume_off) {
+                    fprintf(stderr, "The input file '%s' changed since the journal was written.\n", input.path);
+                    fflush(stderr);
+                    goto cleanup;
+                }
+                bytes_offset = resume_off;
+                resume_off = 0;
+            } else {
+                //  the file-content starts right behind its length
+                uint64_t content_start = written_total + bytes->content_off;
+                uint64_t content_len = bytes->len - bytes->content_off;
+                if (dir && directory_add(dir, input.name, strlen(input.name), content_len, content_start / max_fsize,
+                                         content_start % max_fsize, bytes->kind, bytes->orig_len)) {
+                    fprintf(stderr, "Memory allocation error.\n");
+                    fflush(stderr);
+                    goto cleanup;
+                }
+                if (journal && journal_entry(journal, input.name, content_len, content_start / max_fsize,
+                                             content_start % max_fsize, bytes->kind, bytes->orig_len)) {
+                    goto cleanup;
+                }
+                if (dir && dir->mtimes) {
+                    dir->entries[dir->n_entries - 1].mtime = f_mtime(input.path);
+                }
+                n_entries++;
+            }
+        }
+
+        //  the current input file must not be NULL at this point
+        if (!bytes) {
+            fprintf(stderr, "Error, memory is not allocated.");
+            fflush(stderr);
+            goto cleanup;
+        }
+
+        //  calculating how many bytes are left to write in the same file
+        uint64_t bytes_left = max_fsize - (written_total % max_fsize);
+        if (bytes_left < bytes->len - bytes_offset) {
+            bytes_carry = bytes->len - bytes_offset - bytes_left;
+        } else {
+            bytes_carry = 0;
+        }
+
+        //  when the current input file is shorter than the remaining filesize, only write as much as needed
+        uint64_t write_n = bytes_left;
+        if (bytes->len - bytes_offset < bytes_left) {
+            write_n = bytes->len - bytes_offset;
+        }
+
+        //  check if new output file needs to be created
+        if (bytes_left == max_fsize) {
+            //  close the currently open file
+            if (f_output) {
+                uint64_t t = stats_clock();
+                TRACE_BEGIN("fclose", f_name);
+                fclose(f_output);
+                TRACE_END("fclose");
+                stats_add(PHASE_CLOSE, t);
+                stats_partition(part_start);
+                f_output = NULL;
+
+                //  the complete data-file is handed to the sink while the next one is written
+                if (sink_submit(f_name)) {
+                    goto cleanup;
+                }
+            }
+
+            //  setting up the filename of the new data file
+            snprintf(f_name, f_name_len + 32, "%s_data%u", out_name, f_idx);
+
+            //  grow the array of checksums for the new file
+            if (f_idx == crcs_capacity) {
+                crcs_capacity = crcs_capacity ? crcs_capacity * 2 : 16;
+                uint32_t *new_crcs = realloc(crcs, crcs_capacity * sizeof (uint32_t));
+                if (!new_crcs) {
+                    fprintf(stderr, "Memory allocation error.\n");
+                    fflush(stderr);
+                    goto cleanup;
+                }
+                crcs = new_crcs;
+            }
+            crcs[f_idx] = 0;
+
+            //  open the new file
+            TRACE_BEGIN("open", f_name);
+            f_output = fopen(f_name, "wb+");
+            TRACE_END("open");
+            part_start = stats_clock();
+            if (!f_output) {
+                fprintf(stderr, "Could not open file '%s'.\n", f_name);
+                fflush(stderr);
+                goto cleanup;
+            }
+            f_idx++;
+        }
+
+        //  the output file must be open at this point
+        if (!f_output) {
+            fprintf(stderr, "Error, output file is not open.");
+            fflush(stderr);
+            goto cleanup;
+        }
+
+        //  write the actual output data until everything is written, or until max file size is reached
+        uint64_t written;
+        if (!stream.name) {
+            fprintf(stdout, "Writing %llu MiB to file '%s'.\n", (unsigned long long) write_n / (1024 * 1024), f_name);
+            fflush(stdout);
+        }
+        uint64_t t = stats_clock();
+        written = write_encoded(bytes, bytes_offset, write_n, f_output, buf, ring, opts->no_checksums ? NULL : crcs + f_idx - 1);
+        stats_add(PHASE_WRITE, t);
+        stats.bytes_written += written;
+        if (written < write_n) {
+            fprintf(stderr, "Could not write to file '%s'.\n", f_name);
+            fflush(stderr);
+            goto cleanup;
+        }
+
+        //  adjust how many bytes were written
+        written_total += written;
+        bytes_offset += written;
+
+        if (!stream.name && bytes_offset == bytes->len) {
+            TRACE_END("file");
+        }
+
+        //  the content hash of a raw file is only known once all of its content is written
+        if (manifest && !stream.name && bytes_offset == bytes->len
+            && manifest_add(manifest, input.name, strlen(input.name), bytes->hash)) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            goto cleanup;
+        }
+
+        //  a complete data-file is recorded in the journal, with the position where the next one continues
+        if (journal && written_total % max_fsize == 0) {
+            int finished = bytes_offset == bytes->len;
+            if (fflush(f_output) || journal_part(journal, f_idx - 1, crcs[f_idx - 1], n_entries - !finished,
+                                                 finished ? 0 : bytes_offset, n_entries)) {
+                goto cleanup;
+            }
+        }
+    }
+
+    //  close the last data-file and hand it to the sink
+    if (f_output) {
+        uint64_t t = stats_clock();
+        TRACE_BEGIN("fclose", f_name);
+        fclose(f_output);
+        TRACE_END("fclose");
+        f_output = NULL;
+        stats_add(PHASE_CLOSE, t);
+        stats_partition(part_start);
+        if (sink_submit(f_name)) {
+            goto cleanup;
+        }
+    }
+
+    //  an incremental encode reports the data-files that changed, only these and the main file need to be uploaded again
+    //  the data of outdated files stays in the archive, so the data-files behind them are not shifted
+    uint64_t n_outdated = prev ? prev->n_entries - n_kept : 0;
+    uint64_t live_total = 0;
+    for (uint64_t i = 0; prev && i < dir->n_entries; i++) {
+        live_total += LEN_SIZE * 2 + dir->entries[i].name_len + dir->entries[i].f_len;
+    }
+
+    //  write the main output file, containing the information about the other files
+    struct main_file info = {f_idx, written_total, dir, opts->no_checksums ? NULL : crcs, manifest};
+    uint64_t t = stats_clock();
+    TRACE_BEGIN("main file write", out_name);
+    int err = write_main_file(out_name, &info);
+    TRACE_END("main file write");
+    stats_add(PHASE_MAIN_FILE, t);
+    if (err) {
+        goto cleanup;
+    }
+
+    //  the journal is not needed anymore, once the main file is written
+    if (opts->resume) {
+        uint64_t path_len = strlen(out_name) + 32;
+        char path[path_len];
+        snprintf(path, path_len, "%s.journal", out_name);
+        unlink(path);
+    }
+
+    if (opts->incremental && prev_total) {
+        fprintf(stdout, "Kept %llu unchanged files, %llu files of the archive are outdated.\n", (unsigned long long) n_kept,
+                (unsigned long long) n_outdated);
+        uint32_t first = written_total > prev_total && prev_total % max_fsize ? prev_count - 1 : prev_count;
+        for (uint32_t i = first; i < f_idx; i++) {
+            fprintf(stdout, "Changed data-file '%s_data%u'.\n", out_name, i);
+        }
+        if (written_total > prev_total || n_outdated) {
+            fprintf(stdout, "Changed main file '%s'.\n", out_name);
+        }
+        if (live_total < written_total) {
+            fprintf(stdout, "%llu bytes of the data-files belong to outdated files, encode without '--incremental' to remove them.\n",
+                    (unsigned long long) (written_total - live_total));
+        }
+    }
+
+    fprintf(stdout, "Successfully wrote %llu bytes to %u files.\n", (unsigned long long) written_total, f_idx);
+    fflush(stdout);
+    ret = 0;
+
+cleanup:
+    free_encoded_file(bytes);
+    free(input.path);
+    if (f_output) {
+        fclose(f_output);
+    }
+    close_journal(journal);
+    free_dedup_index(index);
+    free_manifest(manifest);
+    free_directory(prev);
+    free_directory(dir);
+    uring_free(ring);
+    free(crcs);
+    free(buf);
+    free(f_name);
+    return ret;
+}
+
+//  read the main file of the archive that is appended to and check that its data-files fit the given max. filesize
+//  every data-file except the last one has to be full, the last one is cut at the size listed in the main file,
+//  since it can contain the data of an append that was interrupted before the main file was written
+static int open_append(char *out_name, uint64_t max_fsize, const struct fpp_options *opts, struct main_file *info) {
+    if (read_main_file(out_name, info)) {
+        return 1;
+    }
+    if (info->f_count && !info->crcs) {
+        fprintf(stderr, "The archive '%s' has no checksums (written by an older version or with '--no-checksums'), it can "
+                        "not be appended to.\n", out_name);
+        fflush(stderr);
+        free_main_file(info);
+        return 1;
+    }
+    if (opts->directory && !info->dir) {
+        fprintf(stderr, "The archive '%s' has no central directory, '--directory' can not be used to append to it.\n",
+                out_name);
+        fflush(stderr);
+        free_main_file(info);
+        return 1;
+    }
+    //  the hashes of the appended files are only known with '--hash', the manifest has to list all entries
+    if (opts->hash && !info->manifest) {
+        fprintf(stderr, "The archive '%s' has no content hashes, '--hash' can not be used to append to it.\n", out_name);
+        fflush(stderr);
+        free_main_file(info);
+        return 1;
+    }
+    if (opts->append && !opts->hash && info->manifest) {
+        fprintf(stderr, "The archive '%s' has content hashes, '--hash' is needed to append to it.\n", out_name);
+        fflush(stderr);
+        free_main_file(info);
+        return 1;
+    }
+    if (opts->incremental && (!info->dir || !info->dir->mtimes)) {
+        fprintf(stderr, "The archive '%s' was not encoded with '--incremental'.\n", out_name);
+        fflush(stderr);
+        free_main_file(info);
+        return 1;
+    }
+    if ((info->dir && info->dir->max_fsize != max_fsize) ||
+        (info->f_count > 1 && max_fsize > info->size_total / (info->f_count - 1))) {
+        fprintf(stderr, "The archive '%s' was encoded with a different max. output filesize.\n", out_name);
+        fflush(stderr);
+        free_main_file(info);
+        return 1;
+    }
+
+    uint32_t f_name_len = strlen(out_name) + 32;
+    char f_name[f_name_len];
+    for (uint64_t i = 0; i < info->f_count; i++) {
+        snprintf(f_name, f_name_len, "%s_data%llu", out_name, (unsigned long long) i);
+        uint64_t expected = i + 1 < info->f_count ? max_fsize : info->size_total - i * max_fsize;
+        struct stat f_info;
+        if (stat(f_name, &f_info)) {
+            fprintf(stderr, "Error, can not access file '%s'.\n", f_name);
+            fflush(stderr);
+            free_main_file(info);
+            return 1;
+        }
+        if ((uint64_t) f_info.st_size < expected || expected > max_fsize ||
+            (i + 1 < info->f_count && (uint64_t) f_info.st_size != expected)) {
+            fprintf(stderr, "The archive '%s' was encoded with a different max. output filesize or is corrupted.\n",
+                    out_name);
+            fflush(stderr);
+            free_main_file(info);
+            return 1;
+        }
+        if ((uint64_t) f_info.st_size > expected) {
+            fprintf(stdout, "Removing %llu bytes of an interrupted append from file '%s'.\n",
+                    (unsigned long long) (f_info.st_size - expected), f_name);
+            fflush(stdout);
+            if (truncate(f_name, expected)) {
+                fprintf(stderr, "Could not write to file '%s'.\n", f_name);
+                fflush(stderr);
+                free_main_file(info);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+//  append a record to a journal, the record reaches the file before the function returns,
+//  so it survives if the process is killed
+static int append_journal(FILE *journal, uint64_t type, const char *content, uint64_t len) {
+    char fields[16];
+    store_bytes(type, LEN_SIZE, fields);
+    store_bytes(len, LEN_SIZE, fields + LEN_SIZE);
+    if (fwrite64(fields, LEN_SIZE * 2, journal) < LEN_SIZE * 2 || fwrite64(content, len, journal) < len || fflush(journal)) {
+        fprintf(stderr, "Could not write the journal.\n");
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+//  locate the record of a journal at the given position, returns the position of its content
+//  or 0 if there is no complete record (the last record might be incomplete, if the process was killed)
+static uint64_t next_journal_record(const struct byte_string *journal, uint64_t pos, uint64_t *type, uint64_t *len) {
+    if (journal->len < LEN_SIZE * 2 || pos > journal->len - LEN_SIZE * 2) {
+        return 0;
+    }
+    *type = from_bytes(pos, LEN_SIZE, journal->data);
+    *len = from_bytes(pos + LEN_SIZE, LEN_SIZE, journal->data);
+    if (*len > journal->len - pos - LEN_SIZE * 2) {
+        return 0;
+    }
+    return pos + LEN_SIZE * 2;
+}
+
+//  read a journal, returns NULL if it does not exist
+static struct byte_string *read_journal(char *path) {
+    if (access(path, F_OK) == -1) {
+        return NULL;
+    }
+    struct byte_string *journal = read_bytes(path);
+    if (!journal) {
+        fprintf(stderr, "Could not read file '%s'.\n", path);
+        fflush(stderr);
+    }
+    return journal;
+}
+
+//  free a journal that was read
+static void free_journal(struct byte_string *journal) {
+    if (journal) {
+        free(journal->data);
+        free(journal);
+    }
+}
+
+//  close a journal that is written
+static void close_journal(FILE *journal) {
+    if (journal) {
+        fclose(journal);
+    }
+}
+
+//  check that a data-file has the given length and checksum
+static int check_partition(char *f_name, uint64_t len, uint32_t crc, char *buf) {
+    struct stat f_info;
+    if (stat(f_name, &f_info) || (uint64_t) f_info.st_size != len) {
+        return 1;
+    }
+    int fd = open(f_name, O_RDONLY);
+    if (fd < 0) {
+        return 1;
+    }
+    uint32_t actual = 0;
+    int err = checksum_range(fd, 0, len, buf, &actual) || actual != crc;
+    close(fd);
+    return err;
+}
+
+//  open the journal of the encoder, which is written next to the main file while encoding with '--resume'
+//  if there is a journal of an interrupted encode with the same options and inputs, the data-files it lists are
+//  checked and the longest complete prefix of them is kept, the cursor tells where the encoding continues
+//  the entries in front of the cursor are added to the central directory again
+static FILE *open_encode_journal(char *out_name, struct input_walk *walk, uint64_t max_fsize, const struct fpp_options *opts,
+                          struct directory *dir, struct encode_cursor *cursor) {
+    memset(cursor, 0, sizeof (struct encode_cursor));
+    uint64_t path_len = strlen(out_name) + 32;
+    char path[path_len];
+    snprintf(path, path_len, "%s.journal", out_name);
+
+    //  the header identifies the encode, it holds the layout options and a checksum of the inputs
+    char header[40];
+    uint32_t args_crc = 0;
+    for (uint32_t i = 0; i < walk->n_args; i++) {
+        args_crc = crc32c(args_crc, walk->args[i], strlen(walk->args[i]) + 1);
+    }
+    store_bytes(max_fsize, LEN_SIZE, header);
+    store_bytes(opts->compress, LEN_SIZE, header + LEN_SIZE);
+    store_bytes(opts->directory, LEN_SIZE, header + LEN_SIZE * 2);
+    store_bytes(walk->n_args, LEN_SIZE, header + LEN_SIZE * 3);
+    store_bytes(args_crc, LEN_SIZE, header + LEN_SIZE * 4);
+
+    struct byte_string *journal = read_journal(path);
+    uint64_t type;
+    uint64_t len;
+    uint64_t pos = journal ? next_journal_record(journal, 0, &type, &len) : 0;
+    if (!journal || !pos || type != JOURNAL_HEADER || len != sizeof (header) || memcmp(journal->data + pos, header, len)) {
+        if (journal && pos) {
+            fprintf(stderr, "The journal '%s' belongs to a different encode, remove it to start over.\n", path);
+            fflush(stderr);
+            free_journal(journal);
+            return NULL;
+        }
+        free_journal(journal);
+        FILE *file = fopen(path, "wb");
+        if (!file || append_journal(file, JOURNAL_HEADER, header, sizeof (header))) {
+            fprintf(stderr, "Could not open file '%s'.\n", path);
+            fflush(stderr);
+            close_journal(file);
+            return NULL;
+        }
+        return file;
+    }
+
+    //  keep the data-files that are complete, in order, the journal is cut behind the last one
+    char *buf = malloc(BUF_SIZE);
+    uint64_t n_records = 0;
+    uint64_t capacity = 0;
+    uint64_t *entries = NULL;
+    uint64_t keep = pos + len;
+    uint64_t n_kept = 0;
+    uint64_t n_entries = 0;
+    uint32_t f_name_len = strlen(out_name) + 32;
+    char f_name[f_name_len];
+    int err = !buf;
+    for (pos = keep; !err && (pos = next_journal_record(journal, pos, &type, &len)); pos += len) {
+        if (type == JOURNAL_ENTRY) {
+            if (n_records == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                uint64_t *new_entries = realloc(entries, capacity * sizeof (uint64_t));
+                if (!new_entries) {
+                    err = 1;
+                    break;
+                }
+                entries = new_entries;
+            }
+            entries[n_records++] = pos;
+            continue;
+        }
+        if (type != JOURNAL_PART || len != LEN_SIZE * 5) {
+            break;
+        }
+        uint64_t part = from_bytes(pos, LEN_SIZE, journal->data);
+        uint32_t crc = from_bytes(pos + LEN_SIZE, LEN_SIZE, journal->data);
+        snprintf(f_name, f_name_len, "%s_data%llu", out_name, (unsigned long long) part);
+        if (part != cursor->n_parts || check_partition(f_name, max_fsize, crc, buf)) {
+            break;
+        }
+        uint32_t *crcs = realloc(cursor->crcs, (part + 1) * sizeof (uint32_t));
+        if (!crcs) {
+            err = 1;
+            break;
+        }
+        cursor->crcs = crcs;
+        cursor->crcs[cursor->n_parts++] = crc;
+        cursor->entry = from_bytes(pos + LEN_SIZE * 2, LEN_SIZE, journal->data);
+        cursor->off = from_bytes(pos + LEN_SIZE * 3, LEN_SIZE, journal->data);
+        n_entries = from_bytes(pos + LEN_SIZE * 4, LEN_SIZE, journal->data);
+        n_kept = n_records;
+        keep = pos + len;
+    }
+    free(buf);
+    if (err || n_kept != n_entries || n_entries != cursor->entry + (cursor->off ? 1 : 0)) {
+        fprintf(stderr, err ? "Memory allocation error.\n" : "The journal '%s' is corrupted, remove it to start over.\n", path);
+        fflush(stderr);
+        free(entries);
+        free(cursor->crcs);
+        free_journal(journal);
+        return NULL;
+    }
+
+    //  the entries in front of the cursor are checked against the inputs, while the inputs are skipped
+    for (uint64_t i = 0; i < n_kept; i++) {
+        const char *rec = journal->data + entries[i];
+        uint64_t name_len = from_bytes(0, LEN_SIZE, rec);
+        const char *name = rec + LEN_SIZE;
+        const char *fields = name + name_len;
+        if (dir && directory_add(dir, name, name_len, from_bytes(0, LEN_SIZE, fields), from_bytes(LEN_SIZE, LEN_SIZE, fields),
+                                 from_bytes(LEN_SIZE * 2, LEN_SIZE, fields), from_bytes(LEN_SIZE * 3, LEN_SIZE, fields),
+                                 from_bytes(LEN_SIZE * 4, LEN_SIZE, fields))) {
+            err = 1;
+            break;
+        }
+        if (i == cursor->entry) {
+            cursor->f_len = from_bytes(0, LEN_SIZE, fields);
+            break;
+        }
+        struct input_file input;
+        if (next_input(walk, &input) <= 0) {
+            err = 1;
+            break;
+        }
+        int same = strlen(input.name) == name_len && !memcmp(input.name, name, name_len) &&
+                   access(input.path, R_OK) == 0 && f_size(input.path) == from_bytes(LEN_SIZE * 4, LEN_SIZE, fields);
+        free(input.path);
+        if (!same) {
+            fprintf(stderr, "The inputs changed since the journal '%s' was written, remove it to start over.\n", path);
+            fflush(stderr);
+            err = 1;
+            break;
+        }
+    }
+    free(entries);
+    free_journal(journal);
+    if (err) {
+        free(cursor->crcs);
+        return NULL;
+    }
+
+    FILE *file = NULL;
+    if (truncate(path, keep) == 0) {
+        file = fopen(path, "ab");
+    }
+    if (!file) {
+        fprintf(stderr, "Could not open file '%s'.\n", path);
+        fflush(stderr);
+        free(cursor->crcs);
+        return NULL;
+    }
+    fprintf(stdout, "Resuming after %u complete data-files.\n", cursor->n_parts);
+    fflush(stdout);
+    return file;
+}
+
+//  record an entry in the journal of the encoder, with the fields of its directory entry
+static int journal_entry(FILE *journal, const char *name, uint64_t f_len, uint64_t part, uint64_t part_off, enum entry_kind kind,
+                  uint64_t orig_len) {
+    uint64_t name_len = strlen(name);
+    uint64_t len = LEN_SIZE * 6 + name_len;
+    char *rec = malloc(len);
+    if (!rec) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    store_bytes(name_len, LEN_SIZE, rec);
+    bytes_cpy(name, rec + LEN_SIZE, name_len);
+    char *fields = rec + LEN_SIZE + name_len;
+    store_bytes(f_len, LEN_SIZE, fields);
+    store_bytes(part, LEN_SIZE, fields + LEN_SIZE);
+    store_bytes(part_off, LEN_SIZE, fields + LEN_SIZE * 2);
+    store_bytes(kind, LEN_SIZE, fields + LEN_SIZE * 3);
+    store_bytes(orig_len, LEN_SIZE, fields + LEN_SIZE * 4);
+    int err = append_journal(journal, JOURNAL_ENTRY, rec, len);
+    free(rec);
+    return err;
+}
+
+//  record a complete data-file in the journal of the encoder
+//  the cursor is the index of the entry, that continues in the next data-file, and the offset in it,
+//  n_entries is the number of entries that were recorded so far
+static int journal_part(FILE *journal, uint32_t part, uint32_t crc, uint64_t entry, uint64_t off, uint64_t n_entries) {
+    char rec[40];
+    store_bytes(part, LEN_SIZE, rec);
+    store_bytes(crc, LEN_SIZE, rec + LEN_SIZE);
+    store_bytes(entry, LEN_SIZE, rec + LEN_SIZE * 2);
+    store_bytes(off, LEN_SIZE, rec + LEN_SIZE * 3);
+    store_bytes(n_entries, LEN_SIZE, rec + LEN_SIZE * 4);
+    return append_journal(journal, JOURNAL_PART, rec, sizeof (rec));
+}
+
+//  build the partition plan for the given input files
+//  the layout of the data-files only depends on the sizes of the files and their names,
+//  so every byte of the output can be assigned to its data-file and offset before anything is written
+static struct encode_plan *plan_encode(char *out_name, struct input_walk *walk, uint64_t max_fsize, const struct fpp_options *opts) {
+    struct encode_plan *plan = calloc(1, sizeof (struct encode_plan));
+    if (!plan) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    plan->tmp_fd = -1;
+    plan->out_name = out_name;
+    plan->max_fsize = max_fsize;
+    plan->hash = opts->hash;
+    plan->checksums = !opts->no_checksums;
+
+    //  the new chunks of deduplicated files are collected in the temporary file of the index,
+    //  which is handed over to the plan once all files are deduplicated
+    struct dedup_index *index = NULL;
+    if (opts->dedup) {
+        index = new_dedup_index(out_name, opts);
+        if (!index) {
+            free_encode_plan(plan);
+            return NULL;
+        }
+    }
+
+    //  every entry starts right behind the previous one, the files are planned as they are found by the walk
+    uint32_t capacity = 0;
+    while (1) {
+        struct input_file input;
+        int found = next_input(walk, &input);
+        if (!found) {
+            break;
+        }
+        if (found < 0) {
+            free_dedup_index(index);
+            free_encode_plan(plan);
+            return NULL;
+        }
+        if (plan->n_entries == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct plan_entry *entries = realloc(plan->entries, capacity * sizeof (struct plan_entry));
+            if (!entries) {
+                fprintf(stderr, "Memory allocation error.\n");
+                fflush(stderr);
+                free(input.path);
+                free_dedup_index(index);
+                free_encode_plan(plan);
+                return NULL;
+            }
+            plan->entries = entries;
+        }
+        //  the entry owns the path from here on, so it is freed with the plan
+        struct plan_entry *entry = plan->entries + plan->n_entries++;
+        memset(entry, 0, sizeof (struct plan_entry));
+        entry->filepath = input.path;
+        entry->name = input.name;
+        fprintf(stdout, "Encoding file '%s'...\n", entry->name);
+        fflush(stdout);
+        if (access(entry->filepath, R_OK) == -1) {
+            fprintf(stderr, "Could not read file '%s'.\n", entry->filepath);
+            fflush(stderr);
+            free_dedup_index(index);
+            free_encode_plan(plan);
+            return NULL;
+        }
+        entry->f_len = f_size(entry->filepath);
+        entry->orig_len = entry->f_len;
+        if (index && plan_dedup(plan, entry, index, opts)) {
+            free_dedup_index(index);
+            free_encode_plan(plan);
+            return NULL;
+        }
+        if (opts->compress) {
+            //  the blocks of all compressed files are collected in a single temporary file
+            int res = plan_compressed(plan, entry, opts);
+            if (res < 0) {
+                free_dedup_index(index);
+                free_encode_plan(plan);
+                return NULL;
+            }
+        }
+        if (!entry->header) {
+            entry->header = encode_header(entry->name, entry->f_len, &entry->header_len);
+            entry->content_off = entry->header_len;
+            if (!entry->header) {
+                fprintf(stderr, "Memory allocation error.\n");
+                fflush(stderr);
+            }
+        }
+        //  raw files are hashed by the workers, an empty file has nothing to copy
+        int err = !entry->header;
+        if (!err && opts->hash && entry->kind == ENTRY_RAW) {
+            err = unit_hash_init(&entry->units, entry->f_len)
+                  || (!entry->f_len && hash_unit(&entry->units, 0, NULL, 0, entry->hash));
+        }
+        if (err) {
+            free_dedup_index(index);
+            free_encode_plan(plan);
+            return NULL;
+        }
+        entry->start = plan->total;
+        plan->total += entry->header_len + entry->f_len;
+    }
+    if (index) {
+        plan->tmp_fd = index->tmp_fd;
+        index->tmp_fd = -1;
+        free_dedup_index(index);
+    }
+
+    //  the data-files are filled completely, except for the last one
+    plan->n_parts = plan->total / max_fsize + (plan->total % max_fsize ? 1 : 0);
+    plan->n_tasks = plan->total / TASK_SIZE + (plan->total % TASK_SIZE ? 1 : 0);
+    return plan;
+}
+
+//  compress the file of the plan entry into the temporary file of the plan, if samples of it are compressible
+//  the header of the entry is only set if it was compressed, returns -1 on errors
+static int plan_compressed(struct encode_plan *plan, struct plan_entry *entry, const struct fpp_options *opts) {
+    int in_fd = open(entry->filepath, O_RDONLY);
+    if (in_fd < 0) {
+        fprintf(stderr, "Could not read file '%s'.\n", entry->filepath);
+        fflush(stderr);
+        return -1;
+    }
+    if (!is_compressible(in_fd, entry->f_len)) {
+        close(in_fd);
+        return 0;
+    }
+    if (plan->tmp_fd < 0) {
+        plan->tmp_fd = temp_file(plan->out_name);
+        if (plan->tmp_fd < 0) {
+            close(in_fd);
+            return -1;
+        }
+    }
+
+    uint64_t stored_total = 0;
+    uint64_t *table = compress_entry(in_fd, entry->f_len, opts, plan->tmp_fd, plan->tmp_len, &stored_total,
+                                     opts->hash ? entry->hash : NULL);
+    close(in_fd);
+    if (!table) {
+        return -1;
+    }
+    entry->header = encode_compressed_header(entry->name, entry->f_len, opts->compress, table, stored_total,
+                                             &entry->header_len);
+    free(table);
+    if (!entry->header) {
+        return -1;
+    }
+    entry->kind = ENTRY_COMPRESSED;
+    entry->content_off = LEN_SIZE * 2 + from_bytes(0, LEN_SIZE - 1, entry->header);
+    entry->src_off = plan->tmp_len;
+    entry->f_len = stored_total;
+    plan->tmp_len += stored_total;
+    return 1;
+}
+
+//  deduplicate the file of the plan entry, its new chunks are collected in the temporary file of the index
+static int plan_dedup(struct encode_plan *plan, struct plan_entry *entry, struct dedup_index *index, const struct fpp_options *opts) {
+    uint64_t stored_total = 0;
+    entry->header = dedup_file(index, entry->filepath, entry->name, entry->f_len, plan->total, &entry->header_len,
+                               &stored_total, &entry->src_off, opts->hash ? entry->hash : NULL);
+    if (!entry->header) {
+        return 1;
+    }
+    entry->kind = ENTRY_DEDUP;
+    entry->content_off = LEN_SIZE * 2 + from_bytes(0, LEN_SIZE - 1, entry->header);
+    entry->f_len = stored_total;
+    return 0;
+}
+
+//  free a partition plan, the headers and the paths of its entries
+static void free_encode_plan(struct encode_plan *plan) {
+    if (!plan) {
+        return;
+    }
+    if (plan->tmp_fd >= 0) {
+        close(plan->tmp_fd);
+    }
+    for (uint32_t i = 0; i < plan->n_entries; i++) {
+        free(plan->entries[i].header);
+        free(plan->entries[i].filepath);
+        free_unit_hash(&plan->entries[i].units);
+    }
+    free(plan->entries);
+    if (plan->task_crcs) {
+        for (uint64_t i = 0; i < plan->n_tasks; i++) {
+            free(plan->task_crcs[i].pieces);
+        }
+        free(plan->task_crcs);
+    }
+    free(plan->part_left);
+    free(plan);
+}
+
+//  copy len bytes from in_fd at in_off to out_fd at out_off without using the file positions
+//  on linux the data is copied by the kernel, otherwise (or as fallback) it is copied through the given buffer
+//  if crc is given, it is updated with the copied bytes, the data is then always copied through the buffer,
+//  since reading it again after the kernel copied it would read every input twice
+static uint64_t copy_positional(int in_fd, uint64_t in_off, int out_fd, uint64_t out_off, uint64_t len, char *buf, uint32_t *crc) {
+    uint64_t copied = 0;
+
+#ifdef __linux__
+    while (!crc && copied < len) {
+        size_t to_copy = len - copied < ZERO_COPY_CHUNK ? len - copied : ZERO_COPY_CHUNK;
+        off_t off_in = in_off + copied;
+        off_t off_out = out_off + copied;
+        ssize_t res = copy_file_range(in_fd, &off_in, out_fd, &off_out, to_copy, 0);
+        if (res > 0) {
+            copied += res;
+        } else if (res < 0 && errno == EINTR) {
+            continue;
+        } else {
+            break;
+        }
+    }
+#endif
+
+    while (copied < len) {
+        size_t to_read = len - copied < BUF_SIZE ? len - copied : BUF_SIZE;
+        ssize_t bytes_read = pread(in_fd, buf, to_read, in_off + copied);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            return copied;
+        }
+        if (pwrite_all(out_fd, buf, bytes_read, out_off + copied) < (uint64_t) bytes_read) {
+            return copied;
+        }
+        if (crc) {
+            *crc = crc32c(*crc, buf, bytes_read);
+        }
+        copied += bytes_read;
+    }
+    return copied;
+}
+
+//  write all len bytes of the buffer at the given offset, returns the number of written bytes
+static uint64_t pwrite_all(int fd, const char *buf, uint64_t len, uint64_t off) {
+    uint64_t written = 0;
+    while (written < len) {
+        ssize_t res = pwrite(fd, buf + written, len - written, off + written);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return written;
+        }
+        written += res;
+    }
+    return written;
+}
+
+//  open the data-file with the given index for writing, it needs to exist already
+//  with direct, the writes bypass the page cache (if the filesystem supports it)
+static int open_partition(struct encode_plan *plan, uint32_t idx, int direct) {
+    uint32_t f_name_len = strlen(plan->out_name) + 32;
+    char f_name[f_name_len];
+    snprintf(f_name, f_name_len, "%s_data%u", plan->out_name, idx);
+    if (direct) {
+        return open_direct(f_name, O_WRONLY, &plan->direct_warned);
+    }
+    return open(f_name, O_WRONLY);
+}
+
+//  open a file for reads or writes that bypass the page cache, O_DIRECT on linux and F_NOCACHE on macOS
+//  falls back to a buffered descriptor if the filesystem does not support it, which is reported only once
+static int open_direct(const char *filepath, int flags, int *warned) {
+#ifdef O_DIRECT
+    int fd = open(filepath, flags | O_DIRECT);
+    if (fd >= 0 || errno != EINVAL) {
+        return fd;
+    }
+    fd = open(filepath, flags);
+    if (fd >= 0 && !__atomic_exchange_n(warned, 1, __ATOMIC_RELAXED)) {
+        fprintf(stdout, "Direct I/O is not supported for '%s', falling back to buffered I/O.\n", filepath);
+        fflush(stdout);
+    }
+    return fd;
+#else
+    (void) warned;
+    int fd = open(filepath, flags);
+    if (fd >= 0) {
+        fcntl(fd, F_NOCACHE, 1);
+    }
+    return fd;
+#endif
+}
+
+//  read len bytes at the given offset of a file that was opened for direct I/O into dest
+//  the reads start at aligned offsets and go through the aligned buffer (of BUF_SIZE bytes)
+//  returns the number of bytes that were copied to dest
+static uint64_t read_direct(int fd, char *buf, char *dest, uint64_t off, uint64_t len) {
+    uint64_t copied = 0;
+    while (copied < len) {
+        uint64_t skip = (off + copied) % DIRECT_ALIGN;
+        uint64_t n = BUF_SIZE - skip;
+        if (len - copied < n) {
+            n = len - copied;
+        }
+        uint64_t to_read = (skip + n + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+        uint64_t bytes_read = pread_all(fd, buf, to_read, off + copied - skip);
+        if (bytes_read < skip + n) {
+            if (bytes_read > skip) {
+                bytes_cpy(buf + skip, dest + copied, bytes_read - skip);
+                copied += bytes_read - skip;
+            }
+            return copied;
+        }
+        bytes_cpy(buf + skip, dest + copied, n);
+        copied += n;
+    }
+    return copied;
+}
+
+//  write len bytes at the given offset, the data needs to have the same alignment in memory as the offset
+//  the aligned middle is written with direct_fd, the unaligned start and end (at most a block each) with buffered_fd
+//  returns the number of written bytes
+static uint64_t pwrite_direct(int direct_fd, int buffered_fd, const char *data, uint64_t len, uint64_t off) {
+    uint64_t head = (DIRECT_ALIGN - off % DIRECT_ALIGN) % DIRECT_ALIGN;
+    if (head > len) {
+        head = len;
+    }
+    uint64_t middle = (len - head) / DIRECT_ALIGN * DIRECT_ALIGN;
+    uint64_t tail = len - head - middle;
+    if (pwrite_all(buffered_fd, data, head, off) < head) {
+        return 0;
+    }
+    uint64_t written = pwrite_all(direct_fd, data + head, middle, off + head);
+    if (written < middle) {
+        return head + written;
+    }
+    return head + middle + pwrite_all(buffered_fd, data + head + middle, tail, off + head + middle);
+}
+
+//  append a segment of a task to the stage of the worker, the staged data is written once the task is done
+//  or a segment of another data-file follows, the checksum is calculated from the staged data
+static int stage_segment(struct encode_plan *plan, struct plan_worker *worker, uint32_t e_idx, uint64_t pos, uint64_t seg_len,
+                  uint32_t part, uint64_t part_off) {
+    struct plan_entry *entry = plan->entries + e_idx;
+    uint64_t header_end = entry->start + entry->header_len;
+    if (worker->stage_len && worker->stage_part != part && flush_stage(plan, worker)) {
+        return 1;
+    }
+    if (!worker->stage_len) {
+        worker->stage_part = part;
+        worker->stage_off = part_off;
+    }
+    char *dest = worker->stage + worker->stage_off % DIRECT_ALIGN + worker->stage_len;
+
+    if (pos < header_end) {
+        bytes_cpy(entry->header + (pos - entry->start), dest, seg_len);
+    } else if (entry->kind != ENTRY_RAW) {
+        //  the temporary file was just written, so its data is still in the page cache
+        if (pread_all(plan->tmp_fd, dest, seg_len, entry->src_off + pos - header_end) < seg_len) {
+            fprintf(stderr, "Could not read the temporary file.\n");
+            fflush(stderr);
+            return 1;
+        }
+    } else {
+        if (worker->in_fd < 0 || worker->in_entry != e_idx) {
+            if (worker->in_fd >= 0) {
+                close(worker->in_fd);
+            }
+            worker->in_entry = e_idx;
+            worker->in_fd = open_direct(entry->filepath, O_RDONLY, &plan->direct_warned);
+            if (worker->in_fd < 0) {
+                fprintf(stderr, "Could not read file '%s'.\n", entry->filepath);
+                fflush(stderr);
+                return 1;
+            }
+        }
+        if (read_direct(worker->in_fd, worker->buf, dest, pos - header_end, seg_len) < seg_len) {
+            fprintf(stderr, "Could not copy file '%s' (file changed while encoding?).\n", entry->filepath);
+            fflush(stderr);
+            return 1;
+        }
+    }
+    worker->stage_len += seg_len;
+    return 0;
+}
+
+//  write the staged data of the worker to its data-file
+static int flush_stage(struct encode_plan *plan, struct plan_worker *worker) {
+    if (!worker->stage_len) {
+        return 0;
+    }
+    uint32_t part = worker->stage_part;
+    if (worker->out_fd < 0 || worker->out_part != part) {
+        if (worker->out_fd >= 0) {
+            close(worker->out_fd);
+            close(worker->buffered_fd);
+            worker->buffered_fd = -1;
+        }
+        worker->out_part = part;
+        worker->out_fd = open_partition(plan, part, 1);
+        if (worker->out_fd >= 0) {
+            worker->buffered_fd = open_partition(plan, part, 0);
+            if (worker->buffered_fd < 0) {
+                close(worker->out_fd);
+                worker->out_fd = -1;
+            }
+        }
+        if (worker->out_fd < 0) {
+            fprintf(stderr, "Could not open file '%s_data%u'.\n", plan->out_name, part);
+            fflush(stderr);
+            return 1;
+        }
+    }
+    char *data = worker->stage + worker->stage_off % DIRECT_ALIGN;
+    if (pwrite_direct(worker->out_fd, worker->buffered_fd, data, worker->stage_len, worker->stage_off) < worker->stage_len) {
+        fprintf(stderr, "Could not write to file '%s_data%u'.\n", plan->out_name, part);
+        fflush(stderr);
+        return 1;
+    }
+    uint64_t len = worker->stage_len;
+    worker->stage_len = 0;
+    return part_written(plan, part, len);
+}
+
+//  count bytes that were written to a data-file, the data-file is handed to the sink once all of its bytes are written
+//  returns 1 if the sink failed
+static int part_written(struct encode_plan *plan, uint32_t part, uint64_t len) {
+    if (!plan->part_left || __atomic_sub_fetch(plan->part_left + part, len, __ATOMIC_ACQ_REL)) {
+        return 0;
+    }
+    uint32_t f_name_len = strlen(plan->out_name) + 32;
+    char f_name[f_name_len];
+    snprintf(f_name, f_name_len, "%s_data%u", plan->out_name, part);
+    return sink_submit(f_name);
+}
+
+//  append the checksum of a piece of a data-file to the checksums of a task
+static int add_crc_piece(struct task_crc *task_crc, const struct crc_piece *piece) {
+    if (task_crc->n_pieces == task_crc->capacity) {
+        uint64_t capacity = task_crc->capacity ? task_crc->capacity * 2 : 4;
+        struct crc_piece *pieces = realloc(task_crc->pieces, capacity * sizeof (struct crc_piece));
+        if (!pieces) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        task_crc->pieces = pieces;
+        task_crc->capacity = capacity;
+    }
+    task_crc->pieces[task_crc->n_pieces++] = *piece;
+    return 0;
+}
+
+//  write one task of the plan, which is a range of the concatenated data of all entries
+//  the range might span multiple entries and data-files, the file descriptors are cached between the segments
+//  the checksum of every data-file piece of the task is stored, they are combined once all tasks are written
+static int write_task(struct encode_plan *plan, struct plan_worker *worker, uint64_t task) {
+    uint64_t task_start = task * TASK_SIZE;
+    uint64_t pos = task_start;
+    uint64_t end = pos + TASK_SIZE < plan->total ? pos + TASK_SIZE : plan->total;
+    struct task_crc *task_crc = plan->task_crcs + task;
+    struct crc_piece piece = {0};
+    piece.part = pos / plan->max_fsize;
+
+    //  binary search for the entry that contains the start of the task
+    uint32_t lo = 0;
+    uint32_t hi = plan->n_entries - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (plan->entries[mid].start <= pos) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    uint32_t e_idx = lo;
+
+    while (pos < end) {
+        struct plan_entry *entry = plan->entries + e_idx;
+        uint64_t entry_end = entry->start + entry->header_len + entry->f_len;
+        if (pos >= entry_end) {
+            e_idx++;
+            continue;
+        }
+
+        //  the segment ends at the end of the task, the entry, its header or the data-file
+        uint32_t part = pos / plan->max_fsize;
+        uint64_t part_off = pos % plan->max_fsize;
+        uint64_t seg_end = end < entry_end ? end : entry_end;
+        uint64_t header_end = entry->start + entry->header_len;
+        if (pos < header_end && header_end < seg_end) {
+            seg_end = header_end;
+        }
+        if (plan->max_fsize - part_off < seg_end - pos) {
+            seg_end = pos + (plan->max_fsize - part_off);
+        }
+        uint64_t seg_len = seg_end - pos;
+
+        //  a new piece begins with every data-file
+        if (piece.part != part) {
+            if (add_crc_piece(task_crc, &piece)) {
+                return 1;
+            }
+            piece.part = part;
+            piece.crc = 0;
+            piece.len = 0;
+        }
+
+        //  with direct I/O, the segments are collected in the stage and written together
+        if (plan->direct) {
+            if (stage_segment(plan, worker, e_idx, pos, seg_len, part, part_off)) {
+                return 1;
+            }
+            char *staged = worker->stage + worker->stage_off % DIRECT_ALIGN + worker->stage_len - seg_len;
+            piece.crc = crc32c(piece.crc, staged, seg_len);
+            if (plan->hash && entry->kind == ENTRY_RAW && pos >= header_end
+                && hash_segment(plan, worker, e_idx, task_start, pos - header_end, staged, seg_len)) {
+                return 1;
+            }
+            piece.len += seg_len;
+            pos = seg_end;
+            continue;
+        }
+
+        //  open the data-file of the segment
+        if (worker->out_fd < 0 || worker->out_part != part) {
+            if (worker->out_fd >= 0) {
+                close(worker->out_fd);
+            }
+            worker->out_part = part;
+            worker->out_fd = open_partition(plan, part, 0);
+            if (worker->out_fd < 0) {
+                fprintf(stderr, "Could not open file '%s_data%u'.\n", plan->out_name, part);
+                fflush(stderr);
+                return 1;
+            }
+        }
+
+        if (pos < header_end) {
+            //  the header is written from memory
+            if (pwrite_all(worker->out_fd, entry->header + (pos - entry->start), seg_len, part_off) < seg_len) {
+                fprintf(stderr, "Could not write to file '%s_data%u'.\n", plan->out_name, part);
+                fflush(stderr);
+                return 1;
+            }
+            piece.crc = crc32c(piece.crc, entry->header + (pos - entry->start), seg_len);
+        } else {
+            //  the file-content is copied from the input file, the content of compressed and deduplicated files
+            //  from the temporary file
+            uint64_t content_off = pos - header_end;
+            int in_fd = plan->tmp_fd;
+            if (entry->kind != ENTRY_RAW) {
+                content_off += entry->src_off;
+            } else if (worker->in_fd < 0 || worker->in_entry != e_idx) {
+                if (worker->in_fd >= 0) {
+                    close(worker->in_fd);
+                }
+                worker->in_entry = e_idx;
+                worker->in_fd = open(entry->filepath, O_RDONLY);
+                if (worker->in_fd < 0) {
+                    fprintf(stderr, "Could not read file '%s'.\n", entry->filepath);
+                    fflush(stderr);
+                    return 1;
+                }
+            }
+            if (entry->kind == ENTRY_RAW) {
+                in_fd = worker->in_fd;
+            }
+            //  without checksums, the kernel copies the content
+            uint32_t *crc = plan->checksums ? &piece.crc : NULL;
+            int failed = 0;
+            if (plan->hash && entry->kind == ENTRY_RAW) {
+                failed = copy_hashed(plan, worker, e_idx, task_start, content_off, part_off, seg_len, crc);
+            } else {
+                failed = copy_positional(in_fd, content_off, worker->out_fd, part_off, seg_len, worker->buf, crc) < seg_len;
+            }
+            if (failed) {
+                fprintf(stderr, "Could not copy file '%s' (file changed while encoding?).\n", entry->filepath);
+                fflush(stderr);
+                return 1;
+            }
+        }
+        if (part_written(plan, part, seg_len)) {
+            return 1;
+        }
+        piece.len += seg_len;
+        pos = seg_end;
+    }
+    if (worker->unit_open && finish_unit(plan, worker)) {
+        return 1;
+    }
+    if (plan->direct && flush_stage(plan, worker)) {
+        return 1;
+    }
+    return add_crc_piece(task_crc, &piece);
+}
+
+//  copy a segment of a raw entry through the buffer of the worker, in pieces that end at the units of the hash,
+//  so every unit that is copied at once is hashed right from the buffer
+static int copy_hashed(struct encode_plan *plan, struct plan_worker *worker, uint32_t e_idx, uint64_t task_start,
+                uint64_t content_off, uint64_t part_off, uint64_t len, uint32_t *crc) {
+    for (uint64_t done = 0; done < len;) {
+        uint64_t n = HASH_TASK - (content_off + done) % HASH_TASK;
+        if (len - done < n) {
+            n = len - done;
+        }
+        if (pread_all(worker->in_fd, worker->buf, n, content_off + done) < n
+            || pwrite_all(worker->out_fd, worker->buf, n, part_off + done) < n) {
+            return 1;
+        }
+        if (crc) {
+            *crc = crc32c(*crc, worker->buf, n);
+        }
+        if (hash_segment(plan, worker, e_idx, task_start, content_off + done, worker->buf, n)) {
+            return 1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+//  hash the copied bytes of a raw entry, starting at the given offset of its content
+//  every unit is hashed by the task that contains its first byte, a unit that is not copied at once is collected in
+//  the unit buffer of the worker, the rest of a unit that continues behind the task is read by finish_unit
+static int hash_segment(struct encode_plan *plan, struct plan_worker *worker, uint32_t e_idx, uint64_t task_start,
+                 uint64_t off, const char *data, uint64_t len) {
+    struct plan_entry *entry = plan->entries + e_idx;
+    uint64_t content_start = entry->start + entry->header_len;
+    while (len) {
+        uint64_t unit = off / HASH_TASK;
+        uint64_t unit_off = off % HASH_TASK;
+        uint64_t unit_len = entry->f_len - unit * HASH_TASK < HASH_TASK ? entry->f_len - unit * HASH_TASK : HASH_TASK;
+        uint64_t n = unit_len - unit_off < len ? unit_len - unit_off : len;
+        if (content_start + unit * HASH_TASK >= task_start) {
+            const char *unit_data = data;
+            if (n < unit_len) {
+                bytes_cpy(data, worker->unit + unit_off, n);
+                unit_data = worker->unit;
+            }
+            worker->unit_open = unit_off + n < unit_len;
+            worker->unit_entry = e_idx;
+            worker->unit_idx = unit;
+            worker->unit_fill = unit_off + n;
+            if (!worker->unit_open
+                && hash_unit(&entry->units, unit, (const unsigned char *) unit_data, unit_len, entry->hash)) {
+                return 1;
+            }
+        }
+        off += n;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+//  hash the unit that the task started, but that continues behind the end of the task
+//  the task ended in the content of its entry, so the input file of the worker is still the one of the entry
+static int finish_unit(struct encode_plan *plan, struct plan_worker *worker) {
+    struct plan_entry *entry = plan->entries + worker->unit_entry;
+    uint64_t unit_start = worker->unit_idx * HASH_TASK;
+    uint64_t unit_len = entry->f_len - unit_start < HASH_TASK ? entry->f_len - unit_start : HASH_TASK;
+    uint64_t n = unit_len - worker->unit_fill;
+    char *dest = worker->unit + worker->unit_fill;
+    uint64_t read;
+    if (plan->direct) {
+        read = read_direct(worker->in_fd, worker->buf, dest, unit_start + worker->unit_fill, n);
+    } else {
+        read = pread_all(worker->in_fd, dest, n, unit_start + worker->unit_fill);
+    }
+    worker->unit_open = 0;
+    if (read < n) {
+        fprintf(stderr, "Could not copy file '%s' (file changed while encoding?).\n", entry->filepath);
+        fflush(stderr);
+        return 1;
+    }
+    return hash_unit(&entry->units, worker->unit_idx, (const unsigned char *) worker->unit, unit_len, entry->hash);
+}
+
+//  worker thread of the parallel encoder, it takes the next task of the plan until all tasks are written
+static void *plan_worker_run(void *arg) {
+    struct plan_worker *worker = arg;
+    struct encode_plan *plan = worker->plan;
+    while (!__atomic_load_n(&plan->failed, __ATOMIC_RELAXED)) {
+        uint64_t task = __atomic_fetch_add(&plan->next_task, 1, __ATOMIC_RELAXED);
+        if (task >= plan->n_tasks) {
+            break;
+        }
+        TRACE_BEGIN("write task", NULL);
+        if (write_task(plan, worker, task)) {
+            __atomic_store_n(&plan->failed, 1, __ATOMIC_RELAXED);
+        }
+        TRACE_END("write task");
+    }
+    if (worker->in_fd >= 0) {
+        close(worker->in_fd);
+    }
+    if (worker->out_fd >= 0 && close(worker->out_fd)) {
+        __atomic_store_n(&plan->failed, 1, __ATOMIC_RELAXED);
+    }
+    if (worker->buffered_fd >= 0 && close(worker->buffered_fd)) {
+        __atomic_store_n(&plan->failed, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+//  encode the given input files with multiple threads
+//  the complete layout is planned first, then the tasks of the plan are written concurrently with pread / pwrite
+//  the output is identical to the one of the serial encoder
+static int encode_files_parallel(char *out_name, struct input_walk *walk, uint64_t max_fsize, const struct fpp_options *opts) {
+    uint64_t t = stats_clock();
+    TRACE_BEGIN("plan", NULL);
+    struct encode_plan *plan = plan_encode(out_name, walk, max_fsize, opts);
+    TRACE_END("plan");
+    stats_add(PHASE_SCAN, t);
+    if (!plan) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < plan->n_entries; i++) {
+        stats_entry(plan->entries[i].orig_len);
+        stats.bytes_read += plan->entries[i].orig_len;
+    }
+
+    //  create (and truncate) all data-files up front, so the workers can write to them in any order
+    uint32_t f_name_len = strlen(out_name) + 32;
+    char f_name[f_name_len];
+    for (uint32_t i = 0; i < plan->n_parts; i++) {
+        snprintf(f_name, f_name_len, "%s_data%u", out_name, i);
+        int fd = open(f_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "Could not open file '%s'.\n", f_name);
+            fflush(stderr);
+            free_encode_plan(plan);
+            return 1;
+        }
+        close(fd);
+    }
+
+    //  with a sink, the workers hand every data-file over as soon as all of its bytes are written
+    if (partition_sink) {
+        plan->part_left = malloc((plan->n_parts ? plan->n_parts : 1) * sizeof (uint64_t));
+        if (!plan->part_left) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free_encode_plan(plan);
+            return 1;
+        }
+        for (uint32_t i = 0; i < plan->n_parts; i++) {
+            plan->part_left[i] = i + 1 < plan->n_parts ? max_fsize : plan->total - (uint64_t) i * max_fsize;
+        }
+    }
+
+    fprintf(stdout, "Writing %llu MiB to %u files with %u threads.\n", (unsigned long long) plan->total / (1024 * 1024), plan->n_parts, opts->threads);
+    fflush(stdout);
+
+    plan->task_crcs = calloc(plan->n_tasks ? plan->n_tasks : 1, sizeof (struct task_crc));
+    if (!plan->task_crcs) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_encode_plan(plan);
+        return 1;
+    }
+
+    //  start the workers, every worker has its own buffer and cached file descriptors
+    struct plan_worker *workers = calloc(opts->threads, sizeof (struct plan_worker));
+    if (!workers) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_encode_plan(plan);
+        return 1;
+    }
+    //  with direct I/O, the buffers are aligned and every worker stages a complete task
+    plan->direct = opts->direct;
+    t = stats_clock();
+    uint32_t started = 0;
+    for (uint32_t i = 0; i < opts->threads; i++) {
+        workers[i].plan = plan;
+        workers[i].in_fd = -1;
+        workers[i].out_fd = -1;
+        workers[i].buffered_fd = -1;
+        int err = 0;
+        if (plan->direct) {
+            err = posix_memalign((void **) &workers[i].buf, DIRECT_ALIGN, BUF_SIZE) ||
+                  posix_memalign((void **) &workers[i].stage, DIRECT_ALIGN, TASK_SIZE + DIRECT_ALIGN);
+        } else {
+            workers[i].buf = malloc(BUF_SIZE);
+        }
+        if (plan->hash) {
+            workers[i].unit = malloc(HASH_TASK);
+            err = err || !workers[i].unit;
+        }
+        if (err || !workers[i].buf || pthread_create(&workers[i].thread, NULL, plan_worker_run, workers + i)) {
+            fprintf(stderr, "Could not start worker thread.\n");
+            fflush(stderr);
+            free(workers[i].buf);
+            free(workers[i].stage);
+            free(workers[i].unit);
+            __atomic_store_n(&plan->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        started++;
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].buf);
+        free(workers[i].stage);
+        free(workers[i].unit);
+    }
+    free(workers);
+    stats_add(PHASE_WRITE, t);
+    stats.bytes_written = plan->total;
+    stats.partitions = plan->n_parts;
+
+    if (plan->failed) {
+        free_encode_plan(plan);
+        return 1;
+    }
+
+    //  the checksums of the pieces are combined in the order of the tasks, which is the order of the data
+    uint32_t *crcs = calloc(plan->n_parts ? plan->n_parts : 1, sizeof (uint32_t));
+    if (!crcs) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_encode_plan(plan);
+        return 1;
+    }
+    for (uint64_t i = 0; i < plan->n_tasks; i++) {
+        for (uint64_t j = 0; j < plan->task_crcs[i].n_pieces; j++) {
+            struct crc_piece *piece = plan->task_crcs[i].pieces + j;
+            crcs[piece->part] = crc32c_combine(crcs[piece->part], piece->crc, piece->len);
+        }
+    }
+
+    //  the central directory is taken from the plan
+    struct directory *dir = NULL;
+    if (opts->directory) {
+        dir = new_directory(max_fsize);
+        if (!dir) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free(crcs);
+            free_encode_plan(plan);
+            return 1;
+        }
+        for (uint32_t i = 0; i < plan->n_entries; i++) {
+            struct plan_entry *entry = plan->entries + i;
+            uint64_t content_start = entry->start + entry->content_off;
+            uint64_t content_len = entry->header_len - entry->content_off + entry->f_len;
+            if (directory_add(dir, entry->name, strlen(entry->name), content_len, content_start / max_fsize, content_start % max_fsize,
+                              entry->kind, entry->orig_len)) {
+                fprintf(stderr, "Memory allocation error.\n");
+                fflush(stderr);
+                free(crcs);
+                free_directory(dir);
+                free_encode_plan(plan);
+                return 1;
+            }
+        }
+    }
+    //  so are the content hashes, the hashes of raw entries are joined from their units
+    struct manifest *manifest = NULL;
+    if (opts->hash) {
+        manifest = new_manifest();
+        for (uint32_t i = 0; manifest && i < plan->n_entries; i++) {
+            struct plan_entry *entry = plan->entries + i;
+            if (entry->kind == ENTRY_RAW) {
+                unit_hash_final(&entry->units, entry->hash);
+            }
+            if (manifest_add(manifest, entry->name, strlen(entry->name), entry->hash)) {
+                free_manifest(manifest);
+                manifest = NULL;
+            }
+        }
+        if (!manifest) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free(crcs);
+            free_directory(dir);
+            free_encode_plan(plan);
+            return 1;
+        }
+    }
+    uint32_t f_count = plan->n_parts;
+    uint64_t written_total = plan->total;
+    free_encode_plan(plan);
+
+    //  write the main output file, containing the information about the other files
+    struct main_file info = {f_count, written_total, dir, opts->no_checksums ? NULL : crcs, manifest};
+    t = stats_clock();
+    TRACE_BEGIN("main file write", out_name);
+    int err = write_main_file(out_name, &info);
+    TRACE_END("main file write");
+    stats_add(PHASE_MAIN_FILE, t);
+    free_directory(dir);
+    free_manifest(manifest);
+    free(crcs);
+    if (err) {
+        return 1;
+    }
+    fprintf(stdout, "Successfully wrote %llu bytes to %u files.\n", (unsigned long long) written_total, f_count);
+    fflush(stdout);
+    return 0;
+}
+
+//  read the complete content of a specific file as a byte-string
+static struct byte_string *read_bytes(char *filepath) {
+    uint64_t len = f_size(filepath);
+
+    //  allocate the struct for storing the bytes
+    struct byte_string *bytes = malloc(sizeof (struct byte_string));
+    if (!bytes) {
+        return NULL;
+    }
+    bytes->len = len;
+
+    //  open the specified file
+    FILE *file = fopen(filepath, "rb");
+    if (!file) {
+        free(bytes);
+        return NULL;
+    }
+
+    //  allocate the byte-string
+    char *f_data = malloc(len);
+    if (!f_data) {
+        free(bytes);
+        fclose(file);
+        return NULL;
+    }
+    bytes->data = f_data;
+
+    //  read the file
+    char buf[1024];
+    uint64_t bytes_read;
+    uint64_t offset = 0;
+    while ((bytes_read = fread(buf, 1, 1023, file))) {
+        bytes_cpy(buf, f_data + offset, bytes_read);
+        offset += bytes_read;
+    }
+
+    //  finally close the file
+    fclose(file);
+    return bytes;
+}
+
+//  map the complete content of a specific file into memory (read-only)
+static struct mapped_file *map_file(char *filepath) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat f_info;
+    if (fstat(fd, &f_info)) {
+        close(fd);
+        return NULL;
+    }
+
+    //  allocate the struct for storing the mapping
+    struct mapped_file *map = calloc(1, sizeof (struct mapped_file));
+    if (!map) {
+        close(fd);
+        return NULL;
+    }
+    map->len = f_info.st_size;
+
+    //  empty files can not be mapped, their data simply stays NULL
+    if (map->len) {
+        map->data = mmap(NULL, map->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map->data == MAP_FAILED) {
+            close(fd);
+            free(map);
+            return NULL;
+        }
+        madvise(map->data, map->len, MADV_SEQUENTIAL);
+    }
+
+    //  the mapping stays valid after the file is closed
+    close(fd);
+    return map;
+}
+
+//  unmap and free a mapped file
+static void unmap_file(struct mapped_file *map) {
+    if (!map) {
+        return;
+    }
+    if (map->data) {
+        munmap(map->data, map->len);
+    }
+    free(map);
+}
+
+//  prefetch the window of the mapped file that starts at the given position and release the pages before it,
+//  so only a few windows of the file are resident at any time
+static void advise_window(struct mapped_file *map, uint64_t pos) {
+    if (!map->data || pos >= map->len) {
+        return;
+    }
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t start = pos - pos % page_size;
+    uint64_t len = map->len - start < MAP_WINDOW ? map->len - start : MAP_WINDOW;
+    madvise(map->data + start, len, MADV_WILLNEED);
+    if (start > map->released) {
+        madvise(map->data + map->released, start - map->released, MADV_DONTNEED);
+        map->released = start;
+    }
+}
+
+//  calculate the size in bytes of a specific file, 0 if it can not be determined
+static uint64_t f_size(char *filepath) {
+    struct stat f_info;
+    if (stat(filepath, &f_info)) {
+        return 0;
+    }
+    return f_info.st_size;
+}
+
+//  get the modification time of a specific file in ns, 0 if it can not be determined
+static uint64_t f_mtime(char *filepath) {
+    struct stat f_info;
+    if (stat(filepath, &f_info)) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (uint64_t) f_info.st_mtimespec.tv_sec * 1000000000 + f_info.st_mtimespec.tv_nsec;
+#else
+    return (uint64_t) f_info.st_mtim.tv_sec * 1000000000 + f_info.st_mtim.tv_nsec;
+#endif
+}
+
+//  encode unsigned long to byte-string of a specific length
+static char *to_bytes(uint64_t value, uint64_t length) {
+    //  allocate byte-string
+    char *bytes = malloc(length);
+    if (!bytes) {
+        return NULL;
+    }
+
+    //  convert value byte-wise
+    for (uint64_t i = 0; i < length; i++) {
+        *(bytes + i) = (char) (value % 256);
+        value/= 256;
+    }
+    return bytes;
+}
+
+//  encode unsigned long into an existing byte-string of a specific length
+static void store_bytes(uint64_t value, uint64_t length, char *bytes) {
+    for (uint64_t i = 0; i < length; i++) {
+        *(bytes + i) = (char) (value % 256);
+        value /= 256;
+    }
+}
+
+//  decode byte-string to unsigned long
+static uint64_t from_bytes(uint64_t start, uint64_t length, const char *bytes) {
+    if (!bytes) {
+        return 0;
+    }
+
+    //  convert the byte-string byte-wise
+    uint64_t res = 0;
+    uint64_t multiplier = 1;
+    for (uint64_t i = start; i < start + length; i++) {
+        int val = (int) *(bytes + i);
+        if (val < 0) {
+            val += 256;
+        }
+        res += val * multiplier;
+        multiplier *= 256;
+    }
+    return res;
+}
+
+//  return the starting index of the filename included in the specified path
+static uint64_t extract_filename(const char *filepath, uint64_t len) {
+    for (uint64_t i = len; i > 0; i--) {
+        if (*(filepath + i - 1) == '/' || *(filepath + i - 1) == '\\') {
+            return i;
+        }
+    }
+    return 0;
+}
+
+//  open (or create) an output file of the decoder, the directories of its name are created if needed
+//  the descriptors of the directories of the last file are kept in the cache, so files of the same directory
+//  are opened relative to it, without resolving the whole path again
+//  names must be relative and must not contain empty, '.' or '..' components, returns the descriptor or -1
+static int open_output(struct dir_cache *cache, const char *name, uint64_t name_len, int flags) {
+    //  validate the name, it must not point outside of the current directory
+    uint64_t dir_len = 0;
+    int valid = name_len > 0 && name[0] != '/' && !memchr(name, 0, name_len);
+    for (uint64_t start = 0; valid && start <= name_len;) {
+        const char *end = memchr(name + start, '/', name_len - start);
+        uint64_t comp_len = (end ? (uint64_t) (end - name) : name_len) - start;
+        if (!comp_len || (comp_len == 1 && name[start] == '.') ||
+            (comp_len == 2 && name[start] == '.' && name[start + 1] == '.')) {
+            valid = 0;
+        }
+        if (!end) {
+            break;
+        }
+        dir_len = end - name;
+        start = dir_len + 1;
+    }
+    if (!valid) {
+        fprintf(stderr, "Error, invalid filename '%s' in the archive.\n", name);
+        fflush(stderr);
+        return -1;
+    }
+
+    //  keep the cached directories that the name starts with
+    uint32_t kept = 0;
+    uint64_t pos = 0;
+    while (kept < cache->depth && pos < dir_len) {
+        uint64_t comp_start = kept ? cache->ends[kept - 1] + 1 : 0;
+        uint64_t comp_len = cache->ends[kept] - comp_start;
+        if (pos + comp_len > dir_len || (pos + comp_len < dir_len && name[pos + comp_len] != '/') ||
+            memcmp(name + pos, cache->path + comp_start, comp_len)) {
+            break;
+        }
+        pos += comp_len + 1;
+        kept++;
+    }
+    while (cache->depth > kept) {
+        close(cache->fds[--cache->depth]);
+    }
+
+    //  create and open the remaining directories, the path of the cache holds the components separated by zeros
+    if (dir_len + 1 > cache->capacity) {
+        char *path = realloc(cache->path, dir_len + 1);
+        int *fds = realloc(cache->fds, (dir_len + 1) * sizeof (int));
+        uint64_t *ends = realloc(cache->ends, (dir_len + 1) * sizeof (uint64_t));
+        if (path) {
+            cache->path = path;
+        }
+        if (fds) {
+            cache->fds = fds;
+        }
+        if (ends) {
+            cache->ends = ends;
+        }
+        if (!path || !fds || !ends) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return -1;
+        }
+        cache->capacity = dir_len + 1;
+    }
+    while (pos < dir_len) {
+        const char *end = memchr(name + pos, '/', dir_len - pos);
+        uint64_t comp_end = end ? (uint64_t) (end - name) : dir_len;
+        bytes_cpy(name + pos, cache->path + pos, comp_end - pos);
+        cache->path[comp_end] = 0;
+        int parent = cache->depth ? cache->fds[cache->depth - 1] : AT_FDCWD;
+        if (mkdirat(parent, cache->path + pos, 0755) && errno != EEXIST) {
+            fprintf(stderr, "Could not create directory '%.*s'.\n", (int) comp_end, name);
+            fflush(stderr);
+            return -1;
+        }
+        int fd = openat(parent, cache->path + pos, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        if (fd < 0) {
+            fprintf(stderr, "Could not open directory '%.*s'.\n", (int) comp_end, name);
+            fflush(stderr);
+            return -1;
+        }
+        cache->fds[cache->depth] = fd;
+        cache->ends[cache->depth++] = comp_end;
+        pos = comp_end + 1;
+    }
+
+    //  the filename is the last component, the name is terminated by a zero
+    int parent = cache->depth ? cache->fds[cache->depth - 1] : AT_FDCWD;
+    return openat(parent, name + (dir_len ? dir_len + 1 : 0), flags, 0644);
+}
+
+//  close the directories of the cache and free its memory
+static void free_dir_cache(struct dir_cache *cache) {
+    while (cache->depth) {
+        close(cache->fds[--cache->depth]);
+    }
+    free(cache->path);
+    free(cache->fds);
+    free(cache->ends);
+}
+
+//  copy all bytes from src to dest with the specified length
+static void bytes_cpy(const char *src, char *dest, uint64_t len) {
+    for (uint64_t i = 0; i < len; i++) {
+        *(dest + i) = *(src + i);
+    }
+}
+
+static uint64_t fwrite64(const void *str, uint64_t len_bytes, FILE *file) {
+    if (!str || !file) {
+        return 0;
+    }
+
+    //  write the file in chunks of 128 MiB each
+    const uint64_t CHUNK_SIZE = 128 * 1024 * 1024;
+    uint64_t written_complete = 0;
+    uint64_t to_write = 0;
+    uint64_t offset = 0;
+    while (offset < len_bytes) {
+        if (len_bytes - offset < CHUNK_SIZE) {
+            to_write = len_bytes - offset;
+        } else {
+            to_write = CHUNK_SIZE;
+        }
+
+        uint64_t bytes_written = fwrite(str + offset, 1, to_write, file);
+        written_complete += bytes_written;
+        if (bytes_written != to_write) {
+            return written_complete;
+        }
+
+        offset += to_write;
+    }
+
+    return written_complete;
+}
+
+//  multiply two polynomials modulo the CRC32C polynomial, both in reversed bit order
+//  a must not be zero, it is always a power of x in here
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b) {
+    uint32_t m = (uint32_t) 1 << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if (!(a & (m - 1))) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+//  calculate x^(8 * len) modulo the CRC32C polynomial
+//  multiplying a CRC with it is the same as appending len zero bytes
+static uint32_t crc32c_shift(uint64_t len) {
+    uint32_t p = (uint32_t) 1 << 31;
+    uint32_t square = (uint32_t) 1 << 23;
+    while (len) {
+        if (len & 1) {
+            p = crc32c_multiply(square, p);
+        }
+        square = crc32c_multiply(square, square);
+        len >>= 1;
+    }
+    return p;
+}
+
+//  calculate the CRC32C of the concatenation of two byte ranges from their CRC32Cs and the length of the second one
+static uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+    return crc32c_multiply(crc32c_shift(len2), crc1) ^ crc2;
+}
+
+//  portable CRC32C, processes 8 bytes per step with 8 lookup tables
+static uint32_t crc32c_portable(uint32_t crc, const unsigned char *data, uint64_t len) {
+    while (len >= 8) {
+        crc ^= data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24;
+        crc = crc32c_table[7][crc & 0xff] ^ crc32c_table[6][(crc >> 8) & 0xff]
+              ^ crc32c_table[5][(crc >> 16) & 0xff] ^ crc32c_table[4][crc >> 24]
+              ^ crc32c_table[3][data[4]] ^ crc32c_table[2][data[5]]
+              ^ crc32c_table[1][data[6]] ^ crc32c_table[0][data[7]];
+        data += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = crc32c_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HARDWARE
+//  CRC32C with the instructions of the CPU
+//  the instruction has a latency of multiple cycles, so three independent lanes are computed at once
+//  and combined by shifting the CRCs of the first lanes over the following ones
+static CRC32C_TARGET
+uint32_t crc32c_hardware(uint32_t crc, const unsigned char *data, uint64_t len) {
+    while (len >= CRC_LANE * 3) {
+        uint64_t crc_a = crc;
+        uint64_t crc_b = 0;
+        uint64_t crc_c = 0;
+        for (uint64_t i = 0; i < CRC_LANE; i += 8) {
+            uint64_t word_a, word_b, word_c;
+            memcpy(&word_a, data + i, 8);
+            memcpy(&word_b, data + CRC_LANE + i, 8);
+            memcpy(&word_c, data + CRC_LANE * 2 + i, 8);
+            crc_a = CRC32C_U64(crc_a, word_a);
+            crc_b = CRC32C_U64(crc_b, word_b);
+            crc_c = CRC32C_U64(crc_c, word_c);
+        }
+        crc = crc32c_multiply(crc32c_lane_shift[1], crc_a) ^ crc32c_multiply(crc32c_lane_shift[0], crc_b) ^ crc_c;
+        data += CRC_LANE * 3;
+        len -= CRC_LANE * 3;
+    }
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = CRC32C_U64(crc64, word);
+        data += 8;
+        len -= 8;
+    }
+    crc = crc64;
+    while (len--) {
+        crc = CRC32C_U8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+//  set up the lookup tables and select the fastest CRC32C implementation of the CPU
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            crc32c_table[k][i] = (crc32c_table[k - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[k - 1][i] & 0xff];
+        }
+    }
+    crc32c_lane_shift[0] = crc32c_shift(CRC_LANE);
+    crc32c_lane_shift[1] = crc32c_shift(CRC_LANE * 2);
+
+    crc32c_update = crc32c_portable;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_update = crc32c_hardware;
+    }
+#elif defined(CRC32C_HARDWARE)
+    crc32c_update = crc32c_hardware;
+#endif
+}
+
+//  update the CRC32C (0 for no data) with len bytes
+static uint32_t crc32c(uint32_t crc, const char *data, uint64_t len) {
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~crc32c_update(~crc, (const unsigned char *) data, len);
+}
+
+//  update the CRC32C with len bytes of the given file, starting at the given offset
+//  the bytes are read through the given buffer, returns 1 if they can not be read
+static int checksum_range(int fd, uint64_t off, uint64_t len, char *buf, uint32_t *crc) {
+    uint64_t done = 0;
+    while (done < len) {
+        size_t to_read = len - done < BUF_SIZE ? len - done : BUF_SIZE;
+        ssize_t res = pread(fd, buf, to_read, off + done);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return 1;
+        }
+        *crc = crc32c(*crc, buf, res);
+        done += res;
+    }
+    return 0;
+}
+
+//  worker thread that checksums the next data-file of the job until all selected data-files are done
+static void *checksum_worker_run(void *arg) {
+    struct checksum_job *job = arg;
+    char *buf = malloc(BUF_SIZE);
+    if (!buf) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        uint32_t part = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (part >= job->f_count) {
+            break;
+        }
+        if (job->selected && !job->selected[part]) {
+            continue;
+        }
+        char *f_name = job->f_names + (size_t) part * job->f_name_len;
+        int fd = open(f_name, O_RDONLY);
+        uint32_t crc = 0;
+        if (fd < 0 || checksum_range(fd, 0, f_size(f_name), buf, &crc)) {
+            fprintf(stderr, "Error, could not read file '%s'.\n", f_name);
+            fflush(stderr);
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        job->crcs[part] = crc;
+    }
+    free(buf);
+    return NULL;
+}
+
+//  compare the checksums of the selected data-files (all if selected is NULL) with the expected ones
+//  the data-files are read by the given number of threads, every corrupted data-file is reported
+static int verify_partitions(char *f_names, uint32_t f_name_len, uint32_t f_count, const char *selected,
+                      const uint32_t *expected, unsigned threads) {
+    struct checksum_job job = {0};
+    job.f_names = f_names;
+    job.f_name_len = f_name_len;
+    job.f_count = f_count;
+    job.selected = selected;
+    job.crcs = calloc(f_count ? f_count : 1, sizeof (uint32_t));
+    pthread_t *workers = calloc(threads, sizeof (pthread_t));
+    if (!job.crcs || !workers) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free(job.crcs);
+        free(workers);
+        return 1;
+    }
+    if (threads > f_count) {
+        threads = f_count ? f_count : 1;
+    }
+    unsigned started = 0;
+    for (unsigned i = 0; i < threads; i++) {
+        if (pthread_create(workers + i, NULL, checksum_worker_run, &job)) {
+            fprintf(stderr, "Could not start worker thread.\n");
+            fflush(stderr);
+            __atomic_store_n(&job.failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        started++;
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    int err = job.failed;
+    for (uint32_t i = 0; !job.failed && i < f_count; i++) {
+        if ((!selected || selected[i]) && job.crcs[i] != expected[i]) {
+            fprintf(stderr, "Error, file '%s' is corrupted (checksum mismatch).\n", f_names + (size_t) i * f_name_len);
+            fflush(stderr);
+            err = 1;
+        }
+    }
+    free(job.crcs);
+    return err;
+}
+
+//  read a block of BLAKE3 as 16 little-endian message words
+static void blake3_words(const unsigned char *block, uint32_t *m) {
+    for (unsigned i = 0; i < 16; i++) {
+        const unsigned char *p = block + i * 4;
+        m[i] = (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+    }
+}
+
+//  compress a block of message words into the chaining value cv, the result is stored in out (can be cv)
+static void blake3_compress(const uint32_t *cv, const uint32_t *m, uint64_t counter, uint32_t block_len, uint32_t flags,
+                     uint32_t *out) {
+    uint32_t v[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                      BLAKE3_IV[0], BLAKE3_IV[1], BLAKE3_IV[2], BLAKE3_IV[3],
+                      (uint32_t) counter, (uint32_t) (counter >> 32), block_len, flags};
+    for (unsigned r = 0; r < 7; r++) {
+        BLAKE3_ROUND(v, m, BLAKE3_SCHEDULE[r]);
+    }
+    for (unsigned i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i + 8];
+    }
+}
+
+//  calculate the chaining value of the parent node of two subtrees, out can be one of the children
+static void blake3_parent(const uint32_t *left, const uint32_t *right, uint32_t flags, uint32_t *out) {
+    uint32_t m[16];
+    memcpy(m, left, 8 * sizeof (uint32_t));
+    memcpy(m + 8, right, 8 * sizeof (uint32_t));
+    blake3_compress(BLAKE3_IV, m, 0, BLAKE3_BLOCK, flags | BLAKE3_PARENT, out);
+}
+
+//  calculate the chaining value of a complete chunk (that is not the root) with the given index
+static void blake3_chunk(const unsigned char *data, uint64_t counter, uint32_t *cv) {
+    uint32_t m[16];
+    memcpy(cv, BLAKE3_IV, 8 * sizeof (uint32_t));
+    for (uint64_t b = 0; b < BLAKE3_CHUNK / BLAKE3_BLOCK; b++) {
+        uint32_t flags = (b == 0 ? BLAKE3_CHUNK_START : 0) | (b == BLAKE3_CHUNK / BLAKE3_BLOCK - 1 ? BLAKE3_CHUNK_END : 0);
+        blake3_words(data + b * BLAKE3_BLOCK, m);
+        blake3_compress(cv, m, counter, BLAKE3_BLOCK, flags, cv);
+    }
+}
+
+//  calculate the chaining values of BLAKE3_LANES consecutive complete chunks at once, every lane of the vectors
+//  holds the state of one chunk, so the compiler can use the vector registers of the CPU for the rounds
+static BLAKE3_CLONES
+void blake3_lanes(const unsigned char *data, uint64_t counter, uint32_t (*cvs)[8]) {
+    blake3_vec cv[8];
+    blake3_vec m[16];
+    blake3_vec v[16];
+    blake3_vec counter_lo;
+    blake3_vec counter_hi;
+    for (unsigned i = 0; i < 8; i++) {
+        cv[i] = (blake3_vec) {0} + BLAKE3_IV[i];
+    }
+    for (unsigned j = 0; j < BLAKE3_LANES; j++) {
+        counter_lo[j] = (uint32_t) (counter + j);
+        counter_hi[j] = (uint32_t) ((counter + j) >> 32);
+    }
+    for (uint64_t b = 0; b < BLAKE3_CHUNK / BLAKE3_BLOCK; b++) {
+        for (unsigned i = 0; i < 16; i++) {
+            for (unsigned j = 0; j < BLAKE3_LANES; j++) {
+                const unsigned char *p = data + j * BLAKE3_CHUNK + b * BLAKE3_BLOCK + i * 4;
+                m[i][j] = (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+            }
+        }
+        uint32_t flags = (b == 0 ? BLAKE3_CHUNK_START : 0) | (b == BLAKE3_CHUNK / BLAKE3_BLOCK - 1 ? BLAKE3_CHUNK_END : 0);
+        for (unsigned i = 0; i < 8; i++) {
+            v[i] = cv[i];
+        }
+        for (unsigned i = 0; i < 4; i++) {
+            v[i + 8] = (blake3_vec) {0} + BLAKE3_IV[i];
+        }
+        v[12] = counter_lo;
+        v[13] = counter_hi;
+        v[14] = (blake3_vec) {0} + (uint32_t) BLAKE3_BLOCK;
+        v[15] = (blake3_vec) {0} + flags;
+        for (unsigned r = 0; r < 7; r++) {
+            BLAKE3_ROUND(v, m, BLAKE3_SCHEDULE[r]);
+        }
+        for (unsigned i = 0; i < 8; i++) {
+            cv[i] = v[i] ^ v[i + 8];
+        }
+    }
+    for (unsigned j = 0; j < BLAKE3_LANES; j++) {
+        for (unsigned i = 0; i < 8; i++) {
+            cvs[j][i] = cv[i][j];
+        }
+    }
+}
+
+//  calculate the chaining values of n consecutive complete chunks, starting with the chunk with the given index
+static void blake3_chunks(const unsigned char *data, uint64_t n, uint64_t counter, uint32_t (*cvs)[8]) {
+    uint64_t i = 0;
+    for (; i + BLAKE3_LANES <= n; i += BLAKE3_LANES) {
+        blake3_lanes(data + i * BLAKE3_CHUNK, counter + i, cvs + i);
+    }
+    for (; i < n; i++) {
+        blake3_chunk(data + i * BLAKE3_CHUNK, counter + i, cvs[i]);
+    }
+}
+
+//  calculate the chaining value of the complete subtree of n chunks (a power of two), starting with the chunk with
+//  the given index, cvs has room for the chaining values of the n chunks
+static void blake3_subtree(const unsigned char *data, uint64_t n, uint64_t counter, uint32_t (*cvs)[8], uint32_t *out) {
+    blake3_chunks(data, n, counter, cvs);
+    for (; n > 1; n /= 2) {
+        for (uint64_t i = 0; i < n / 2; i++) {
+            blake3_parent(cvs[2 * i], cvs[2 * i + 1], 0, cvs[i]);
+        }
+    }
+    memcpy(out, cvs[0], 8 * sizeof (uint32_t));
+}
+
+//  start a new BLAKE3 hash
+static void blake3_init(struct blake3 *hasher) {
+    memset(hasher, 0, sizeof (struct blake3));
+    memcpy(hasher->cv, BLAKE3_IV, 8 * sizeof (uint32_t));
+}
+
+//  add the chaining value of a complete subtree of n chunks (a power of two) at the current position of the hash,
+//  which has to be a multiple of n chunks, and merge the subtrees of the same size on the stack
+static void blake3_push(struct blake3 *hasher, const uint32_t *cv, uint64_t n) {
+    uint32_t merged[8];
+    memcpy(merged, cv, 8 * sizeof (uint32_t));
+    hasher->chunks += n;
+    for (uint64_t total = hasher->chunks / n; !(total & 1); total >>= 1) {
+        blake3_parent(hasher->stack[--hasher->n_stack], merged, 0, merged);
+    }
+    memcpy(hasher->stack[hasher->n_stack++], merged, 8 * sizeof (uint32_t));
+}
+
+//  add len bytes to the hash
+//  whole chunks that start at a chunk boundary are hashed in the lanes, at least one byte is left for the last chunk
+static void blake3_update(struct blake3 *hasher, const unsigned char *data, uint64_t len) {
+    uint32_t m[16];
+    uint32_t cvs[64][8];
+    while (len) {
+        if (hasher->blocks == BLAKE3_CHUNK / BLAKE3_BLOCK - 1 && hasher->block_len == BLAKE3_BLOCK) {
+            uint32_t cv[8];
+            blake3_words(hasher->block, m);
+            blake3_compress(hasher->cv, m, hasher->chunks, BLAKE3_BLOCK, BLAKE3_CHUNK_END, cv);
+            blake3_push(hasher, cv, 1);
+            memcpy(hasher->cv, BLAKE3_IV, 8 * sizeof (uint32_t));
+            hasher->blocks = 0;
+            hasher->block_len = 0;
+        }
+        if (!hasher->blocks && !hasher->block_len && len > BLAKE3_CHUNK) {
+            uint64_t n = (len - 1) / BLAKE3_CHUNK;
+            n = n < 64 ? n : 64;
+            blake3_chunks(data, n, hasher->chunks, cvs);
+            for (uint64_t i = 0; i < n; i++) {
+                blake3_push(hasher, cvs[i], 1);
+            }
+            data += n * BLAKE3_CHUNK;
+            len -= n * BLAKE3_CHUNK;
+            continue;
+        }
+        if (hasher->block_len == BLAKE3_BLOCK) {
+            blake3_words(hasher->block, m);
+            blake3_compress(hasher->cv, m, hasher->chunks, BLAKE3_BLOCK, hasher->blocks ? 0 : BLAKE3_CHUNK_START,
+                            hasher->cv);
+            hasher->blocks++;
+            hasher->block_len = 0;
+        }
+        uint64_t take = BLAKE3_BLOCK - hasher->block_len < len ? BLAKE3_BLOCK - hasher->block_len : len;
+        memcpy(hasher->block + hasher->block_len, data, take);
+        hasher->block_len += take;
+        data += take;
+        len -= take;
+    }
+}
+
+//  finish the hash, the last chunk (or the top parent node) is compressed as the root
+static void blake3_final(struct blake3 *hasher, unsigned char *out) {
+    uint32_t m[16];
+    uint32_t cv[8];
+    uint32_t flags = BLAKE3_CHUNK_END | (hasher->blocks ? 0 : BLAKE3_CHUNK_START);
+    memset(hasher->block + hasher->block_len, 0, BLAKE3_BLOCK - hasher->block_len);
+    blake3_words(hasher->block, m);
+    blake3_compress(hasher->cv, m, hasher->chunks, hasher->block_len, flags | (hasher->n_stack ? 0 : BLAKE3_ROOT), cv);
+    for (uint32_t i = hasher->n_stack; i-- > 0;) {
+        blake3_parent(hasher->stack[i], cv, i ? 0 : BLAKE3_ROOT, cv);
+    }
+    for (unsigned i = 0; i < 8; i++) {
+        store_bytes(cv[i], 4, (char *) out + i * 4);
+    }
+}
+
+//  worker thread that hashes the next subtree of the job until all of them are done
+static void *hash_worker_run(void *arg) {
+    struct hash_job *job = arg;
+    unsigned char *buf = malloc(HASH_TASK);
+    uint32_t (*cvs)[8] = malloc(HASH_TASK / BLAKE3_CHUNK * sizeof (*cvs));
+    if (!buf || !cvs) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        uint64_t task = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (task >= job->n_tasks) {
+            break;
+        }
+        if (pread_all(job->fd, (char *) buf, HASH_TASK, task * HASH_TASK) < HASH_TASK) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        blake3_subtree(buf, HASH_TASK / BLAKE3_CHUNK, task * (HASH_TASK / BLAKE3_CHUNK), cvs, job->cvs[task]);
+    }
+    free(buf);
+    free(cvs);
+    return NULL;
+}
+
+//  calculate the BLAKE3 hash of the first len bytes of the file
+//  all subtrees of HASH_TASK bytes before the last byte are hashed by the given number of threads, the rest is
+//  hashed by the calling thread, returns 1 if the file can not be read
+static int hash_fd(int fd, uint64_t len, unsigned threads, unsigned char *out) {
+    struct hash_job job = {0};
+    struct blake3 hasher;
+    blake3_init(&hasher);
+    job.fd = fd;
+    job.n_tasks = len ? (len - 1) / HASH_TASK : 0;
+    if (threads > job.n_tasks) {
+        threads = job.n_tasks;
+    }
+    if (threads > 1) {
+        job.cvs = malloc(job.n_tasks * sizeof (*job.cvs));
+        pthread_t *workers = calloc(threads, sizeof (pthread_t));
+        if (!job.cvs || !workers) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free(job.cvs);
+            free(workers);
+            return 1;
+        }
+        unsigned started = 0;
+        for (unsigned i = 0; i < threads; i++) {
+            if (pthread_create(workers + i, NULL, hash_worker_run, &job)) {
+                break;
+            }
+            started++;
+        }
+        if (!started) {
+            hash_worker_run(&job);
+        }
+        for (unsigned i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        free(workers);
+        for (uint64_t i = 0; !job.failed && i < job.n_tasks; i++) {
+            blake3_push(&hasher, job.cvs[i], HASH_TASK / BLAKE3_CHUNK);
+        }
+        free(job.cvs);
+        if (job.failed) {
+            return 1;
+        }
+    } else {
+        job.n_tasks = 0;
+    }
+
+    char *buf = malloc(BUF_SIZE);
+    if (!buf) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    for (uint64_t off = job.n_tasks * HASH_TASK; off < len;) {
+        uint64_t to_read = len - off < BUF_SIZE ? len - off : BUF_SIZE;
+        if (pread_all(fd, buf, to_read, off) < to_read) {
+            free(buf);
+            return 1;
+        }
+        blake3_update(&hasher, (const unsigned char *) buf, to_read);
+        off += to_read;
+    }
+    free(buf);
+    blake3_final(&hasher, out);
+    return 0;
+}
+
+//  calculate the BLAKE3 hash of the content of the file with the given path
+static int hash_path(const char *filepath, unsigned threads, unsigned char *out) {
+    int fd = open(filepath, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) || hash_fd(fd, st.st_size, threads, out)) {
+        fprintf(stderr, "Error, could not hash file '%s'.\n", filepath);
+        fflush(stderr);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
+
+//  prepare the hash of a content of len bytes, which is split into units of HASH_TASK bytes
+static int unit_hash_init(struct unit_hash *units, uint64_t len) {
+    units->n_units = len ? (len - 1) / HASH_TASK + 1 : 1;
+    units->cvs = NULL;
+    units->tail = NULL;
+    if (units->n_units > 1) {
+        units->cvs = malloc((units->n_units - 1) * sizeof (*units->cvs));
+        if (!units->cvs) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//  hash the unit with the given index, len is HASH_TASK for all units but the last one
+//  the hash of a content with a single unit is finished right away into out, otherwise the last unit is kept
+//  until all units are hashed
+static int hash_unit(struct unit_hash *units, uint64_t unit, const unsigned char *data, uint64_t len, unsigned char *out) {
+    if (unit + 1 < units->n_units) {
+        uint32_t cvs[HASH_TASK / BLAKE3_CHUNK][8];
+        blake3_subtree(data, HASH_TASK / BLAKE3_CHUNK, unit * (HASH_TASK / BLAKE3_CHUNK), cvs, units->cvs[unit]);
+        return 0;
+    }
+    //  the unit starts at a multiple of HASH_TASK, so its subtrees merge the same way as with the preceding units
+    struct blake3 hasher;
+    blake3_init(&hasher);
+    hasher.chunks = unit * (HASH_TASK / BLAKE3_CHUNK);
+    blake3_update(&hasher, data, len);
+    if (units->n_units == 1) {
+        blake3_final(&hasher, out);
+        return 0;
+    }
+    units->tail = malloc(sizeof (struct blake3));
+    if (!units->tail) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    *units->tail = hasher;
+    return 0;
+}
+
+//  finish the hash once all units are hashed, the subtrees of the complete units go below the ones of the last unit
+static void unit_hash_final(struct unit_hash *units, unsigned char *out) {
+    if (units->n_units == 1) {
+        return;
+    }
+    struct blake3 hasher;
+    blake3_init(&hasher);
+    for (uint64_t i = 0; i + 1 < units->n_units; i++) {
+        blake3_push(&hasher, units->cvs[i], HASH_TASK / BLAKE3_CHUNK);
+    }
+    struct blake3 *tail = units->tail;
+    memmove(tail->stack + hasher.n_stack, tail->stack, tail->n_stack * sizeof (tail->stack[0]));
+    memcpy(tail->stack, hasher.stack, hasher.n_stack * sizeof (hasher.stack[0]));
+    tail->n_stack += hasher.n_stack;
+    blake3_final(tail, out);
+    free_unit_hash(units);
+}
+
+//  free the chaining values and the last unit of a hash
+static void free_unit_hash(struct unit_hash *units) {
+    free(units->cvs);
+    free(units->tail);
+    units->cvs = NULL;
+    units->tail = NULL;
+}
+
+//  compress a block with the fast codec, an LZ4-style format of literal runs and matches
+//  every sequence is a token (4 bits literal length, 4 bits match length), the literals and a 2-byte offset,
+//  returns the compressed length or 0 if it does not fit into cap bytes
+static uint64_t lz_compress(const unsigned char *src, uint64_t len, unsigned char *dst, uint64_t cap) {
+    uint32_t table[1 << 14];
+    memset(table, 0, sizeof (table));
+    uint64_t ip = 0;
+    uint64_t op = 0;
+    uint64_t anchor = 0;
+
+    //  the last match has to start 12 bytes and end 5 bytes before the end of the block (as in LZ4)
+    uint64_t limit = len > 12 ? len - 12 : 0;
+    while (ip < limit) {
+        uint32_t seq;
+        memcpy(&seq, src + ip, 4);
+        uint32_t hash = (seq * 2654435761u) >> 18;
+        uint64_t ref = table[hash];
+        table[hash] = ip;
+        uint32_t ref_seq;
+        memcpy(&ref_seq, src + ref, 4);
+        if (ref >= ip || ip - ref > 65535 || ref_seq != seq) {
+            //  skip faster through data without matches
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        uint64_t match_len = 4;
+        while (ip + match_len < len - 5 && src[ref + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+
+        //  token, literal length, literals, offset, match length
+        uint64_t lit_len = ip - anchor;
+        if (op + 1 + lit_len / 255 + 1 + lit_len + 2 + (match_len - 4) / 255 + 1 > cap) {
+            return 0;
+        }
+        unsigned char *token = dst + op++;
+        *token = (lit_len < 15 ? lit_len : 15) << 4;
+        if (lit_len >= 15) {
+            uint64_t rest = lit_len - 15;
+            for (; rest >= 255; rest -= 255) {
+                dst[op++] = 255;
+            }
+            dst[op++] = rest;
+        }
+        memcpy(dst + op, src + anchor, lit_len);
+        op += lit_len;
+        dst[op++] = (ip - ref) & 0xff;
+        dst[op++] = (ip - ref) >> 8;
+        *token |= match_len - 4 < 15 ? match_len - 4 : 15;
+        if (match_len - 4 >= 15) {
+            uint64_t rest = match_len - 4 - 15;
+            for (; rest >= 255; rest -= 255) {
+                dst[op++] = 255;
+            }
+            dst[op++] = rest;
+        }
+        ip += match_len;
+        anchor = ip;
+    }
+
+    //  the remaining bytes are stored as the literals of the last sequence
+    uint64_t lit_len = len - anchor;
+    if (op + 1 + lit_len / 255 + 1 + lit_len > cap) {
+        return 0;
+    }
+    dst[op++] = (lit_len < 15 ? lit_len : 15) << 4;
+    if (lit_len >= 15) {
+        uint64_t rest = lit_len - 15;
+        for (; rest >= 255; rest -= 255) {
+            dst[op++] = 255;
+        }
+        dst[op++] = rest;
+    }
+    memcpy(dst + op, src + anchor, lit_len);
+    return op + lit_len;
+}
+
+//  decompress a block of the fast codec, the output has to be exactly out_len bytes
+//  returns 1 if the block is invalid
+static int lz_decompress(const unsigned char *src, uint64_t len, unsigned char *dst, uint64_t out_len) {
+    uint64_t ip = 0;
+    uint64_t op = 0;
+    while (ip < len) {
+        unsigned char token = src[ip++];
+        uint64_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            unsigned char b;
+            do {
+                if (ip >= len) {
+                    return 1;
+                }
+                b = src[ip++];
+                lit_len += b;
+            } while (b == 255);
+        }
+        if (lit_len > len - ip || lit_len > out_len - op) {
+            return 1;
+        }
+        memcpy(dst + op, src + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        //  the last sequence has no match
+        if (ip == len) {
+            break;
+        }
+
+        if (len - ip < 2) {
+            return 1;
+        }
+        uint64_t offset = src[ip] | (uint64_t) src[ip + 1] << 8;
+        ip += 2;
+        uint64_t match_len = token & 15;
+        if (match_len == 15) {
+            unsigned char b;
+            do {
+                if (ip >= len) {
+                    return 1;
+                }
+                b = src[ip++];
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += 4;
+        if (!offset || offset > op || match_len > out_len - op) {
+            return 1;
+        }
+        //  matches can overlap with their own output, those are copied byte by byte
+        if (offset >= match_len) {
+            memcpy(dst + op, dst + op - offset, match_len);
+        } else {
+            for (uint64_t i = 0; i < match_len; i++) {
+                dst[op + i] = dst[op + i - offset];
+            }
+        }
+        op += match_len;
+    }
+    return op != out_len;
+}
+
+//  compress a block with the given codec into at most len - 1 bytes
+//  returns the compressed length or 0 if the block does not shrink
+static uint64_t compress_block(enum codec codec, const char *src, uint64_t len, char *dst) {
+    if (len < 2) {
+        return 0;
+    }
+    if (codec == CODEC_FAST) {
+        return lz_compress((const unsigned char *) src, len, (unsigned char *) dst, len - 1);
+    }
+    uLongf dst_len = len - 1;
+    if (compress2((Bytef *) dst, &dst_len, (const Bytef *) src, len, Z_BEST_COMPRESSION) != Z_OK) {
+        return 0;
+    }
+    return dst_len;
+}
+
+//  decompress a block of the given codec, the output has to be exactly out_len bytes
+//  returns 1 if the block is invalid
+static int decompress_block(enum codec codec, const char *src, uint64_t len, char *dst, uint64_t out_len) {
+    if (codec == CODEC_FAST) {
+        return lz_decompress((const unsigned char *) src, len, (unsigned char *) dst, out_len);
+    }
+    uLongf dst_len = out_len;
+    return uncompress((Bytef *) dst, &dst_len, (const Bytef *) src, len) != Z_OK || dst_len != out_len;
+}
+
+//  read len bytes at the given offset of the file, returns the number of read bytes
+static uint64_t pread_all(int fd, char *buf, uint64_t len, uint64_t off) {
+    uint64_t bytes_read = 0;
+    while (bytes_read < len) {
+        ssize_t res = pread(fd, buf + bytes_read, len - bytes_read, off + bytes_read);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return bytes_read;
+        }
+        bytes_read += res;
+    }
+    return bytes_read;
+}
+
+//  decide from samples at the start, the middle and the end of the file, if it is worth compressing it
+//  already compressed data (media, archives) is stored as it is, without spending time on compressing it
+static int is_compressible(int in_fd, uint64_t f_len) {
+    char *sample = malloc(SAMPLE_SIZE * 2);
+    if (!sample) {
+        return 0;
+    }
+    //  small files are sampled completely
+    uint64_t sampled = 0;
+    uint64_t compressed = 0;
+    for (uint64_t i = 0; i < 3; i++) {
+        uint64_t off = f_len <= SAMPLE_SIZE * 3 ? i * SAMPLE_SIZE : (f_len - SAMPLE_SIZE) / 2 * i;
+        if (off >= f_len) {
+            break;
+        }
+        uint64_t len = f_len - off < SAMPLE_SIZE ? f_len - off : SAMPLE_SIZE;
+        if (pread_all(in_fd, sample, len, off) < len) {
+            free(sample);
+            return 0;
+        }
+        uint64_t res = compress_block(CODEC_FAST, sample, len, sample + SAMPLE_SIZE);
+        compressed += res ? res : len;
+        sampled += len;
+    }
+    free(sample);
+    //  the samples are compressed with the fast codec, they have to shrink by at least an eighth
+    return compressed < sampled - sampled / 8;
+}
+
+//  worker of the compression pool, it compresses the next block of the batch until all blocks are done
+//  blocks that do not shrink are copied into their output buffer and marked as raw
+static void *compress_worker_run(void *arg) {
+    struct compress_job *job = arg;
+    char *in = malloc(COMPRESS_BLOCK);
+    if (!in) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        uint64_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->n_blocks) {
+            break;
+        }
+        uint64_t off = (job->first + i) * COMPRESS_BLOCK;
+        uint64_t len = job->f_len - off < COMPRESS_BLOCK ? job->f_len - off : COMPRESS_BLOCK;
+        if (pread_all(job->in_fd, in, len, off) < len
+            || (job->units && hash_unit(job->units, job->first + i, (const unsigned char *) in, len, job->hash))) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        job->stored[i] = compress_block(job->codec, in, len, job->outs[i]);
+        if (!job->stored[i]) {
+            bytes_cpy(in, job->outs[i], len);
+            job->stored[i] = len | BLOCK_RAW;
+        }
+    }
+    free(in);
+    return NULL;
+}
+
+//  compress the input file block by block with the pool of threads and write the blocks to out_fd at out_off
+//  the blocks are compressed in batches, so only a few blocks per thread are kept in memory
+//  the table of stored block lengths is returned, the total length of the blocks is stored in stored_total
+//  if hash is given, the content hash is calculated from the blocks that are read for the compression,
+//  a block is exactly one unit of the hash
+static uint64_t *compress_entry(int in_fd, uint64_t f_len, const struct fpp_options *opts, int out_fd, uint64_t out_off,
+                         uint64_t *stored_total, unsigned char *hash) {
+    uint64_t n_blocks = f_len / COMPRESS_BLOCK + (f_len % COMPRESS_BLOCK ? 1 : 0);
+    uint64_t batch = opts->threads * BLOCKS_PER_THREAD;
+    uint64_t *table = malloc((n_blocks ? n_blocks : 1) * sizeof (uint64_t));
+    char **outs = calloc(batch, sizeof (char *));
+    pthread_t *workers = calloc(opts->threads, sizeof (pthread_t));
+    int err = !table || !outs || !workers;
+    for (uint64_t i = 0; !err && i < batch; i++) {
+        outs[i] = malloc(COMPRESS_BLOCK);
+        err = !outs[i];
+    }
+    if (err) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+    }
+
+    struct compress_job job = {0};
+    struct unit_hash units = {0};
+    if (!err && hash) {
+        err = unit_hash_init(&units, f_len);
+        job.units = &units;
+        job.hash = hash;
+    }
+    job.in_fd = in_fd;
+    job.f_len = f_len;
+    job.codec = opts->compress;
+    job.outs = outs;
+    *stored_total = 0;
+    for (uint64_t first = 0; !err && first < n_blocks; first += batch) {
+        job.first = first;
+        job.n_blocks = n_blocks - first < batch ? n_blocks - first : batch;
+        job.stored = table + first;
+        job.next = 0;
+
+        //  a single thread compresses the blocks itself
+        unsigned started = 0;
+        for (unsigned i = 1; i < opts->threads && i < job.n_blocks; i++) {
+            if (pthread_create(workers + started, NULL, compress_worker_run, &job)) {
+                break;
+            }
+            started++;
+        }
+        compress_worker_run(&job);
+        for (unsigned i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        if (job.failed) {
+            fprintf(stderr, "Could not compress file (file changed while encoding?).\n");
+            fflush(stderr);
+            err = 1;
+            break;
+        }
+
+        //  the blocks of the batch are written in order
+        for (uint64_t i = 0; i < job.n_blocks; i++) {
+            uint64_t len = table[first + i] & ~BLOCK_RAW;
+            if (pwrite_all(out_fd, outs[i], len, out_off + *stored_total) < len) {
+                fprintf(stderr, "Could not write the temporary file.\n");
+                fflush(stderr);
+                err = 1;
+                break;
+            }
+            *stored_total += len;
+        }
+    }
+
+    for (uint64_t i = 0; outs && i < batch; i++) {
+        free(outs[i]);
+    }
+    free(outs);
+    free(workers);
+    if (err) {
+        free_unit_hash(&units);
+        free(table);
+        return NULL;
+    }
+    //  an empty file has no block, its hash is the one of the empty unit
+    if (hash && !n_blocks) {
+        hash_unit(&units, 0, NULL, 0, hash);
+    }
+    if (hash) {
+        unit_hash_final(&units, hash);
+    }
+    return table;
+}
+
+//  encode the header of a compressed file, it is the normal header (with the kind in the length of the filename)
+//  followed by the block fields and the block table, the blocks themselves follow as the rest of the content
+static char *encode_compressed_header(const char *name, uint64_t orig_len, enum codec codec, const uint64_t *table,
+                               uint64_t stored_total, uint64_t *header_len) {
+    uint64_t n_blocks = orig_len / COMPRESS_BLOCK + (orig_len % COMPRESS_BLOCK ? 1 : 0);
+    uint64_t table_len = BLOCK_FIELDS + n_blocks * LEN_SIZE;
+    uint64_t prefix_len = 0;
+    char *prefix = encode_header(name, table_len + stored_total, &prefix_len);
+    if (!prefix) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    char *header = realloc(prefix, prefix_len + table_len);
+    if (!header) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free(prefix);
+        return NULL;
+    }
+    header[LEN_SIZE - 1] = ENTRY_COMPRESSED;
+    char *fields = header + prefix_len;
+    store_bytes(codec, LEN_SIZE, fields);
+    store_bytes(orig_len, LEN_SIZE, fields + LEN_SIZE);
+    store_bytes(COMPRESS_BLOCK, LEN_SIZE, fields + LEN_SIZE * 2);
+    store_bytes(n_blocks, LEN_SIZE, fields + LEN_SIZE * 3);
+    for (uint64_t i = 0; i < n_blocks; i++) {
+        store_bytes(table[i], LEN_SIZE, fields + BLOCK_FIELDS + i * LEN_SIZE);
+    }
+    *header_len = prefix_len + table_len;
+    return header;
+}
+
+//  create a temporary file next to the given file, it is removed as soon as it is closed
+//  being on the same filesystem as the output, the kernel can copy from it directly
+static int temp_file(const char *near) {
+    uint64_t len = strlen(near) + 16;
+    char *path = malloc(len);
+    if (!path) {
+        return -1;
+    }
+    snprintf(path, len, "%s.tmpXXXXXX", near);
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+    } else {
+        fprintf(stderr, "Could not create temporary file '%s'.\n", path);
+        fflush(stderr);
+    }
+    free(path);
+    return fd;
+}
+
+//  set up the random values of the gear hash, they are derived from a fixed seed so every run chunks the same way
+static void gear_init(void) {
+    uint64_t state = 0x9E3779B97F4A7C15;
+    for (unsigned i = 0; i < 256; i++) {
+        //  splitmix64
+        state += 0x9E3779B97F4A7C15;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        gear_table[i] = z ^ (z >> 31);
+    }
+}
+
+//  create the index of unique chunks, the chunks are staged in a temporary file next to the given file
+static struct dedup_index *new_dedup_index(const char *near, const struct fpp_options *opts) {
+    pthread_once(&gear_once, gear_init);
+    struct dedup_index *index = calloc(1, sizeof (struct dedup_index));
+    if (!index) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    index->chunk_avg = opts->chunk_avg;
+    index->chunk_min = opts->chunk_avg / 4;
+    index->chunk_max = opts->chunk_avg * 4;
+
+    //  normalized chunking, cuts are less likely before the average size and more likely after it
+    //  the hash is shifted by one bit per byte, so only its top bits depend on the last 64 bytes
+    unsigned bits = 0;
+    while (((uint64_t) 1 << bits) < opts->chunk_avg) {
+        bits++;
+    }
+    index->mask_small = ~(~(uint64_t) 0 >> (bits + 2));
+    index->mask_large = ~(~(uint64_t) 0 >> (bits - 2));
+
+    index->window_len = BUF_SIZE > index->chunk_max * 2 ? BUF_SIZE : index->chunk_max * 2;
+    index->n_buckets = 1024;
+    index->buckets = calloc(index->n_buckets, sizeof (uint64_t));
+    index->window = malloc(index->window_len);
+    index->cmp = malloc(index->chunk_max);
+    index->tmp_fd = -1;
+    if (!index->buckets || !index->window || !index->cmp) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_dedup_index(index);
+        return NULL;
+    }
+    index->tmp_fd = temp_file(near);
+    if (index->tmp_fd < 0) {
+        free_dedup_index(index);
+        return NULL;
+    }
+    return index;
+}
+
+//  close the temporary file and free the index of unique chunks
+static void free_dedup_index(struct dedup_index *index) {
+    if (!index) {
+        return;
+    }
+    if (index->tmp_fd >= 0) {
+        close(index->tmp_fd);
+    }
+    free(index->chunks);
+    free(index->buckets);
+    free(index->window);
+    free(index->cmp);
+    free(index);
+}
+
+//  find the end of the next chunk at the start of data with the gear hash, len is at least the maximum chunk size
+//  unless the end of the file is reached, the first chunk_min bytes are skipped since no cut can be placed there
+static uint64_t next_chunk(const struct dedup_index *index, const unsigned char *data, uint64_t len) {
+    if (len <= index->chunk_min) {
+        return len;
+    }
+    uint64_t end = len < index->chunk_max ? len : index->chunk_max;
+    uint64_t normal = end < index->chunk_avg ? end : index->chunk_avg;
+    uint64_t hash = 0;
+    uint64_t i = index->chunk_min;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear_table[data[i]];
+        if (!(hash & index->mask_small)) {
+            return i + 1;
+        }
+    }
+    for (; i < end; i++) {
+        hash = (hash << 1) + gear_table[data[i]];
+        if (!(hash & index->mask_large)) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+//  bucket of the hash table for the given checksum and length of a chunk
+static uint64_t chunk_bucket(const struct dedup_index *index, uint32_t crc, uint64_t len) {
+    return ((uint64_t) crc * 0x9E3779B97F4A7C15 ^ len) & (index->n_buckets - 1);
+}
+
+//  look up a chunk in the index, chunks with the same checksum and length are compared byte by byte
+//  returns the index of the chunk plus one, 0 if it is not in the index and -1 on errors
+static int64_t find_chunk(struct dedup_index *index, const char *data, uint64_t len, uint32_t crc) {
+    for (uint64_t b = chunk_bucket(index, crc, len); index->buckets[b]; b = (b + 1) & (index->n_buckets - 1)) {
+        struct dedup_chunk *chunk = index->chunks + index->buckets[b] - 1;
+        if (chunk->crc != crc || chunk->len != len) {
+            continue;
+        }
+        if (pread_all(index->tmp_fd, index->cmp, len, chunk->tmp_off) < len) {
+            fprintf(stderr, "Could not read the temporary file.\n");
+            fflush(stderr);
+            return -1;
+        }
+        if (!memcmp(index->cmp, data, len)) {
+            return index->buckets[b];
+        }
+    }
+    return 0;
+}
+
+//  add a chunk to the index, the hash table is doubled once it is half full
+static int add_chunk(struct dedup_index *index, const struct dedup_chunk *chunk) {
+    if (index->n_chunks == index->capacity) {
+        uint64_t capacity = index->capacity ? index->capacity * 2 : 1024;
+        struct dedup_chunk *chunks = realloc(index->chunks, capacity * sizeof (struct dedup_chunk));
+        if (!chunks) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        index->chunks = chunks;
+        index->capacity = capacity;
+    }
+    index->chunks[index->n_chunks++] = *chunk;
+
+    if (index->n_chunks * 2 > index->n_buckets) {
+        uint64_t *buckets = calloc(index->n_buckets * 2, sizeof (uint64_t));
+        if (!buckets) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        free(index->buckets);
+        index->buckets = buckets;
+        index->n_buckets *= 2;
+        for (uint64_t i = 0; i < index->n_chunks - 1; i++) {
+            uint64_t b = chunk_bucket(index, index->chunks[i].crc, index->chunks[i].len);
+            while (index->buckets[b]) {
+                b = (b + 1) & (index->n_buckets - 1);
+            }
+            index->buckets[b] = i + 1;
+        }
+    }
+    uint64_t b = chunk_bucket(index, chunk->crc, chunk->len);
+    while (index->buckets[b]) {
+        b = (b + 1) & (index->n_buckets - 1);
+    }
+    index->buckets[b] = index->n_chunks;
+    return 0;
+}
+
+//  append a reference to the references of an entry, it is merged with the previous one if the chunks are adjacent
+static int add_ref(struct dedup_ref **refs, uint64_t *n_refs, uint64_t *capacity, enum ref_kind kind, uint64_t src, uint64_t len) {
+    if (*n_refs) {
+        struct dedup_ref *last = *refs + *n_refs - 1;
+        if (last->kind == kind && last->src + last->len == src) {
+            last->len += len;
+            return 0;
+        }
+    }
+    if (*n_refs == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        struct dedup_ref *new_refs = realloc(*refs, *capacity * sizeof (struct dedup_ref));
+        if (!new_refs) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        *refs = new_refs;
+    }
+    (*refs)[(*n_refs)++] = (struct dedup_ref) {kind, src, len};
+    return 0;
+}
+
+//  split the input file into chunks and look them up in the index, new chunks are appended to the temporary file
+//  the references of the entry are returned, the total length of its new chunks is stored in stored_total
+//  chunks that are new in this entry are only located relative to its new chunks, until its header is built
+//  if hasher is given, the file-content is added to it as it is read
+static struct dedup_ref *dedup_entry(struct dedup_index *index, int in_fd, uint64_t f_len, uint64_t *n_refs,
+                              uint64_t *stored_total, struct blake3 *hasher) {
+    struct dedup_ref *refs = NULL;
+    uint64_t capacity = 0;
+    uint64_t first_new = index->n_chunks;
+    *n_refs = 0;
+    *stored_total = 0;
+
+    //  the window always holds at least the maximum chunk size, unless the end of the file is reached
+    uint64_t read = 0;
+    uint64_t filled = 0;
+    uint64_t pos = 0;
+    while (pos < filled || read < f_len) {
+        if (filled - pos < index->chunk_max && read < f_len) {
+            memmove(index->window, index->window + pos, filled - pos);
+            filled -= pos;
+            pos = 0;
+            uint64_t n = f_len - read < index->window_len - filled ? f_len - read : index->window_len - filled;
+            if (pread_all(in_fd, index->window + filled, n, read) < n) {
+                fprintf(stderr, "Could not read file (file changed while encoding?).\n");
+                fflush(stderr);
+                free(refs);
+                return NULL;
+            }
+            if (hasher) {
+                blake3_update(hasher, (const unsigned char *) index->window + filled, n);
+            }
+            filled += n;
+            read += n;
+        }
+
+        char *data = index->window + pos;
+        uint64_t len = next_chunk(index, (const unsigned char *) data, filled - pos);
+        uint32_t crc = crc32c(0, data, len);
+        int64_t found = find_chunk(index, data, len, crc);
+        int err = found < 0;
+        if (found > 0) {
+            //  the chunk is stored already, either earlier in this entry or in an earlier entry
+            struct dedup_chunk *chunk = index->chunks + found - 1;
+            enum ref_kind kind = (uint64_t) found > first_new ? REF_OWN : REF_PRIOR;
+            err = add_ref(&refs, n_refs, &capacity, kind, chunk->off, len);
+        } else if (!found) {
+            struct dedup_chunk chunk = {crc, len, *stored_total, index->tmp_len};
+            if (pwrite_all(index->tmp_fd, data, len, index->tmp_len) < len) {
+                fprintf(stderr, "Could not write the temporary file.\n");
+                fflush(stderr);
+                err = 1;
+            }
+            err = err || add_chunk(index, &chunk) || add_ref(&refs, n_refs, &capacity, REF_NEW, *stored_total, len);
+            index->tmp_len += len;
+            *stored_total += len;
+        }
+        if (err) {
+            free(refs);
+            return NULL;
+        }
+        pos += len;
+    }
+
+    //  an empty file has no references, the table still has to be allocated
+    if (!refs) {
+        refs = malloc(sizeof (struct dedup_ref));
+        if (!refs) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+        }
+    }
+    return refs;
+}
+
+//  encode the header of a deduplicated file, it is the normal header (with the kind in the length of the filename)
+//  followed by the fields and the reference table, the new chunks follow as the rest of the content
+//  start is the offset of the entry in the concatenated data-files, the new chunks of the entry get their final offset
+static char *encode_dedup_header(const char *name, uint64_t orig_len, const struct dedup_ref *refs, uint64_t n_refs,
+                          uint64_t stored_total, uint64_t start, struct dedup_index *index, uint64_t first_new,
+                          uint64_t *header_len) {
+    uint64_t table_len = DEDUP_FIELDS + n_refs * REF_SIZE;
+    uint64_t prefix_len = 0;
+    char *prefix = encode_header(name, table_len + stored_total, &prefix_len);
+    if (!prefix) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    char *header = realloc(prefix, prefix_len + table_len);
+    if (!header) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free(prefix);
+        return NULL;
+    }
+    header[LEN_SIZE - 1] = ENTRY_DEDUP;
+    *header_len = prefix_len + table_len;
+
+    //  the new chunks directly follow the header
+    uint64_t chunks_start = start + *header_len;
+    for (uint64_t i = first_new; i < index->n_chunks; i++) {
+        index->chunks[i].off += chunks_start;
+    }
+
+    char *fields = header + prefix_len;
+    store_bytes(orig_len, LEN_SIZE, fields);
+    store_bytes(n_refs, LEN_SIZE, fields + LEN_SIZE);
+    for (uint64_t i = 0; i < n_refs; i++) {
+        uint64_t src = refs[i].src;
+        if (refs[i].kind == REF_NEW) {
+            src |= REF_STREAM;
+        } else if (refs[i].kind == REF_OWN) {
+            src += chunks_start;
+        }
+        store_bytes(src, LEN_SIZE, fields + DEDUP_FIELDS + i * REF_SIZE);
+        store_bytes(refs[i].len, LEN_SIZE, fields + DEDUP_FIELDS + i * REF_SIZE + LEN_SIZE);
+    }
+    return header;
+}
+
+//  split the input file into chunks, store its new chunks in the temporary file of the index and build its header
+//  start is the offset of the entry in the concatenated data-files, the offset of the new chunks in the
+//  temporary file is stored in src_off, returns the header or NULL on errors
+//  if hash is given, the content hash is calculated from the data that is read for the chunking
+static char *dedup_file(struct dedup_index *index, char *filepath, const char *name, uint64_t f_len, uint64_t start,
+                 uint64_t *header_len, uint64_t *stored_total, uint64_t *src_off, unsigned char *hash) {
+    int in_fd = open(filepath, O_RDONLY);
+    if (in_fd < 0) {
+        fprintf(stderr, "Could not read file '%s'.\n", filepath);
+        fflush(stderr);
+        return NULL;
+    }
+    uint64_t first_new = index->n_chunks;
+    uint64_t n_refs = 0;
+    *src_off = index->tmp_len;
+    struct blake3 hasher;
+    blake3_init(&hasher);
+    struct dedup_ref *refs = dedup_entry(index, in_fd, f_len, &n_refs, stored_total, hash ? &hasher : NULL);
+    close(in_fd);
+    if (!refs) {
+        return NULL;
+    }
+    if (hash) {
+        blake3_final(&hasher, hash);
+    }
+    char *header = encode_dedup_header(name, f_len, refs, n_refs, *stored_total, start, index, first_new, header_len);
+    free(refs);
+    return header;
+}
+
+//  start walking the given input arguments, directories are listed by a pool of threads in the background
+//  explicit files are passed on as they are, their stored name is the filename without the directories
+static struct input_walk *start_walk(char **args, uint32_t n_args, const struct fpp_options *opts) {
+    struct input_walk *walk = calloc(1, sizeof (struct input_walk));
+    if (!walk) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    walk->args = args;
+    walk->n_args = n_args;
+    pthread_mutex_init(&walk->lock, NULL);
+    pthread_cond_init(&walk->work_cond, NULL);
+    pthread_cond_init(&walk->ready_cond, NULL);
+    walk->roots = calloc(n_args ? n_args : 1, sizeof (struct walk_node *));
+    if (!walk->roots) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_walk(walk);
+        return NULL;
+    }
+
+    //  the stored names of the files of a directory start with the name of the directory itself,
+    //  unless it has none (e.g. '.' or '/'), then they are relative to it
+    for (uint32_t i = 0; i < n_args; i++) {
+        struct stat st;
+        if (stat(args[i], &st) || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        uint64_t len = strlen(args[i]);
+        while (len > 1 && args[i][len - 1] == '/') {
+            len--;
+        }
+        uint64_t name_off = extract_filename(args[i], len);
+        const char *base = args[i] + name_off;
+        if (len == name_off || !strncmp(base, ".", len - name_off) || !strncmp(base, "..", len - name_off)) {
+            name_off = len + (args[i][len - 1] == '/' ? 0 : 1);
+        }
+        walk->roots[i] = new_walk_node(args[i], len, name_off);
+        if (!walk->roots[i] || queue_walk_node(walk, walk->roots[i])) {
+            free_walk(walk);
+            return NULL;
+        }
+    }
+    if (!walk->n_queued) {
+        return walk;
+    }
+
+    //  listing directories mostly waits for the filesystem, so at least a few threads are used
+    unsigned n_threads = opts->threads > WALK_THREADS ? opts->threads : WALK_THREADS;
+    walk->threads = calloc(n_threads, sizeof (pthread_t));
+    if (!walk->threads) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_walk(walk);
+        return NULL;
+    }
+    for (unsigned i = 0; i < n_threads; i++) {
+        if (pthread_create(walk->threads + i, NULL, walk_worker_run, walk)) {
+            break;
+        }
+        walk->n_threads++;
+    }
+    if (!walk->n_threads) {
+        fprintf(stderr, "Could not start worker thread.\n");
+        fflush(stderr);
+        free_walk(walk);
+        return NULL;
+    }
+    return walk;
+}
+
+//  allocate a directory of the walk with the first len bytes of the given path
+static struct walk_node *new_walk_node(const char *path, uint64_t len, uint64_t name_off) {
+    struct walk_node *node = calloc(1, sizeof (struct walk_node));
+    char *node_path = malloc(len + 1);
+    if (!node || !node_path) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free(node);
+        free(node_path);
+        return NULL;
+    }
+    bytes_cpy(path, node_path, len);
+    node_path[len] = 0;
+    node->path = node_path;
+    node->name_off = name_off;
+    return node;
+}
+
+//  join the path of a directory and the name of one of its entries
+static char *join_path(const char *dir, const char *name) {
+    uint64_t dir_len = strlen(dir);
+    uint64_t name_len = strlen(name);
+    int sep = dir_len && dir[dir_len - 1] != '/';
+    char *path = malloc(dir_len + sep + name_len + 1);
+    if (!path) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    bytes_cpy(dir, path, dir_len);
+    path[dir_len] = '/';
+    bytes_cpy(name, path + dir_len + sep, name_len + 1);
+    return path;
+}
+
+//  push a directory onto the work queue of the walker threads, the caller holds the lock (or no thread runs yet)
+static int queue_walk_node(struct input_walk *walk, struct walk_node *node) {
+    if (walk->n_queued == walk->queue_capacity) {
+        uint64_t capacity = walk->queue_capacity ? walk->queue_capacity * 2 : 64;
+        struct walk_node **queue = realloc(walk->queue, capacity * sizeof (struct walk_node *));
+        if (!queue) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        walk->queue = queue;
+        walk->queue_capacity = capacity;
+    }
+    walk->queue[walk->n_queued++] = node;
+    return 0;
+}
+
+//  walker thread, it lists directories until the tree is walked completely
+//  the queue is a stack, so the threads stay close to the directory that is encoded next
+static void *walk_worker_run(void *arg) {
+    struct input_walk *walk = arg;
+    char *buf = malloc(WALK_BUF);
+    pthread_mutex_lock(&walk->lock);
+    while (1) {
+        while (!walk->stop && !walk->n_queued && walk->active) {
+            pthread_cond_wait(&walk->work_cond, &walk->lock);
+        }
+        if (walk->stop || !walk->n_queued) {
+            break;
+        }
+        struct walk_node *node = walk->queue[--walk->n_queued];
+        walk->active++;
+        pthread_mutex_unlock(&walk->lock);
+
+        int err = !buf || list_directory(node, buf);
+
+        //  the subdirectories are queued in reverse order, so the first one is listed first
+        pthread_mutex_lock(&walk->lock);
+        for (uint32_t i = node->n_dirs; !err && i > 0; i--) {
+            err = queue_walk_node(walk, node->dirs[i - 1]);
+        }
+        node->failed = err;
+        node->ready = 1;
+        walk->active--;
+        pthread_cond_broadcast(&walk->work_cond);
+        pthread_cond_broadcast(&walk->ready_cond);
+    }
+    pthread_mutex_unlock(&walk->lock);
+    free(buf);
+    return NULL;
+}
+
+//  add an entry of a directory to its files or subdirectories, other kinds of files are skipped
+static int add_walk_entry(struct walk_node *node, const char *name, int is_dir, uint32_t *files_capacity,
+                   uint32_t *dirs_capacity) {
+    if (is_dir) {
+        if (node->n_dirs == *dirs_capacity) {
+            *dirs_capacity = *dirs_capacity ? *dirs_capacity * 2 : 16;
+            struct walk_node **dirs = realloc(node->dirs, *dirs_capacity * sizeof (struct walk_node *));
+            if (!dirs) {
+                return 1;
+            }
+            node->dirs = dirs;
+        }
+        char *path = join_path(node->path, name);
+        struct walk_node *child = path ? new_walk_node(path, strlen(path), node->name_off) : NULL;
+        free(path);
+        if (!child) {
+            return 1;
+        }
+        node->dirs[node->n_dirs++] = child;
+        return 0;
+    }
+    if (node->n_files == *files_capacity) {
+        *files_capacity = *files_capacity ? *files_capacity * 2 : 64;
+        char **files = realloc(node->files, *files_capacity * sizeof (char *));
+        if (!files) {
+            return 1;
+        }
+        node->files = files;
+    }
+    node->files[node->n_files] = strdup(name);
+    return !node->files[node->n_files++];
+}
+
+//  list the regular files and subdirectories of a directory and sort them by name
+//  on linux, the entries are read with getdents64 and their type is only looked up with statx if it is not included
+static int list_directory(struct walk_node *node, char *buf) {
+    int fd = open(node->path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not read directory '%s'.\n", node->path);
+        fflush(stderr);
+        return 1;
+    }
+    uint32_t files_capacity = 0;
+    uint32_t dirs_capacity = 0;
+    int err = 0;
+#ifdef __linux__
+    while (!err) {
+        long n = syscall(SYS_getdents64, fd, buf, WALK_BUF);
+        if (n <= 0) {
+            err = n < 0;
+            break;
+        }
+        for (long off = 0; !err && off < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *) (buf + off);
+            off += d->d_reclen;
+            if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, "..")) {
+                continue;
+            }
+            unsigned type = d->d_type;
+            if (type == DT_UNKNOWN) {
+                struct statx stx;
+                if (statx(fd, d->d_name, AT_SYMLINK_NOFOLLOW, STATX_TYPE, &stx)) {
+                    err = 1;
+                    break;
+                }
+                type = S_ISDIR(stx.stx_mode) ? DT_DIR : S_ISREG(stx.stx_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type != DT_DIR && type != DT_REG) {
+                fprintf(stderr, "Skipping '%s/%s' (not a regular file or directory).\n", node->path, d->d_name);
+                fflush(stderr);
+                continue;
+            }
+            err = add_walk_entry(node, d->d_name, type == DT_DIR, &files_capacity, &dirs_capacity);
+        }
+    }
+    close(fd);
+#else
+    (void) buf;
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        err = 1;
+    }
+    struct dirent *d;
+    while (!err && (d = readdir(dir))) {
+        if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, "..")) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+            err = 1;
+            break;
+        }
+        if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "Skipping '%s/%s' (not a regular file or directory).\n", node->path, d->d_name);
+            fflush(stderr);
+            continue;
+        }
+        err = add_walk_entry(node, d->d_name, S_ISDIR(st.st_mode), &files_capacity, &dirs_capacity);
+    }
+    if (dir) {
+        closedir(dir);
+    }
+#endif
+    if (err) {
+        fprintf(stderr, "Could not read directory '%s'.\n", node->path);
+        fflush(stderr);
+        return 1;
+    }
+    if (node->n_files > 1) {
+        qsort(node->files, node->n_files, sizeof (char *), compare_names);
+    }
+    if (node->n_dirs > 1) {
+        qsort(node->dirs, node->n_dirs, sizeof (struct walk_node *), compare_nodes);
+    }
+    return 0;
+}
+
+//  compare two filenames for sorting
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+//  compare two directories of the walk by their path for sorting
+static int compare_nodes(const void *a, const void *b) {
+    return strcmp((*(struct walk_node * const *) a)->path, (*(struct walk_node * const *) b)->path);
+}
+
+//  take the next input file, returns 1 if there is one, 0 once all files are taken and -1 on errors
+//  the path of the file is allocated and needs to be freed by the caller, its stored name is a suffix of the path
+//  the files of a directory are taken as soon as it is listed, while the threads continue with the rest of the tree
+static int next_input(struct input_walk *walk, struct input_file *input) {
+    while (1) {
+        if (walk->depth) {
+            struct walk_frame *frame = walk->stack + walk->depth - 1;
+            struct walk_node *node = frame->node;
+            pthread_mutex_lock(&walk->lock);
+            while (!node->ready) {
+                pthread_cond_wait(&walk->ready_cond, &walk->lock);
+            }
+            pthread_mutex_unlock(&walk->lock);
+            if (node->failed) {
+                return -1;
+            }
+
+            if (frame->file_idx < node->n_files) {
+                input->path = join_path(node->path, node->files[frame->file_idx++]);
+                if (!input->path) {
+                    return -1;
+                }
+                input->name = input->path + node->name_off;
+                return 1;
+            }
+            if (frame->dir_idx < node->n_dirs) {
+                if (push_walk_frame(walk, node->dirs[frame->dir_idx++])) {
+                    return -1;
+                }
+                continue;
+            }
+            //  the directory and all of its subdirectories are done
+            free_walk_node(node);
+            walk->depth--;
+            continue;
+        }
+
+        if (walk->arg_idx == walk->n_args) {
+            return 0;
+        }
+        uint32_t i = walk->arg_idx++;
+        if (walk->roots[i]) {
+            struct walk_node *root = walk->roots[i];
+            walk->roots[i] = NULL;
+            if (push_walk_frame(walk, root)) {
+                free_walk_tree(root);
+                return -1;
+            }
+            continue;
+        }
+        input->path = strdup(walk->args[i]);
+        if (!input->path) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return -1;
+        }
+        input->name = input->path + extract_filename(input->path, strlen(input->path));
+        return 1;
+    }
+}
+
+//  push a directory onto the stack of the traversal
+static int push_walk_frame(struct input_walk *walk, struct walk_node *node) {
+    if (walk->depth == walk->stack_capacity) {
+        uint32_t capacity = walk->stack_capacity ? walk->stack_capacity * 2 : 16;
+        struct walk_frame *stack = realloc(walk->stack, capacity * sizeof (struct walk_frame));
+        if (!stack) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        walk->stack = stack;
+        walk->stack_capacity = capacity;
+    }
+    walk->stack[walk->depth++] = (struct walk_frame) {node, 0, 0};
+    return 0;
+}
+
+//  free a directory of the walk, its subdirectories are freed separately
+static void free_walk_node(struct walk_node *node) {
+    for (uint32_t i = 0; i < node->n_files; i++) {
+        free(node->files[i]);
+    }
+    free(node->files);
+    free(node->dirs);
+    free(node->path);
+    free(node);
+}
+
+//  free a directory of the walk and all of its subdirectories
+static void free_walk_tree(struct walk_node *node) {
+    for (uint32_t i = 0; i < node->n_dirs; i++) {
+        free_walk_tree(node->dirs[i]);
+    }
+    free_walk_node(node);
+}
+
+//  stop the walker threads and free the walk, including the directories that were not taken yet
+static void free_walk(struct input_walk *walk) {
+    if (!walk) {
+        return;
+    }
+    pthread_mutex_lock(&walk->lock);
+    walk->stop = 1;
+    pthread_cond_broadcast(&walk->work_cond);
+    pthread_mutex_unlock(&walk->lock);
+    for (unsigned i = 0; i < walk->n_threads; i++) {
+        pthread_join(walk->threads[i], NULL);
+    }
+    free(walk->threads);
+
+    //  the subdirectories in front of the current one of every directory on the stack are freed already
+    for (uint32_t i = walk->depth; i > 0; i--) {
+        struct walk_frame *frame = walk->stack + i - 1;
+        for (uint32_t j = frame->dir_idx; j < frame->node->n_dirs; j++) {
+            free_walk_tree(frame->node->dirs[j]);
+        }
+        free_walk_node(frame->node);
+    }
+    for (uint32_t i = 0; walk->roots && i < walk->n_args; i++) {
+        if (walk->roots[i]) {
+            free_walk_tree(walk->roots[i]);
+        }
+    }
+    free(walk->roots);
+    free(walk->stack);
+    free(walk->queue);
+    pthread_mutex_destroy(&walk->lock);
+    pthread_cond_destroy(&walk->work_cond);
+    pthread_cond_destroy(&walk->ready_cond);
+    free(walk);
+}
+
+//  allocate a ring of buffers between the reader and the writer of the pipelined engine
+static struct pipe_ring *new_pipe_ring(void) {
+    struct pipe_ring *ring = calloc(1, sizeof (struct pipe_ring));
+    if (!ring) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    ring->slots = calloc(PIPE_SLOTS, sizeof (struct pipe_slot));
+    for (unsigned i = 0; ring->slots && i < PIPE_SLOTS; i++) {
+        ring->slots[i].data = malloc(BUF_SIZE);
+    }
+    for (unsigned i = 0; i < PIPE_SLOTS; i++) {
+        if (!ring->slots || !ring->slots[i].data) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free_pipe_ring(ring);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->filled, NULL);
+    pthread_cond_init(&ring->emptied, NULL);
+    ring->ready = 1;
+    return ring;
+}
+
+//  free the ring and its buffers
+static void free_pipe_ring(struct pipe_ring *ring) {
+    if (!ring) {
+        return;
+    }
+    for (unsigned i = 0; ring->slots && i < PIPE_SLOTS; i++) {
+        free(ring->slots[i].data);
+    }
+    free(ring->slots);
+    if (ring->ready) {
+        pthread_mutex_destroy(&ring->lock);
+        pthread_cond_destroy(&ring->filled);
+        pthread_cond_destroy(&ring->emptied);
+    }
+    free(ring);
+}
+
+//  take the next empty slot of the ring for filling, waits while all slots are filled
+//  returns NULL if the writer aborted
+static struct pipe_slot *pipe_acquire(struct pipe_ring *ring) {
+    pthread_mutex_lock(&ring->lock);
+    while (!ring->aborted && ring->head - ring->tail == PIPE_SLOTS) {
+        pthread_cond_wait(&ring->emptied, &ring->lock);
+    }
+    struct pipe_slot *slot = ring->aborted ? NULL : ring->slots + ring->head % PIPE_SLOTS;
+    pthread_mutex_unlock(&ring->lock);
+    if (slot) {
+        slot->len = 0;
+    }
+    return slot;
+}
+
+//  pass the slot that was filled last on to the writer
+static void pipe_publish(struct pipe_ring *ring) {
+    pthread_mutex_lock(&ring->lock);
+    ring->head++;
+    pthread_cond_signal(&ring->filled);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+//  take the next filled slot of the ring, waits until the reader filled one
+//  returns NULL once the reader is done and all slots are consumed, or if the reader failed
+static struct pipe_slot *pipe_take(struct pipe_ring *ring) {
+    pthread_mutex_lock(&ring->lock);
+    while (!ring->failed && !ring->done && ring->head == ring->tail) {
+        pthread_cond_wait(&ring->filled, &ring->lock);
+    }
+    struct pipe_slot *slot = NULL;
+    if (!ring->failed && ring->head != ring->tail) {
+        slot = ring->slots + ring->tail % PIPE_SLOTS;
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return slot;
+}
+
+//  hand the slot that was taken last back to the reader
+static void pipe_release(struct pipe_ring *ring) {
+    pthread_mutex_lock(&ring->lock);
+    ring->tail++;
+    pthread_cond_signal(&ring->emptied);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+//  mark the end of the data, failed is set if the reader could not read all of it
+static void pipe_finish(struct pipe_ring *ring, int failed) {
+    pthread_mutex_lock(&ring->lock);
+    ring->done = 1;
+    ring->failed = failed;
+    pthread_cond_signal(&ring->filled);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+//  stop the reader, after the writer failed
+static void pipe_abort(struct pipe_ring *ring) {
+    pthread_mutex_lock(&ring->lock);
+    ring->aborted = 1;
+    pthread_cond_signal(&ring->emptied);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+//  reader thread of the pipelined encoder
+//  it encodes the input files one after another and streams the encoded data (headers and file-contents)
+//  into the ring, so the next input file is read while the data-files are written
+//  the central directory and the index of unique chunks are only used by this thread
+static void *pipe_read_inputs(void *arg) {
+    struct pipe_encoder *enc_state = arg;
+    struct pipe_ring *ring = enc_state->ring;
+    struct input_file input;
+    struct pipe_slot *slot = NULL;
+    uint64_t total = 0;
+    int found;
+    uint64_t t = stats_clock();
+    while ((found = next_input(enc_state->walk, &input)) > 0) {
+        stats_add(PHASE_SCAN, t);
+        t = stats_clock();
+        TRACE_BEGIN("file", input.name);
+        struct encoded_file *enc = encode_file(input.path, input.name, enc_state->out_name, enc_state->opts,
+                                               enc_state->index, total);
+        if (!enc) {
+            fprintf(stderr, "Could not encode file '%s'.\n", input.path);
+            fflush(stderr);
+            free(input.path);
+            pipe_finish(ring, 1);
+            return NULL;
+        }
+        uint64_t content_start = total + enc->content_off;
+        uint64_t max_fsize = enc_state->max_fsize;
+        if (enc_state->dir && directory_add(enc_state->dir, input.name, strlen(input.name), enc->len - enc->content_off,
+                                            content_start / max_fsize, content_start % max_fsize, enc->kind, enc->orig_len)) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free_encoded_file(enc);
+            free(input.path);
+            pipe_finish(ring, 1);
+            return NULL;
+        }
+
+        //  the header is copied from memory, the file-content is read from the input (or temporary) file
+        uint64_t off = 0;
+        while (off < enc->len) {
+            if (!slot) {
+                slot = pipe_acquire(ring);
+                if (!slot) {
+                    free_encoded_file(enc);
+                    free(input.path);
+                    pipe_finish(ring, 1);
+                    return NULL;
+                }
+            }
+            uint64_t n = BUF_SIZE - slot->len;
+            if (enc->len - off < n) {
+                n = enc->len - off;
+            }
+            if (off < enc->header_len) {
+                if (enc->header_len - off < n) {
+                    n = enc->header_len - off;
+                }
+                bytes_cpy(enc->header + off, slot->data + slot->len, n);
+            } else {
+                TRACE_BEGIN_IF(enc->traced, "read", input.name);
+                uint64_t n_read = pread_all(fileno(enc->file), slot->data + slot->len, n, enc->src_off + off - enc->header_len);
+                TRACE_END_IF(enc->traced, "read");
+                if (n_read < n) {
+                    fprintf(stderr, "Could not copy file '%s' (file changed while encoding?).\n", input.path);
+                    fflush(stderr);
+                    free_encoded_file(enc);
+                    free(input.path);
+                    pipe_finish(ring, 1);
+                    return NULL;
+                }
+                if (enc->hasher) {
+                    blake3_update(enc->hasher, (const unsigned char *) slot->data + slot->len, n);
+                }
+            }
+            slot->len += n;
+            off += n;
+            if (slot->len == BUF_SIZE) {
+                pipe_publish(ring);
+                slot = NULL;
+            }
+        }
+        TRACE_END("file");
+
+        //  the content hash of a raw file is calculated from the data that was read into the ring
+        if (enc->hasher) {
+            blake3_final(enc->hasher, enc->hash);
+        }
+        if (enc_state->manifest && manifest_add(enc_state->manifest, input.name, strlen(input.name), enc->hash)) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free_encoded_file(enc);
+            free(input.path);
+            pipe_finish(ring, 1);
+            return NULL;
+        }
+        stats_add(PHASE_READ, t);
+        total += enc->len;
+        stats_entry(enc->orig_len);
+        stats.bytes_read += enc->orig_len;
+        free_encoded_file(enc);
+        free(input.path);
+        t = stats_clock();
+    }
+    stats_add(PHASE_SCAN, t);
+    if (slot && slot->len) {
+        pipe_publish(ring);
+    }
+    pipe_finish(ring, found < 0);
+    return NULL;
+}
+
+//  encode the given input files with a reader and a writer thread, connected by a ring of buffers
+//  the reader encodes and reads the input files, while this thread splits the data into the data-files
+//  the output is identical to the one of the serial encoder
+static int encode_files_pipelined(char *out_name, struct input_walk *walk, uint64_t max_fsize, const struct fpp_options *opts) {
+    struct pipe_encoder enc_state = {0};
+    enc_state.walk = walk;
+    enc_state.out_name = out_name;
+    enc_state.max_fsize = max_fsize;
+    enc_state.opts = opts;
+    if (opts->directory) {
+        enc_state.dir = new_directory(max_fsize);
+        if (!enc_state.dir) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+    }
+    if (opts->hash) {
+        enc_state.manifest = new_manifest();
+        if (!enc_state.manifest) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free_directory(enc_state.dir);
+            return 1;
+        }
+    }
+    if (opts->dedup) {
+        enc_state.index = new_dedup_index(out_name, opts);
+        if (!enc_state.index) {
+            free_directory(enc_state.dir);
+            free_manifest(enc_state.manifest);
+            return 1;
+        }
+    }
+    enc_state.ring = new_pipe_ring();
+    uint32_t f_name_len = strlen(out_name) + 32;
+    char *f_name = malloc(f_name_len);
+    if (!enc_state.ring || !f_name) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free(f_name);
+        free_pipe_ring(enc_state.ring);
+        free_dedup_index(enc_state.index);
+        free_directory(enc_state.dir);
+        free_manifest(enc_state.manifest);
+        return 1;
+    }
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, pipe_read_inputs, &enc_state)) {
+        fprintf(stderr, "Could not start worker thread.\n");
+        fflush(stderr);
+        free(f_name);
+        free_pipe_ring(enc_state.ring);
+        free_dedup_index(enc_state.index);
+        free_directory(enc_state.dir);
+        free_manifest(enc_state.manifest);
+        return 1;
+    }
+
+    //  split the data into the data-files, a new data-file is only created if there is data left for it
+    uint64_t written_total = 0;
+    uint32_t f_idx = 0;
+    uint64_t crcs_capacity = 0;
+    uint32_t *crcs = NULL;
+    int out_fd = -1;
+    uint64_t part_start = 0;
+    int err = 0;
+    struct pipe_slot *slot;
+    while (!err && (slot = pipe_take(enc_state.ring))) {
+        uint64_t pos = 0;
+        while (pos < slot->len) {
+            if (written_total % max_fsize == 0) {
+                if (out_fd >= 0) {
+                    uint64_t t = stats_clock();
+                    TRACE_BEGIN("close", f_name);
+                    int failed = close(out_fd);
+                    TRACE_END("close");
+                    out_fd = -1;
+                    if (failed) {
+                        fprintf(stderr, "Could not write to file '%s'.\n", f_name);
+                        fflush(stderr);
+                        err = 1;
+                        break;
+                    }
+                    stats_add(PHASE_CLOSE, t);
+                    stats_partition(part_start);
+                    if (sink_submit(f_name)) {
+                        err = 1;
+                        break;
+                    }
+                }
+                if (f_idx == crcs_capacity) {
+                    crcs_capacity = crcs_capacity ? crcs_capacity * 2 : 16;
+                    uint32_t *new_crcs = realloc(crcs, crcs_capacity * sizeof (uint32_t));
+                    if (!new_crcs) {
+                        fprintf(stderr, "Memory allocation error.\n");
+                        fflush(stderr);
+                        out_fd = -1;
+                        err = 1;
+                        break;
+                    }
+                    crcs = new_crcs;
+                }
+                snprintf(f_name, f_name_len, "%s_data%u", out_name, f_idx);
+                fprintf(stdout, "Writing file '%s'.\n", f_name);
+                fflush(stdout);
+                TRACE_BEGIN("open", f_name);
+                out_fd = open(f_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                TRACE_END("open");
+                part_start = stats_clock();
+                if (out_fd < 0) {
+                    fprintf(stderr, "Could not open file '%s'.\n", f_name);
+                    fflush(stderr);
+                    err = 1;
+                    break;
+                }
+                crcs[f_idx++] = 0;
+            }
+            uint64_t n = max_fsize - written_total % max_fsize;
+            if (slot->len - pos < n) {
+                n = slot->len - pos;
+            }
+            uint64_t t = stats_clock();
+            TRACE_BEGIN("write", f_name);
+            uint64_t written = pwrite_all(out_fd, slot->data + pos, n, written_total % max_fsize);
+            TRACE_END("write");
+            if (written < n) {
+                fprintf(stderr, "Could not write to file '%s'.\n", f_name);
+                fflush(stderr);
+                err = 1;
+                break;
+            }
+            stats_add(PHASE_WRITE, t);
+            if (!opts->no_checksums) {
+                crcs[f_idx - 1] = crc32c(crcs[f_idx - 1], slot->data + pos, n);
+            }
+            stats.bytes_written += n;
+            written_total += n;
+            pos += n;
+        }
+        pipe_release(enc_state.ring);
+    }
+    if (err) {
+        pipe_abort(enc_state.ring);
+    }
+    pthread_join(reader, NULL);
+    err |= enc_state.ring->failed;
+    if (out_fd >= 0) {
+        uint64_t t = stats_clock();
+        TRACE_BEGIN("close", f_name);
+        int failed = close(out_fd);
+        TRACE_END("close");
+        if (failed && !err) {
+            fprintf(stderr, "Could not write to file '%s'.\n", f_name);
+            fflush(stderr);
+            err = 1;
+        }
+        stats_add(PHASE_CLOSE, t);
+        stats_partition(part_start);
+        if (!err && sink_submit(f_name)) {
+            err = 1;
+        }
+    }
+    free(f_name);
+    free_pipe_ring(enc_state.ring);
+    free_dedup_index(enc_state.index);
+    if (err) {
+        free(crcs);
+        free_directory(enc_state.dir);
+        free_manifest(enc_state.manifest);
+        return 1;
+    }
+
+    //  write the main output file, containing the information about the other files
+    struct main_file info = {f_idx, written_total, enc_state.dir, opts->no_checksums ? NULL : crcs, enc_state.manifest};
+    uint64_t t = stats_clock();
+    TRACE_BEGIN("main file write", out_name);
+    err = write_main_file(out_name, &info);
+    TRACE_END("main file write");
+    stats_add(PHASE_MAIN_FILE, t);
+    free_directory(enc_state.dir);
+    free_manifest(enc_state.manifest);
+    free(crcs);
+    if (err) {
+        return 1;
+    }
+    fprintf(stdout, "Successfully wrote %llu bytes to %u files.\n", (unsigned long long) written_total, f_idx);
+    fflush(stdout);
+    return 0;
+}
+
+//  reader thread of the pipelined decoder
+//  it verifies and reads the data-files one after another into the ring, so the next data-file is read
+//  while the files of the current one are extracted
+static void *pipe_read_partitions(void *arg) {
+    struct pipe_decoder *dec_state = arg;
+    struct pipe_ring *ring = dec_state->ring;
+    uint64_t read_total = 0;
+    for (uint32_t i = 0; i < dec_state->f_count; i++) {
+        char *f_name = dec_state->f_names + (uint64_t) i * dec_state->f_name_len;
+        fprintf(stdout, "Reading file '%s'\n", f_name + extract_filename(f_name, strlen(f_name)));
+        fflush(stdout);
+        uint64_t part_start = stats_clock();
+        int fd = open(f_name, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Error, could not read file '%s'.\n", f_name);
+            fflush(stderr);
+            pipe_finish(ring, 1);
+            return NULL;
+        }
+        uint64_t part_len = f_size(f_name);
+        if (read_total + part_len > dec_state->size_total) {
+            fprintf(stderr, "Error, data-files exceed the expected size. Input file might be corrupted.\n");
+            fflush(stderr);
+            close(fd);
+            pipe_finish(ring, 1);
+            return NULL;
+        }
+
+        //  the data-file is verified before anything is extracted from it, afterwards it is read from the page cache
+        uint32_t crc = 0;
+        TRACE_BEGIN("verify", f_name);
+        int corrupted = dec_state->crcs && (checksum_range(fd, 0, part_len, dec_state->buf, &crc) || crc != dec_state->crcs[i]);
+        TRACE_END("verify");
+        if (corrupted) {
+            fprintf(stderr, "Error, file '%s' is corrupted (checksum mismatch).\n", f_name);
+            fflush(stderr);
+            close(fd);
+            pipe_finish(ring, 1);
+            return NULL;
+        }
+        for (uint64_t off = 0; off < part_len;) {
+            struct pipe_slot *slot = pipe_acquire(ring);
+            if (!slot) {
+                close(fd);
+                pipe_finish(ring, 1);
+                return NULL;
+            }
+            uint64_t n = part_len - off < BUF_SIZE ? part_len - off : BUF_SIZE;
+            TRACE_BEGIN("read", f_name);
+            uint64_t n_read = pread_all(fd, slot->data, n, off);
+            TRACE_END("read");
+            if (n_read < n) {
+                fprintf(stderr, "Error, could not read file '%s'.\n", f_name);
+                fflush(stderr);
+                close(fd);
+                pipe_finish(ring, 1);
+                return NULL;
+            }
+            slot->len = n;
+            pipe_publish(ring);
+            off += n;
+        }
+        close(fd);
+        stats_add(PHASE_READ, part_start);
+        stats_partition(part_start);
+        read_total += part_len;
+    }
+    pipe_finish(ring, 0);
+    return NULL;
+}
+
+//  extract the files of the data-files with a reader and a writer thread, connected by a ring of buffers
+//  the reader reads ahead, while this thread extracts the files from the data that was read already
+//  the number of extracted bytes is stored in read_total
+static int extract_pipelined(struct extract_state *st, char *f_names, uint32_t f_name_len, uint32_t f_count,
+                      uint64_t size_total, uint32_t *crcs, char *buf, uint64_t *read_total) {
+    struct pipe_decoder dec_state = {0};
+    dec_state.f_names = f_names;
+    dec_state.f_name_len = f_name_len;
+    dec_state.f_count = f_count;
+    dec_state.size_total = size_total;
+    dec_state.crcs = crcs;
+    dec_state.buf = buf;
+    dec_state.ring = new_pipe_ring();
+    if (!dec_state.ring) {
+        return 1;
+    }
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, pipe_read_partitions, &dec_state)) {
+        fprintf(stderr, "Could not start worker thread.\n");
+        fflush(stderr);
+        free_pipe_ring(dec_state.ring);
+        return 1;
+    }
+
+    //  the whole buffer is consumed, since nothing is copied past the buffer
+    st->zero_copy = 0;
+    int err = 0;
+    struct pipe_slot *slot;
+    while ((slot = pipe_take(dec_state.ring))) {
+        uint64_t consumed = 0;
+        uint64_t t = stats_clock();
+        if (extract_files(st, slot->data, slot->len, &consumed)) {
+            err = 1;
+            pipe_abort(dec_state.ring);
+            break;
+        }
+        stats_add(PHASE_WRITE, t);
+        *read_total += consumed;
+        pipe_release(dec_state.ring);
+    }
+    pthread_join(reader, NULL);
+    err |= dec_state.ring->failed;
+    free_pipe_ring(dec_state.ring);
+    return err;
+}
+
+//  set up the io_uring instance if the io_uring backend is selected
+//  returns NULL if it is not selected or not available, the stdio backend is used in that case
+static struct uring *setup_uring(const struct fpp_options *opts) {
+    if (opts->io != IO_URING) {
+        return NULL;
+    }
+    struct uring *ring = uring_init(opts->queue_depth);
+    if (!ring) {
+        fprintf(stdout, "io_uring is not available, falling back to I/O backend 'stdio'.\n");
+        fflush(stdout);
+    }
+    return ring;
+}
+
+#ifdef __linux__
+//  set up an io_uring instance with the given queue depth and the buffers for the copy operations
+//  returns NULL if io_uring is not available (old kernel, disabled by seccomp, ...)
+static struct uring *uring_init(unsigned depth) {
+    struct uring *ring = calloc(1, sizeof (struct uring));
+    if (!ring) {
+        return NULL;
+    }
+
+    //  every copied chunk needs two entries (read and write)
+    if (depth < 2) {
+        depth = 2;
+    }
+    struct io_uring_params params;
+    memset(&params, 0, sizeof (params));
+    ring->fd = (int) syscall(__NR_io_uring_setup, depth, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+    ring->depth = params.sq_entries;
+
+    //  map the submission queue, the completion queue and the submission entries
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    ring->slots = ring->depth / 2;
+    ring->bufs = malloc(ring->slots * URING_CHUNK);
+    if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED || !ring->bufs) {
+        uring_free(ring);
+        return NULL;
+    }
+
+    ring->sq_head = (unsigned *) ((char *) ring->sq_ptr + params.sq_off.head);
+    ring->sq_tail = (unsigned *) ((char *) ring->sq_ptr + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) ((char *) ring->sq_ptr + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) ((char *) ring->sq_ptr + params.sq_off.array);
+    ring->cq_head = (unsigned *) ((char *) ring->cq_ptr + params.cq_off.head);
+    ring->cq_tail = (unsigned *) ((char *) ring->cq_ptr + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) ((char *) ring->cq_ptr + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) ((char *) ring->cq_ptr + params.cq_off.cqes);
+    return ring;
+}
+
+//  unmap and close an io_uring instance
+static void uring_free(struct uring *ring) {
+    if (!ring) {
+        return;
+    }
+    if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    close(ring->fd);
+    free(ring->bufs);
+    free(ring);
+}
+
+//  queue a read or write of a buffer at the given file offset
+static void uring_queue(struct uring *ring, uint8_t opcode, int fd, char *buf, uint32_t len, uint64_t off, uint8_t flags, uint64_t user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof (struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->flags = flags;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = user_data;
+    ring->sq_array[idx] = idx;
+    //  the kernel may only see the new tail after the entry is completely written
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+//  copy len bytes from in_fd at in_off to out_fd at out_off through the io_uring instance
+//  every buffer slot is filled by a read that is linked to the write of the same buffer,
+//  so up to depth requests are in flight and submitted with a single syscall
+//  returns the number of bytes that were copied without a gap from the beginning,
+//  it only returns once no request is in flight anymore, so the caller can write the rest at the same offsets
+//  if crc or hasher is given, they are updated with the returned number of bytes from the buffers, in the order
+//  of the data
+static uint64_t uring_copy(struct uring *ring, int in_fd, uint64_t in_off, int out_fd, uint64_t out_off, uint64_t len,
+                    uint32_t *crc, struct blake3 *hasher) {
+    uint64_t slot_off[ring->slots];
+    uint32_t slot_len[ring->slots];
+    char slot_written[ring->slots];
+    uint64_t summed = 0;
+    unsigned free_slots[ring->slots];
+    unsigned n_free = ring->slots;
+    for (unsigned i = 0; i < ring->slots; i++) {
+        free_slots[i] = i;
+        slot_written[i] = 0;
+    }
+
+    uint64_t queued = 0;
+    uint64_t failed_at = len;
+    unsigned to_submit = 0;
+    unsigned in_flight = 0;
+    while ((queued < len && failed_at == len) || in_flight) {
+        //  fill all free buffer slots with linked read-write pairs
+        while (n_free && queued < len && failed_at == len) {
+            unsigned slot = free_slots[--n_free];
+            uint32_t n = len - queued < URING_CHUNK ? len - queued : URING_CHUNK;
+            char *buf = ring->bufs + slot * URING_CHUNK;
+            slot_off[slot] = queued;
+            slot_len[slot] = n;
+            uring_queue(ring, IORING_OP_READ, in_fd, buf, n, in_off + queued, IOSQE_IO_LINK, slot * 2);
+            uring_queue(ring, IORING_OP_WRITE, out_fd, buf, n, out_off + queued, 0, slot * 2 + 1);
+            queued += n;
+            to_submit += 2;
+            in_flight += 2;
+        }
+
+        //  submit everything that is queued and wait for at least one completion
+        int res = (int) syscall(__NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (res < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+            continue;
+        }
+        if (res < 0) {
+            //  nothing more is queued, the remaining data is copied by the caller
+            if (queued < failed_at) {
+                failed_at = queued;
+            }
+            //  the entries the kernel did not take yet are withdrawn, their data is not copied
+            unsigned sq_head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+            for (unsigned i = sq_head; i != *ring->sq_tail; i++) {
+                unsigned slot = ring->sqes[ring->sq_array[i & *ring->sq_mask]].user_data / 2;
+                if (slot_off[slot] < failed_at) {
+                    failed_at = slot_off[slot];
+                }
+                in_flight--;
+            }
+            __atomic_store_n(ring->sq_tail, sq_head, __ATOMIC_RELEASE);
+            to_submit = 0;
+            //  the entries the kernel took may still read into the buffers and write to the output file,
+            //  so their completions are awaited before the caller writes the same range,
+            //  if even waiting fails, the completion queue is polled
+            if (in_flight && __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) == *ring->cq_head) {
+                struct timespec pause = {0, 100000};
+                nanosleep(&pause, NULL);
+            }
+        } else {
+            to_submit -= res;
+        }
+
+        //  reap all completions
+        unsigned head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            unsigned slot = cqe->user_data / 2;
+            //  short reads break the link, the write then completes with -ECANCELED
+            if (cqe->res != (int32_t) slot_len[slot] && slot_off[slot] < failed_at) {
+                failed_at = slot_off[slot];
+            }
+            //  the slot of a failed write is free again right away, the others once their data is checksummed
+            if (cqe->user_data % 2 && cqe->res == (int32_t) slot_len[slot]) {
+                slot_written[slot] = 1;
+            } else if (cqe->user_data % 2) {
+                free_slots[n_free++] = slot;
+            }
+            in_flight--;
+            head++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+        //  the written chunks complete in any order, they are added to the checksum and the hash in the order of the data
+        int progress = 1;
+        while (progress) {
+            progress = 0;
+            for (unsigned i = 0; i < ring->slots; i++) {
+                if (slot_written[i] && slot_off[i] == summed && summed < failed_at) {
+                    if (crc) {
+                        *crc = crc32c(*crc, ring->bufs + i * URING_CHUNK, slot_len[i]);
+                    }
+                    if (hasher) {
+                        blake3_update(hasher, (const unsigned char *) ring->bufs + i * URING_CHUNK, slot_len[i]);
+                    }
+                    summed += slot_len[i];
+                    slot_written[i] = 0;
+                    free_slots[n_free++] = i;
+                    progress = 1;
+                }
+            }
+        }
+    }
+    return failed_at;
+}
+#else
+//  io_uring is only available on linux
+static struct uring *uring_init(unsigned depth) {
+    (void) depth;
+    return NULL;
+}
+
+static void uring_free(struct uring *ring) {
+    (void) ring;
+}
+#endif
+
+//  copy len bytes of the input file, starting at the given offset, to the current position of the output file
+//  on linux the data is moved by the kernel (copy_file_range, sendfile) without copying it to user space,
+//  with an io_uring instance, the data is copied by batches of linked reads and writes instead
+//  otherwise or if the kernel can not copy between the two files, it is streamed through the given buffer
+//  if crc or hasher is given, they are updated with the copied bytes, which are only available in user space in the
+//  buffer or in the buffers of the io_uring instance, so the kernel copies are only used without them
+static uint64_t copy_range(FILE *in, uint64_t in_off, FILE *out, uint64_t len, char *buf, struct uring *ring, uint32_t *crc,
+                    struct blake3 *hasher) {
+    uint64_t copied = 0;
+
+#ifdef __linux__
+    //  the buffered data needs to reach the file before the kernel appends to it
+    if (fflush(out)) {
+        return 0;
+    }
+    int in_fd = fileno(in);
+    int out_fd = fileno(out);
+
+    if (ring) {
+        off_t out_off = ftello(out);
+        if (out_off < 0) {
+            return 0;
+        }
+        while (copied < len) {
+            uint64_t to_copy = len - copied < ZERO_COPY_CHUNK ? len - copied : ZERO_COPY_CHUNK;
+            uint64_t res = uring_copy(ring, in_fd, in_off + copied, out_fd, out_off + copied, to_copy, crc, hasher);
+            copied += res;
+            if (res < to_copy) {
+                break;
+            }
+        }
+        //  the writes do not move the file position, the remaining data (if any) is written right behind the copied data
+        if (fseeko(out, out_off + copied, SEEK_SET)) {
+            return 0;
+        }
+    } else if (!crc && !hasher) {
+        int use_sendfile = 0;
+        while (copied < len) {
+            size_t to_copy = len - copied < ZERO_COPY_CHUNK ? len - copied : ZERO_COPY_CHUNK;
+            off_t off = in_off + copied;
+            ssize_t res;
+            if (!use_sendfile) {
+                res = copy_file_range(in_fd, &off, out_fd, NULL, to_copy, 0);
+            } else {
+                res = sendfile(out_fd, in_fd, &off, to_copy);
+            }
+            if (res > 0) {
+                copied += res;
+                continue;
+            }
+            if (res < 0 && errno == EINTR) {
+                continue;
+            }
+            //  copy_file_range is not supported for every pair of files (e.g. across filesystems on old kernels),
+            //  try sendfile and finally the buffered copy
+            if (!use_sendfile) {
+                use_sendfile = 1;
+                continue;
+            }
+            break;
+        }
+        //  the kernel moved the file position, stdio needs to be synchronized with it
+        if (fseeko(out, 0, SEEK_END)) {
+            return copied;
+        }
+    }
+    if (copied == len) {
+        return copied;
+    }
+#else
+    (void) ring;
+#endif
+
+    //  stream the remaining data through the buffer
+    if (fseeko(in, in_off + copied, SEEK_SET)) {
+        return copied;
+    }
+    while (copied < len) {
+        uint64_t to_read = len - copied;
+        if (to_read > BUF_SIZE) {
+            to_read = BUF_SIZE;
+        }
+        uint64_t bytes_read = fread(buf, 1, to_read, in);
+        if (!bytes_read) {
+            return copied;
+        }
+        uint64_t written = fwrite64(buf, bytes_read, out);
+        if (crc) {
+            *crc = crc32c(*crc, buf, written);
+        }
+        if (hasher) {
+            blake3_update(hasher, (const unsigned char *) buf, written);
+        }
+        copied += written;
+        if (written < bytes_read) {
+            return copied;
+        }
+    }
+    return copied;
+}
+
+//  encode the header of a file (length of filename, filename, length of file-content)
+//  the name is stored as it is, files of directories keep their path relative to the input directory
+//  the length of the header is stored in header_len, returns NULL if memory can not be allocated
+static char *encode_header(const char *name, uint64_t f_len, uint64_t *header_len) {
+    //  calculate the length of the filename
+    uint64_t name_len = strlen(name);
+
+    //  allocate memory for storing the header
+    *header_len = LEN_SIZE * 2 + name_len;
+    char *header = malloc(*header_len);
+    if (!header) {
+        return NULL;
+    }
+
+    //  encode the length of the filename and the file-content
+    char *bytes_len_name = to_bytes(name_len, LEN_SIZE);
+    char *bytes_len_f = to_bytes(f_len, LEN_SIZE);
+    if (!bytes_len_name || !bytes_len_f) {
+        fprintf(stderr, "Error processing data.\n");
+        fflush(stderr);
+        free(bytes_len_name);
+        free(bytes_len_f);
+        free(header);
+        return NULL;
+    }
+
+    //  encode the filename and corresponding lengths
+    uint64_t idx = 0;
+    //  length of filename
+    bytes_cpy(bytes_len_name, header + idx, LEN_SIZE);
+    idx += LEN_SIZE;
+    //  filename
+    bytes_cpy(name, header + idx, name_len);
+    idx += name_len;
+    //  length of file content
+    bytes_cpy(bytes_len_f, header + idx, LEN_SIZE);
+
+    //  clean-up
+    free(bytes_len_f);
+    free(bytes_len_name);
+    return header;
+}
+
+//  encode the file containing filename and content
+//  only the header is encoded in memory, the file-content is streamed later on by write_encoded
+//  with an index of unique chunks, the file is deduplicated, start is its offset in the concatenated data-files
+static struct encoded_file *encode_file(char *filepath, char *name, char *out_name, const struct fpp_options *opts,
+                                 struct dedup_index *index, uint64_t start) {
+    fprintf(stdout, "Encoding file '%s'...\n", name);
+    fflush(stdout);
+
+    //  allocate the struct for storing the encoded file
+    struct encoded_file *enc = calloc(1, sizeof (struct encoded_file));
+    if (!enc) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    enc->filepath = filepath;
+    enc->name = name;
+
+    //  the new chunks of deduplicated files are collected in the temporary file of the index
+    if (index) {
+        TRACE_BEGIN("dedup", name);
+        int err = dedup_encoded(enc, index, start, opts->hash ? enc->hash : NULL);
+        TRACE_END("dedup");
+        if (err) {
+            free_encoded_file(enc);
+            return NULL;
+        }
+        fprintf(stdout, "Extracting %llu MiB of data (deduplicated from %llu MiB) from file '%s'.\n",
+                (unsigned long long) enc->len / (1024 * 1024), (unsigned long long) enc->orig_len / (1024 * 1024), filepath);
+        fflush(stdout);
+        enc->traced = enc->orig_len >= TRACE_SMALL;
+        return enc;
+    }
+
+    //  compressible files are compressed into a temporary file first, the blocks are written from there
+    if (opts->compress) {
+        TRACE_BEGIN("compress", name);
+        int res = compress_file(enc, out_name, opts);
+        TRACE_END("compress");
+        if (res < 0) {
+            free_encoded_file(enc);
+            return NULL;
+        }
+        if (res) {
+            fprintf(stdout, "Extracting %llu MiB of data (compressed from %llu MiB) from file '%s'.\n",
+                    (unsigned long long) enc->len / (1024 * 1024), (unsigned long long) enc->orig_len / (1024 * 1024), filepath);
+            fflush(stdout);
+            enc->traced = enc->orig_len >= TRACE_SMALL;
+            return enc;
+        }
+    }
+
+    //  open (or map) the specified file, it stays open until the file-content is completely written
+    uint64_t f_len;
+    uint64_t opened = TRACE_CLOCK();
+    if (opts->io == IO_MMAP) {
+        enc->map = map_file(filepath);
+        if (!enc->map) {
+            fprintf(stderr, "Could not map file '%s'.\n", filepath);
+            fflush(stderr);
+            free(enc);
+            return NULL;
+        }
+        f_len = enc->map->len;
+    } else {
+        enc->file = fopen(filepath, "rb");
+        if (!enc->file) {
+            fprintf(stderr, "Could not read file '%s'.\n", filepath);
+            fflush(stderr);
+            free(enc);
+            return NULL;
+        }
+        f_len = f_size(filepath);
+    }
+    enc->traced = f_len >= TRACE_SMALL;
+    TRACE_SPAN_IF(enc->traced, "open", name, opened);
+
+    //  the hash is calculated from the original file-content while it is written, it is not read a second time
+    if (opts->hash) {
+        enc->hasher = malloc(sizeof (struct blake3));
+        if (!enc->hasher) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free_encoded_file(enc);
+            return NULL;
+        }
+        blake3_init(enc->hasher);
+    }
+
+    //  encode the header
+    TRACE_BEGIN_IF(enc->traced, "header encode", name);
+    enc->header = encode_header(name, f_len, &enc->header_len);
+    TRACE_END_IF(enc->traced, "header encode");
+    if (!enc->header) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_encoded_file(enc);
+        return NULL;
+    }
+    enc->len = enc->header_len + f_len;
+    enc->content_off = enc->header_len;
+    enc->orig_len = f_len;
+
+    fprintf(stdout, "Extracting %llu MiB of data from file '%s'.\n", (unsigned long long) enc->len / (1024 * 1024), filepath);
+    fflush(stdout);
+    return enc;
+}
+
+//  compress the file of the encoded file into a temporary file, if samples of it are compressible
+//  returns 1 if it was compressed, 0 if it is stored as it is and -1 on errors
+static int compress_file(struct encoded_file *enc, char *out_name, const struct fpp_options *opts) {
+    int in_fd = open(enc->filepath, O_RDONLY);
+    if (in_fd < 0) {
+        fprintf(stderr, "Could not read file '%s'.\n", enc->filepath);
+        fflush(stderr);
+        return -1;
+    }
+    uint64_t f_len = f_size(enc->filepath);
+    if (!is_compressible(in_fd, f_len)) {
+        close(in_fd);
+        return 0;
+    }
+    int tmp_fd = temp_file(out_name);
+    if (tmp_fd < 0) {
+        close(in_fd);
+        return -1;
+    }
+
+    uint64_t stored_total = 0;
+    uint64_t *table = compress_entry(in_fd, f_len, opts, tmp_fd, 0, &stored_total, opts->hash ? enc->hash : NULL);
+    close(in_fd);
+    if (table) {
+        enc->header = encode_compressed_header(enc->name, f_len, opts->compress, table, stored_total, &enc->header_len);
+        free(table);
+    }
+    enc->file = enc->header ? fdopen(tmp_fd, "rb") : NULL;
+    if (!enc->file) {
+        close(tmp_fd);
+        return -1;
+    }
+    enc->kind = ENTRY_COMPRESSED;
+    enc->content_off = LEN_SIZE * 2 + from_bytes(0, LEN_SIZE - 1, enc->header);
+    enc->orig_len = f_len;
+    enc->len = enc->header_len + stored_total;
+    return 1;
+}
+
+//  deduplicate the file of the encoded file, its new chunks are streamed from the temporary file of the index
+//  if hash is given, the content hash is calculated while the file is deduplicated
+static int dedup_encoded(struct encoded_file *enc, struct dedup_index *index, uint64_t start, unsigned char *hash) {
+    if (access(enc->filepath, R_OK) == -1) {
+        fprintf(stderr, "Could not read file '%s'.\n", enc->filepath);
+        fflush(stderr);
+        return 1;
+    }
+    uint64_t f_len = f_size(enc->filepath);
+    uint64_t stored_total = 0;
+    enc->header = dedup_file(index, enc->filepath, enc->name, f_len, start, &enc->header_len, &stored_total, &enc->src_off,
+                             hash);
+    if (!enc->header) {
+        return 1;
+    }
+    //  the encoded file gets its own descriptor of the temporary file, so closing it keeps the index intact
+    int fd = dup(index->tmp_fd);
+    enc->file = fd >= 0 ? fdopen(fd, "rb") : NULL;
+    if (!enc->file) {
+        fprintf(stderr, "Could not read the temporary file.\n");
+        fflush(stderr);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+    enc->kind = ENTRY_DEDUP;
+    enc->content_off = LEN_SIZE * 2 + from_bytes(0, LEN_SIZE - 1, enc->header);
+    enc->orig_len = f_len;
+    enc->len = enc->header_len + stored_total;
+    return 0;
+}
+
+//  read the next chunk of the standard input, the first chunk starts with the header of the entry
+//  the whole chunk is kept in the header of the encoded file, the chunk is empty once the input ends
+static struct encoded_file *read_stream_chunk(struct stream_input *stream) {
+    struct encoded_file *enc = calloc(1, sizeof (struct encoded_file));
+    if (!enc) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    enc->filepath = stream->name;
+    enc->name = stream->name;
+    enc->kind = ENTRY_STREAM;
+
+    //  the length of the content is not known yet, the header only holds a placeholder
+    uint64_t prefix_len = 0;
+    char *prefix = NULL;
+    if (!stream->f_len) {
+        prefix = encode_header(stream->name, STREAM_LEN, &prefix_len);
+        if (!prefix) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free(enc);
+            return NULL;
+        }
+        prefix[LEN_SIZE - 1] = ENTRY_STREAM;
+    }
+    enc->header = malloc(prefix_len + LEN_SIZE + STREAM_CHUNK);
+    if (!enc->header) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free(prefix);
+        free(enc);
+        return NULL;
+    }
+    bytes_cpy(prefix, enc->header, prefix_len);
+    free(prefix);
+
+    //  the chunk is filled completely unless the input ends, pipes deliver their data in small pieces
+    char *data = enc->header + prefix_len + LEN_SIZE;
+    uint64_t n = 0;
+    TRACE_BEGIN("read", stream->name);
+    while (n < STREAM_CHUNK) {
+        ssize_t res = read(STDIN_FILENO, data + n, STREAM_CHUNK - n);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            TRACE_END("read");
+            fprintf(stderr, "Could not read from the standard input.\n");
+            fflush(stderr);
+            free_encoded_file(enc);
+            return NULL;
+        }
+        if (res == 0) {
+            break;
+        }
+        n += res;
+    }
+    TRACE_END("read");
+    if (stream->hash) {
+        blake3_update(&stream->hasher, (const unsigned char *) data, n);
+    }
+    store_bytes(n, LEN_SIZE, enc->header + prefix_len);
+    enc->header_len = prefix_len + LEN_SIZE + n;
+    enc->len = enc->header_len;
+    enc->content_off = prefix_len;
+    enc->orig_len = n;
+    stream->f_len += LEN_SIZE + n;
+    stream->orig_len += n;
+    stream->finished = !n;
+    return enc;
+}
+
+//  close the input file and free the header of an encoded file
+static void free_encoded_file(struct encoded_file *enc) {
+    if (!enc) {
+        return;
+    }
+    if (enc->file) {
+        fclose(enc->file);
+    }
+    unmap_file(enc->map);
+    free(enc->hasher);
+    free(enc->header);
+    free(enc);
+}
+
+//  write len bytes of the encoded file, starting at the given offset, to the output file
+//  the file-content is written from the mapping or copied by copy_range,
+//  the given buffer is only used if the kernel can not copy it
+//  the CRC32C of the data-file is updated with the written bytes, the hash of raw entries with the written content
+static uint64_t write_encoded(struct encoded_file *enc, uint64_t offset, uint64_t len, FILE *out, char *buf, struct uring *ring,
+                       uint32_t *crc) {
+    uint64_t written_complete = 0;
+
+    //  write the part of the header that has not been written yet
+    if (offset < enc->header_len) {
+        uint64_t to_write = enc->header_len - offset;
+        if (len < to_write) {
+            to_write = len;
+        }
+        TRACE_BEGIN_IF(enc->traced, "fwrite64", enc->name);
+        uint64_t written = fwrite64(enc->header + offset, to_write, out);
+        TRACE_END_IF(enc->traced, "fwrite64");
+        if (crc) {
+            *crc = crc32c(*crc, enc->header + offset, written);
+        }
+        written_complete += written;
+        if (written < to_write) {
+            return written_complete;
+        }
+    }
+
+    //  write the file-content directly from the mapped input file, window by window
+    while (enc->map && written_complete < len) {
+        uint64_t content_off = offset + written_complete - enc->header_len;
+        uint64_t to_write = len - written_complete;
+        if (to_write > MAP_WINDOW) {
+            to_write = MAP_WINDOW;
+        }
+        advise_window(enc->map, content_off);
+        TRACE_BEGIN_IF(enc->traced, "fwrite64", enc->name);
+        uint64_t written = fwrite64(enc->map->data + content_off, to_write, out);
+        TRACE_END_IF(enc->traced, "fwrite64");
+        if (crc) {
+            *crc = crc32c(*crc, enc->map->data + content_off, written);
+        }
+        if (enc->hasher) {
+            blake3_update(enc->hasher, (const unsigned char *) enc->map->data + content_off, written);
+        }
+        written_complete += written;
+        if (written < to_write) {
+            return written_complete;
+        }
+    }
+
+    //  copy the file-content, the input file is read at the position right after the already written content
+    if (written_complete < len) {
+        uint64_t content_off = offset + written_complete - enc->header_len;
+        uint64_t to_copy = len - written_complete;
+        TRACE_BEGIN_IF(enc->traced, "copy", enc->name);
+        uint64_t copied = copy_range(enc->file, enc->src_off + content_off, out, to_copy, buf, ring, crc, enc->hasher);
+        TRACE_END_IF(enc->traced, "copy");
+        written_complete += copied;
+        if (copied < to_copy) {
+            fprintf(stderr, "Could not copy file '%s' (file changed while encoding?).\n", enc->filepath);
+            fflush(stderr);
+        }
+    }
+
+    //  the hash is complete once the last byte of the content is written
+    if (enc->hasher && offset + written_complete == enc->len) {
+        blake3_final(enc->hasher, enc->hash);
+    }
+    return written_complete;
+}
+
+//  consume the next part of the concatenated data-files and extract the encoded files from it
+//  the data can be split at arbitrary positions, the progress is kept in the given state
+//  stops early when the content of a large file begins, so the caller can copy it without the buffer
+//  the number of consumed bytes is stored in consumed
+static int extract_files(struct extract_state *st, const char *data, uint64_t len, uint64_t *consumed) {
+    uint64_t pos = 0;
+    while (pos < len) {
+        if (st->step == STEP_CONTENT && st->f_len - st->pos >= ZERO_COPY_MIN && st->zero_copy) {
+            break;
+        }
+
+        switch (st->step) {
+            case STEP_NAME_LEN:
+            case STEP_CONTENT_LEN: {
+                //  collect the length field, which might be split between two data-files
+                uint64_t n = LEN_SIZE - st->pos;
+                if (len - pos < n) {
+                    n = len - pos;
+                }
+                bytes_cpy(data + pos, st->len_buf + st->pos, n);
+                st->pos += n;
+                pos += n;
+                if (st->pos < LEN_SIZE) {
+                    break;
+                }
+                st->pos = 0;
+
+                if (st->step == STEP_NAME_LEN) {
+                    //  decode length of filename and allocate memory for storing the filename
+                    //  the top byte of the length holds the kind of the entry
+                    st->name_len = from_bytes(0, LEN_SIZE - 1, st->len_buf);
+                    st->kind = from_bytes(LEN_SIZE - 1, 1, st->len_buf);
+                    if (st->name_len > MAX_NAME_LEN || st->kind > ENTRY_STREAM) {
+                        fprintf(stderr, "Error, invalid filename length. Input file might be corrupted.\n");
+                        fflush(stderr);
+                        return 1;
+                    }
+                    st->f_name = malloc(st->name_len + 1);
+                    if (!st->f_name) {
+                        fprintf(stderr, "Memory allocation error.\n");
+                        fflush(stderr);
+                        return 1;
+                    }
+                    *(st->f_name + st->name_len) = 0;
+                    st->step = STEP_NAME;
+                } else {
+                    //  decode length of the file-content
+                    st->f_len = from_bytes(0, LEN_SIZE, st->len_buf);
+                    st->step = STEP_CONTENT;
+                    if (st->kind == ENTRY_COMPRESSED) {
+                        st->step = STEP_BLOCK_FIELDS;
+                    } else if (st->kind == ENTRY_DEDUP) {
+                        st->step = STEP_DEDUP_FIELDS;
+                    } else if (st->kind == ENTRY_STREAM) {
+                        st->step = STEP_CHUNK_LEN;
+                        st->orig_len = 0;
+                        st->chunk_start = 0;
+                    }
+                }
+                break;
+            }
+            case STEP_BLOCK_FIELDS:
+            case STEP_BLOCK_TABLE:
+            case STEP_BLOCK: {
+                uint64_t n = 0;
+                if (extract_block_step(st, data + pos, len - pos, &n)) {
+                    return 1;
+                }
+                pos += n;
+                break;
+            }
+            case STEP_DEDUP_FIELDS:
+            case STEP_DEDUP_TABLE:
+            case STEP_DEDUP_DATA: {
+                uint64_t n = 0;
+                if (extract_dedup_step(st, data + pos, len - pos, &n)) {
+                    return 1;
+                }
+                pos += n;
+                break;
+            }
+            case STEP_CHUNK_LEN:
+            case STEP_CHUNK: {
+                uint64_t n = 0;
+                if (extract_stream_step(st, data + pos, len - pos, &n)) {
+                    return 1;
+                }
+                pos += n;
+                break;
+            }
+            case STEP_NAME: {
+                //  copy the filename into the buffer
+                uint64_t n = st->name_len - st->pos;
+                if (len - pos < n) {
+                    n = len - pos;
+                }
+                bytes_cpy(data + pos, st->f_name + st->pos, n);
+                st->pos += n;
+                pos += n;
+                if (st->pos < st->name_len) {
+                    break;
+                }
+                st->pos = 0;
+
+                //  create corresponding output file, the extraction of the entry is traced until it is closed
+                fprintf(stdout, "Writing file '%s'\n", st->f_name);
+                fflush(stdout);
+                TRACE_BEGIN("extract", st->f_name);
+                int fd = open_output(&st->dirs, st->f_name, st->name_len, O_RDWR | O_CREAT | O_TRUNC);
+                st->out = fd >= 0 ? fdopen(fd, "wb+") : NULL;
+                if (!st->out) {
+                    if (fd >= 0) {
+                        close(fd);
+                    }
+                    fprintf(stderr, "Could not create file '%s'.\n", st->f_name);
+                    fflush(stderr);
+                    return 1;
+                }
+                blake3_init(&st->hasher);
+                st->step = STEP_CONTENT_LEN;
+                break;
+            }
+            case STEP_CONTENT: {
+                //  write file content to output file
+                uint64_t n = st->f_len - st->pos;
+                if (len - pos < n) {
+                    n = len - pos;
+                }
+                uint64_t written = write_output(st, data + pos, n);
+                if (written < n) {
+                    fprintf(stderr, "Could not write file '%s'.\n", st->f_name);
+                    fflush(stderr);
+                    return 1;
+                }
+                st->pos += n;
+                pos += n;
+                break;
+            }
+        }
+
+        if (complete_entry(st)) {
+            return 1;
+        }
+    }
+    *consumed = pos;
+    return 0;
+}
+
+//  consume the next bytes of the content of a compressed entry, the number of consumed bytes is stored in consumed
+//  the block fields and the block table are collected first, then every block is collected and decompressed
+static int extract_block_step(struct extract_state *st, const char *data, uint64_t len, uint64_t *consumed) {
+    uint64_t n = 0;
+    if (st->step == STEP_BLOCK_FIELDS) {
+        n = BLOCK_FIELDS - st->pos < len ? BLOCK_FIELDS - st->pos : len;
+        bytes_cpy(data, st->fields + st->pos, n);
+        st->pos += n;
+        *consumed = n;
+        if (st->pos < BLOCK_FIELDS) {
+            return 0;
+        }
+        st->codec = from_bytes(0, LEN_SIZE, st->fields);
+        st->orig_len = from_bytes(LEN_SIZE, LEN_SIZE, st->fields);
+        st->block_size = from_bytes(LEN_SIZE * 2, LEN_SIZE, st->fields);
+        st->n_blocks = from_bytes(LEN_SIZE * 3, LEN_SIZE, st->fields);
+        if (check_block_fields(st->codec, st->orig_len, st->block_size, st->n_blocks, st->f_len)) {
+            fprintf(stderr, "Error, invalid compressed file '%s'. Input file might be corrupted.\n", st->f_name);
+            fflush(stderr);
+            return 1;
+        }
+        st->table = malloc(st->n_blocks ? st->n_blocks * LEN_SIZE : 1);
+        st->block = malloc(st->block_size);
+        st->plain = malloc(st->block_size);
+        if (!st->table || !st->block || !st->plain) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        st->step = STEP_BLOCK_TABLE;
+    } else if (st->step == STEP_BLOCK_TABLE) {
+        uint64_t table_len = st->n_blocks * LEN_SIZE;
+        uint64_t table_pos = st->pos - BLOCK_FIELDS;
+        n = table_len - table_pos < len ? table_len - table_pos : len;
+        bytes_cpy(data, st->table + table_pos, n);
+        st->pos += n;
+        *consumed = n;
+    } else {
+        //  collect the stored bytes of the current block
+        uint64_t stored = from_bytes(st->block_idx * LEN_SIZE, LEN_SIZE, st->table) & ~BLOCK_RAW;
+        uint64_t block_pos = st->pos - st->block_start;
+        n = stored - block_pos < len ? stored - block_pos : len;
+        bytes_cpy(data, st->block + block_pos, n);
+        st->pos += n;
+        *consumed = n;
+        if (block_pos + n < stored) {
+            return 0;
+        }
+
+        //  decompress the block and write it to the output file
+        uint64_t plain_len = st->orig_len - st->block_idx * st->block_size;
+        if (plain_len > st->block_size) {
+            plain_len = st->block_size;
+        }
+        int raw = (from_bytes(st->block_idx * LEN_SIZE, LEN_SIZE, st->table) & BLOCK_RAW) != 0;
+        if (raw ? stored != plain_len : decompress_block(st->codec, st->block, stored, st->plain, plain_len)) {
+            fprintf(stderr, "Error, could not decompress file '%s'. Input file might be corrupted.\n", st->f_name);
+            fflush(stderr);
+            return 1;
+        }
+        if (write_output(st, raw ? st->block : st->plain, plain_len) < plain_len) {
+            fprintf(stderr, "Could not write file '%s'.\n", st->f_name);
+            fflush(stderr);
+            return 1;
+        }
+        st->block_idx++;
+        st->block_start = st->pos;
+    }
+
+    //  once the table is complete, the stored lengths of the blocks have to add up to the rest of the content
+    if (st->step == STEP_BLOCK_TABLE && st->pos == BLOCK_FIELDS + st->n_blocks * LEN_SIZE) {
+        if (check_block_table(st->table, st->n_blocks, st->orig_len, st->block_size, st->f_len - st->pos)) {
+            fprintf(stderr, "Error, invalid compressed file '%s'. Input file might be corrupted.\n", st->f_name);
+            fflush(stderr);
+            return 1;
+        }
+        st->step = STEP_BLOCK;
+        st->block_idx = 0;
+        st->block_start = st->pos;
+    }
+    return 0;
+}
+
+//  check the block fields of a compressed entry with the given stored length, returns 1 if they are invalid
+static int check_block_fields(uint64_t codec, uint64_t orig_len, uint64_t block_size, uint64_t n_blocks, uint64_t f_len) {
+    if ((codec != CODEC_FAST && codec != CODEC_HIGH) || !block_size || block_size > MAX_BLOCK) {
+        return 1;
+    }
+    if (n_blocks != orig_len / block_size + (orig_len % block_size ? 1 : 0)) {
+        return 1;
+    }
+    return f_len < BLOCK_FIELDS || n_blocks > (f_len - BLOCK_FIELDS) / LEN_SIZE;
+}
+
+//  check the block table of a compressed entry, the blocks have to fill exactly data_len bytes
+//  raw blocks have the length of their original data, compressed blocks are smaller
+static int check_block_table(const char *table, uint64_t n_blocks, uint64_t orig_len, uint64_t block_size, uint64_t data_len) {
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < n_blocks; i++) {
+        uint64_t stored = from_bytes(i * LEN_SIZE, LEN_SIZE, table);
+        uint64_t plain_len = orig_len - i * block_size < block_size ? orig_len - i * block_size : block_size;
+        uint64_t len = stored & ~BLOCK_RAW;
+        if (!len || ((stored & BLOCK_RAW) ? len != plain_len : len >= plain_len) || len > data_len - total) {
+            return 1;
+        }
+        total += len;
+    }
+    return total != data_len;
+}
+
+//  consume the next bytes of the content of a deduplicated entry, the number of consumed bytes is stored in consumed
+//  the fields and the reference table are collected first, then the new chunks are written as they stream by,
+//  chunks that are stored earlier in the archive are copied from the data-files in between
+static int extract_dedup_step(struct extract_state *st, const char *data, uint64_t len, uint64_t *consumed) {
+    uint64_t n = 0;
+    if (st->step == STEP_DEDUP_FIELDS) {
+        n = DEDUP_FIELDS - st->pos < len ? DEDUP_FIELDS - st->pos : len;
+        bytes_cpy(data, st->fields + st->pos, n);
+        st->pos += n;
+        *consumed = n;
+        if (st->pos < DEDUP_FIELDS) {
+            return 0;
+        }
+        st->orig_len = from_bytes(0, LEN_SIZE, st->fields);
+        st->n_refs = from_bytes(LEN_SIZE, LEN_SIZE, st->fields);
+        if (st->f_len < DEDUP_FIELDS || st->n_refs > (st->f_len - DEDUP_FIELDS) / REF_SIZE) {
+            fprintf(stderr, "Error, invalid deduplicated file '%s'. Input file might be corrupted.\n", st->f_name);
+            fflush(stderr);
+            return 1;
+        }
+        st->table = malloc(st->n_refs ? st->n_refs * REF_SIZE : 1);
+        st->block = malloc(BUF_SIZE);
+        if (!st->table || !st->block) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        st->step = STEP_DEDUP_TABLE;
+    } else if (st->step == STEP_DEDUP_TABLE) {
+        uint64_t table_len = st->n_refs * REF_SIZE;
+        uint64_t table_pos = st->pos - DEDUP_FIELDS;
+        n = table_len - table_pos < len ? table_len - table_pos : len;
+        bytes_cpy(data, st->table + table_pos, n);
+        st->pos += n;
+        *consumed = n;
+    } else {
+        //  write the bytes of the current reference, which is one of the new chunks
+        uint64_t ref_len = from_bytes(st->ref_idx * REF_SIZE + LEN_SIZE, LEN_SIZE, st->table);
+        uint64_t ref_pos = st->pos - st->ref_start;
+        n = ref_len - ref_pos < len ? ref_len - ref_pos : len;
+        if (write_output(st, data, n) < n) {
+            fprintf(stderr, "Could not write file '%s'.\n", st->f_name);
+            fflush(stderr);
+            return 1;
+        }
+        st->pos += n;
+        *consumed = n;
+        if (ref_pos + n < ref_len) {
+            return 0;
+        }
+        st->ref_idx++;
+        st->ref_start = st->pos;
+        return copy_prior_refs(st);
+    }
+
+    //  once the table is complete, the references are checked against the archive and the rest of the content
+    if (st->step == STEP_DEDUP_TABLE && st->pos == DEDUP_FIELDS + st->n_refs * REF_SIZE) {
+        if (load_partitions(st)) {
+            return 1;
+        }
+        if (check_ref_table(st->table, st->n_refs, st->orig_len, st->f_len - st->pos, st->part_start[st->f_count])) {
+            fprintf(stderr, "Error, invalid deduplicated file '%s'. Input file might be corrupted.\n", st->f_name);
+            fflush(stderr);
+            return 1;
+        }
+        st->step = STEP_DEDUP_DATA;
+        st->ref_idx = 0;
+        st->ref_start = st->pos;
+        return copy_prior_refs(st);
+    }
+    return 0;
+}
+
+//  consume the next bytes of the content of a stream entry, the number of consumed bytes is stored in consumed
+//  the length of every chunk is collected first, then the chunk is written as it streams by
+//  the empty chunk at the end sets the length of the content, which completes the entry
+static int extract_stream_step(struct extract_state *st, const char *data, uint64_t len, uint64_t *consumed) {
+    uint64_t n = 0;
+    if (st->step == STEP_CHUNK_LEN) {
+        uint64_t field_pos = st->pos - st->chunk_start;
+        n = LEN_SIZE - field_pos < len ? LEN_SIZE - field_pos : len;
+        bytes_cpy(data, st->len_buf + field_pos, n);
+        st->pos += n;
+        *consumed = n;
+        if (field_pos + n < LEN_SIZE) {
+            return 0;
+        }
+        st->chunk_len = from_bytes(0, LEN_SIZE, st->len_buf);
+        st->chunk_start = st->pos;
+        if (!st->chunk_len) {
+            st->f_len = st->pos;
+        } else {
+            st->step = STEP_CHUNK;
+        }
+        return 0;
+    }
+
+    uint64_t chunk_pos = st->pos - st->chunk_start;
+    n = st->chunk_len - chunk_pos < len ? st->chunk_len - chunk_pos : len;
+    if (write_output(st, data, n) < n) {
+        fprintf(stderr, "Could not write file '%s'.\n", st->f_name);
+        fflush(stderr);
+        return 1;
+    }
+    st->pos += n;
+    st->orig_len += n;
+    *consumed = n;
+    if (chunk_pos + n == st->chunk_len) {
+        st->step = STEP_CHUNK_LEN;
+        st->chunk_start = st->pos;
+    }
+    return 0;
+}
+
+//  check the reference table of a deduplicated entry, the references have to add up to the original length
+//  the new chunks have to fill exactly data_len bytes in order, the other chunks have to be within the archive
+static int check_ref_table(const char *table, uint64_t n_refs, uint64_t orig_len, uint64_t data_len, uint64_t size_total) {
+    uint64_t total = 0;
+    uint64_t stream = 0;
+    for (uint64_t i = 0; i < n_refs; i++) {
+        uint64_t src = from_bytes(i * REF_SIZE, LEN_SIZE, table);
+        uint64_t len = from_bytes(i * REF_SIZE + LEN_SIZE, LEN_SIZE, table);
+        if (!len || len > orig_len - total) {
+            return 1;
+        }
+        if (src & REF_STREAM) {
+            if ((src & ~REF_STREAM) != stream || len > data_len - stream) {
+                return 1;
+            }
+            stream += len;
+        } else if (src > size_total || len > size_total - src) {
+            return 1;
+        }
+        total += len;
+    }
+    return total != orig_len || stream != data_len;
+}
+
+//  copy the chunks of the following references, that are stored earlier in the archive, from the data-files
+//  stops at the next reference to one of the new chunks, which follow in the content of the entry
+static int copy_prior_refs(struct extract_state *st) {
+    for (; st->ref_idx < st->n_refs; st->ref_idx++) {
+        uint64_t src = from_bytes(st->ref_idx * REF_SIZE, LEN_SIZE, st->table);
+        uint64_t len = from_bytes(st->ref_idx * REF_SIZE + LEN_SIZE, LEN_SIZE, st->table);
+        if (src & REF_STREAM) {
+            return 0;
+        }
+        uint64_t copied = 0;
+        while (copied < len) {
+            uint32_t part = locate_partition(st->part_start, st->f_count, src + copied);
+            uint64_t n = st->part_start[part + 1] - (src + copied);
+            if (len - copied < n) {
+                n = len - copied;
+            }
+            if (n > BUF_SIZE) {
+                n = BUF_SIZE;
+            }
+            if (st->part_fd < 0 || st->part != part) {
+                if (st->part_fd >= 0) {
+                    close(st->part_fd);
+                }
+                st->part = part;
+                st->part_fd = open(st->f_names + (size_t) part * st->f_name_len, O_RDONLY);
+                if (st->part_fd < 0) {
+                    fprintf(stderr, "Error, could not read file '%s'.\n", st->f_names + (size_t) part * st->f_name_len);
+                    fflush(stderr);
+                    return 1;
+                }
+            }
+            if (pread_all(st->part_fd, st->block, n, src + copied - st->part_start[part]) < n) {
+                fprintf(stderr, "Error, could not read file '%s'.\n", st->f_names + (size_t) part * st->f_name_len);
+                fflush(stderr);
+                return 1;
+            }
+            if (write_output(st, st->block, n) < n) {
+                fprintf(stderr, "Could not write file '%s'.\n", st->f_name);
+                fflush(stderr);
+                return 1;
+            }
+            copied += n;
+        }
+    }
+    return 0;
+}
+
+//  calculate the offsets of the data-files in the concatenated data, once the first deduplicated entry is extracted
+static int load_partitions(struct extract_state *st) {
+    if (st->part_start) {
+        return 0;
+    }
+    st->part_start = calloc(st->f_count + 1, sizeof (uint64_t));
+    if (!st->part_start) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    for (uint32_t i = 0; i < st->f_count; i++) {
+        st->part_start[i + 1] = st->part_start[i] + f_size(st->f_names + (size_t) i * st->f_name_len);
+    }
+    return 0;
+}
+
+//  open the journal of the decoder, which is written next to parser.log while decoding with '--resume'
+//  if there is a journal of an interrupted decode of the same archive, the extracted files it lists are checked
+//  and the longest prefix of complete files is kept, their names are written to parser.log again
+//  the position in the concatenated data-files where the decoding continues is stored in resume_pos
+static FILE *open_decode_journal(uint64_t size_total, uint32_t f_count, const uint32_t *crcs, FILE *log, uint64_t *resume_pos,
+                          uint64_t *n_done) {
+    char path[] = "parser.journal";
+    char header[24];
+    store_bytes(size_total, LEN_SIZE, header);
+    store_bytes(f_count, LEN_SIZE, header + LEN_SIZE);
+    store_bytes(crcs ? crc32c(0, (const char *) crcs, f_count * sizeof (uint32_t)) : 0, LEN_SIZE, header + LEN_SIZE * 2);
+    *resume_pos = 0;
+    *n_done = 0;
+
+    struct byte_string *journal = read_journal(path);
+    uint64_t type;
+    uint64_t len;
+    uint64_t pos = journal ? next_journal_record(journal, 0, &type, &len) : 0;
+    if (!journal || !pos || type != JOURNAL_HEADER || len != sizeof (header) || memcmp(journal->data + pos, header, len)) {
+        if (journal && pos) {
+            fprintf(stderr, "The journal '%s' belongs to a different archive, remove it to start over.\n", path);
+            fflush(stderr);
+            free_journal(journal);
+            return NULL;
+        }
+        free_journal(journal);
+        FILE *file = fopen(path, "wb");
+        if (!file || append_journal(file, JOURNAL_HEADER, header, sizeof (header))) {
+            fprintf(stderr, "Could not open file '%s'.\n", path);
+            fflush(stderr);
+            close_journal(file);
+            return NULL;
+        }
+        return file;
+    }
+
+    //  keep the files that are still complete, in order, the journal is cut behind the last one
+    char *buf = malloc(BUF_SIZE);
+    uint64_t keep = pos + len;
+    uint64_t n_files = 0;
+    int err = !buf;
+    for (pos = keep; !err && (pos = next_journal_record(journal, pos, &type, &len)); pos += len) {
+        if (type != JOURNAL_FILE || len < LEN_SIZE * 4) {
+            break;
+        }
+        const char *rec = journal->data + pos;
+        uint64_t end = from_bytes(0, LEN_SIZE, rec);
+        uint64_t out_len = from_bytes(LEN_SIZE, LEN_SIZE, rec);
+        uint32_t crc = from_bytes(LEN_SIZE * 2, LEN_SIZE, rec);
+        uint64_t name_len = from_bytes(LEN_SIZE * 3, LEN_SIZE, rec);
+        if (name_len != len - LEN_SIZE * 4 || end > size_total) {
+            break;
+        }
+        char *name = malloc(name_len + 1);
+        if (!name) {
+            err = 1;
+            break;
+        }
+        bytes_cpy(rec + LEN_SIZE * 4, name, name_len);
+        name[name_len] = 0;
+        int valid = !memchr(name, 0, name_len) && !check_partition(name, out_len, crc, buf);
+        if (valid && (fwrite64(name, name_len, log) < name_len || fwrite64("\n", 1, log) < 1)) {
+            fprintf(stderr, "Could not write file 'parser.log'.\n");
+            fflush(stderr);
+            err = 1;
+        }
+        free(name);
+        if (!valid || err) {
+            break;
+        }
+        *resume_pos = end;
+        keep = pos + len;
+        n_files++;
+    }
+    free(buf);
+    free_journal(journal);
+    FILE *file = NULL;
+    if (!err && truncate(path, keep) == 0) {
+        file = fopen(path, "ab");
+    }
+    if (!file) {
+        if (!err) {
+            fprintf(stderr, "Could not open file '%s'.\n", path);
+            fflush(stderr);
+        }
+        return NULL;
+    }
+    fprintf(stdout, "Resuming after %llu extracted files.\n", (unsigned long long) n_files);
+    fflush(stdout);
+    *n_done = n_files;
+    return file;
+}
+
+//  record the extracted file in the journal of the decoder, with its length and checksum
+//  the file is read again for the checksum, mostly from the page cache
+static int journal_file(struct extract_state *st) {
+    uint64_t out_len = st->kind == ENTRY_RAW ? st->f_len : st->orig_len;
+    if (!st->journal_buf) {
+        st->journal_buf = malloc(BUF_SIZE);
+    }
+    uint32_t crc = 0;
+    if (!st->journal_buf || fflush(st->out) || checksum_range(fileno(st->out), 0, out_len, st->journal_buf, &crc)) {
+        fprintf(stderr, "Could not read file '%s'.\n", st->f_name);
+        fflush(stderr);
+        return 1;
+    }
+    uint64_t len = LEN_SIZE * 4 + st->name_len;
+    char *rec = malloc(len);
+    if (!rec) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    store_bytes(st->stream_pos, LEN_SIZE, rec);
+    store_bytes(out_len, LEN_SIZE, rec + LEN_SIZE);
+    store_bytes(crc, LEN_SIZE, rec + LEN_SIZE * 2);
+    store_bytes(st->name_len, LEN_SIZE, rec + LEN_SIZE * 3);
+    bytes_cpy(st->f_name, rec + LEN_SIZE * 4, st->name_len);
+    int err = append_journal(st->journal, JOURNAL_FILE, rec, len);
+    free(rec);
+    return err;
+}
+
+//  compare the hash of the extracted file with the next one of the manifest, mismatching files are reported and counted
+static void check_entry_hash(struct extract_state *st) {
+    unsigned char hash[32];
+    blake3_final(&st->hasher, hash);
+    struct hash_entry *entry = st->entry_idx < st->manifest->n_entries ? st->manifest->entries + st->entry_idx : NULL;
+    st->entry_idx++;
+    if (!entry || entry->name_len != st->name_len || memcmp(entry->name, st->f_name, st->name_len)
+        || memcmp(entry->hash, hash, HASH_LEN)) {
+        fprintf(stderr, "Error, file '%s' does not match its content hash.\n", st->f_name);
+        fflush(stderr);
+        st->mismatched++;
+    }
+}
+
+//  write extracted data to the current output file, with a manifest the written data is added to the hash of the file
+static uint64_t write_output(struct extract_state *st, const char *data, uint64_t len) {
+    uint64_t written = fwrite64(data, len, st->out);
+    if (st->manifest) {
+        blake3_update(&st->hasher, (const unsigned char *) data, written);
+    }
+    return written;
+}
+
+//  compare the hashes of the files extracted by the parallel decoder with the manifest, every mismatching file is
+//  reported, the hashes are joined from the units the workers hashed, only the entries marked for it are read again
+static int check_extracted_hashes(struct decode_plan *plan, const struct manifest *manifest, unsigned threads) {
+    uint64_t mismatched = 0;
+    for (uint64_t i = 0; i < plan->n_entries; i++) {
+        struct decode_entry *entry = plan->entries + i;
+        if (entry->superseded) {
+            continue;
+        }
+        if (entry->rehash) {
+            TRACE_BEGIN("hash", entry->f_name);
+            int err = hash_path(entry->f_name, threads, entry->hash);
+            TRACE_END("hash");
+            if (err) {
+                return 1;
+            }
+        } else {
+            unit_hash_final(&entry->units, entry->hash);
+        }
+        const struct hash_entry *expected = entry->idx < manifest->n_entries ? manifest->entries + entry->idx : NULL;
+        if (!expected || expected->name_len != entry->name_len || memcmp(expected->name, entry->f_name, entry->name_len)
+            || memcmp(expected->hash, entry->hash, HASH_LEN)) {
+            fprintf(stderr, "Error, file '%s' does not match its content hash.\n", entry->f_name);
+            fflush(stderr);
+            mismatched++;
+        }
+    }
+    if (mismatched) {
+        fprintf(stderr, "Error, %llu files do not match their content hash.\n", (unsigned long long) mismatched);
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+//  finish the current file once all of its content is written
+static int complete_entry(struct extract_state *st) {
+    if ((st->step != STEP_CONTENT && st->step != STEP_BLOCK && st->step != STEP_DEDUP_DATA && st->step != STEP_CHUNK_LEN)
+        || st->pos != st->f_len) {
+        return 0;
+    }
+
+    //  write parser log
+    uint64_t written_log = fwrite64(st->f_name, st->name_len, st->log);
+    uint64_t written_log_separator = fwrite64("\n", 1, st->log);
+    if (written_log < st->name_len || written_log_separator < 1) {
+        fprintf(stderr, "Could not write file 'parser.log'.\n");
+        fflush(stderr);
+        return 1;
+    }
+
+    //  the journal records the file together with the position behind it in the data-files
+    st->stream_pos += LEN_SIZE * 2 + st->name_len + st->f_len;
+    if (st->journal && journal_file(st)) {
+        return 1;
+    }
+    uint64_t out_len = st->kind == ENTRY_RAW ? st->f_len : st->orig_len;
+    if (st->manifest) {
+        check_entry_hash(st);
+    }
+
+    //  the files are closed while extracting, the time is moved from the write to the close phase
+    stats_entry(out_len);
+    stats.bytes_written += out_len;
+    uint64_t t = stats_clock();
+    TRACE_BEGIN_IF(out_len >= TRACE_SMALL, "fclose", st->f_name);
+    fclose(st->out);
+    TRACE_END_IF(out_len >= TRACE_SMALL, "fclose");
+    TRACE_END("extract");
+    if (stats.enabled) {
+        uint64_t closing = now_ns() - t;
+        stats.phases[PHASE_CLOSE] += closing;
+        stats.phases[PHASE_WRITE] -= closing;
+    }
+    st->out = NULL;
+    free(st->f_name);
+    st->f_name = NULL;
+    free(st->table);
+    st->table = NULL;
+    free(st->block);
+    st->block = NULL;
+    free(st->plain);
+    st->plain = NULL;
+    st->pos = 0;
+    st->step = STEP_NAME_LEN;
+    return 0;
+}
+
+//  close all files and free all memory of the extraction state
+static void free_extract_state(struct extract_state *st) {
+    if (st->out) {
+        fclose(st->out);
+    }
+    if (st->log) {
+        fclose(st->log);
+    }
+    free(st->f_name);
+    free(st->table);
+    free(st->block);
+    free(st->plain);
+    if (st->part_fd >= 0) {
+        close(st->part_fd);
+    }
+    free(st->part_start);
+    free_dir_cache(&st->dirs);
+    close_journal(st->journal);
+    free(st->journal_buf);
+    free_manifest(st->manifest);
+}
+
+//  read len bytes at the given offset of the concatenated data-files
+//  the bytes are served from a window of the data-files, which is refilled if needed,
+//  so scanning the headers of consecutive small files does not need a syscall per header
+static int scan_read(struct decode_plan *plan, struct scan_window *win, uint64_t off, char *dest, uint64_t len) {
+    if (off + len > plan->size_total || len > SCAN_WINDOW) {
+        return 1;
+    }
+    if (off < win->start || off + len > win->start + win->len) {
+        //  refill the window starting at the requested offset, it might span multiple data-files
+        win->start = off;
+        win->len = plan->size_total - off < SCAN_WINDOW ? plan->size_total - off : SCAN_WINDOW;
+        uint64_t filled = 0;
+        while (filled < win->len) {
+            uint32_t part = find_partition(plan, off + filled);
+            uint64_t part_off = off + filled - plan->part_start[part];
+            uint64_t n = plan->part_start[part + 1] - (off + filled);
+            if (win->len - filled < n) {
+                n = win->len - filled;
+            }
+            if (win->fd < 0 || win->part != part) {
+                if (win->fd >= 0) {
+                    close(win->fd);
+                }
+                win->fd = open(plan->f_names + (size_t) part * plan->f_name_len, O_RDONLY);
+                win->part = part;
+                if (win->fd < 0) {
+                    return 1;
+                }
+            }
+            uint64_t bytes_read = 0;
+            while (bytes_read < n) {
+                ssize_t res = pread(win->fd, win->data + filled + bytes_read, n - bytes_read, part_off + bytes_read);
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (res <= 0) {
+                    return 1;
+                }
+                bytes_read += res;
+            }
+            filled += n;
+        }
+    }
+    bytes_cpy(win->data + (off - win->start), dest, len);
+    return 0;
+}
+
+//  return the index of the data-file that contains the given offset of the concatenated data-files
+static uint32_t find_partition(struct decode_plan *plan, uint64_t off) {
+    return locate_partition(plan->part_start, plan->f_count, off);
+}
+
+//  binary search for the data-file that contains the given offset, part_start holds the offsets of the f_count data-files
+static uint32_t locate_partition(const uint64_t *part_start, uint32_t f_count, uint64_t off) {
+    uint32_t lo = 0;
+    uint32_t hi = f_count - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (part_start[mid] <= off) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+//  scan the headers of all encoded files and build the table of entries
+//  the file-contents are skipped using their length, so only the headers are read
+//  and data-files that contain no header are never opened
+static int scan_entries(struct decode_plan *plan) {
+    struct scan_window win = {0};
+    win.fd = -1;
+    win.data = malloc(SCAN_WINDOW);
+    if (!win.data) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+
+    uint64_t capacity = 0;
+    uint64_t pos = 0;
+    char len_buf[8];
+    while (pos < plan->size_total) {
+        //  grow the table of entries
+        if (plan->n_entries == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            struct decode_entry *entries = realloc(plan->entries, capacity * sizeof (struct decode_entry));
+            if (!entries) {
+                fprintf(stderr, "Memory allocation error.\n");
+                fflush(stderr);
+                free_scan_window(&win);
+                return 1;
+            }
+            plan->entries = entries;
+        }
+        struct decode_entry *entry = plan->entries + plan->n_entries;
+
+        //  decode length of filename, filename and length of the file-content
+        if (scan_read(plan, &win, pos, len_buf, LEN_SIZE)) {
+            break;
+        }
+        entry->name_len = from_bytes(0, LEN_SIZE - 1, len_buf);
+        entry->kind = from_bytes(LEN_SIZE - 1, 1, len_buf);
+        entry->blocks = NULL;
+        entry->refs = NULL;
+        entry->n_refs = 0;
+        entry->superseded = 0;
+        memset(&entry->units, 0, sizeof (struct unit_hash));
+        entry->rehash = 0;
+        if (entry->name_len > MAX_NAME_LEN || entry->kind > ENTRY_STREAM) {
+            break;
+        }
+        entry->f_name = malloc(entry->name_len + 1);
+        if (!entry->f_name) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free_scan_window(&win);
+            return 1;
+        }
+        *(entry->f_name + entry->name_len) = 0;
+        entry->idx = plan->n_entries++;
+        if (scan_read(plan, &win, pos + LEN_SIZE, entry->f_name, entry->name_len)
+            || scan_read(plan, &win, pos + LEN_SIZE + entry->name_len, len_buf, LEN_SIZE)) {
+            break;
+        }
+        entry->f_len = from_bytes(0, LEN_SIZE, len_buf);
+        entry->start = pos + LEN_SIZE * 2 + entry->name_len;
+        if (entry->kind != ENTRY_STREAM && entry->f_len > plan->size_total - entry->start) {
+            break;
+        }
+
+        //  the original length of a compressed or deduplicated file is stored in its fields
+        entry->orig_len = entry->f_len;
+        if (entry->kind == ENTRY_COMPRESSED) {
+            char fields[32];
+            if (entry->f_len < BLOCK_FIELDS || scan_read(plan, &win, entry->start, fields, BLOCK_FIELDS)) {
+                break;
+            }
+            entry->orig_len = from_bytes(LEN_SIZE, LEN_SIZE, fields);
+        } else if (entry->kind == ENTRY_DEDUP) {
+            char fields[16];
+            if (entry->f_len < DEDUP_FIELDS || scan_read(plan, &win, entry->start, fields, DEDUP_FIELDS)) {
+                break;
+            }
+            entry->orig_len = from_bytes(0, LEN_SIZE, fields);
+        } else if (entry->kind == ENTRY_STREAM && scan_stream(plan, &win, entry)) {
+            break;
+        }
+        pos = entry->start + entry->f_len;
+    }
+    free_scan_window(&win);
+
+    if (pos != plan->size_total) {
+        fprintf(stderr, "Error, data-files are incomplete. Input file might be corrupted.\n");
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+//  close the data-file of the window and free its buffer
+static void free_scan_window(struct scan_window *win) {
+    if (win->fd >= 0) {
+        close(win->fd);
+    }
+    free(win->data);
+}
+
+//  build the table of entries from the central directory, no data-file needs to be read for that
+//  only the entries marked in selected are taken, all entries if it is NULL
+static int entries_from_directory(struct decode_plan *plan, const struct directory *dir, const char *selected) {
+    plan->entries = calloc(dir->n_entries ? dir->n_entries : 1, sizeof (struct decode_entry));
+    if (!plan->entries) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    for (uint64_t i = 0; i < dir->n_entries; i++) {
+        if (selected && !selected[i]) {
+            continue;
+        }
+        struct dir_entry *d_entry = dir->entries + i;
+        struct decode_entry *entry = plan->entries + plan->n_entries;
+        if (d_entry->part > plan->f_count
+            || d_entry->part_off > plan->size_total - plan->part_start[d_entry->part]
+            || d_entry->f_len > plan->size_total - plan->part_start[d_entry->part] - d_entry->part_off) {
+            fprintf(stderr, "Error, invalid entry in the central directory. Input file might be corrupted.\n");
+            fflush(stderr);
+            return 1;
+        }
+        entry->f_name = malloc(d_entry->name_len + 1);
+        if (!entry->f_name) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+        bytes_cpy(d_entry->name, entry->f_name, d_entry->name_len + 1);
+        entry->name_len = d_entry->name_len;
+        entry->f_len = d_entry->f_len;
+        entry->kind = d_entry->kind;
+        entry->orig_len = d_entry->orig_len;
+        entry->start = plan->part_start[d_entry->part] + d_entry->part_off;
+        entry->idx = i;
+        plan->n_entries++;
+    }
+    return 0;
+}
+
+//  take the next item of the given worker, the owner takes items from the front of its own queue,
+//  idle workers steal items from the back of the queues of the other workers
+static int take_item(struct decode_plan *plan, uint32_t worker, struct decode_item *item) {
+    for (uint32_t i = 0; i < plan->n_workers; i++) {
+        struct item_queue *queue = plan->queues + (worker + i) % plan->n_workers;
+        pthread_mutex_lock(&queue->lock);
+        if (queue->head < queue->tail) {
+            if (!i) {
+                *item = queue->items[queue->head++];
+            } else {
+                *item = queue->items[--queue->tail];
+            }
+            pthread_mutex_unlock(&queue->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return 0;
+}
+
+//  extract a range of the content of an entry, the range might span multiple data-files
+static int extract_item(struct decode_plan *plan, struct decode_worker *worker, struct decode_item *item) {
+    struct decode_entry *entry = plan->entries + item->entry;
+
+    //  open the output file, it was already created by the planning thread
+    if (worker->out_fd < 0 || worker->out_entry != item->entry) {
+        if (worker->out_fd >= 0 && close(worker->out_fd)) {
+            fprintf(stderr, "Could not write file '%s'.\n", plan->entries[worker->out_entry].f_name);
+            fflush(stderr);
+            worker->out_fd = -1;
+            return 1;
+        }
+        worker->out_entry = item->entry;
+        worker->out_fd = open_output(&worker->dirs, entry->f_name, entry->name_len, O_WRONLY);
+        if (worker->out_fd < 0) {
+            fprintf(stderr, "Could not create file '%s'.\n", entry->f_name);
+            fflush(stderr);
+            return 1;
+        }
+    }
+
+    if (entry->kind == ENTRY_COMPRESSED) {
+        return extract_block(plan, worker, item);
+    }
+
+    //  with a manifest, the units are read into memory and hashed while they are written,
+    //  the items start at multiples of the units
+    for (uint64_t off = item->off; plan->hash && off < item->off + item->len; off += HASH_TASK) {
+        uint64_t n = item->off + item->len - off < HASH_TASK ? item->off + item->len - off : HASH_TASK;
+        int err = entry->kind == ENTRY_RAW ? read_range(plan, worker, entry->start + off, worker->unit, n)
+                                           : read_chunks(plan, worker, entry, off, worker->unit, n);
+        if (err || write_unit(worker, entry, off, n)) {
+            return 1;
+        }
+    }
+    if (plan->hash) {
+        return 0;
+    }
+
+    if (entry->kind == ENTRY_DEDUP || entry->kind == ENTRY_STREAM) {
+        return extract_chunks(plan, worker, item);
+    }
+
+    uint64_t pos = entry->start + item->off;
+    uint64_t end = pos + item->len;
+    while (pos < end) {
+        uint32_t part = find_partition(plan, pos);
+        uint64_t part_off = pos - plan->part_start[part];
+        uint64_t n = plan->part_start[part + 1] - pos;
+        if (end - pos < n) {
+            n = end - pos;
+        }
+        if (open_part(plan, worker, part)) {
+            return 1;
+        }
+        if (copy_positional(worker->part_fd, part_off, worker->out_fd, pos - entry->start, n, worker->buf, NULL) < n) {
+            fprintf(stderr, "Could not write file '%s'.\n", entry->f_name);
+            fflush(stderr);
+            return 1;
+        }
+        pos += n;
+    }
+    return 0;
+}
+
+//  decompress a single block of a compressed entry and write it at its position in the output file
+static int extract_block(struct decode_plan *plan, struct decode_worker *worker, struct decode_item *item) {
+    struct decode_entry *entry = plan->entries + item->entry;
+    struct block_ref *block = entry->blocks + item->off;
+    if (!worker->block) {
+        worker->block = malloc(MAX_BLOCK);
+        worker->plain = malloc(MAX_BLOCK);
+        if (!worker->block || !worker->plain) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            return 1;
+        }
+    }
+    if (read_range(plan, worker, block->start, worker->block, block->len)) {
+        return 1;
+    }
+
+    uint64_t plain_off = item->off * entry->block_size;
+    uint64_t plain_len = entry->orig_len - plain_off < entry->block_size ? entry->orig_len - plain_off : entry->block_size;
+    if (!block->raw && decompress_block(entry->codec, worker->block, block->len, worker->plain, plain_len)) {
+        fprintf(stderr, "Error, could not decompress file '%s'. Input file might be corrupted.\n", entry->f_name);
+        fflush(stderr);
+        return 1;
+    }
+    const char *plain = block->raw ? worker->block : worker->plain;
+    if (pwrite_all(worker->out_fd, plain, plain_len, plain_off) < plain_len) {
+        fprintf(stderr, "Could not write file '%s'.\n", entry->f_name);
+        fflush(stderr);
+        return 1;
+    }
+    //  a block is made of whole units of the hash, unless the entry is hashed after it is extracted
+    for (uint64_t off = 0; plan->hash && !entry->rehash && off < plain_len; off += HASH_TASK) {
+        uint64_t n = plain_len - off < HASH_TASK ? plain_len - off : HASH_TASK;
+        if (hash_unit(&entry->units, (plain_off + off) / HASH_TASK, (const unsigned char *) plain + off, n, entry->hash)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//  extract a range of a deduplicated entry, the chunks of its references are copied from the data-files
+static int extract_chunks(struct decode_plan *plan, struct decode_worker *worker, struct decode_item *item) {
+    struct decode_entry *entry = plan->entries + item->entry;
+    uint64_t pos = item->off;
+    uint64_t end = item->off + item->len;
+    for (uint64_t i = find_ref(entry, item->off); pos < end; i++) {
+        struct chunk_ref *ref = entry->refs + i;
+        uint64_t ref_end = ref->out_off + ref->len < end ? ref->out_off + ref->len : end;
+        while (pos < ref_end) {
+            uint64_t src = ref->start + (pos - ref->out_off);
+            uint32_t part = find_partition(plan, src);
+            uint64_t n = plan->part_start[part + 1] - src;
+            if (ref_end - pos < n) {
+                n = ref_end - pos;
+            }
+            if (open_part(plan, worker, part)) {
+                return 1;
+            }
+            if (copy_positional(worker->part_fd, src - plan->part_start[part], worker->out_fd, pos, n, worker->buf, NULL) < n) {
+                fprintf(stderr, "Could not write file '%s'.\n", entry->f_name);
+                fflush(stderr);
+                return 1;
+            }
+            pos += n;
+        }
+    }
+    return 0;
+}
+
+//  binary search for the reference of a deduplicated entry that contains the given offset of the extracted file
+static uint64_t find_ref(const struct decode_entry *entry, uint64_t off) {
+    uint64_t lo = 0;
+    uint64_t hi = entry->n_refs - 1;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo + 1) / 2;
+        if (entry->refs[mid].out_off <= off) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+//  read a range of the extracted file of a deduplicated entry into dest, from the chunks of its references
+static int read_chunks(struct decode_plan *plan, struct decode_worker *worker, const struct decode_entry *entry, uint64_t off,
+                char *dest, uint64_t len) {
+    uint64_t end = off + len;
+    for (uint64_t i = find_ref(entry, off); off < end; i++) {
+        const struct chunk_ref *ref = entry->refs + i;
+        uint64_t n = ref->out_off + ref->len - off;
+        if (end - off < n) {
+            n = end - off;
+        }
+        if (read_range(plan, worker, ref->start + (off - ref->out_off), dest, n)) {
+            return 1;
+        }
+        dest += n;
+        off += n;
+    }
+    return 0;
+}
+
+//  write a unit of the extracted file from the unit buffer of the worker and hash it
+static int write_unit(struct decode_worker *worker, struct decode_entry *entry, uint64_t off, uint64_t len) {
+    if (pwrite_all(worker->out_fd, worker->unit, len, off) < len) {
+        fprintf(stderr, "Could not write file '%s'.\n", entry->f_name);
+        fflush(stderr);
+        return 1;
+    }
+    return hash_unit(&entry->units, off / HASH_TASK, (const unsigned char *) worker->unit, len, entry->hash);
+}
+
+//  open the data-file with the given index for the worker, unless it is open already
+static int open_part(struct decode_plan *plan, struct decode_worker *worker, uint32_t part) {
+    if (worker->part_fd >= 0 && worker->part == part) {
+        return 0;
+    }
+    if (worker->part_fd >= 0) {
+        close(worker->part_fd);
+    }
+    worker->part = part;
+    worker->part_fd = open(plan->f_names + (size_t) part * plan->f_name_len, O_RDONLY);
+    if (worker->part_fd < 0) {
+        fprintf(stderr, "Error, could not read file '%s'.\n", plan->f_names + (size_t) part * plan->f_name_len);
+        fflush(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+//  read a range of the concatenated data-files into dest, the range might span multiple data-files
+static int read_range(struct decode_plan *plan, struct decode_worker *worker, uint64_t pos, char *dest, uint64_t len) {
+    uint64_t end = pos + len;
+    while (pos < end) {
+        uint32_t part = find_partition(plan, pos);
+        uint64_t n = plan->part_start[part + 1] - pos;
+        if (end - pos < n) {
+            n = end - pos;
+        }
+        if (open_part(plan, worker, part)) {
+            return 1;
+        }
+        if (pread_all(worker->part_fd, dest, n, pos - plan->part_start[part]) < n) {
+            fprintf(stderr, "Error, could not read file '%s'.\n", plan->f_names + (size_t) part * plan->f_name_len);
+            fflush(stderr);
+            return 1;
+        }
+        dest += n;
+        pos += n;
+    }
+    return 0;
+}
+
+//  worker thread of the parallel decoder, it extracts items until all queues are empty
+static void *decode_worker_run(void *arg) {
+    struct decode_worker *worker = arg;
+    struct decode_plan *plan = worker->plan;
+    struct decode_item item;
+    while (!__atomic_load_n(&plan->failed, __ATOMIC_RELAXED) && take_item(plan, worker->id, &item)) {
+        TRACE_BEGIN("extract", plan->entries[item.entry].f_name);
+        if (extract_item(plan, worker, &item)) {
+            __atomic_store_n(&plan->failed, 1, __ATOMIC_RELAXED);
+        }
+        TRACE_END("extract");
+    }
+    if (worker->part_fd >= 0) {
+        close(worker->part_fd);
+    }
+    if (worker->out_fd >= 0 && close(worker->out_fd)) {
+        __atomic_store_n(&plan->failed, 1, __ATOMIC_RELAXED);
+    }
+    free_dir_cache(&worker->dirs);
+    return NULL;
+}
+
+//  free the entries, queues and offsets of a decode plan
+static void free_decode_plan(struct decode_plan *plan) {
+    for (uint64_t i = 0; i < plan->n_entries; i++) {
+        free(plan->entries[i].f_name);
+        free(plan->entries[i].blocks);
+        free(plan->entries[i].refs);
+        free_unit_hash(&plan->entries[i].units);
+    }
+    free(plan->entries);
+    if (plan->queues) {
+        for (uint32_t i = 0; i < plan->n_workers; i++) {
+            pthread_mutex_destroy(&plan->queues[i].lock);
+            free(plan->queues[i].items);
+        }
+        free(plan->queues);
+    }
+    free(plan->part_start);
+}
+
+//  build the table of entries of the given data-files, restricted to the entries selected by '--only'
+static int prepare_decode_plan(struct decode_plan *plan, char *f_names, uint32_t f_name_len, uint32_t f_count,
+                        uint64_t size_total, const struct directory *dir, const struct fpp_options *opts) {
+    plan->f_names = f_names;
+    plan->f_name_len = f_name_len;
+    plan->f_count = f_count;
+    plan->size_total = size_total;
+    plan->n_workers = opts->threads;
+
+    //  calculate the offsets of the data-files in the concatenated data
+    plan->part_start = calloc(f_count + 1, sizeof (uint64_t));
+    if (!plan->part_start) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    //  with a central directory, the offsets follow from the max. size of the data-files (every data-file is full,
+    //  except the last one), so no data-file needs to exist to list the archive
+    for (uint32_t i = 0; i < f_count; i++) {
+        if (dir) {
+            uint64_t full = dir->max_fsize > size_total / (i + 1) ? size_total : dir->max_fsize * (i + 1);
+            plan->part_start[i + 1] = i + 1 == f_count ? size_total : full;
+        } else {
+            plan->part_start[i + 1] = plan->part_start[i] + f_size(f_names + (size_t) i * f_name_len);
+        }
+    }
+    if (plan->part_start[f_count] != size_total) {
+        fprintf(stderr, "Error, data-files do not match the expected size. Input file might be corrupted.\n");
+        fflush(stderr);
+        return 1;
+    }
+    if (dir) {
+        char *selected = NULL;
+        if (opts->n_only && !(selected = select_from_directory(dir, opts))) {
+            return 1;
+        }
+        int err = entries_from_directory(plan, dir, selected);
+        free(selected);
+        return err;
+    }
+    if (scan_entries(plan)) {
+        return 1;
+    }
+    return opts->n_only ? filter_entries(plan, opts) : 0;
+}
+
+//  mark the entries of the central directory whose name matches one of the patterns given with '--only'
+//  plain names are looked up in the hash table, only shell patterns are matched against every entry
+//  a pattern that matches no entry is an error, so typos do not go unnoticed
+static char *select_from_directory(const struct directory *dir, const struct fpp_options *opts) {
+    char *selected = calloc(dir->n_entries ? dir->n_entries : 1, 1);
+    if (!selected) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return NULL;
+    }
+    int err = 0;
+    for (unsigned j = 0; j < opts->n_only; j++) {
+        const char *pattern = opts->only[j];
+        int matched = 0;
+        if (strpbrk(pattern, "*?[\\")) {
+            for (uint64_t i = 0; i < dir->n_entries; i++) {
+                if (!fnmatch(pattern, dir->entries[i].name, 0)) {
+                    selected[i] = 1;
+                    matched = 1;
+                }
+            }
+        } else {
+            //  all entries with the same name are in the probe sequence that starts at the bucket of the name,
+            //  so the probing continues after the first match to find every copy of the file
+            uint64_t len = strlen(pattern);
+            uint64_t bucket = hash_name(pattern, len) & (dir->n_buckets - 1);
+            while (dir->n_buckets && dir->buckets[bucket]) {
+                uint64_t i = dir->buckets[bucket] - 1;
+                if (dir->entries[i].name_len == len && !memcmp(dir->entries[i].name, pattern, len)) {
+                    selected[i] = 1;
+                    matched = 1;
+                }
+                bucket = (bucket + 1) & (dir->n_buckets - 1);
+            }
+        }
+        if (!matched) {
+            fprintf(stderr, "Error, no file in the archive matches '%s'.\n", pattern);
+            fflush(stderr);
+            err = 1;
+        }
+    }
+    if (err) {
+        free(selected);
+        return NULL;
+    }
+    return selected;
+}
+
+//  keep only the entries whose name matches one of the patterns given with '--only'
+//  a pattern that matches no entry is an error, so typos do not go unnoticed
+static int filter_entries(struct decode_plan *plan, const struct fpp_options *opts) {
+    char *matched = calloc(opts->n_only, 1);
+    if (!matched) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    uint64_t kept = 0;
+    for (uint64_t i = 0; i < plan->n_entries; i++) {
+        struct decode_entry *entry = plan->entries + i;
+        int keep = 0;
+        for (unsigned j = 0; j < opts->n_only; j++) {
+            if (!fnmatch(opts->only[j], entry->f_name, 0)) {
+                matched[j] = 1;
+                keep = 1;
+            }
+        }
+        if (keep) {
+            plan->entries[kept++] = *entry;
+        } else {
+            free(entry->f_name);
+            free(entry->refs);
+        }
+    }
+    plan->n_entries = kept;
+
+    int err = 0;
+    for (unsigned j = 0; j < opts->n_only; j++) {
+        if (!matched[j]) {
+            fprintf(stderr, "Error, no file in the archive matches '%s'.\n", opts->only[j]);
+            fflush(stderr);
+            err = 1;
+        }
+    }
+    free(matched);
+    return err;
+}
+
+//  compare two entries of the parallel decoder by their name, entries with the same name in the order of the archive
+static int compare_entry_names(const void *a, const void *b) {
+    const struct decode_entry *entry_a = *(struct decode_entry * const *) a;
+    const struct decode_entry *entry_b = *(struct decode_entry * const *) b;
+    uint64_t len = entry_a->name_len < entry_b->name_len ? entry_a->name_len : entry_b->name_len;
+    int cmp = memcmp(entry_a->f_name, entry_b->f_name, len);
+    if (cmp || entry_a->name_len != entry_b->name_len) {
+        return cmp ? cmp : entry_a->name_len < entry_b->name_len ? -1 : 1;
+    }
+    return entry_a->idx < entry_b->idx ? -1 : entry_a->idx > entry_b->idx;
+}
+
+//  mark every entry that is followed by an entry with the same name, only the last one is extracted,
+//  like the sequential decoder overwrites the file, otherwise the workers would write both into the same file
+static int mark_superseded(struct decode_plan *plan) {
+    if (plan->n_entries < 2) {
+        return 0;
+    }
+    struct decode_entry **sorted = malloc(plan->n_entries * sizeof (struct decode_entry *));
+    if (!sorted) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    for (uint64_t i = 0; i < plan->n_entries; i++) {
+        sorted[i] = plan->entries + i;
+    }
+    qsort(sorted, plan->n_entries, sizeof (struct decode_entry *), compare_entry_names);
+    for (uint64_t i = 0; i + 1 < plan->n_entries; i++) {
+        sorted[i]->superseded = sorted[i]->name_len == sorted[i + 1]->name_len
+            && !memcmp(sorted[i]->f_name, sorted[i + 1]->f_name, sorted[i]->name_len);
+    }
+    free(sorted);
+    return 0;
+}
+
+//  read the block fields and block tables of the selected compressed entries
+//  the offsets of the blocks in the concatenated data-files are stored, so every block can be extracted on its own
+static int load_block_tables(struct decode_plan *plan) {
+    struct scan_window win = {0};
+    win.fd = -1;
+    win.data = malloc(SCAN_WINDOW);
+    if (!win.data) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+
+    char fields[32];
+    for (uint64_t i = 0; i < plan->n_entries; i++) {
+        struct decode_entry *entry = plan->entries + i;
+        if (entry->kind != ENTRY_COMPRESSED) {
+            continue;
+        }
+        int invalid = entry->f_len < BLOCK_FIELDS || scan_read(plan, &win, entry->start, fields, BLOCK_FIELDS);
+        if (!invalid) {
+            entry->codec = from_bytes(0, LEN_SIZE, fields);
+            entry->orig_len = from_bytes(LEN_SIZE, LEN_SIZE, fields);
+            entry->block_size = from_bytes(LEN_SIZE * 2, LEN_SIZE, fields);
+            entry->n_blocks = from_bytes(LEN_SIZE * 3, LEN_SIZE, fields);
+            invalid = check_block_fields(entry->codec, entry->orig_len, entry->block_size, entry->n_blocks, entry->f_len);
+        }
+        if (invalid) {
+            fprintf(stderr, "Error, invalid compressed file '%s'. Input file might be corrupted.\n", entry->f_name);
+            fflush(stderr);
+            free_scan_window(&win);
+            return 1;
+        }
+
+        //  the table might be larger than the window, so it is read in pieces
+        uint64_t table_len = entry->n_blocks * LEN_SIZE;
+        char *table = malloc(table_len ? table_len : 1);
+        entry->blocks = malloc((entry->n_blocks ? entry->n_blocks : 1) * sizeof (struct block_ref));
+        if (!table || !entry->blocks) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free(table);
+            free_scan_window(&win);
+            return 1;
+        }
+        for (uint64_t read = 0; !invalid && read < table_len; read += SCAN_WINDOW) {
+            uint64_t n = table_len - read < SCAN_WINDOW ? table_len - read : SCAN_WINDOW;
+            invalid = scan_read(plan, &win, entry->start + BLOCK_FIELDS + read, table + read, n);
+        }
+        uint64_t data_start = BLOCK_FIELDS + table_len;
+        if (invalid
+            || check_block_table(table, entry->n_blocks, entry->orig_len, entry->block_size, entry->f_len - data_start)) {
+            fprintf(stderr, "Error, invalid compressed file '%s'. Input file might be corrupted.\n", entry->f_name);
+            fflush(stderr);
+            free(table);
+            free_scan_window(&win);
+            return 1;
+        }
+        uint64_t block_start = entry->start + data_start;
+        for (uint64_t j = 0; j < entry->n_blocks; j++) {
+            uint64_t stored = from_bytes(j * LEN_SIZE, LEN_SIZE, table);
+            entry->blocks[j].start = block_start;
+            entry->blocks[j].len = stored & ~BLOCK_RAW;
+            entry->blocks[j].raw = (stored & BLOCK_RAW) != 0;
+            block_start += entry->blocks[j].len;
+        }
+        free(table);
+    }
+    free_scan_window(&win);
+    return 0;
+}
+
+//  read the reference tables of the selected deduplicated entries
+//  the offsets of the chunks in the concatenated data-files and in the extracted file are stored,
+//  so every range of the extracted file can be copied on its own
+static int load_ref_tables(struct decode_plan *plan) {
+    struct scan_window win = {0};
+    win.fd = -1;
+    win.data = malloc(SCAN_WINDOW);
+    if (!win.data) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+
+    char fields[16];
+    for (uint64_t i = 0; i < plan->n_entries; i++) {
+        struct decode_entry *entry = plan->entries + i;
+        if (entry->kind != ENTRY_DEDUP) {
+            continue;
+        }
+        int invalid = entry->f_len < DEDUP_FIELDS || scan_read(plan, &win, entry->start, fields, DEDUP_FIELDS);
+        if (!invalid) {
+            entry->orig_len = from_bytes(0, LEN_SIZE, fields);
+            entry->n_refs = from_bytes(LEN_SIZE, LEN_SIZE, fields);
+            invalid = entry->n_refs > (entry->f_len - DEDUP_FIELDS) / REF_SIZE;
+        }
+        if (invalid) {
+            fprintf(stderr, "Error, invalid deduplicated file '%s'. Input file might be corrupted.\n", entry->f_name);
+            fflush(stderr);
+            free_scan_window(&win);
+            return 1;
+        }
+
+        //  the table might be larger than the window, so it is read in pieces (of whole references)
+        uint64_t table_len = entry->n_refs * REF_SIZE;
+        char *table = malloc(table_len ? table_len : 1);
+        entry->refs = malloc((entry->n_refs ? entry->n_refs : 1) * sizeof (struct chunk_ref));
+        if (!table || !entry->refs) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free(table);
+            free_scan_window(&win);
+            return 1;
+        }
+        for (uint64_t read = 0; !invalid && read < table_len; read += SCAN_WINDOW) {
+            uint64_t n = table_len - read < SCAN_WINDOW ? table_len - read : SCAN_WINDOW;
+            invalid = scan_read(plan, &win, entry->start + DEDUP_FIELDS + read, table + read, n);
+        }
+        uint64_t data_start = DEDUP_FIELDS + table_len;
+        if (invalid || check_ref_table(table, entry->n_refs, entry->orig_len, entry->f_len - data_start, plan->size_total)) {
+            fprintf(stderr, "Error, invalid deduplicated file '%s'. Input file might be corrupted.\n", entry->f_name);
+            fflush(stderr);
+            free(table);
+            free_scan_window(&win);
+            return 1;
+        }
+        uint64_t out_off = 0;
+        for (uint64_t j = 0; j < entry->n_refs; j++) {
+            uint64_t src = from_bytes(j * REF_SIZE, LEN_SIZE, table);
+            entry->refs[j].start = src & REF_STREAM ? entry->start + data_start + (src & ~REF_STREAM) : src;
+            entry->refs[j].len = from_bytes(j * REF_SIZE + LEN_SIZE, LEN_SIZE, table);
+            entry->refs[j].out_off = out_off;
+            out_off += entry->refs[j].len;
+        }
+        free(table);
+    }
+    free_scan_window(&win);
+    return 0;
+}
+
+//  walk the chunks of a stream entry, which has no length in its header
+//  the length of its content and the offsets of its chunks are stored in the entry, the chunks are extracted
+//  like the references of a deduplicated entry
+static int scan_stream(struct decode_plan *plan, struct scan_window *win, struct decode_entry *entry) {
+    uint64_t capacity = 0;
+    uint64_t pos = entry->start;
+    char len_buf[8];
+    entry->orig_len = 0;
+    while (1) {
+        if (scan_read(plan, win, pos, len_buf, LEN_SIZE)) {
+            return 1;
+        }
+        uint64_t len = from_bytes(0, LEN_SIZE, len_buf);
+        pos += LEN_SIZE;
+        if (!len) {
+            break;
+        }
+        if (len > plan->size_total - pos) {
+            return 1;
+        }
+        if (entry->n_refs == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            struct chunk_ref *refs = realloc(entry->refs, capacity * sizeof (struct chunk_ref));
+            if (!refs) {
+                fprintf(stderr, "Memory allocation error.\n");
+                fflush(stderr);
+                return 1;
+            }
+            entry->refs = refs;
+        }
+        entry->refs[entry->n_refs].start = pos;
+        entry->refs[entry->n_refs].len = len;
+        entry->refs[entry->n_refs].out_off = entry->orig_len;
+        entry->n_refs++;
+        entry->orig_len += len;
+        pos += len;
+    }
+    entry->f_len = pos - entry->start;
+    return 0;
+}
+
+//  walk the chunks of the selected stream entries, that were taken from the central directory
+//  their lengths have to match the ones in the directory
+static int load_stream_tables(struct decode_plan *plan) {
+    struct scan_window win = {0};
+    win.fd = -1;
+    win.data = malloc(SCAN_WINDOW);
+    if (!win.data) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        return 1;
+    }
+    for (uint64_t i = 0; i < plan->n_entries; i++) {
+        struct decode_entry *entry = plan->entries + i;
+        if (entry->kind != ENTRY_STREAM || entry->refs) {
+            continue;
+        }
+        uint64_t f_len = entry->f_len;
+        uint64_t orig_len = entry->orig_len;
+        if (scan_stream(plan, &win, entry) || entry->f_len != f_len || entry->orig_len != orig_len) {
+            fprintf(stderr, "Error, invalid stream file '%s'. Input file might be corrupted.\n", entry->f_name);
+            fflush(stderr);
+            free_scan_window(&win);
+            return 1;
+        }
+    }
+    free_scan_window(&win);
+    return 0;
+}
+
+//  list the name and size of all files in the archive, the file-contents are never read
+//  with a central directory, no data-file is opened at all
+static int list_files(char *filepath, const struct fpp_options *opts) {
+    struct main_file info;
+    if (read_main_file(filepath, &info)) {
+        return 1;
+    }
+
+    uint32_t f_name_len = strlen(filepath) + 32;
+    char *f_names = calloc(info.f_count ? info.f_count : 1, f_name_len);
+    if (!f_names) {
+        fprintf(stderr, "Could not allocate memory.\n");
+        fflush(stderr);
+        free_main_file(&info);
+        return 1;
+    }
+    for (uint64_t i = 0; i < info.f_count; i++) {
+        snprintf(f_names + (size_t) i * f_name_len, f_name_len, "%s_data%llu", filepath, (unsigned long long) i);
+    }
+
+    struct decode_plan plan = {0};
+    int err = prepare_decode_plan(&plan, f_names, f_name_len, info.f_count, info.size_total, info.dir, opts);
+    for (uint64_t i = 0; !err && i < plan.n_entries; i++) {
+        fprintf(stdout, "%12llu  %s\n", (unsigned long long) plan.entries[i].orig_len, plan.entries[i].f_name);
+    }
+    fflush(stdout);
+    free_decode_plan(&plan);
+    free(f_names);
+    free_main_file(&info);
+    return err;
+}
+
+//  print the content hashes of the archive like b3sum (hash, two spaces, name), only the main file is read
+static int print_manifest(char *filepath, const struct fpp_options *opts) {
+    struct main_file info;
+    if (read_main_file(filepath, &info)) {
+        return 1;
+    }
+    if (!info.manifest) {
+        fprintf(stderr, "Error, archive '%s' has no content hashes (encode it with '--hash').\n", filepath);
+        fflush(stderr);
+        free_main_file(&info);
+        return 1;
+    }
+    char *matched = calloc(opts->n_only ? opts->n_only : 1, 1);
+    if (!matched) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_main_file(&info);
+        return 1;
+    }
+    for (uint64_t i = 0; i < info.manifest->n_entries; i++) {
+        struct hash_entry *entry = info.manifest->entries + i;
+        int keep = !opts->n_only;
+        for (unsigned j = 0; j < opts->n_only; j++) {
+            if (!fnmatch(opts->only[j], entry->name, 0)) {
+                matched[j] = 1;
+                keep = 1;
+            }
+        }
+        if (!keep) {
+            continue;
+        }
+        char hex[HASH_LEN * 2 + 1];
+        for (uint64_t k = 0; k < HASH_LEN; k++) {
+            snprintf(hex + k * 2, 3, "%02x", entry->hash[k]);
+        }
+        fprintf(stdout, "%s  %s\n", hex, entry->name);
+    }
+    fflush(stdout);
+
+    int err = 0;
+    for (unsigned j = 0; j < opts->n_only; j++) {
+        if (!matched[j]) {
+            fprintf(stderr, "Error, no file in the archive matches '%s'.\n", opts->only[j]);
+            fflush(stderr);
+            err = 1;
+        }
+    }
+    free(matched);
+    free_main_file(&info);
+    return err;
+}
+
+//  extract all files from the given data-files with multiple threads
+//  the table of entries is taken from the central directory or built by scanning the headers,
+//  then the entries (large ones split into ranges) are distributed to the workers,
+//  which steal from each other when they run out of work
+//  with a manifest, the extracted files are compared with their content hashes at the end
+static int extract_files_parallel(char *f_names, uint32_t f_name_len, uint32_t f_count, uint64_t size_total,
+                           const struct directory *dir, const uint32_t *crcs, const struct manifest *manifest,
+                           const struct fpp_options *opts) {
+    struct decode_plan plan = {0};
+    uint64_t t = stats_clock();
+    TRACE_BEGIN("scan", NULL);
+    if (prepare_decode_plan(&plan, f_names, f_name_len, f_count, size_total, dir, opts)
+        || load_block_tables(&plan) || load_ref_tables(&plan) || load_stream_tables(&plan)
+        || mark_superseded(&plan)) {
+        free_decode_plan(&plan);
+        return 1;
+    }
+    TRACE_END("scan");
+    stats_add(PHASE_SCAN, t);
+    for (uint64_t i = 0; i < plan.n_entries; i++) {
+        stats_entry(plan.entries[i].orig_len);
+        stats.bytes_read += LEN_SIZE * 2 + plan.entries[i].name_len + plan.entries[i].f_len;
+        stats.bytes_written += plan.entries[i].orig_len;
+    }
+
+    //  the data-files are verified before any file is written, only the ones containing selected entries are read
+    if (crcs && f_count) {
+        char *selected = NULL;
+        if (opts->n_only) {
+            selected = calloc(f_count, 1);
+            if (!selected) {
+                fprintf(stderr, "Memory allocation error.\n");
+                fflush(stderr);
+                free_decode_plan(&plan);
+                return 1;
+            }
+            for (uint64_t i = 0; i < plan.n_entries; i++) {
+                struct decode_entry *entry = plan.entries + i;
+                if (entry->superseded) {
+                    continue;
+                }
+                uint64_t header_start = entry->start - LEN_SIZE * 2 - entry->name_len;
+                if (entry->start < LEN_SIZE * 2 + entry->name_len) {
+                    header_start = 0;
+                }
+                uint32_t first = find_partition(&plan, header_start);
+                uint32_t last = find_partition(&plan, entry->f_len ? entry->start + entry->f_len - 1 : entry->start - 1);
+                memset(selected + first, 1, last - first + 1);
+                //  deduplicated entries also need the data-files of the chunks stored by earlier entries
+                for (uint64_t j = 0; j < entry->n_refs; j++) {
+                    first = find_partition(&plan, entry->refs[j].start);
+                    last = find_partition(&plan, entry->refs[j].start + entry->refs[j].len - 1);
+                    memset(selected + first, 1, last - first + 1);
+                }
+            }
+        }
+        t = stats_clock();
+        TRACE_BEGIN("verify", NULL);
+        int err = verify_partitions(f_names, f_name_len, f_count, selected, crcs, plan.n_workers);
+        TRACE_END("verify");
+        stats_add(PHASE_READ, t);
+        free(selected);
+        if (err) {
+            free_decode_plan(&plan);
+            return 1;
+        }
+    }
+
+    //  create all output files (and their directories) and split the entries into items
+    t = stats_clock();
+    uint64_t n_items = 0;
+    struct dir_cache dirs = {0};
+    for (uint64_t i = 0; i < plan.n_entries; i++) {
+        struct decode_entry *entry = plan.entries + i;
+        if (entry->superseded) {
+            continue;
+        }
+        fprintf(stdout, "Writing file '%s'\n", entry->f_name);
+        fflush(stdout);
+        int fd = open_output(&dirs, entry->f_name, entry->name_len, O_WRONLY | O_CREAT | O_TRUNC);
+        if (fd < 0) {
+            fprintf(stderr, "Could not create file '%s'.\n", entry->f_name);
+            fflush(stderr);
+            free_dir_cache(&dirs);
+            free_decode_plan(&plan);
+            return 1;
+        }
+        close(fd);
+        //  with a manifest, the units of the file are hashed as they are written, an empty file has no item
+        if (manifest) {
+            entry->rehash = entry->kind == ENTRY_COMPRESSED && entry->block_size % HASH_TASK;
+            if (!entry->rehash && (unit_hash_init(&entry->units, entry->orig_len)
+                                   || (!entry->orig_len && hash_unit(&entry->units, 0, NULL, 0, entry->hash)))) {
+                free_dir_cache(&dirs);
+                free_decode_plan(&plan);
+                return 1;
+            }
+        }
+        if (entry->kind == ENTRY_COMPRESSED) {
+            n_items += entry->n_blocks;
+        } else {
+            n_items += entry->orig_len / TASK_SIZE + (entry->orig_len % TASK_SIZE ? 1 : 0);
+        }
+    }
+    free_dir_cache(&dirs);
+
+    //  every worker gets a contiguous part of the items, so workers read the data-files mostly sequentially
+    plan.queues = calloc(plan.n_workers, sizeof (struct item_queue));
+    if (!plan.queues) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_decode_plan(&plan);
+        return 1;
+    }
+    uint64_t per_worker = n_items / plan.n_workers + 1;
+    for (uint32_t i = 0; i < plan.n_workers; i++) {
+        pthread_mutex_init(&plan.queues[i].lock, NULL);
+        plan.queues[i].items = malloc(per_worker * sizeof (struct decode_item));
+        if (!plan.queues[i].items) {
+            fprintf(stderr, "Memory allocation error.\n");
+            fflush(stderr);
+            free_decode_plan(&plan);
+            return 1;
+        }
+    }
+    //  compressed entries are split into their blocks, the offset of such an item is the index of the block
+    uint64_t item_idx = 0;
+    for (uint64_t i = 0; i < plan.n_entries; i++) {
+        if (plan.entries[i].superseded) {
+            continue;
+        }
+        for (uint64_t idx = 0; plan.entries[i].kind == ENTRY_COMPRESSED && idx < plan.entries[i].n_blocks; idx++) {
+            struct item_queue *queue = plan.queues + item_idx / per_worker;
+            struct decode_item *item = queue->items + queue->tail++;
+            item->entry = i;
+            item->off = idx;
+            item->len = plan.entries[i].blocks[idx].len;
+            item_idx++;
+        }
+        //  the items of raw and deduplicated entries are ranges of the extracted file
+        uint64_t orig_len = plan.entries[i].orig_len;
+        for (uint64_t off = 0; plan.entries[i].kind != ENTRY_COMPRESSED && off < orig_len; off += TASK_SIZE) {
+            struct item_queue *queue = plan.queues + item_idx / per_worker;
+            struct decode_item *item = queue->items + queue->tail++;
+            item->entry = i;
+            item->off = off;
+            item->len = orig_len - off < TASK_SIZE ? orig_len - off : TASK_SIZE;
+            item_idx++;
+        }
+    }
+
+    //  start the workers
+    struct decode_worker *workers = calloc(plan.n_workers, sizeof (struct decode_worker));
+    if (!workers) {
+        fprintf(stderr, "Memory allocation error.\n");
+        fflush(stderr);
+        free_decode_plan(&plan);
+        return 1;
+    }
+    plan.hash = manifest != NULL;
+    uint32_t started = 0;
+    for (uint32_t i = 0; i < plan.n_workers; i++) {
+        workers[i].plan = &plan;
+        workers[i].id = i;
+        workers[i].part_fd = -1;
+        workers[i].out_fd = -1;
+        workers[i].buf = malloc(BUF_SIZE);
+        workers[i].unit = plan.hash ? malloc(HASH_TASK) : NULL;
+        if (!workers[i].buf || (plan.hash && !workers[i].unit)
+            || pthread_create(&workers[i].thread, NULL, decode_worker_run, workers + i)) {
+            fprintf(stderr, "Could not start worker thread.\n");
+            fflush(stderr);
+            free(workers[i].buf);
+            free(workers[i].unit);
+            __atomic_store_n(&plan.failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        started++;
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].buf);
+        free(workers[i].unit);
+        free(workers[i].block);
+        free(workers[i].plain);
+    }
+    free(workers);
+    stats_add(PHASE_WRITE, t);
+    if (plan.failed) {
+        free_decode_plan(&plan);
+        return 1;
+    }
+
+    //  write parser log, the files are listed in the order of the archive
+    FILE *log = fopen("parser.log", "wb+");
+    if (!log) {
+        fprintf(stderr, "Could not open file 'parser.log'.\n");
+        fflush(stderr);
+        free_decode_plan(&plan);
+        return 1;
+    }
+    for (uint64_t i = 0; i < plan.n_entries; i++) {
+        uint64_t written_log = fwrite64(plan.entries[i].f_name, plan.entries[i].name_len, log);
+        uint64_t written_log_separator = fwrite64("\n", 1, log);
+        if (written_log < plan.entries[i].name_len || written_log_separator < 1) {
+            fprintf(stderr, "Could not write file 'parser.log'.\n");
+            fflush(stderr);
+            fclose(log);
+            free_decode_plan(&plan);
+            return 1;
+        }
+    }
+    fclose(log);
+    int err = 0;
+    if (manifest) {
+        t = stats_clock();
+        err = check_extracted_hashes(&plan, manifest, opts->hash_threads);
+        stats_add(PHASE_READ, t);
+    }
+    free_decode_plan(&plan);
+    return err;
+}
+
+//  verify the checksums of all data-files of the given main file without extracting anything
+//  the data-files are read concurrently, one data-file per thread at a time
+static int verify_files(char *filepath, const struct fpp_options *opts) {
+    struct main_file info;
+    if (read_main_file(filepath, &info)) {
+        return 1;
+    }
+    if (!info.crcs) {
+        fprintf(stderr, "Error, file '%s' contains no checksums (it was encoded by an older version or with "
+                        "'--no-checksums').\n", filepath);
+        fflush(stderr);
+        free_main_file(&info);
+        return 1;
+    }
+
+    uint32_t f_name_len = strlen(filepath) + 32;
+    char *f_names = calloc(info.f_count ? info.f_count : 1, f_name_len);
+    if (!f_names) {
+        fprintf(stderr, "Could not allocate memory.\n");
+        fflush(stderr);
+        free_main_file(&info);
+        return 1;
+    }
+    uint64_t size_total = 0;
+    for (uint64_t i = 0; i < info.f_count; i++) {
+        char *f_name = f_names + (size_t) i * f_name_len;
+        snprintf(f_name, f_name_len, "%s_data%llu", filepath, (unsigned long long) i);
+        if (access(f_name, R_OK) == -1) {
+            fprintf(stderr, "Error, can not access file '%s'.\n", f_name);
+            fflush(stderr);
+            free(f_names);
+            free_main_file(&info);
+            return 1;
+        }
+        size_total += f_size(f_name);
+    }
+    if (size_total != info.size_total) {
+        fprintf(stderr, "Error, data-files do not match the expected size. Input file might be corrupted.\n");
+        fflush(stderr);
+        free(f_names);
+        free_main_file(&info);
+        return 1;
+    }
+
+    fprintf(stdout, "Verifying %llu files with %u threads.\n", (unsigned long long) info.f_count, opts->threads);
+    fflush(stdout);
+    int err = verify_partitions(f_names, f_name_len, info.f_count, NULL, info.crcs, opts->threads);
+    if (!err) {
+        fprintf(stdout, "Successfully verified %llu files.\n", (unsigned long long) info.f_count);
+        fflush(stdout);
+    }
+    free(f_names);
+    free_main_file(&info);
+    return err;
+}
+
+//  process the given input file
+static int process_input_file(char *filepath, const struct fpp_options *opts) {
+    //  the resources of the decode, all of them are released at the end, whether the decode failed or not
+    int ret = 1;
+    struct main_file info = {0};
+    char *f_names = NULL;
+    uint32_t *crcs = NULL;
+    char *buf = NULL;
+    struct uring *ring = NULL;
+    struct extract_state st = {0};
+    st.part_fd = -1;
+    FILE *file = NULL;
+    struct mapped_file *map = NULL;
+
+    //  read the information about the data that needs to be reads from the files
+    uint64_t t = stats_clock();
+    TRACE_BEGIN("main file read", filepath);
+    if (read_main_file(filepath, &info)) {
+        goto cleanup;
+    }
+    TRACE_END("main file read");
+    stats_add(PHASE_SCAN, t);
+    uint64_t f_count = info.f_count;
+    uint64_t size_total = info.size_total;
+
+    //  store all file names of the data files in an array, so they can be accessed easily
+    uint32_t f_name_len = strlen(filepath) + 32;
+    f_names = calloc(f_count ? f_count : 1, f_name_len);
+    if (!f_names) {
+        fprintf(stderr, "Could not allocate memory.\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+    for (uint64_t i = 0; i < f_count; i++) {
+        snprintf(f_names + (size_t) i * f_name_len, f_name_len, "%s_data%llu", filepath, (unsigned long long) i);
+    }
+
+    //  archives updated by incremental encodes still contain the data of outdated files,
+    //  only the entries of the central directory are extracted from them
+    uint64_t live_total = 0;
+    for (uint64_t i = 0; info.dir && i < info.dir->n_entries; i++) {
+        live_total += LEN_SIZE * 2 + info.dir->entries[i].name_len + info.dir->entries[i].f_len;
+    }
+    int outdated = info.dir && live_total != size_total;
+    if (outdated && opts->resume) {
+        fprintf(stderr, "The archive '%s' contains outdated files, '--resume' can not be used to decode it.\n", filepath);
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    //  check if all needed data-files exist and are accessible
+    //  with a central directory, the parallel decoder only opens the data-files of the selected entries,
+    //  a missing one is reported once it is opened
+    int parallel = (opts->threads > 1 && f_count) || opts->n_only || outdated;
+    for (uint64_t i = 0; !(parallel && info.dir) && i < f_count; i++) {
+        if (access(f_names + ((size_t) i * f_name_len), R_OK) == -1) {
+            fprintf(stderr, "Error, can not access file '%s'.\n", f_names + ((size_t) i * f_name_len));
+            fflush(stderr);
+            goto cleanup;
+        }
+    }
+
+    //  with multiple threads, the entries are extracted concurrently
+    //  selected entries are located by their headers, so only the data-files containing them are read
+    if (parallel) {
+        ret = extract_files_parallel(f_names, f_name_len, f_count, size_total, info.dir, info.crcs, info.manifest, opts);
+        goto cleanup;
+    }
+    //  the checksums are kept to verify every data-file before it is extracted, the content hashes to verify every
+    //  extracted file
+    crcs = info.crcs;
+    st.manifest = info.manifest;
+    info.crcs = NULL;
+    info.manifest = NULL;
+    free_main_file(&info);
+
+    //  the data-files are streamed through this buffer, so memory usage does not depend on the archive size
+    buf = malloc(BUF_SIZE);
+    if (!buf) {
+        fprintf(stderr, "Could not allocate memory.\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    //  the io_uring backend falls back to the stdio backend if io_uring is not available
+    ring = setup_uring(opts);
+
+    //  setup log file and extraction state
+    //  files are hashed while they are written, so their content has to pass through the buffer with a manifest
+#ifdef __linux__
+    st.zero_copy = opts->io != IO_MMAP && !st.manifest;
+#endif
+    st.f_names = f_names;
+    st.f_name_len = f_name_len;
+    st.f_count = f_count;
+    st.log = fopen("parser.log", "wb+");
+    if (!st.log) {
+        fprintf(stderr, "Could not open file 'parser.log'.\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    //  with '--resume', the files that were completely extracted by an interrupted decode are kept
+    //  and the extraction continues behind the last of them
+    uint64_t resume_pos = 0;
+    if (opts->resume) {
+        st.journal = open_decode_journal(size_total, f_count, crcs, st.log, &resume_pos, &st.entry_idx);
+        if (!st.journal) {
+            goto cleanup;
+        }
+        st.stream_pos = resume_pos;
+    }
+
+    //  read all data from all data files and extract the files on the fly
+    uint64_t read_total = 0;
+    if (opts->io == IO_PIPELINE && extract_pipelined(&st, f_names, f_name_len, f_count, size_total, crcs, buf, &read_total)) {
+        goto cleanup;
+    }
+    for (uint64_t i = 0; opts->io != IO_PIPELINE && i < f_count; i++) {
+        //  data-files in front of the position of a resumed decode are skipped, the one containing it is read from there
+        uint64_t part_len = f_size(f_names + ((size_t) i * f_name_len));
+        uint64_t part_off = 0;
+        if (resume_pos > read_total) {
+            if (resume_pos - read_total >= part_len) {
+                read_total += part_len;
+                continue;
+            }
+            part_off = resume_pos - read_total;
+            read_total = resume_pos;
+        }
+        fprintf(stdout, "Reading file '%s'\n", f_names + ((size_t) i * f_name_len + extract_filename( f_names + ((size_t) i * f_name_len), f_name_len)));
+        fflush(stdout);
+        uint64_t part_start = stats_clock();
+        //  with the mmap backend the files are extracted directly from the mapped data-file
+        if (opts->io == IO_MMAP) {
+            map = map_file(f_names + ((size_t) i * f_name_len));
+            if (!map) {
+                fprintf(stderr, "Error, could not map file '%s'.\n", f_names + ((size_t) i * f_name_len));
+                fflush(stderr);
+                goto cleanup;
+            }
+            if (read_total + map->len - part_off > size_total) {
+                fprintf(stderr, "Error, data-files exceed the expected size. Input file might be corrupted.\n");
+                fflush(stderr);
+                goto cleanup;
+            }
+            //  the data-file is verified before anything is extracted from it
+            t = stats_clock();
+            TRACE_BEGIN("verify", f_names + ((size_t) i * f_name_len));
+            uint32_t crc = crcs ? crc32c(0, map->data, map->len) : 0;
+            TRACE_END("verify");
+            stats_add(PHASE_READ, t);
+            if (crcs && crc != crcs[i]) {
+                fprintf(stderr, "Error, file '%s' is corrupted (checksum mismatch).\n", f_names + ((size_t) i * f_name_len));
+                fflush(stderr);
+                goto cleanup;
+            }
+
+            while (part_off < map->len) {
+                uint64_t window = map->len - part_off < MAP_WINDOW ? map->len - part_off : MAP_WINDOW;
+                uint64_t consumed = 0;
+                advise_window(map, part_off);
+                t = stats_clock();
+                int err = extract_files(&st, map->data + part_off, window, &consumed);
+                stats_add(PHASE_WRITE, t);
+                if (err) {
+                    goto cleanup;
+                }
+                part_off += consumed;
+                read_total += consumed;
+            }
+            unmap_file(map);
+            map = NULL;
+            stats_partition(part_start);
+            continue;
+        }
+
+        file = fopen(f_names + ((size_t) i * f_name_len), "rb");
+        if (!file) {
+            fprintf(stderr, "Error, could not read file '%s'.\n", f_names + ((size_t) i * f_name_len));
+            fflush(stderr);
+            goto cleanup;
+        }
+
+        //  the data-file is verified before anything is extracted from it, afterwards it is read from the page cache
+        uint32_t crc = 0;
+        t = stats_clock();
+        TRACE_BEGIN("verify", f_names + ((size_t) i * f_name_len));
+        int corrupted = crcs && (checksum_range(fileno(file), 0, part_len, buf, &crc) || crc != crcs[i]);
+        TRACE_END("verify");
+        stats_add(PHASE_READ, t);
+        if (corrupted) {
+            fprintf(stderr, "Error, file '%s' is corrupted (checksum mismatch).\n", f_names + ((size_t) i * f_name_len));
+            fflush(stderr);
+            goto cleanup;
+        }
+
+        //  the headers and small files are read through the buffer, large file-contents are copied directly
+        //  the buffer holds the bytes of the data-file starting at buf_start, they are reused after a direct copy
+        uint64_t buf_start = part_off;
+        uint64_t buf_len = 0;
+        while (part_off < part_len) {
+            //  abort on data-files that contain more data than specified in the main file
+            if (read_total + part_len - part_off > size_total) {
+                fprintf(stderr, "Error, data-files exceed the expected size. Input file might be corrupted.\n");
+                fflush(stderr);
+                goto cleanup;
+            }
+
+            uint64_t consumed = 0;
+            if (st.step == STEP_CONTENT && st.zero_copy) {
+                uint64_t to_copy = st.f_len - st.pos;
+                if (part_len - part_off < to_copy) {
+                    to_copy = part_len - part_off;
+                }
+                t = stats_clock();
+                TRACE_BEGIN_IF(st.f_len >= TRACE_SMALL, "copy", st.f_name);
+                consumed = copy_range(file, part_off, st.out, to_copy, buf, ring, NULL, NULL);
+                TRACE_END_IF(st.f_len >= TRACE_SMALL, "copy");
+                st.pos += consumed;
+                int err = consumed < to_copy || complete_entry(&st);
+                stats_add(PHASE_WRITE, t);
+                if (err) {
+                    fprintf(stderr, "Could not write file '%s'.\n", st.f_name);
+                    fflush(stderr);
+                    goto cleanup;
+                }
+            } else {
+                if (part_off < buf_start || part_off >= buf_start + buf_len) {
+                    buf_start = part_off;
+                    buf_len = part_len - part_off;
+                    if (buf_len > BUF_SIZE) {
+                        buf_len = BUF_SIZE;
+                    }
+                    t = stats_clock();
+                    TRACE_BEGIN("read", f_names + ((size_t) i * f_name_len));
+                    int failed = fseeko(file, buf_start, SEEK_SET) || fread(buf, 1, buf_len, file) < buf_len;
+                    TRACE_END("read");
+                    stats_add(PHASE_READ, t);
+                    if (failed) {
+                        fprintf(stderr, "Error, could not read file '%s'.\n", f_names + ((size_t) i * f_name_len));
+                        fflush(stderr);
+                        goto cleanup;
+                    }
+                }
+                uint64_t buf_pos = part_off - buf_start;
+                t = stats_clock();
+                int err = extract_files(&st, buf + buf_pos, buf_len - buf_pos, &consumed);
+                stats_add(PHASE_WRITE, t);
+                if (err) {
+                    goto cleanup;
+                }
+            }
+            part_off += consumed;
+            read_total += consumed;
+        }
+        fclose(file);
+        file = NULL;
+        stats_partition(part_start);
+    }
+    stats.bytes_read = read_total;
+
+    //  all data must be consumed and the last file must be complete
+    if (read_total != size_total || st.step != STEP_NAME_LEN || st.pos) {
+        fprintf(stderr, "Error, data-files are incomplete. Input file might be corrupted.\n");
+        fflush(stderr);
+        goto cleanup;
+    }
+
+    //  the journal is not needed anymore, once everything is extracted
+    if (st.journal) {
+        close_journal(st.journal);
+        st.journal = NULL;
+        unlink("parser.journal");
+    }
+    //  the files are extracted completely, even if some of them do not match their content hash
+    if (st.mismatched) {
+        fprintf(stderr, "Error, %llu files do not match their content hash.\n", (unsigned long long) st.mismatched);
+        fflush(stderr);
+        goto cleanup;
+    }
+    ret = 0;
+
+cleanup:
+    if (map) {
+        unmap_file(map);
+    }
+    if (file) {
+        fclose(file);
+    }
+    free_extract_state(&st);
+    uring_free(ring);
+    free(buf);
+    free(crcs);
+    free(f_names);
+    free_main_file(&info);
+    return ret;
+}
+
+//  create an encoder of the library for data-files of the given max. size (0 for unlimited)
+struct fpp_encoder *fpp_encoder_new(uint64_t max_fsize, int flags, const struct fpp_sink *sink) {
+    if (!sink || !sink->write) {
+        return NULL;
+    }
+    struct fpp_encoder *enc = calloc(1, sizeof (struct fpp_encoder));
+    if (!enc) {
+        return NULL;
+    }
+    enc->sink = *sink;
+    enc->max_fsize = max_fsize ? max_fsize : UINT64_MAX;
+    enc->buf = malloc(BUF_SIZE);
+    if (flags & FPP_DIRECTORY) {
+        enc->dir = new_directory(enc->max_fsize);
+    }
+    if (!enc->buf || ((flags & FPP_DIRECTORY) && !enc->dir)) {
+        fpp_encoder_free(enc);
+        return NULL;
+    }
+    return enc;
+}
+
+//  mark the encoder as failed, the archive is incomplete from here on
+static int fpp_fail(struct fpp_encoder *enc, const char *error) {
+    enc->failed = 1;
+    enc->error = error;
+    return -1;
+}
+
+//  write the next bytes of the archive, split into data-files of the max. size
+//  a data-file is only started once there is data for it, the previous one is closed first
+static int fpp_emit(struct fpp_encoder *enc, const char *data, uint64_t len) {
+    while (len) {
+        if (enc->written_total % enc->max_fsize == 0) {
+            if (enc->f_idx && enc->sink.close && enc->sink.close(enc->sink.ctx, enc->f_idx - 1)) {
+                return fpp_fail(enc, "could not close a data-file");
+            }
+            if (enc->f_idx == enc->crcs_capacity) {
+                uint64_t capacity = enc->crcs_capacity ? enc->crcs_capacity * 2 : 16;
+                uint32_t *crcs = realloc(enc->crcs, capacity * sizeof (uint32_t));
+                if (!crcs) {
+                    return fpp_fail(enc, "memory allocation error");
+                }
+                enc->crcs = crcs;
+                enc->crcs_capacity = capacity;
+            }
+            enc->crcs[enc->f_idx++] = 0;
+        }
+        uint64_t n = enc->max_fsize - enc->written_total % enc->max_fsize;
+        if (len < n) {
+            n = len;
+        }
+        if (enc->sink.write(enc->sink.ctx, enc->f_idx - 1, data, n)) {
+            return fpp_fail(enc, "could not write to a data-file");
+        }
+        enc->crcs[enc->f_idx - 1] = crc32c(enc->crcs[enc->f_idx - 1], data, n);
+        enc->written_total += n;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+//  write the header of an entry with the given name and length and add it to the central directory
+static int fpp_begin_entry(struct fpp_encoder *enc, const char *name, uint64_t len) {
+    if (enc->failed) {
+        return -1;
+    }
+    if (!name || !*name || strlen(name) > MAX_NAME_LEN) {
+        enc->error = "invalid name";
+        return -1;
+    }
+    uint64_t header_len = 0;
+    char *header = encode_header(name, len, &header_len);
+    if (!header) {
+        return fpp_fail(enc, "memory allocation error");
+    }
+    uint64_t content_start = enc->written_total + header_len;
+    if (enc->dir && directory_add(enc->dir, name, strlen(name), len, content_start / enc->max_fsize,
+                                  content_start % enc->max_fsize, ENTRY_RAW, len)) {
+        free(header);
+        return fpp_fail(enc, "memory allocation error");
+    }
+    int err = fpp_emit(enc, header, header_len);
+    free(header);
+    return err;
+}
+
+//  add a file with the given name and content to the archive
+int fpp_encoder_add_buffer(struct fpp_encoder *enc, const char *name, const void *data, uint64_t len) {
+    if (fpp_begin_entry(enc, name, len)) {
+        return -1;
+    }
+    return fpp_emit(enc, data, len);
+}
+
+//  add a file with the given name and length to the archive, its content is read with the callback
+//  the archive can not be completed without the content, so a failed or short read fails the encoder
+int fpp_encoder_add_file(struct fpp_encoder *enc, const char *name, uint64_t len, fpp_read_fn read, void *ctx) {
+    if (fpp_begin_entry(enc, name, len)) {
+        return -1;
+    }
+    uint64_t done = 0;
+    while (done < len) {
+        uint64_t n = len - done < BUF_SIZE ? len - done : BUF_SIZE;
+        int64_t r = read(ctx, enc->buf, n);
+        if (r < 0) {
+            return fpp_fail(enc, "could not read a file");
+        }
+        if (r == 0) {
+            return fpp_fail(enc, "file is shorter than its length");
+        }
+        if (fpp_emit(enc, enc->buf, r)) {
+            return -1;
+        }
+        done += r;
+    }
+    return 0;
+}
+
+//  close the last data-file and write the main file, which is identical to the one of 'parser encode'
+int fpp_encoder_finish(struct fpp_encoder *enc) {
+    if (enc->failed) {
+        return -1;
+    }
+    if (enc->f_idx && enc->sink.close && enc->sink.close(enc->sink.ctx, enc->f_idx - 1)) {
+        return fpp_fail(enc, "could not close a data-file");
+    }
+    struct main_file info = {enc->f_idx, enc->written_total, enc->dir, enc->crcs, NULL};
+    uint64_t len = 0;
+    char *data = serialize_main_file(&info, &len);
+    if (!data) {
+        return fpp_fail(enc, "memory allocation error");
+    }
+    int err = enc->sink.write(enc->sink.ctx, FPP_MAIN_FILE, data, len);
+    free(data);
+    if (err || (enc->sink.close && enc->sink.close(enc->sink.ctx, FPP_MAIN_FILE))) {
+        return fpp_fail(enc, "could not write the main file");
+    }
+    //  the archive is complete, further entries would not be part of it
+    enc->failed = 1;
+    enc->error = "encoder is finished";
+    return 0;
+}
+
+const char *fpp_encoder_error(const struct fpp_encoder *enc) {
+    return enc->error ? enc->error : "no error";
+}
+
+void fpp_encoder_free(struct fpp_encoder *enc) {
+    if (!enc) {
+        return;
+    }
+    free_directory(enc->dir);
+    free(enc->crcs);
+    free(enc->buf);
+    free(enc);
+}
+
+//  create a decoder of the library and read the main file
+struct fpp_decoder *fpp_decoder_new(const struct fpp_source *source) {
+    if (!source || !source->read) {
+        return NULL;
+    }
+    struct fpp_decoder *dec = calloc(1, sizeof (struct fpp_decoder));
+    if (!dec) {
+        return NULL;
+    }
+    dec->source = *source;
+    dec->buf = malloc(BUF_SIZE);
+    if (!dec->buf) {
+        free(dec);
+        return NULL;
+    }
+    if (fpp_read_main_file(dec)) {
+        //  the error is reported by fpp_decoder_next_entry()
+        dec->failed = 1;
+    }
+    return dec;
+}
+
+//  mark the decoder as failed
+static int fpp_error(struct fpp_decoder *dec, const char *error) {
+    dec->failed = 1;
+    dec->error = error;
+    return 1;
+}
+
+//  read the whole main file and keep the checksums of the data-files, the central directory is not needed
+static int fpp_read_main_file(struct fpp_decoder *dec) {
+    uint64_t len = 0;
+    uint64_t capacity = BUF_SIZE;
+    char *data = malloc(capacity);
+    for (;;) {
+        if (data && len == capacity) {
+            capacity *= 2;
+            char *new_data = realloc(data, capacity);
+            if (!new_data) {
+                free(data);
+            }
+            data = new_data;
+        }
+        if (!data) {
+            return fpp_error(dec, "memory allocation error");
+        }
+        int64_t n = dec->source.read(dec->source.ctx, FPP_MAIN_FILE, len, data + len, capacity - len);
+        if (n < 0 || (uint64_t) n > capacity - len) {
+            free(data);
+            return fpp_error(dec, "could not read the main file");
+        }
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+    struct main_file info;
+    int err = parse_main_file(data, len, &info);
+    free(data);
+    if (err == 1) {
+        return fpp_error(dec, "the main file is too short");
+    }
+    if (err == 3) {
+        return fpp_error(dec, "the main file is corrupted");
+    }
+    if (err) {
+        return fpp_error(dec, "the main file contains an invalid section");
+    }
+    dec->f_count = info.f_count;
+    dec->size_total = info.size_total;
+    dec->crcs = info.crcs;
+    free_directory(info.dir);
+    return 0;
+}
+
+//  check the data-file that was read completely against its checksum and move on to the next one
+//  all data-files but the last have the size of the first one
+static int fpp_next_part(struct fpp_decoder *dec) {
+    if (dec->part == 0 && !dec->part_len) {
+        dec->part_len = dec->part_off;
+    }
+    if (!dec->part_len || dec->part_off != dec->part_len) {
+        return fpp_error(dec, "a data-file is too short");
+    }
+    if (dec->crcs && dec->crc != dec->crcs[dec->part]) {
+        return fpp_error(dec, "a data-file is corrupted");
+    }
+    dec->part++;
+    dec->part_off = 0;
+    dec->crc = 0;
+    if (dec->part >= dec->f_count) {
+        return fpp_error(dec, "the data-files are too short");
+    }
+    return 0;
+}
+
+//  consume the next len bytes of the data-files, they are copied to dst unless it is NULL
+//  every data-file is checked against its checksum, the last one once the end of the data is read
+static int fpp_stream_read(struct fpp_decoder *dec, char *dst, uint64_t len) {
+    if (len > dec->size_total - dec->pos) {
+        return fpp_error(dec, "an entry exceeds the data-files");
+    }
+    while (len) {
+        if (dec->buf_pos == dec->buf_len) {
+            uint64_t want = dec->size_total - dec->fetched < BUF_SIZE ? dec->size_total - dec->fetched : BUF_SIZE;
+            if (dec->part_len && dec->part_len - dec->part_off < want) {
+                want = dec->part_len - dec->part_off;
+            }
+            if (want == 0) {
+                if (fpp_next_part(dec)) {
+                    return 1;
+                }
+                continue;
+            }
+            int64_t n = dec->source.read(dec->source.ctx, dec->part, dec->part_off, dec->buf, want);
+            if (n < 0 || (uint64_t) n > want) {
+                return fpp_error(dec, "could not read a data-file");
+            }
+            if (n == 0) {
+                if (fpp_next_part(dec)) {
+                    return 1;
+                }
+                continue;
+            }
+            dec->crc = crc32c(dec->crc, dec->buf, n);
+            dec->part_off += n;
+            dec->fetched += n;
+            dec->buf_pos = 0;
+            dec->buf_len = n;
+            if (dec->fetched == dec->size_total) {
+                if (dec->part + 1 != dec->f_count) {
+                    return fpp_error(dec, "the data-files are too long");
+                }
+                if (dec->crcs && dec->crc != dec->crcs[dec->part]) {
+                    return fpp_error(dec, "a data-file is corrupted");
+                }
+            }
+        }
+        uint64_t n = dec->buf_len - dec->buf_pos < len ? dec->buf_len - dec->buf_pos : len;
+        if (dst) {
+            bytes_cpy(dec->buf + dec->buf_pos, dst, n);
+            dst += n;
+        }
+        dec->buf_pos += n;
+        dec->pos += n;
+        len -= n;
+    }
+    return 0;
+}
+
+//  read len bytes at the given position of the data, which were consumed (and checked) before
+//  used for the chunks of deduplicated entries, that are stored earlier in the archive
+static int fpp_read_at(struct fpp_decoder *dec, uint64_t at, char *dst, uint64_t len) {
+    if (at > dec->pos || len > dec->pos - at) {
+        return fpp_error(dec, "invalid deduplicated entry");
+    }
+    while (len) {
+        uint32_t part = dec->part_len ? at / dec->part_len : 0;
+        uint64_t off = dec->part_len ? at % dec->part_len : at;
+        uint64_t n = dec->part_len && dec->part_len - off < len ? dec->part_len - off : len;
+        int64_t r = dec->source.read(dec->source.ctx, part, off, dst, n);
+        if (r <= 0 || (uint64_t) r > n) {
+            return fpp_error(dec, "could not read a data-file");
+        }
+        at += r;
+        dst += r;
+        len -= r;
+    }
+    return 0;
+}
+
+//  read the header of the next entry, and the tables in front of the content of compressed and deduplicated ones
+static int fpp_open_entry(struct fpp_decoder *dec) {
+    char len_bytes[LEN_SIZE];
+    if (fpp_stream_read(dec, len_bytes, LEN_SIZE)) {
+        return 1;
+    }
+    uint64_t name_len = from_bytes(0, LEN_SIZE, len_bytes);
+    dec->kind = name_len >> KIND_SHIFT;
+    name_len &= ((uint64_t) 1 << KIND_SHIFT) - 1;
+    if (name_len > MAX_NAME_LEN || dec->kind > ENTRY_STREAM) {
+        return fpp_error(dec, "invalid entry header");
+    }
+    dec->name = malloc(name_len + 1);
+    if (!dec->name) {
+        return fpp_error(dec, "memory allocation error");
+    }
+    if (fpp_stream_read(dec, dec->name, name_len) || fpp_stream_read(dec, len_bytes, LEN_SIZE)) {
+        return 1;
+    }
+    dec->name[name_len] = '\0';
+    dec->name_len = name_len;
+    dec->f_len = from_bytes(0, LEN_SIZE, len_bytes);
+    if (dec->kind == ENTRY_STREAM ? dec->f_len != STREAM_LEN : dec->f_len > dec->size_total - dec->pos) {
+        return fpp_error(dec, "an entry exceeds the data-files");
+    }
+    dec->content_pos = 0;
+    dec->out_pos = 0;
+    dec->orig_len = dec->f_len;
+
+    if (dec->kind == ENTRY_COMPRESSED) {
+        if (dec->f_len < BLOCK_FIELDS || fpp_stream_read(dec, dec->fields, BLOCK_FIELDS)) {
+            return dec->failed ? 1 : fpp_error(dec, "invalid compressed entry");
+        }
+        dec->codec = from_bytes(0, LEN_SIZE, dec->fields);
+        dec->orig_len = from_bytes(LEN_SIZE, LEN_SIZE, dec->fields);
+        dec->block_size = from_bytes(LEN_SIZE * 2, LEN_SIZE, dec->fields);
+        dec->n_blocks = from_bytes(LEN_SIZE * 3, LEN_SIZE, dec->fields);
+        if (check_block_fields(dec->codec, dec->orig_len, dec->block_size, dec->n_blocks, dec->f_len)) {
+            return fpp_error(dec, "invalid compressed entry");
+        }
+        dec->table = malloc(dec->n_blocks ? dec->n_blocks * LEN_SIZE : 1);
+        dec->block = malloc(dec->block_size);
+        dec->plain = malloc(dec->block_size);
+        if (!dec->table || !dec->block || !dec->plain) {
+            return fpp_error(dec, "memory allocation error");
+        }
+        if (fpp_stream_read(dec, dec->table, dec->n_blocks * LEN_SIZE)) {
+            return 1;
+        }
+        dec->content_pos = BLOCK_FIELDS + dec->n_blocks * LEN_SIZE;
+        if (check_block_table(dec->table, dec->n_blocks, dec->orig_len, dec->block_size, dec->f_len - dec->content_pos)) {
+            return fpp_error(dec, "invalid compressed entry");
+        }
+        dec->block_idx = 0;
+        dec->plain_pos = 0;
+        dec->plain_len = 0;
+    } else if (dec->kind == ENTRY_DEDUP) {
+        if (dec->f_len < DEDUP_FIELDS || fpp_stream_read(dec, dec->fields, DEDUP_FIELDS)) {
+            return dec->failed ? 1 : fpp_error(dec, "invalid deduplicated entry");
+        }
+        dec->orig_len = from_bytes(0, LEN_SIZE, dec->fields);
+        dec->n_refs = from_bytes(LEN_SIZE, LEN_SIZE, dec->fields);
+        if (dec->n_refs > (dec->f_len - DEDUP_FIELDS) / REF_SIZE) {
+            return fpp_error(dec, "invalid deduplicated entry");
+        }
+        dec->table = malloc(dec->n_refs ? dec->n_refs * REF_SIZE : 1);
+        if (!dec->table) {
+            return fpp_error(dec, "memory allocation error");
+        }
+        if (fpp_stream_read(dec, dec->table, dec->n_refs * REF_SIZE)) {
+            return 1;
+        }
+        dec->content_pos = DEDUP_FIELDS + dec->n_refs * REF_SIZE;
+        if (check_ref_table(dec->table, dec->n_refs, dec->orig_len, dec->f_len - dec->content_pos, dec->size_total)) {
+            return fpp_error(dec, "invalid deduplicated entry");
+        }
+        dec->ref_idx = 0;
+        dec->ref_pos = 0;
+    } else if (dec->kind == ENTRY_STREAM) {
+        dec->chunk_left = 0;
+    }
+    dec->active = 1;
+    return 0;
+}
+
+//  free the buffers of the current entry
+static void fpp_close_entry(struct fpp_decoder *dec) {
+    free(dec->name);
+    free(dec->table);
+    free(dec->block);
+    free(dec->plain);
+    dec->name = NULL;
+    dec->table = NULL;
+    dec->block = NULL;
+    dec->plain = NULL;
+    dec->active = 0;
+}
+
+//  move to the next entry, the rest of the current one is read (so the data-files are still checked) but not decoded
+int fpp_decoder_next_entry(struct fpp_decoder *dec, struct fpp_entry *entry) {
+    if (dec->failed) {
+        return -1;
+    }
+    //  the end of a stream entry is only found by walking its chunks
+    while (dec->active && dec->f_len == STREAM_LEN) {
+        if (dec->chunk_left) {
+            if (fpp_stream_read(dec, NULL, dec->chunk_left)) {
+                return -1;
+            }
+            dec->content_pos += dec->chunk_left;
+            dec->chunk_left = 0;
+        } else if (fpp_next_chunk(dec)) {
+            return -1;
+        }
+    }
+    if (dec->active) {
+        uint64_t rest = dec->f_len - dec->content_pos;
+        fpp_close_entry(dec);
+        if (fpp_stream_read(dec, NULL, rest)) {
+            return -1;
+        }
+    }
+    if (dec->pos == dec->size_total) {
+        return 0;
+    }
+    if (fpp_open_entry(dec)) {
+        fpp_close_entry(dec);
+        return -1;
+    }
+    entry->name = dec->name;
+    entry->name_len = dec->name_len;
+    entry->size = dec->kind == ENTRY_STREAM ? FPP_UNKNOWN_SIZE : dec->orig_len;
+    return 1;
+}
+
+//  read the length of the next chunk of a stream entry, the empty chunk at the end sets the length of the entry
+static int fpp_next_chunk(struct fpp_decoder *dec) {
+    char len_bytes[LEN_SIZE];
+    if (fpp_stream_read(dec, len_bytes, LEN_SIZE)) {
+        return 1;
+    }
+    dec->content_pos += LEN_SIZE;
+    dec->chunk_left = from_bytes(0, LEN_SIZE, len_bytes);
+    if (!dec->chunk_left) {
+        dec->f_len = dec->content_pos;
+        dec->orig_len = dec->out_pos;
+    }
+    return 0;
+}
+
+//  read the next bytes of the content of the current entry, at most one block or chunk per call
+int64_t fpp_decoder_read(struct fpp_decoder *dec, void *buf, size_t len) {
+    if (dec->failed) {
+        return -1;
+    }
+    if (!dec->active || dec->out_pos == dec->orig_len || !len) {
+        return 0;
+    }
+    uint64_t n = dec->orig_len - dec->out_pos < len ? dec->orig_len - dec->out_pos : len;
+    if (dec->kind == ENTRY_RAW) {
+        if (fpp_stream_read(dec, buf, n)) {
+            return -1;
+        }
+        dec->content_pos += n;
+    } else if (dec->kind == ENTRY_COMPRESSED) {
+        //  load and decompress the next block once the current one is used up
+        if (dec->plain_pos == dec->plain_len) {
+            uint64_t entry = from_bytes(dec->block_idx * LEN_SIZE, LEN_SIZE, dec->table);
+            uint64_t stored = entry & ~BLOCK_RAW;
+            uint64_t plain_len = dec->orig_len - dec->block_idx * dec->block_size;
+            if (plain_len > dec->block_size) {
+                plain_len = dec->block_size;
+            }
+            if (fpp_stream_read(dec, dec->block, stored)) {
+                return -1;
+            }
+            dec->content_pos += stored;
+            if (entry & BLOCK_RAW) {
+                bytes_cpy(dec->block, dec->plain, plain_len);
+            } else if (decompress_block(dec->codec, dec->block, stored, dec->plain, plain_len)) {
+                fpp_error(dec, "could not decompress an entry");
+                return -1;
+            }
+            dec->block_idx++;
+            dec->plain_pos = 0;
+            dec->plain_len = plain_len;
+        }
+        if (dec->plain_len - dec->plain_pos < n) {
+            n = dec->plain_len - dec->plain_pos;
+        }
+        bytes_cpy(dec->plain + dec->plain_pos, buf, n);
+        dec->plain_pos += n;
+    } else if (dec->kind == ENTRY_STREAM) {
+        if (!dec->chunk_left && fpp_next_chunk(dec)) {
+            return -1;
+        }
+        if (dec->f_len != STREAM_LEN) {
+            return 0;
+        }
+        if (dec->chunk_left < n) {
+            n = dec->chunk_left;
+        }
+        if (fpp_stream_read(dec, buf, n)) {
+            return -1;
+        }
+        dec->content_pos += n;
+        dec->chunk_left -= n;
+    } else {
+        //  new chunks follow in the content, the others are read where they are stored earlier in the archive
+        uint64_t src = from_bytes(dec->ref_idx * REF_SIZE, LEN_SIZE, dec->table);
+        uint64_t ref_len = from_bytes(dec->ref_idx * REF_SIZE + LEN_SIZE, LEN_SIZE, dec->table);
+        if (ref_len - dec->ref_pos < n) {
+            n = ref_len - dec->ref_pos;
+        }
+        if (src & REF_STREAM) {
+            if (fpp_stream_read(dec, buf, n)) {
+                return -1;
+            }
+            dec->content_pos += n;
+        } else if (fpp_read_at(dec, src + dec->ref_pos, buf, n)) {
+            return -1;
+        }
+        dec->ref_pos += n;
+        if (dec->ref_pos == ref_len) {
+            dec->ref_idx++;
+            dec->ref_pos = 0;
+        }
+    }
+    dec->out_pos += n;
+    return n;
+}
+
+const char *fpp_decoder_error(const struct fpp_decoder *dec) {
+    return dec->error ? dec->error : "no error";
+}
+
+void fpp_decoder_free(struct fpp_decoder *dec) {
+    if (!dec) {
+        return;
+    }
+    fpp_close_entry(dec);
+    free(dec->crcs);
+    free(dec->buf);
+    free(dec);
+}
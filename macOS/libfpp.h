@@ -0,0 +1,180 @@
+#ifndef LIBFPP_H
+#define LIBFPP_H
+
+//  libfpp: encode and decode FilePartitionParser archives in-process
+//  the encoder and decoder write and read the data-files and the main file through callbacks of the caller, so
+//  archives can be created from memory buffers and streamed anywhere without temporary files
+//  they print nothing (not even failed allocations) and return 0 on success and -1 on errors, the error
+//  is described by fpp_encoder_error() or fpp_decoder_error()
+//  every encoder and decoder keeps its state to itself, different ones can be used by different threads at the same
+//  time, each of them by one thread at a time
+//  the archives are identical to the ones of 'parser encode' with the same max. filesize (and '--directory' for
+//  FPP_DIRECTORY), the decoder reads all archives, including compressed and deduplicated ones
+//  the modes of the 'parser' command line tool work on files and are part of the library as well (fpp_encode() etc.)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FPP_API __attribute__((visibility("default")))
+
+//  the index of the main file in the callbacks, the data-files have the indices 0, 1, ...
+#define FPP_MAIN_FILE UINT32_MAX
+
+//  flags of the encoder
+//  FPP_DIRECTORY stores a central directory in the main file
+#define FPP_DIRECTORY 1
+
+//  destination of an encode
+//  write appends len bytes to the data-file with the given index (or the main file), the data-files are written
+//  one after another, the main file is written last
+//  close is called once a data-file is complete (can be NULL), e.g. to upload it while the next one is written
+//  both return 0 on success
+struct fpp_sink {
+    void *ctx;
+    int (*write)(void *ctx, uint32_t part, const void *data, size_t len);
+    int (*close)(void *ctx, uint32_t part);
+};
+
+//  source of a decode
+//  read reads up to len bytes at the given offset of the data-file with the given index (or the main file),
+//  returns the number of bytes read, 0 at the end of the file and -1 on errors
+//  the data-files are mostly read in order, deduplicated entries also read chunks stored earlier in the archive
+struct fpp_source {
+    void *ctx;
+    int64_t (*read)(void *ctx, uint32_t part, uint64_t off, void *buf, size_t len);
+};
+
+//  reads the next bytes of a file that is added to an encode, same return values as fpp_source.read
+typedef int64_t (*fpp_read_fn)(void *ctx, void *buf, size_t len);
+
+//  size of entries whose length was not known when they were encoded (read from the standard input with
+//  'parser encode ... -'), their content is read until fpp_decoder_read() returns 0
+#define FPP_UNKNOWN_SIZE UINT64_MAX
+
+//  an entry of the archive, the name is valid until the next call of fpp_decoder_next_entry()
+//  the name is not checked, callers that create files from it have to reject absolute names and '..' themselves
+struct fpp_entry {
+    const char *name;
+    uint64_t name_len;
+    uint64_t size;
+};
+
+struct fpp_encoder;
+struct fpp_decoder;
+
+//  create an encoder for data-files of the given max. size (0 for unlimited), returns NULL on errors
+FPP_API struct fpp_encoder *fpp_encoder_new(uint64_t max_fsize, int flags, const struct fpp_sink *sink);
+
+//  add a file with the given name and content
+FPP_API int fpp_encoder_add_buffer(struct fpp_encoder *enc, const char *name, const void *data, uint64_t len);
+
+//  add a file with the given name and length, its content is read with the given callback
+FPP_API int fpp_encoder_add_file(struct fpp_encoder *enc, const char *name, uint64_t len, fpp_read_fn read, void *ctx);
+
+//  close the last data-file and write the main file
+FPP_API int fpp_encoder_finish(struct fpp_encoder *enc);
+
+//  the description of the last error of the encoder
+FPP_API const char *fpp_encoder_error(const struct fpp_encoder *enc);
+
+//  free the encoder, after fpp_encoder_finish() or to abort the encode
+FPP_API void fpp_encoder_free(struct fpp_encoder *enc);
+
+//  create a decoder and read the main file, returns NULL if memory can not be allocated
+//  errors of the main file are reported by the first call of fpp_decoder_next_entry()
+FPP_API struct fpp_decoder *fpp_decoder_new(const struct fpp_source *source);
+
+//  move to the next entry of the archive, the rest of the current one is skipped
+//  returns 1 if there is a next entry, 0 at the end of the archive and -1 on errors
+FPP_API int fpp_decoder_next_entry(struct fpp_decoder *dec, struct fpp_entry *entry);
+
+//  read up to len bytes of the content of the current entry
+//  returns the number of bytes read, 0 at the end of the entry and -1 on errors
+FPP_API int64_t fpp_decoder_read(struct fpp_decoder *dec, void *buf, size_t len);
+
+//  the description of the last error of the decoder
+FPP_API const char *fpp_decoder_error(const struct fpp_decoder *dec);
+
+//  free the decoder
+FPP_API void fpp_decoder_free(struct fpp_decoder *dec);
+
+//  the modes of the 'parser' command line tool, which only parses its arguments and calls them
+//  they read and write the files on disk with all options of the tool, print their progress to the standard output
+//  and their errors to the standard error and return 0 on success and 1 on errors (the exit status of the tool)
+//  they are not reentrant: the statistics, the trace and the sinks are process-wide state, so only one of them can
+//  run at a time in a process (the encoder and decoder above can be used meanwhile)
+
+//  I/O backends for reading input files and data-files (fpp_options.io)
+#define FPP_IO_STDIO 0
+#define FPP_IO_MMAP 1
+#define FPP_IO_URING 2
+#define FPP_IO_PIPELINE 3
+
+//  compressions of the encoded files (fpp_options.compress)
+#define FPP_COMPRESS_NONE 0
+#define FPP_COMPRESS_FAST 1
+#define FPP_COMPRESS_HIGH 2
+
+//  limits of the options and of the names of the files
+#define FPP_MAX_THREADS 256
+#define FPP_MIN_CHUNK_SIZE (4 * 1024)
+#define FPP_MAX_CHUNK_SIZE (4 * 1024 * 1024)
+#define FPP_MAX_NAME_LEN (64 * 1024)
+
+//  options of the modes, one field per option of the tool (e.g. chunk_avg for '--chunk-size')
+//  threads 0 is a single thread (all CPUs for fpp_verify()), only holds n_only names or shell patterns,
+//  large files are hashed by hash_threads threads, the strings are not copied
+struct fpp_options {
+    int io;
+    unsigned queue_depth;
+    unsigned threads;
+    int directory;
+    char **only;
+    unsigned n_only;
+    int compress;
+    int dedup;
+    uint64_t chunk_avg;
+    int direct;
+    int resume;
+    int append;
+    int incremental;
+    int stats;
+    char *trace;
+    char *stdin_name;
+    char *sink_exec;
+    char *sink_socket;
+    unsigned sink_jobs;
+    int hash;
+    unsigned hash_threads;
+    int no_checksums;
+};
+
+//  set the default options of the tool
+FPP_API void fpp_options_init(struct fpp_options *opts);
+
+//  encode the input files and directories (recursively, '-' is the standard input) into the main file out_name and
+//  its data-files of at most max_fsize bytes each (0 for unlimited)
+FPP_API int fpp_encode(const char *out_name, char **inputs, uint32_t n_inputs, uint64_t max_fsize,
+                       const struct fpp_options *opts);
+
+//  extract the files of the archive with the given main file into the current directory
+FPP_API int fpp_decode(const char *main_name, const struct fpp_options *opts);
+
+//  print the name and size of the files of the archive
+FPP_API int fpp_list(const char *main_name, const struct fpp_options *opts);
+
+//  check the data-files of the archive against their checksums
+FPP_API int fpp_verify(const char *main_name, const struct fpp_options *opts);
+
+//  print the content hashes of the files of the archive, in the format of b3sum
+FPP_API int fpp_manifest(const char *main_name, const struct fpp_options *opts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,703 +1,361 @@
-#define __DARWIN_64_BIT_INO_T 1
-
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/stat.h>
 #include <string.h>
-#include <unistd.h>
-
-//  constant number of bytes which the length of byte-strings gets encoded
-const uint64_t LEN_SIZE = 8;
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "libfpp.h"
 
-//  struct for storing byte-strings and their length
-struct byte_string {
-    uint64_t len;
-    char *data;
-};
+//  the command line interface, the modes are run by the library (libfpp.c)
 
 //  function declarations
-struct byte_string *read_bytes(char *);
-uint64_t f_size(char *);
-uint64_t from_bytes(uint64_t, uint64_t, const char *);
-char *to_bytes(uint64_t, uint64_t);
-int process_input_file(char *);
-struct byte_string *encode_file(char *);
-uint64_t fwrite64(const void *, uint64_t, FILE *);
-void bytes_cpy(const char *, char *, uint64_t);
-
-void print_help(char *app_name) {
-    fprintf(stdout, "This application can be executed in 2 different modes (encode, decode).\n"
-                    "Syntax:\n1) %s encode <max output filesize> <output filename> <input filename 1> ... <input filename n>\n"
-                    "2) %s decode <input filename>\n"
+static void print_help(char *);
+static int parse_options(int, char **, int, struct fpp_options *);
+static int parse_size(const char *, uint64_t *);
+
+//  print the modes, the options and examples
+static void print_help(char *app_name) {
+    fprintf(stdout, "This application can be executed in 5 different modes (encode, decode, list, verify, manifest).\n"
+                    "Syntax:\n1) %s encode [options] <max output filesize> <output filename> <input filename 1> ... <input filename n>\n"
+                    "2) %s decode [options] <input filename>\n"
+                    "3) %s list [options] <input filename>\n"
+                    "4) %s verify [options] <input filename>\n"
+                    "5) %s manifest [options] <input filename>\n"
                     "| <max output filesize>: 5K -> 5 KiB, 7M -> 7 MiB, 13G -> 13 GiB (0 -> unlimited)\n"
                     "|-> output will be split into multiple data-files if total data exceeds the max output filesize.\n"
-                    "| Multiple input files can be added.\n"
+                    "| Multiple input files can be added, directories are encoded recursively with their relative paths.\n"
+                    "Options:\n"
+                    "| --io <stdio | mmap | uring | pipeline>: I/O backend for reading input files and data-files\n"
+                    "|   (default: stdio), pipeline reads ahead in a separate thread while writing\n"
+                    "| --queue-depth <n>: number of requests in flight with the io_uring backend (default: 32)\n"
+                    "| --threads <n>: number of threads, encode plans the data-files first and writes them concurrently,\n"
+                    "|   decode scans the headers first and extracts the files concurrently (default: 1),\n"
+                    "|   verify checks the data-files concurrently (default: number of CPUs)\n"
+                    "| --directory: store a central directory of all files in the main file (encode)\n"
+                    "| --compress <fast | high>: compress the files in independent blocks, files that do not compress\n"
+                    "|   well are stored as they are (encode)\n"
+                    "| --dedup: split the files into content-defined chunks and store every unique chunk only once (encode)\n"
+                    "| --chunk-size <n>: average chunk size of '--dedup', a power of two from 4K to 4M (default: 64K)\n"
+                    "| --direct: read the input files and write the data-files without the page cache (encode)\n"
+                    "| --resume: record the progress in a journal and continue an interrupted encode or decode from it\n"
+                    "| --append: add the input files to the existing archive <output filename>, continuing its last\n"
+                    "|   data-file, the max output filesize has to be the one of the archive (encode)\n"
+                    "| --incremental: update the archive <output filename>, the data of unchanged files keeps its\n"
+                    "|   place, changed and new files are added at the end and the changed data-files are listed (encode)\n"
+                    "| --hash: store the BLAKE3 hash of every file in the main file, decode checks the extracted files\n"
+                    "|   against them and manifest prints them (encode)\n"
+                    "| --no-checksums: store no checksums of the data-files, so the kernel can copy the file contents\n"
+                    "|   into them, decode and verify can not check the data-files (encode)\n"
+                    "| --only <name | pattern>: only extract or list the files matching the name or shell pattern,\n"
+                    "|   can be given multiple times (decode, list, manifest)\n"
+                    "| --stats json: print the time of every phase, the bytes read and written, a latency histogram of\n"
+                    "|   the data-files, the peak memory and the throughput as JSON to the standard error at the end\n"
+                    "|   (encode, decode)\n"
+                    "| --trace <file>: record the opening, reading, writing and closing of every file and write them\n"
+                    "|   as Chrome trace-event JSON to the given file at the end (encode, decode)\n"
+                    "| --stdin-name <name>: name of the file read from the standard input, given as '-' (encode,\n"
+                    "|   default: stdin)\n"
+                    "| --sink-exec <command>: run the command for every data-file once it is complete and for the main\n"
+                    "|   file at the end, '%%f' is replaced by the path of the file (encode)\n"
+                    "| --sink-socket <path>: send the path of every complete data-file and of the main file as a line to\n"
+                    "|   the unix socket, which replies 'ok' once it took the file (encode)\n"
+                    "| --sink-jobs <n>: number of data-files that are handed to the sink concurrently, the encode waits\n"
+                    "|   if the sink falls behind (default: 2)\n"
                     "Examples:\n1) %s encode 32M out dir/file0 dir/file1\n"
                     "2) %s encode 10K out file\n"
-                    "3) %s decode out\n", app_name, app_name, app_name, app_name, app_name);
+                    "3) %s encode --compress fast 0 out dir/file.csv\n"
+                    "4) %s encode 1G out dir\n"
+                    "5) %s decode out\n"
+                    "6) %s decode --io mmap out\n"
+                    "7) %s decode --only 'dir/*.txt' out\n"
+                    "8) %s list out\n"
+                    "9) %s verify out\n"
+                    "10) %s manifest out\n", app_name, app_name, app_name, app_name, app_name, app_name, app_name,
+                    app_name, app_name, app_name, app_name, app_name, app_name, app_name, app_name);
     fflush(stdout);
 }
 
-int main(int argc, char **argv) {
-    //  check if number of passed arguments is correct
-    if (argc < 2) {
-        print_help(argv[0]);
-        return 1;
-    }
-
-    //  can be executed in two different modes (encode, decode)
-    if (!strcmp(argv[1], "encode")) {
-        if (argc < 5) {
-            fprintf(stderr, "Wrong number of arguments for mode 'encode'. Expected at least 4.\n");
-            fflush(stderr);
-            print_help(argv[0]);
-            return 1;
+//  parse the options, that are placed between the mode and the positional arguments
+//  returns the index of the first positional argument or -1 on error
+static int parse_options(int argc, char **argv, int idx, struct fpp_options *opts) {
+    while (idx < argc && !strncmp(argv[idx], "--", 2)) {
+        char *opt = argv[idx];
+        //  '--' ends the options, so filenames starting with '--' can be used
+        if (!strcmp(opt, "--")) {
+            return idx + 1;
         }
 
-        //  parse thw given max output-filesize in kb
-        char *ptr = argv[2];
-        if (*ptr == '-') {
-            fprintf(stderr, "Error parsing the given max. output size: '%s'\n", argv[2]);
-            fflush(stderr);
-            return 1;
+        //  options without a value
+        if (!strcmp(opt, "--directory")) {
+            opts->directory = 1;
+            idx++;
+            continue;
         }
-        uint64_t max_fsize = strtol(argv[2], &ptr, 10);
-        if (ptr == argv[2]) {
-            fprintf(stderr, "Error parsing the given max. output size: '%s'\n", argv[2]);
-            fflush(stderr);
-            return 1;
+        if (!strcmp(opt, "--dedup")) {
+            opts->dedup = 1;
+            idx++;
+            continue;
         }
-        if (max_fsize) {
-            switch (*ptr) {
-                case 'k':
-                case 'K':
-                    if (max_fsize *  1024 < max_fsize) {
-                        fprintf(stderr, "Error parsing the given max. output size: '%s' (overflow)\n", argv[2]);
-                        fflush(stderr);
-                        return 1;
-                    }
-                    max_fsize *= 1024;
-                    break;
-                case 'm':
-                case 'M':
-                    if (max_fsize *  1024 * 1024 < max_fsize) {
-                        fprintf(stderr, "Error parsing the given max. output size: '%s' (overflow)\n", argv[2]);
-                        fflush(stderr);
-                        return 1;
-                    }
-                    max_fsize *= 1024 * 1024;
-                    break;
-                case 'g':
-                case 'G':
-                    if (max_fsize *  1024 * 1024 * 1024 < max_fsize) {
-                        fprintf(stderr, "Error parsing the given max. output size: '%s' (overflow)\n", argv[2]);
-                        fflush(stderr);
-                        return 1;
-                    }
-                    max_fsize *= 1024 * 1024 * 1024;
-                    break;
-                default:
-                    fprintf(stderr, "Missing unit for the given max. output size: '%s' (valid are: K | M | G)\n", argv[2]);
-                    fflush(stderr);
-                    return 1;
-            }
+        if (!strcmp(opt, "--hash")) {
+            opts->hash = 1;
+            idx++;
+            continue;
         }
-        if (!max_fsize) {
-            max_fsize--;
+        if (!strcmp(opt, "--no-checksums")) {
+            opts->no_checksums = 1;
+            idx++;
+            continue;
+        }
+        if (!strcmp(opt, "--direct")) {
+            opts->direct = 1;
+            idx++;
+            continue;
+        }
+        if (!strcmp(opt, "--resume")) {
+            opts->resume = 1;
+            idx++;
+            continue;
+        }
+        if (!strcmp(opt, "--append")) {
+            opts->append = 1;
+            idx++;
+            continue;
+        }
+        if (!strcmp(opt, "--incremental")) {
+            opts->incremental = 1;
+            idx++;
+            continue;
         }
 
-        uint32_t f_name_len = strlen(argv[3]);
-        char *f_name =  malloc(f_name_len + 32);
-        if (!f_name) {
-            fprintf(stderr, "Could not allocate memory'.\n");
+        if (idx + 1 >= argc) {
+            fprintf(stderr, "Missing value for option '%s'.\n", opt);
             fflush(stderr);
-            return 1;
+            return -1;
         }
-
-        //  setting up all the variables, that need to be persistent over potentially many iterations
-        //  all are adjusted within the loop to reflect the current state of the data output process
-        uint64_t written_total = 0;
-        uint64_t bytes_carry = 0;
-        uint64_t bytes_offset = 0;
-        uint32_t f_idx = 0;
-        struct byte_string *bytes = NULL;
-        FILE *f_output = NULL;
-
-        //  iterate through all input files
-        //  one file can be written in multiple iterations depending on the maximum output file size
-        //  iteration counter is adjusted accordingly
-        for (uint32_t i = 4; i < (uint32_t) argc; i++) {
-            //  when there is no carry, the current byte-string needs to be cleared and a new file needs to be read
-            if (!bytes_carry) {
-                if (bytes) {
-                    free(bytes->data);
-                    free(bytes);
-                }
-                //  read and encode the new file
-                bytes = encode_file(argv[i]);
-                if (!bytes) {
-                    fprintf(stderr, "Could not encode file '%s'.\n", argv[i]);
-                    fflush(stderr);
-                    free(f_name);
-                    return 1;
-                }
-                bytes_offset = 0;
+        char *val = argv[idx + 1];
+
+        if (!strcmp(opt, "--io")) {
+            if (!strcmp(val, "stdio")) {
+                opts->io = FPP_IO_STDIO;
+            } else if (!strcmp(val, "mmap")) {
+                opts->io = FPP_IO_MMAP;
+            } else if (!strcmp(val, "uring")) {
+                opts->io = FPP_IO_URING;
+            } else if (!strcmp(val, "pipeline")) {
+                opts->io = FPP_IO_PIPELINE;
+            } else {
+                fprintf(stderr, "Unknown I/O backend '%s' (valid are: stdio | mmap | uring | pipeline).\n", val);
+                fflush(stderr);
+                return -1;
             }
-
-            //  the current byte-string must not be NULL at this point
-            if (!bytes) {
-                fprintf(stderr, "Error, memory is not allocated.");
+        } else if (!strcmp(opt, "--queue-depth")) {
+            char *end = val;
+            long depth = strtol(val, &end, 10);
+            if (end == val || *end || depth < 2 || depth > 4096) {
+                fprintf(stderr, "Invalid queue depth '%s' (valid are: 2 - 4096).\n", val);
                 fflush(stderr);
-                free(f_name);
-                return 1;
+                return -1;
             }
-
-            //  calculating how many bytes are left to write in the same file
-            uint64_t bytes_left = max_fsize - (written_total % max_fsize);
-            if (bytes_left < bytes->len - bytes_offset) {
-                bytes_carry = bytes->len - bytes_offset - bytes_left;
+            opts->queue_depth = depth;
+        } else if (!strcmp(opt, "--threads")) {
+            char *end = val;
+            long threads = strtol(val, &end, 10);
+            if (end == val || *end || threads < 1 || threads > FPP_MAX_THREADS) {
+                fprintf(stderr, "Invalid number of threads '%s' (valid are: 1 - %u).\n", val, FPP_MAX_THREADS);
+                fflush(stderr);
+                return -1;
+            }
+            opts->threads = threads;
+        } else if (!strcmp(opt, "--compress")) {
+            if (!strcmp(val, "fast")) {
+                opts->compress = FPP_COMPRESS_FAST;
+            } else if (!strcmp(val, "high")) {
+                opts->compress = FPP_COMPRESS_HIGH;
             } else {
-                bytes_carry = 0;
+                fprintf(stderr, "Unknown compression '%s' (valid are: fast | high).\n", val);
+                fflush(stderr);
+                return -1;
             }
-
-            //  when the current byte-string is shorter than the remaining filesize, only write as much as needed
-            uint64_t write_n = bytes_left;
-            if (bytes->len - bytes_offset < bytes_left) {
-                write_n = bytes->len - bytes_offset;
+        } else if (!strcmp(opt, "--chunk-size")) {
+            //  the average chunk size has to be a power of two, it can be given in KiB or MiB
+            char *end = val;
+            uint64_t size = strtoull(val, &end, 10);
+            if (*end == 'k' || *end == 'K') {
+                size *= 1024;
+                end++;
+            } else if (*end == 'm' || *end == 'M') {
+                size *= 1024 * 1024;
+                end++;
             }
-
-            //  check if new output file needs to be created
-            if (bytes_left == max_fsize) {
-                //  setting up the filename of the new data file
-                memset(f_name, 0, f_name_len + 31);
-                strncpy(f_name, argv[3], f_name_len);
-                snprintf(f_name + f_name_len, f_name_len + 31, "_data%u", f_idx);
-
-                //  close the currently open file
-                if (f_output) {
-                    fclose(f_output);
-                }
-
-                //  open the new file
-                f_output = fopen(f_name, "wb+");
-                if (!f_output) {
-                    fprintf(stderr, "Could not open file '%s'.\n", f_name);
-                    fflush(stderr);
-                    free(f_name);
-                    free(bytes->data);
-                    free(bytes);
-                    return 1;
-                }
-                f_idx++;
+            if (end == val || *val == '-' || *end || size < FPP_MIN_CHUNK_SIZE || size > FPP_MAX_CHUNK_SIZE || (size & (size - 1))) {
+                fprintf(stderr, "Invalid chunk size '%s' (valid are: powers of two from 4K to 4M).\n", val);
+                fflush(stderr);
+                return -1;
             }
-
-            //  the output file must be open at this point
-            if (!f_output) {
-                fprintf(stderr, "Error, output file is not open.");
+            opts->chunk_avg = size;
+        } else if (!strcmp(opt, "--stats")) {
+            if (strcmp(val, "json")) {
+                fprintf(stderr, "Unknown statistics format '%s' (valid are: json).\n", val);
                 fflush(stderr);
-                free(bytes->data);
-                free(bytes);
-                free(f_name);
-                return 1;
+                return -1;
             }
-
-            //  write the actual output data until everything is written, or until max file size is reached
-            uint64_t written;
-            fprintf(stdout, "Writing %llu MiB to file '%s'.\n", write_n / (1024 * 1024), f_name);
-            fflush(stdout);
-            written = fwrite64(bytes->data + bytes_offset, write_n, f_output);
-            if (written < write_n) {
-                fprintf(stderr, "Could not write to file '%s'.\n", f_name);
+            opts->stats = 1;
+        } else if (!strcmp(opt, "--trace")) {
+            opts->trace = val;
+        } else if (!strcmp(opt, "--stdin-name")) {
+            if (!*val || strlen(val) > FPP_MAX_NAME_LEN) {
+                fprintf(stderr, "Invalid name for the standard input '%s'.\n", val);
                 fflush(stderr);
-                free(bytes->data);
-                free(bytes);
-                free(f_name);
-                return 1;
+                return -1;
             }
-
-            //  adjust how many bytes were written
-            //  also don't increase file idx if the current file was not completely written
-            written_total += written;
-            bytes_offset += written;
-            if (bytes_carry) {
-                i--;
+            opts->stdin_name = val;
+        } else if (!strcmp(opt, "--sink-exec")) {
+            if (!*val) {
+                fprintf(stderr, "Invalid sink command '%s'.\n", val);
+                fflush(stderr);
+                return -1;
             }
-        }
-
-        //  free all remaining recourses
-        if (bytes) {
-            free(bytes->data);
-            free(bytes);
-        }
-        if (f_output) {
-            fclose(f_output);
-        }
-        free(f_name);
-
-        //  open main output file, containing the information about the other files
-        //  this includes file count and total size written to them
-        f_output = fopen(argv[3], "wb+");
-        if (!f_output) {
-            fprintf(stderr, "Could not open file '%s'.\n", argv[3]);
-            fflush(stderr);
-            return 1;
-        }
-        char *f_count = to_bytes(f_idx, LEN_SIZE);
-        uint32_t written = fwrite64(f_count, LEN_SIZE, f_output);
-        if (written < LEN_SIZE) {
-            fprintf(stderr, "Could not write to file '%s'.\n", argv[3]);
-            fflush(stderr);
-            free(f_count);
-            return 1;
-        }
-        free(f_count);
-        char *bytes_written = to_bytes(written_total, LEN_SIZE);
-        written = fwrite64(bytes_written, LEN_SIZE, f_output);
-        if (written < LEN_SIZE) {
-            fprintf(stderr, "Could not write to file '%s'.\n", argv[3]);
-            fflush(stderr);
-            free(bytes_written);
-            return 1;
-        }
-        free(bytes_written);
-        fclose(f_output);
-
-        fprintf(stdout, "Successfully wrote %llu bytes to %u files.\n", written_total, f_idx);
-        fflush(stdout);
-
-        return 0;
-    } else if (!strcmp(argv[1], "decode")) {
-        if (argc != 3) {
-            fprintf(stderr, "Wrong number of arguments for mode 'decode'. Expected 2.\n");
-            fflush(stderr);
-            print_help(argv[0]);
-            return 1;
-        }
-
-        //  extract the files from the input file and return the error code
-        int err = process_input_file(argv[2]);
-        if (!err) {
-            fprintf(stdout, "Successfully extracted all files.\n");
-            fflush(stdout);
-        }
-        return err;
-    }
-
-    print_help(argv[0]);
-    return 1;
-}
-
-//  read the complete content of a specific file as a byte-string
-struct byte_string *read_bytes(char *filepath) {
-    uint64_t len = f_size(filepath);
-
-    //  allocate the struct for storing the bytes
-    struct byte_string *bytes = malloc(sizeof (struct byte_string));
-    if (!bytes) {
-        return NULL;
-    }
-    bytes->len = len;
-
-    //  open the specified file
-    FILE *file = fopen(filepath, "rb");
-    if (!file) {
-        free(bytes->data);
-        free(bytes);
-        return NULL;
-    }
-
-    //  allocate the byte-string
-    char *f_data = malloc(len);
-    if (!f_data) {
-        free(bytes);
-        fclose(file);
-        return NULL;
-    }
-    bytes->data = f_data;
-
-    //  read the file
-    char buf[1024];
-    uint64_t bytes_read;
-    uint64_t offset = 0;
-    while ((bytes_read = fread(buf, 1, 1023, file))) {
-        bytes_cpy(buf, f_data + offset, bytes_read);
-        offset += bytes_read;
-    }
-
-    //  finally close the file
-    fclose(file);
-    return bytes;
-}
-
-//  calculate the size in bytes of a specific file
-uint64_t f_size(char *filepath) {
-    struct stat f_info;
-    stat(filepath, &f_info);
-    return f_info.st_size;
-}
-
-//  encode unsigned long to byte-string of a specific length
-char *to_bytes(uint64_t value, uint64_t length) {
-    //  allocate byte-string
-    char *bytes = malloc(length);
-    if (!bytes) {
-        return NULL;
-    }
-
-    //  convert value byte-wise
-    for (uint64_t i = 0; i < length; i++) {
-        *(bytes + i) = (char) (value % 256);
-        value/= 256;
-    }
-    return bytes;
-}
-
-//  decode byte-string to unsigned long
-uint64_t from_bytes(uint64_t start, uint64_t length, const char *bytes) {
-    if (!bytes) {
-        return 0;
-    }
-
-    //  convert the byte-string byte-wise
-    uint64_t res = 0;
-    uint64_t multiplier = 1;
-    for (uint64_t i = start; i < start + length; i++) {
-        int val = (int) *(bytes + i);
-        if (val < 0) {
-            val += 256;
-        }
-        res += val * multiplier;
-        multiplier *= 256;
-    }
-    return res;
-}
-
-//  return the starting index of the filename included in the specified path
-uint64_t extract_filename(const char *filepath, uint64_t len) {
-    for (uint64_t i = len; i > 0; i--) {
-        if (*(filepath + i - 1) == '/' || *(filepath + i - 1) == '\\') {
-            return i;
-        }
-    }
-    return 0;
-}
-
-//  copy all bytes from src to dest with the specified length
-void bytes_cpy(const char *src, char *dest, uint64_t len) {
-    for (uint64_t i = 0; i < len; i++) {
-        *(dest + i) = *(src + i);
-    }
-}
-
-uint64_t fwrite64(const void *str, uint64_t len_bytes, FILE *file) {
-    if (!str || !file) {
-        return 0;
-    }
-
-    //  write the file in chunks of 128 MiB each
-    const uint64_t CHUNK_SIZE = 128 * 1024 * 1024;
-    uint64_t written_complete = 0;
-    uint64_t to_write = 0;
-    uint64_t offset = 0;
-    while (offset < len_bytes) {
-        if (len_bytes - offset < CHUNK_SIZE) {
-            to_write = len_bytes - offset;
+            opts->sink_exec = val;
+        } else if (!strcmp(opt, "--sink-socket")) {
+            if (!*val || strlen(val) >= sizeof (((struct sockaddr_un *) NULL)->sun_path)) {
+                fprintf(stderr, "Invalid sink socket '%s'.\n", val);
+                fflush(stderr);
+                return -1;
+            }
+            opts->sink_socket = val;
+        } else if (!strcmp(opt, "--sink-jobs")) {
+            char *end = val;
+            long jobs = strtol(val, &end, 10);
+            if (end == val || *end || jobs < 1 || jobs > FPP_MAX_THREADS) {
+                fprintf(stderr, "Invalid number of sink jobs '%s' (valid are: 1 - %u).\n", val, FPP_MAX_THREADS);
+                fflush(stderr);
+                return -1;
+            }
+            opts->sink_jobs = jobs;
+        } else if (!strcmp(opt, "--only")) {
+            //  the patterns point into argv, only the array of them is allocated
+            char **only = realloc(opts->only, (opts->n_only + 1) * sizeof (char *));
+            if (!only) {
+                fprintf(stderr, "Memory allocation error.\n");
+                fflush(stderr);
+                return -1;
+            }
+            opts->only = only;
+            opts->only[opts->n_only++] = val;
         } else {
-            to_write = CHUNK_SIZE;
-        }
-
-        uint64_t bytes_written = fwrite(str + offset, 1, to_write, file);
-        written_complete += bytes_written;
-        if (bytes_written != to_write) {
-            return written_complete;
+            fprintf(stderr, "Unknown option '%s'.\n", opt);
+            fflush(stderr);
+            return -1;
         }
-
-        offset += to_write;
+        idx += 2;
     }
-
-    return written_complete;
+    return idx;
 }
 
-//  encode the file containing filename and content
-struct byte_string *encode_file(char *filepath) {
-    //  read all bytes of the specified file
-    fprintf(stdout, "Encoding file '%s'...\n", filepath + extract_filename(filepath, strlen(filepath)));
-    fflush(stdout);
-    struct byte_string *bytes_f = read_bytes(filepath);
-    if (!bytes_f) {
-        fprintf(stderr, "Could not read file '%s'.\n", filepath);
+//  parse the max. output filesize with its unit (K, M or G), 0 is unlimited
+//  returns 0 and the size in max_fsize or -1 on errors
+static int parse_size(const char *arg, uint64_t *size) {
+    char *ptr = NULL;
+    if (*arg == '-') {
+        fprintf(stderr, "Error parsing the given max. output size: '%s'\n", arg);
         fflush(stderr);
-        return NULL;
+        return -1;
     }
-
-    //  encode the length of the file-content
-    char *bytes_len_f = to_bytes(bytes_f->len, LEN_SIZE);
-    if (!bytes_len_f) {
-        fprintf(stderr, "Error processing data.\n");
+    uint64_t max_fsize = strtol(arg, &ptr, 10);
+    if (ptr == arg) {
+        fprintf(stderr, "Error parsing the given max. output size: '%s'\n", arg);
         fflush(stderr);
-        free(bytes_f->data);
-        free(bytes_f);
-        return NULL;
+        return -1;
     }
-
-    //  calculate and encode the length of the filename
-    uint64_t path_len = strlen(filepath);
-    uint64_t filename_offset = extract_filename(filepath, path_len);
-    uint64_t name_len = path_len - filename_offset;
-    char *bytes_len_name = to_bytes(name_len, LEN_SIZE);
-    if (!bytes_len_name) {
-        fprintf(stderr, "Error processing data.\n");
-        fflush(stderr);
-        free(bytes_f->data);
-        free(bytes_f);
-        free(bytes_len_f);
-        return NULL;
-    }
-
-    //  allocate byte-string for storing the result
-    struct byte_string *bytes = malloc(sizeof (struct byte_string));
-    if (!bytes) {
-        fprintf(stderr, "Memory allocation error.\n");
-        fflush(stderr);
-        free(bytes_f->data);
-        free(bytes_f);
-        free(bytes_len_f);
-        return NULL;
-    }
-
-    //  allocate memory for storing the data
-    uint64_t buf_size = LEN_SIZE * 2 + bytes_f->len + name_len;
-    char *buf = malloc(buf_size);
-    if (!buf) {
-        fprintf(stderr, "Memory allocation error.\n");
-        fflush(stderr);
-        free(bytes);
-        free(bytes_f->data);
-        free(bytes_f);
-        free(bytes_len_f);
-        free(bytes_len_name);
-        return NULL;
-    }
-    bytes->data = buf;
-    bytes->len = buf_size;
-
-    fprintf(stdout, "Extracting %llu MiB of data from file '%s'.\n", bytes->len / (1024 * 1024), filepath);
-    fflush(stdout);
-    //  encode the filename and file-content and corresponding lengths
-    uint64_t idx = 0;
-    //  length of filename
-    bytes_cpy(bytes_len_name, buf + idx, LEN_SIZE);
-    idx += LEN_SIZE;
-    //  filename
-    bytes_cpy(filepath + filename_offset, buf + idx, name_len);
-    idx += name_len;
-    //  length of file content
-    bytes_cpy(bytes_len_f, buf + idx, LEN_SIZE);
-    idx += LEN_SIZE;
-    //  file content
-    bytes_cpy(bytes_f->data, buf + idx, bytes_f->len);
-
-    //  clean-up
-    free(bytes_f->data);
-    free(bytes_f);
-    free(bytes_len_f);
-    free(bytes_len_name);
-    return bytes;
-}
-
-//  extract all files that are encoded in the given byte-string
-int extract_files(struct byte_string *bytes_f) {
-    //  setup log file
-    FILE *log = fopen("parser.log", "wb+");
-    if (!log) {
-        fprintf(stderr, "Could not open file 'parser.log'.\n");
-        fflush(stderr);
-        return 1;
-    }
-    char *separator = malloc(1);
-    if (!separator) {
-        fprintf(stderr, "Memory allocation error.\n");
-        fflush(stderr);
-        return 1;
-    }
-    *separator = '\n';
-
-    //  iterate through the byte-string and extract the encoded file data
-    uint64_t pos = 0;
-    while (pos < bytes_f->len) {
-        //  decode length of filename
-        uint64_t name_len = from_bytes(pos, LEN_SIZE, bytes_f->data);
-        //  allocate memory for storing the filename
-        char *f_name = malloc(name_len + 1);
-        if (!f_name) {
-            fprintf(stderr, "Memory allocation error.\n");
-            fflush(stderr);
-            free(bytes_f->data);
-            free(bytes_f);
-            fclose(log);
-            free(separator);
-            return 1;
-        }
-        //  copy the filename into the buffer
-        *(f_name + name_len) = 0;
-        pos += LEN_SIZE;
-        bytes_cpy(bytes_f->data + pos, f_name, name_len);
-        pos += name_len;
-
-        //  create corresponding output file
-        fprintf(stdout, "Writing file '%s'\n", f_name + extract_filename(f_name, name_len));
-        fflush(stdout);
-        FILE *out = fopen(f_name, "wb+");
-        if (!out) {
-            fprintf(stderr, "Could not create file '%s'.\n", f_name);
-            fflush(stderr);
-            free(bytes_f->data);
-            free(bytes_f);
-            free(f_name);
-            fclose(log);
-            free(separator);
-            return 1;
-        }
-
-        //  decode length of the file-content
-        uint64_t f_len = from_bytes(pos, LEN_SIZE, bytes_f->data);
-        pos += LEN_SIZE;
-        //  write file content to output file
-        uint64_t written = fwrite64(bytes_f->data + pos, f_len, out);
-        if (written < f_len) {
-            fprintf(stderr, "Could not write file '%s'.\n", f_name);
-            fflush(stderr);
-            free(bytes_f->data);
-            free(bytes_f);
-            fclose(out);
-            free(f_name);
-            fclose(log);
-            free(separator);
-            return 1;
-        }
-
-        //  write parser log
-        uint64_t written_log = fwrite64(f_name, name_len, log);
-        uint64_t written_log_separator = fwrite64(separator, 1, log);
-        if (written_log < name_len || written_log_separator < 1) {
-            fprintf(stderr, "Could not write file 'parser.log'.\n");
-            fflush(stderr);
-            free(bytes_f->data);
-            free(bytes_f);
-            fclose(out);
-            free(f_name);
-            fclose(log);
-            free(separator);
-            return 1;
+    if (max_fsize) {
+        switch (*ptr) {
+            case 'k':
+            case 'K':
+                if (max_fsize *  1024 < max_fsize) {
+                    fprintf(stderr, "Error parsing the given max. output size: '%s' (overflow)\n", arg);
+                    fflush(stderr);
+                    return -1;
+                }
+                max_fsize *= 1024;
+                break;
+            case 'm':
+            case 'M':
+                if (max_fsize *  1024 * 1024 < max_fsize) {
+                    fprintf(stderr, "Error parsing the given max. output size: '%s' (overflow)\n", arg);
+                    fflush(stderr);
+                    return -1;
+                }
+                max_fsize *= 1024 * 1024;
+                break;
+            case 'g':
+            case 'G':
+                if (max_fsize *  1024 * 1024 * 1024 < max_fsize) {
+                    fprintf(stderr, "Error parsing the given max. output size: '%s' (overflow)\n", arg);
+                    fflush(stderr);
+                    return -1;
+                }
+                max_fsize *= 1024 * 1024 * 1024;
+                break;
+            default:
+                fprintf(stderr, "Missing unit for the given max. output size: '%s' (valid are: K | M | G)\n", arg);
+                fflush(stderr);
+                return -1;
         }
-
-        pos += f_len;
-        free(f_name);
-        fclose(out);
     }
-
-    //  clean-up
-    free(bytes_f->data);
-    free(bytes_f);
-    fclose(log);
-    free(separator);
+    *size = max_fsize;
     return 0;
 }
 
-//  process the given input file
-int process_input_file(char *filepath) {
-    //  read data from the given file
-    struct byte_string *bytes_f = read_bytes(filepath);
-    if (!bytes_f) {
-        fprintf(stderr, "Could not read file '%s'.\n", filepath);
-        fflush(stderr);
+int main(int argc, char **argv) {
+    //  check if number of passed arguments is correct
+    if (argc < 2) {
+        print_help(argv[0]);
         return 1;
     }
 
-    //  read the information about the data that needs to be reads from the files
-    uint64_t f_count = from_bytes(0, LEN_SIZE, bytes_f->data);
-    uint64_t size_total = from_bytes(LEN_SIZE, LEN_SIZE, bytes_f->data);
-    free(bytes_f->data);
-    free(bytes_f);
-
-    //  store all file names of the data files in an array, so they can be accessed easily
-    uint32_t f_name_len = strlen(filepath) + 32;
-    char *f_names = calloc(f_count, f_name_len);
-    if (!f_names) {
-        fprintf(stderr, "Could not allocate memory.\n");
-        fflush(stderr);
+    //  the options are placed between the mode and the positional arguments
+    struct fpp_options opts;
+    fpp_options_init(&opts);
+    int idx = parse_options(argc, argv, 2, &opts);
+    if (idx < 0) {
+        free(opts.only);
+        print_help(argv[0]);
         return 1;
     }
-    for (uint32_t i = 0; i < f_count; i++) {
-        snprintf(f_names + (i * f_name_len), f_name_len, "%s_data%u", filepath, i);
-    }
+    char **args = argv + idx;
+    int n_args = argc - idx;
 
-    //  check if all needed data-files exist and are accessible
-    for (uint32_t i = 0; i < f_count; i++) {
-        if (access(f_names + (i * f_name_len), R_OK) == -1) {
-            fprintf(stderr, "Error, can not access file '%s'.\n", f_names + (i * f_name_len));
+    //  can be executed in five different modes (encode, decode, list, verify, manifest), which are run by the library
+    int err = 1;
+    if (!strcmp(argv[1], "encode")) {
+        uint64_t max_fsize = 0;
+        if (n_args < 3) {
+            fprintf(stderr, "Wrong number of arguments for mode 'encode'. Expected at least 4.\n");
             fflush(stderr);
-            free(f_names);
-            return 1;
+            print_help(argv[0]);
+        } else if (!parse_size(args[0], &max_fsize)) {
+            err = fpp_encode(args[1], args + 2, n_args - 2, max_fsize, &opts);
         }
-    }
-
-    //  allocate enough memory to read in all data-files
-    struct byte_string *bytes_complete = malloc(sizeof (struct byte_string));
-    if (!bytes_complete) {
-        fprintf(stderr, "Could not allocate memory.\n");
-        fflush(stderr);
-        free(f_names);
-        return 1;
-    }
-    //  the actual bytes are stored here
-    char *data = malloc(size_total);
-    if (!data) {
-        fprintf(stderr, "Could not allocate memory.\n");
+    } else if (strcmp(argv[1], "decode") && strcmp(argv[1], "list") && strcmp(argv[1], "verify")
+               && strcmp(argv[1], "manifest")) {
+        print_help(argv[0]);
+    } else if (n_args != 1) {
+        fprintf(stderr, "Wrong number of arguments for mode '%s'. Expected 2.\n", argv[1]);
         fflush(stderr);
-        free(f_names);
-        free(bytes_complete);
-        return 1;
-    }
-    bytes_complete->data = data;
-    bytes_complete->len = size_total;
-
-    //  read all data from all data files
-    uint64_t cpy_offset = 0;
-    for (uint32_t i = 0; i < f_count; i++) {
-        fprintf(stdout, "Reading file '%s'\n", f_names + (i * f_name_len + extract_filename( f_names + (i * f_name_len), f_name_len)));
-        fflush(stdout);
-        struct byte_string *bytes = read_bytes(f_names + (i * f_name_len));
-        if (!bytes) {
-            fprintf(stderr, "Error, could not read file '%s'.\n", f_names + (i * f_name_len));
-            fflush(stderr);
-            free(f_names);
-            free(bytes_complete);
-            free(data);
-            return 1;
-        }
-
-        //  prevent buffer-overflow on corrupt input file
-        if (cpy_offset + bytes->len > size_total) {
-            fprintf(stderr, "Error, aborting to prevent buffer-overflow. Input file might be corrupted.\n");
-            fflush(stderr);
-            free(f_names);
-            free(bytes->data);
-            free(bytes);
-            free(bytes_complete);
-            free(data);
-            return 1;
-        }
-        //  the data of all data-files will be stored as one large byte-string
-        bytes_cpy(bytes->data, bytes_complete->data + cpy_offset, bytes->len);
-        cpy_offset += bytes->len;
-
-        free(bytes->data);
-        free(bytes);
+        print_help(argv[0]);
+    } else if (!strcmp(argv[1], "decode")) {
+        //  extract the files from the input file
+        err = fpp_decode(args[0], &opts);
+    } else if (!strcmp(argv[1], "list")) {
+        //  print name and size of the files in the input file
+        err = fpp_list(args[0], &opts);
+    } else if (!strcmp(argv[1], "verify")) {
+        //  check the data-files of the input file
+        err = fpp_verify(args[0], &opts);
+    } else {
+        //  print the content hashes stored in the main file
+        err = fpp_manifest(args[0], &opts);
     }
-    free(f_names);
-
-    //  extract the files from the given bytes
-    return extract_files(bytes_complete);
+    free(opts.only);
+    return err;
 }